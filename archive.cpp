@@ -0,0 +1,237 @@
+#include "archive.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <limits>
+#include <sys/stat.h>
+
+namespace {
+
+const char kSegmentPrefix[] = "segment-";
+const char kSegmentSuffix[] = ".snap";
+const char kColumnSuffix[] = ".cols";
+
+// Parse "segment-NNNNNN.snap"; returns the number or -1
+int segmentNumber(const std::string& name) {
+    const size_t prefix = sizeof(kSegmentPrefix) - 1;
+    const size_t suffix = sizeof(kSegmentSuffix) - 1;
+    if (name.size() <= prefix + suffix || name.compare(0, prefix, kSegmentPrefix) != 0 ||
+        name.compare(name.size() - suffix, suffix, kSegmentSuffix) != 0) {
+        return -1;
+    }
+    int number = 0;
+    for (size_t i = prefix; i < name.size() - suffix; i++) {
+        if (name[i] < '0' || name[i] > '9' || number > 99999999) {
+            return -1;
+        }
+        number = number * 10 + (name[i] - '0');
+    }
+    return number;
+}
+
+std::string segmentPath(const std::string& dir, int number, const char* suffix = kSegmentSuffix) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%s%06d%s", kSegmentPrefix, number, suffix);
+    return dir + "/" + name;
+}
+
+}  // namespace
+
+EventArchive::EventArchive()
+    : next_segment_(1), archived_until_(std::numeric_limits<time_t>::min()) {
+}
+
+bool EventArchive::open(const std::string& dir) {
+    if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        return false;
+    }
+    DIR* d = ::opendir(dir.c_str());
+    if (!d) {
+        return false;
+    }
+    std::vector<int> numbers;
+    while (struct dirent* entry = ::readdir(d)) {
+        int number = segmentNumber(entry->d_name);
+        if (number >= 0) {
+            numbers.push_back(number);
+        }
+    }
+    ::closedir(d);
+    std::sort(numbers.begin(), numbers.end());
+
+    dir_ = dir;
+    segments_.clear();
+    columns_.clear();
+    next_segment_ = 1;
+    archived_until_ = std::numeric_limits<time_t>::min();
+    for (int number : numbers) {
+        // Only the header is checked: verifying years of history would
+        // read every page at startup, which is what the archive avoids
+        std::unique_ptr<SnapshotFile> segment(new SnapshotFile());
+        if (!segment->open(segmentPath(dir, number), false)) {
+            return false;
+        }
+        if (segment->size() > 0) {
+            // Events don't overlap, so the last one ends last
+            archived_until_ = std::max(archived_until_, segment->event(segment->size() - 1).end_utc);
+        }
+        std::unique_ptr<ColumnSegment> columns =
+            openColumns(segmentPath(dir, number, kColumnSuffix), *segment);
+        if (!columns) {
+            return false;
+        }
+        segments_.push_back(std::move(segment));
+        columns_.push_back(std::move(columns));
+        next_segment_ = number + 1;
+    }
+    return true;
+}
+
+bool EventArchive::addSegment(const std::vector<Event>& events) {
+    if (events.empty()) {
+        return true;
+    }
+    std::string path = segmentPath(dir_, next_segment_);
+    std::string column_path = segmentPath(dir_, next_segment_, kColumnSuffix);
+    std::unique_ptr<SnapshotFile> segment(new SnapshotFile());
+    std::unique_ptr<ColumnSegment> columns(new ColumnSegment());
+    if (!SnapshotFile::write(path, events, 0) || !segment->open(path, false) ||
+        !ColumnSegment::write(column_path, events) || !columns->open(column_path)) {
+        return false;
+    }
+    next_segment_++;
+    archived_until_ = std::max(archived_until_, events.back().end_utc);
+    segments_.push_back(std::move(segment));
+    columns_.push_back(std::move(columns));
+    return true;
+}
+
+std::unique_ptr<ColumnSegment> EventArchive::openColumns(const std::string& path,
+                                                         const SnapshotFile& segment) {
+    std::unique_ptr<ColumnSegment> columns(new ColumnSegment());
+    if (columns->open(path) && columns->size() == segment.size()) {
+        return columns;
+    }
+
+    std::vector<Event> events;
+    events.reserve(segment.size());
+    for (size_t i = 0; i < segment.size(); i++) {
+        SnapshotEventView view = segment.event(i);
+        events.emplace_back(view.id, "", view.start_utc, view.end_utc);  // No titles in columns
+    }
+    if (!ColumnSegment::write(path, events) || !columns->open(path)) {
+        return nullptr;
+    }
+    return columns;
+}
+
+size_t EventArchive::firstOverlapping(const SnapshotFile& segment, time_t start_utc) {
+    const SnapshotRecord* begin = segment.records();
+    const SnapshotRecord* end = begin + segment.size();
+    const SnapshotRecord* it = std::lower_bound(
+        begin, end, static_cast<int64_t>(start_utc),
+        [](const SnapshotRecord& r, int64_t t) { return r.start_utc < t; });
+    if (it != begin && (it - 1)->end_utc > start_utc) {
+        --it;
+    }
+    return static_cast<size_t>(it - begin);
+}
+
+void EventArchive::query(time_t start_utc, time_t end_utc,
+                         std::vector<SnapshotEventView>& out) const {
+    if (start_utc >= archived_until_) {
+        return;  // The common case: a range after all archived history
+    }
+    size_t first = out.size();
+    for (const auto& segment : segments_) {
+        for (size_t i = firstOverlapping(*segment, start_utc);
+             i < segment->size() && segment->records()[i].start_utc < end_utc; i++) {
+            out.push_back(segment->event(i));
+        }
+    }
+    if (segments_.size() > 1) {
+        // Neighbouring segments can interleave at their edges
+        std::sort(out.begin() + first, out.end(),
+                  [](const SnapshotEventView& a, const SnapshotEventView& b) {
+                      return a.start_utc != b.start_utc ? a.start_utc < b.start_utc : a.id < b.id;
+                  });
+    }
+}
+
+void EventArchive::page(time_t from_utc, size_t limit, std::vector<SnapshotEventView>& out) const {
+    if (from_utc >= archived_until_) {
+        return;
+    }
+    size_t first = out.size();
+    for (const auto& segment : segments_) {
+        const SnapshotRecord* begin = segment->records();
+        const SnapshotRecord* end = begin + segment->size();
+        size_t i = std::lower_bound(begin, end, static_cast<int64_t>(from_utc),
+                                    [](const SnapshotRecord& r, int64_t t) { return r.start_utc < t; }) -
+                   begin;
+        for (size_t taken = 0; i < segment->size() && taken < limit; i++, taken++) {
+            out.push_back(segment->event(i));
+        }
+    }
+    if (segments_.size() > 1) {
+        std::sort(out.begin() + first, out.end(),
+                  [](const SnapshotEventView& a, const SnapshotEventView& b) {
+                      return a.start_utc != b.start_utc ? a.start_utc < b.start_utc : a.id < b.id;
+                  });
+        if (out.size() - first > limit) {
+            out.resize(first + limit);
+        }
+    }
+}
+
+bool EventArchive::overlaps(time_t start_utc, time_t end_utc) const {
+    if (start_utc >= archived_until_) {
+        return false;
+    }
+    for (const auto& segment : segments_) {
+        size_t i = firstOverlapping(*segment, start_utc);
+        if (i < segment->size() && segment->records()[i].start_utc < end_utc) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t EventArchive::size() const {
+    size_t total = 0;
+    for (const auto& segment : segments_) {
+        total += segment->size();
+    }
+    return total;
+}
+
+uint64_t EventArchive::count(time_t start_utc, time_t end_utc) const {
+    uint64_t total = 0;
+    if (start_utc < archived_until_) {
+        for (const auto& columns : columns_) {
+            total += columns->count(start_utc, end_utc);
+        }
+    }
+    return total;
+}
+
+int64_t EventArchive::sumDurations(time_t start_utc, time_t end_utc) const {
+    int64_t total = 0;
+    if (start_utc < archived_until_) {
+        for (const auto& columns : columns_) {
+            total += columns->sumDurations(start_utc, end_utc);
+        }
+    }
+    return total;
+}
+
+void EventArchive::addBusySecondsPerDay(const std::vector<time_t>& day_bounds,
+                                        std::vector<int64_t>& busy_seconds) const {
+    if (day_bounds.front() < archived_until_) {
+        for (const auto& columns : columns_) {
+            columns->addBusySecondsPerDay(day_bounds, busy_seconds);
+        }
+    }
+}
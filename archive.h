@@ -0,0 +1,110 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "columnar.h"
+#include "event.h"
+#include "snapshot.h"
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Read-only tier for historical events.
+ *
+ * Past events are moved out of the live std::set into immutable segment
+ * files (the snapshot format, one file per archiving run) that stay
+ * mmap'd. Queries binary-search the mapped records and return titles as
+ * string_views into the mapping, so nothing is copied onto the heap and
+ * only the pages a query touches become resident.
+ *
+ * Within a segment events are sorted and never overlap (the calendar
+ * rejects conflicts), so a range query only has to look one record back
+ * from the first event starting inside the range.
+ *
+ * Every segment also has a column file (segment-NNNNNN.cols, see
+ * ColumnSegment) for analytics scans that never need titles.
+ *
+ * Segments are never modified or unmapped while the archive is open:
+ * views returned by query() stay valid until the archive is destroyed.
+ * Not thread-safe on its own; CalendarService guards it with its mutex.
+ */
+class EventArchive {
+public:
+    EventArchive();
+
+    EventArchive(const EventArchive&) = delete;
+    EventArchive& operator=(const EventArchive&) = delete;
+
+    /**
+     * Map every segment in dir (creating the directory if needed).
+     *
+     * @return false on an I/O error or a corrupt segment header
+     */
+    bool open(const std::string& dir);
+
+    /**
+     * Write events (sorted by EventComparator) as a new segment and map it.
+     *
+     * @return false on an I/O error (no segment is added)
+     */
+    bool addSegment(const std::vector<Event>& events);
+
+    /**
+     * Latest end time of any archived event. Everything ending at or
+     * before it is history and read-only. Minimum time_t when empty.
+     */
+    time_t archivedUntil() const { return archived_until_; }
+
+    /**
+     * Archived events overlapping [start_utc, end_utc), sorted by
+     * (start_utc, id), appended to out.
+     */
+    void query(time_t start_utc, time_t end_utc, std::vector<SnapshotEventView>& out) const;
+
+    /**
+     * The first limit archived events starting at or after from_utc,
+     * sorted, appended to out. Reads at most limit records per segment.
+     */
+    void page(time_t from_utc, size_t limit, std::vector<SnapshotEventView>& out) const;
+
+    /**
+     * Does any archived event overlap [start_utc, end_utc)?
+     */
+    bool overlaps(time_t start_utc, time_t end_utc) const;
+
+    /**
+     * Total number of archived events.
+     */
+    size_t size() const;
+
+    /**
+     * Column scans over every segment; see ColumnSegment.
+     */
+    uint64_t count(time_t start_utc, time_t end_utc) const;
+    int64_t sumDurations(time_t start_utc, time_t end_utc) const;
+    void addBusySecondsPerDay(const std::vector<time_t>& day_bounds,
+                              std::vector<int64_t>& busy_seconds) const;
+
+private:
+    std::string dir_;
+    std::vector<std::unique_ptr<SnapshotFile>> segments_;
+    std::vector<std::unique_ptr<ColumnSegment>> columns_;  // Parallel to segments_
+    int next_segment_;
+    time_t archived_until_;
+
+    /**
+     * Index of the first record in segment with start_utc >= start_utc,
+     * stepped back one if the record before it still runs past start_utc.
+     */
+    static size_t firstOverlapping(const SnapshotFile& segment, time_t start_utc);
+
+    /**
+     * Map the column file for a segment, (re)building it from the segment
+     * if it is missing or damaged (e.g. a crash right after addSegment).
+     */
+    static std::unique_ptr<ColumnSegment> openColumns(const std::string& path,
+                                                      const SnapshotFile& segment);
+};
+
+#endif // ARCHIVE_H
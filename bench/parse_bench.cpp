@@ -0,0 +1,135 @@
+// Parse cost of the text front end, in nanoseconds per call.
+#include "command_processor.h"
+#include "timezone.h"
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Defeats dead-code elimination of the measured results
+volatile long long sink;
+
+template <typename Body>
+void measure(const char* name, size_t count, Body body) {
+    auto start = std::chrono::steady_clock::now();
+    long long sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += body(i);
+    }
+    auto end = std::chrono::steady_clock::now();
+    sink = sum;
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / count;
+    std::printf("  %-40s %8.1f ns\n", name, ns);
+}
+
+// The istringstream date parser that parseDate replaced
+int streamParseDate(const std::string& s) {
+    std::istringstream iss(s);
+    char dash1, dash2;
+    int year, month, day;
+    if (!(iss >> year >> dash1 >> month >> dash2 >> day)) {
+        return -1;
+    }
+    return year + month + day;
+}
+
+// The istringstream tokenizer that CommandProcessor::tokenize replaced
+std::vector<std::string> streamTokenize(const std::string& line) {
+    std::vector<std::string> tokens;
+    std::istringstream iss(line);
+    std::string token;
+    bool in_quotes = false;
+    std::string quoted_token;
+    while (iss >> token) {
+        if (token.front() == '"') {
+            in_quotes = true;
+            quoted_token = token.substr(1);
+            if (token.back() == '"' && token.length() > 1) {
+                quoted_token = quoted_token.substr(0, quoted_token.length() - 1);
+                tokens.push_back(quoted_token);
+                in_quotes = false;
+            }
+        } else if (in_quotes) {
+            quoted_token += " " + token;
+            if (token.back() == '"') {
+                quoted_token = quoted_token.substr(0, quoted_token.length() - 1);
+                tokens.push_back(quoted_token);
+                in_quotes = false;
+            }
+        } else {
+            tokens.push_back(token);
+        }
+    }
+    return tokens;
+}
+
+// Discards the replies
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+}  // namespace
+
+int main() {
+    const size_t kCount = 1000000;
+    const std::string dates[] = {"2025-03-10", "1999-12-31", "2024-02-29", "2031-07-04"};
+    const std::string times[] = {"09:00", "23:59", "00:30", "14:15"};
+
+    std::printf("date and time fields\n");
+    measure("parseDate (string_view)", kCount, [&](size_t i) {
+        LocalDate date;
+        TimezoneUtils::parseDate(std::string_view(dates[i % 4]), date);
+        return date.day;
+    });
+    measure("parseDate (istringstream, replaced)", kCount, [&](size_t i) {
+        return streamParseDate(dates[i % 4]);
+    });
+    measure("parseTime (string_view)", kCount, [&](size_t i) {
+        LocalTime time;
+        TimezoneUtils::parseTime(std::string_view(times[i % 4]), time);
+        return time.minute;
+    });
+
+    // Per command: the tokenizer alone, then execute() on an empty
+    // calendar, where parsing the fields is most of the work (the create
+    // conflicts with the event made before the loop, the delete finds
+    // nothing)
+    const std::string create = "create \"Weekly team sync\" 2025-03-10 09:00 10:00 America/New_York";
+    const char* lines[][2] = {
+        {"create", create.c_str()},
+        {"list week", "list week 2025-03-10 America/New_York"},
+        {"delete", "delete 12345"},
+        {"free", "free 2025-03-10 30 America/New_York"},
+        {"stats", "stats 2025-03-01 2025-03-31 America/New_York"},
+    };
+    CalendarService calendar;
+    CommandProcessor processor(calendar);
+    NullBuffer null_buffer;
+    std::ostream null_out(&null_buffer);
+    processor.execute(create, null_out);
+
+    std::printf("command lines\n");
+    measure("create: istringstream tokenizer, replaced", kCount, [&](size_t) {
+        return static_cast<long long>(streamTokenize(create).size());
+    });
+    CommandProcessor::Tokens tokens;
+    for (const auto& line : lines) {
+        std::string name = std::string(line[0]) + ": tokenize";
+        measure(name.c_str(), kCount, [&](size_t) {
+            CommandProcessor::tokenize(line[1], tokens);
+            return static_cast<long long>(tokens.size());
+        });
+    }
+    for (const auto& line : lines) {
+        std::string name = std::string(line[0]) + ": execute";
+        measure(name.c_str(), kCount / 10, [&](size_t) {
+            return static_cast<long long>(processor.execute(line[1], null_out));
+        });
+    }
+    return 0;
+}
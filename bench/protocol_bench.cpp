@@ -0,0 +1,82 @@
+// Text against binary protocol on loopback: operations per second through
+// an in-process CalendarServer, driven by the calendar-loadgen client.
+#include "calendar_service.h"
+#include "loadgen.h"
+#include "server.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+namespace {
+
+const int kSeconds = 2;
+const int kOpsInFlight = 64;  // Pipelined lines, or ops per binary frame
+
+double opsPerSecond(int port, bool binary, LoadOp op) {
+    LoadOptions options;
+    options.port = port;
+    options.connections = 4;
+    options.duration_seconds = kSeconds;
+    options.binary = binary;
+    options.pipeline = binary ? 1 : kOpsInFlight;
+    options.batch = binary ? kOpsInFlight : 1;
+    for (int& weight : options.weights) {
+        weight = 0;
+    }
+    options.weights[op] = 1;
+    options.conflict_rate = 0;
+
+    LoadReport report;
+    std::string error;
+    if (!runLoad(options, report, error)) {
+        std::fprintf(stderr, "protocol_bench: %s\n", error.c_str());
+        std::exit(1);
+    }
+    return report.seconds > 0 ? report.ops[op] / report.seconds : 0;
+}
+
+// Creates, then week queries against what they made, on a fresh calendar
+void run(const char* storage, const std::string& data_dir, bool binary) {
+    CalendarService calendar;
+    if (!data_dir.empty() && !calendar.openPersistence(data_dir, WalOptions())) {
+        std::fprintf(stderr, "protocol_bench: cannot open %s\n", data_dir.c_str());
+        std::exit(1);
+    }
+    ServerOptions options;
+    options.port = 0;
+    options.worker_threads = 4;
+    CalendarServer server(calendar, options);
+    if (!server.listen()) {
+        std::perror("protocol_bench: listen");
+        std::exit(1);
+    }
+    std::thread loop([&server] { server.run(); });
+
+    double creates = opsPerSecond(server.port(), binary, kLoadCreate);
+    double queries = opsPerSecond(server.port(), binary, kLoadList);
+    std::printf("  %-10s %-7s %12.0f %12.0f\n", storage, binary ? "binary" : "text", creates, queries);
+
+    server.stop();
+    loop.join();
+}
+
+}  // namespace
+
+int main() {
+    std::printf("4 connections, %d ops in flight each, %d s per run\n", kOpsInFlight, kSeconds);
+    std::printf("  %-10s %-7s %12s %12s\n", "storage", "proto", "creates/s", "queries/s");
+    run("memory", "", false);
+    run("memory", "", true);
+
+    char dir[] = "/tmp/protocol_bench.XXXXXX";
+    if (::mkdtemp(dir) == nullptr) {
+        std::perror("protocol_bench: mkdtemp");
+        return 1;
+    }
+    std::string base = dir;
+    run("data-dir", base + "/text", false);
+    run("data-dir", base + "/binary", true);
+    std::string cleanup = "rm -rf " + base;
+    return std::system(cleanup.c_str()) == 0 ? 0 : 1;
+}
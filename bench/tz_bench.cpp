@@ -0,0 +1,88 @@
+// Conversion throughput of TimezoneUtils, in nanoseconds per call.
+#include "timezone.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Defeats dead-code elimination of the measured results
+volatile long long sink;
+
+template <typename Body>
+void measure(const char* name, size_t count, Body body) {
+    auto start = std::chrono::steady_clock::now();
+    long long sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += body(i);
+    }
+    auto end = std::chrono::steady_clock::now();
+    sink = sum;
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / count;
+    std::printf("  %-40s %8.1f ns\n", name, ns);
+}
+
+}  // namespace
+
+int main() {
+    const size_t kCount = 2000000;
+    // One instant per 25 minutes from 2000 to 2095
+    std::vector<time_t> instants(kCount);
+    for (size_t i = 0; i < kCount; i++) {
+        instants[i] = 946684800 + static_cast<time_t>(i) * 1500;
+    }
+
+    std::printf("civil date math\n");
+    measure("daysFromCivil", kCount, [](size_t i) {
+        return TimezoneUtils::daysFromCivil(1900 + int(i % 400), 1 + int(i % 12), 1 + int(i % 28));
+    });
+    measure("civilFromDays", kCount, [](size_t i) {
+        return TimezoneUtils::civilFromDays(static_cast<long long>(i) * 7 - 3000000).day;
+    });
+
+    const char* zones[] = {"UTC", "America/New_York"};
+    for (const char* name : zones) {
+        TzId tz = TimezoneUtils::resolveTimezone(name);
+        if (!tz.isValid()) {
+            std::printf("%s: not installed, skipped\n", name);
+            continue;
+        }
+        std::printf("%s\n", name);
+        measure("toLocal", kCount, [&](size_t i) {
+            LocalDateTime local;
+            TimezoneUtils::toLocal(instants[i], tz, local);
+            return local.time.minute;
+        });
+        measure("formatLocal", kCount, [&](size_t i) {
+            char out[TimezoneUtils::kLocalTimestampLength];
+            return static_cast<long long>(TimezoneUtils::formatLocal(instants[i], tz, out)) + out[15];
+        });
+        measure("utcToLocal (std::string)", kCount, [&](size_t i) {
+            return static_cast<long long>(TimezoneUtils::utcToLocal(instants[i], tz).size());
+        });
+        measure("toUTC", kCount, [&](size_t i) {
+            LocalDateTime local = {TimezoneUtils::civilFromDays(10957 + long(i % 20000)), {int(i % 24), 30}};
+            return static_cast<long long>(TimezoneUtils::toUTC(local, tz));
+        });
+    }
+
+    // The per-thread transition cache: sorted instants stay inside the
+    // cached interval, shuffled ones miss and binary-search the table
+    TzId new_york = TimezoneUtils::resolveTimezone("America/New_York");
+    if (new_york.isValid()) {
+        std::vector<time_t> shuffled = instants;
+        std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(20250310));
+        std::printf("America/New_York, transition cache\n");
+        measure("formatLocal, sorted instants", kCount, [&](size_t i) {
+            char out[TimezoneUtils::kLocalTimestampLength];
+            return static_cast<long long>(TimezoneUtils::formatLocal(instants[i], new_york, out)) + out[15];
+        });
+        measure("formatLocal, shuffled instants", kCount, [&](size_t i) {
+            char out[TimezoneUtils::kLocalTimestampLength];
+            return static_cast<long long>(TimezoneUtils::formatLocal(shuffled[i], new_york, out)) + out[15];
+        });
+    }
+    return 0;
+}
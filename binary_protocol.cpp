@@ -0,0 +1,333 @@
+#include "binary_protocol.h"
+#include "varint.h"
+#include <cstdint>
+#include <limits>
+
+namespace {
+
+struct Op {
+    BinaryProtocol::OpType type;
+    int event_id;
+    time_t start_utc;
+    time_t end_utc;
+    std::string title;
+};
+
+// Decoding cursor over a payload; every read fails cleanly at the end
+class Reader {
+public:
+    Reader(const char* data, size_t size)
+        : p_(reinterpret_cast<const uint8_t*>(data)), end_(p_ + size) {}
+
+    bool atEnd() const { return p_ == end_; }
+
+    bool byte(uint8_t& v) {
+        if (p_ == end_) {
+            return false;
+        }
+        v = *p_++;
+        return true;
+    }
+
+    bool varint(uint64_t& v) { return getVarint(p_, end_, v); }
+
+    bool eventId(int& id) {
+        uint64_t v;
+        if (!varint(v) || v > static_cast<uint64_t>(std::numeric_limits<int32_t>::max())) {
+            return false;
+        }
+        id = static_cast<int>(v);
+        return true;
+    }
+
+    // previous + zigzag delta, then + duration; rejects overflow
+    bool range(time_t& previous, time_t& start_utc, time_t& end_utc) {
+        uint64_t delta, duration;
+        int64_t start, end;
+        if (!varint(delta) || !varint(duration) || duration > uint64_t(std::numeric_limits<int64_t>::max()) ||
+            __builtin_add_overflow(int64_t(previous), unzigzag(delta), &start) ||
+            __builtin_add_overflow(start, int64_t(duration), &end)) {
+            return false;
+        }
+        previous = start_utc = static_cast<time_t>(start);
+        end_utc = static_cast<time_t>(end);
+        return true;
+    }
+
+    bool string(std::string& out) {
+        uint64_t length;
+        if (!varint(length) || length > static_cast<uint64_t>(end_ - p_)) {
+            return false;
+        }
+        out.assign(reinterpret_cast<const char*>(p_), static_cast<size_t>(length));
+        p_ += length;
+        return true;
+    }
+
+private:
+    const uint8_t* p_;
+    const uint8_t* end_;
+};
+
+// Titles reach text clients in list replies, where a control character
+// (a newline above all) would break the line framing
+bool isPrintableTitle(const std::string& title) {
+    for (char c : title) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (byte < 0x20 || byte == 0x7F) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void putRange(std::string& out, time_t& previous, time_t start_utc, time_t end_utc) {
+    putVarint(out, zigzag(int64_t(start_utc) - int64_t(previous)));
+    putVarint(out, static_cast<uint64_t>(int64_t(end_utc) - int64_t(start_utc)));
+    previous = start_utc;
+}
+
+void putString(std::string& out, const std::string& s) {
+    putVarint(out, s.size());
+    out.append(s);
+}
+
+bool parseRequest(const char* payload, size_t size, std::vector<Op>& ops) {
+    Reader in(payload, size);
+    uint64_t count;
+    // Every op takes at least two bytes, which bounds the reservation
+    if (!in.varint(count) || count > size) {
+        return false;
+    }
+    ops.resize(static_cast<size_t>(count));
+    time_t previous = 0;
+    for (Op& op : ops) {
+        uint8_t type;
+        if (!in.byte(type)) {
+            return false;
+        }
+        op.type = static_cast<BinaryProtocol::OpType>(type);
+        bool ok;
+        switch (type) {
+        case BinaryProtocol::kCreate:
+            ok = in.range(previous, op.start_utc, op.end_utc) && in.string(op.title);
+            break;
+        case BinaryProtocol::kDelete:
+            ok = in.eventId(op.event_id);
+            break;
+        case BinaryProtocol::kQuery:
+            ok = in.range(previous, op.start_utc, op.end_utc);
+            break;
+        default:
+            ok = false;  // Including kUse: the server front end handles it
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    return in.atEnd();
+}
+
+}  // namespace
+
+namespace BinaryProtocol {
+
+int findFrame(const char* data, size_t size, size_t max_payload_size, size_t& header_size,
+              size_t& payload_size) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    const uint8_t* end = p + size;
+    uint64_t length;
+    if (!getVarint(p, end, length)) {
+        // Truncated, unless ten bytes already failed to end the varint
+        return size >= 10 ? -1 : 0;
+    }
+    if (length > max_payload_size) {
+        return -1;
+    }
+    header_size = static_cast<size_t>(p - reinterpret_cast<const uint8_t*>(data));
+    payload_size = static_cast<size_t>(length);
+    return size - header_size >= payload_size ? 1 : 0;
+}
+
+void appendFrame(const std::string& payload, std::string& out) {
+    putVarint(out, payload.size());
+    out.append(payload);
+}
+
+bool parseUse(const char* payload, size_t size, std::string& calendar) {
+    Reader in(payload, size);
+    uint64_t count;
+    uint8_t type;
+    return in.varint(count) && count == 1 && in.byte(type) && type == kUse && in.string(calendar) && in.atEnd();
+}
+
+void appendUseResponse(Status status, std::string& out) {
+    std::string response;
+    response.push_back(static_cast<char>(kOk));
+    putVarint(response, 1);
+    response.push_back(static_cast<char>(kUse));
+    response.push_back(static_cast<char>(status));
+    appendFrame(response, out);
+}
+
+RequestBuilder::RequestBuilder() : op_count_(0), previous_start_(0) {
+}
+
+void RequestBuilder::addCreate(const std::string& title, time_t start_utc, time_t end_utc) {
+    ops_.push_back(static_cast<char>(kCreate));
+    putRange(ops_, previous_start_, start_utc, end_utc);
+    putString(ops_, title);
+    op_count_++;
+}
+
+void RequestBuilder::addDelete(int event_id) {
+    ops_.push_back(static_cast<char>(kDelete));
+    putVarint(ops_, static_cast<uint32_t>(event_id));
+    op_count_++;
+}
+
+void RequestBuilder::addQuery(time_t start_utc, time_t end_utc) {
+    ops_.push_back(static_cast<char>(kQuery));
+    putRange(ops_, previous_start_, start_utc, end_utc);
+    op_count_++;
+}
+
+void RequestBuilder::addUse(const std::string& calendar) {
+    ops_.push_back(static_cast<char>(kUse));
+    putString(ops_, calendar);
+    op_count_++;
+}
+
+std::string RequestBuilder::finish() {
+    std::string payload;
+    putVarint(payload, op_count_);
+    payload.append(ops_);
+
+    std::string frame;
+    appendFrame(payload, frame);
+    ops_.clear();
+    op_count_ = 0;
+    previous_start_ = 0;
+    return frame;
+}
+
+bool parseResponse(const char* payload, size_t size, std::vector<OpResult>& results) {
+    Reader in(payload, size);
+    uint8_t status;
+    uint64_t count;
+    if (!in.byte(status) || status != kOk || !in.varint(count) || count > size) {
+        return false;
+    }
+    results.resize(static_cast<size_t>(count));
+    for (OpResult& result : results) {
+        uint8_t type;
+        uint8_t op_status;
+        if (!in.byte(type) || !in.byte(op_status) || op_status > kFailed) {
+            return false;
+        }
+        result.type = static_cast<OpType>(type);
+        result.status = static_cast<Status>(op_status);
+        result.event_id = -1;
+        result.events.clear();
+        if (type == kCreate) {
+            if (op_status == kOk && !in.eventId(result.event_id)) {
+                return false;
+            }
+        } else if (type == kQuery) {
+            uint64_t events;
+            if (!in.varint(events) || events > size) {
+                return false;
+            }
+            time_t previous = 0;
+            result.events.resize(static_cast<size_t>(events));
+            for (Event& event : result.events) {
+                if (!in.range(previous, event.start_utc, event.end_utc) || !in.eventId(event.id) ||
+                    !in.string(event.title)) {
+                    return false;
+                }
+            }
+        } else if (type != kDelete && type != kUse) {
+            return false;
+        }
+    }
+    return in.atEnd();
+}
+
+}  // namespace BinaryProtocol
+
+BinaryProcessor::BinaryProcessor(CalendarService& calendar_service)
+    : calendar_service_(calendar_service) {
+}
+
+void BinaryProcessor::execute(const char* payload, size_t size, std::string& out) {
+    using namespace BinaryProtocol;
+
+    std::string response;
+    std::vector<Op> ops;
+    if (!parseRequest(payload, size, ops)) {
+        response.push_back(static_cast<char>(kMalformed));
+        appendFrame(response, out);
+        return;
+    }
+
+    response.push_back(static_cast<char>(kOk));
+    putVarint(response, ops.size());
+
+    // Run each stretch of same-type ops as one batch call
+    for (size_t begin = 0; begin < ops.size();) {
+        size_t end = begin;
+        while (end < ops.size() && ops[end].type == ops[begin].type) {
+            end++;
+        }
+
+        if (ops[begin].type == kCreate) {
+            std::vector<NewEvent> events;
+            std::vector<bool> printable(end - begin);
+            events.reserve(end - begin);
+            for (size_t i = begin; i < end; i++) {
+                printable[i - begin] = isPrintableTitle(ops[i].title);
+                if (printable[i - begin]) {
+                    events.push_back(NewEvent{std::move(ops[i].title), ops[i].start_utc, ops[i].end_utc});
+                }
+            }
+            std::vector<int> ids = calendar_service_.createEvents(events);
+            for (size_t i = 0, created = 0; i < printable.size(); i++) {
+                int id = printable[i] ? ids[created++] : -1;
+                response.push_back(static_cast<char>(kCreate));
+                response.push_back(static_cast<char>(id >= 0 ? kOk : kFailed));
+                if (id >= 0) {
+                    putVarint(response, static_cast<uint32_t>(id));
+                }
+            }
+        } else if (ops[begin].type == kDelete) {
+            std::vector<int> ids;
+            ids.reserve(end - begin);
+            for (size_t i = begin; i < end; i++) {
+                ids.push_back(ops[i].event_id);
+            }
+            for (bool deleted : calendar_service_.deleteEvents(ids)) {
+                response.push_back(static_cast<char>(kDelete));
+                response.push_back(static_cast<char>(deleted ? kOk : kFailed));
+            }
+        } else {
+            std::vector<std::pair<time_t, time_t>> ranges;
+            ranges.reserve(end - begin);
+            for (size_t i = begin; i < end; i++) {
+                ranges.emplace_back(ops[i].start_utc, ops[i].end_utc);
+            }
+            for (const std::vector<Event>& events : calendar_service_.getEventsInRanges(ranges)) {
+                response.push_back(static_cast<char>(kQuery));
+                response.push_back(static_cast<char>(kOk));
+                putVarint(response, events.size());
+                time_t previous = 0;
+                for (const Event& event : events) {
+                    putRange(response, previous, event.start_utc, event.end_utc);
+                    putVarint(response, static_cast<uint32_t>(event.id));
+                    putString(response, event.title);
+                }
+            }
+        }
+        begin = end;
+    }
+    appendFrame(response, out);
+}
@@ -0,0 +1,159 @@
+#ifndef BINARY_PROTOCOL_H
+#define BINARY_PROTOCOL_H
+
+#include "calendar_service.h"
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+/**
+ * Compact binary alternative to the text command protocol.
+ *
+ * A connection is binary if its first byte is kMagic (a byte no text
+ * command starts with); everything after it is frames. A frame is a
+ * varint payload length followed by the payload. Every request frame gets
+ * exactly one response frame, in order, so frames can be pipelined like
+ * text lines.
+ *
+ * Request payload: varint op count, then the ops:
+ *   create: kCreate, zigzag start delta, varint duration, varint title length, title
+ *   delete: kDelete, varint event ID
+ *   query:  kQuery, zigzag start delta, varint duration
+ *   use:    kUse, varint name length, name (see below)
+ * Start deltas are relative to the previous start in the frame (0 for the
+ * first), so a batch of nearby events costs a few bytes per timestamp.
+ * A title may not contain control characters (bytes below 0x20, or 0x7F):
+ * such a create fails with kFailed, since the title could not be listed
+ * over the text protocol.
+ *
+ * use selects the calendar for the connection's following frames, like the
+ * text command "use NAME". It must be the only op of its frame and only
+ * ShardedServer takes it (a single-calendar server answers kMalformed).
+ *
+ * Response payload: kOk (or kMalformed, with nothing after it), varint
+ * result count, then one result per op:
+ *   create: kCreate, status, varint event ID if status is kOk
+ *   delete: kDelete, status
+ *   use:    kUse, status (kFailed for an invalid name)
+ *   query:  kQuery, kOk, varint event count, then per event: zigzag start
+ *           delta, varint duration, varint ID, varint title length, title
+ *           (each start relative to the previous one, the first to 0)
+ *
+ * A frame is one batch: consecutive ops of the same type run through one
+ * call of CalendarService::createEvents, deleteEvents or getEventsInRanges,
+ * so a frame of 100 creates takes the calendar lock once and waits for
+ * one log flush.
+ */
+namespace BinaryProtocol {
+
+const uint8_t kMagic = 0xCA;
+
+enum OpType : uint8_t {
+    kCreate = 1,
+    kDelete = 2,
+    kQuery = 3,
+    kUse = 4
+};
+
+enum Status : uint8_t {
+    kOk = 0,
+    kFailed = 1,     // Create conflicted or was invalid (incl. title); delete found nothing; use got a bad name
+    kMalformed = 2   // Whole request rejected (response status only)
+};
+
+/**
+ * Locate the first frame in data[0, size).
+ *
+ * @param header_size Set to the length of the varint prefix
+ * @param payload_size Set to the payload length
+ * @return 1 if a whole frame is there, 0 if more bytes are needed, -1 if
+ *         the length prefix is corrupt or exceeds max_payload_size
+ */
+int findFrame(const char* data, size_t size, size_t max_payload_size, size_t& header_size,
+              size_t& payload_size);
+
+/**
+ * Append a varint length prefix and the payload.
+ */
+void appendFrame(const std::string& payload, std::string& out);
+
+/**
+ * Recognize a use request (server side).
+ *
+ * @param calendar Set to the requested name (not validated)
+ * @return true if the payload is a frame holding a single kUse op
+ */
+bool parseUse(const char* payload, size_t size, std::string& calendar);
+
+/**
+ * Append the response frame to a use request.
+ */
+void appendUseResponse(Status status, std::string& out);
+
+/**
+ * Builds one request payload (client side).
+ */
+class RequestBuilder {
+public:
+    RequestBuilder();
+
+    void addCreate(const std::string& title, time_t start_utc, time_t end_utc);
+    void addDelete(int event_id);
+    void addQuery(time_t start_utc, time_t end_utc);
+
+    /**
+     * Select a calendar; finish() the frame right after (use goes alone).
+     */
+    void addUse(const std::string& calendar);
+
+    size_t opCount() const { return op_count_; }
+
+    /**
+     * The finished frame (length prefix included); resets the builder.
+     */
+    std::string finish();
+
+private:
+    std::string ops_;
+    size_t op_count_;
+    time_t previous_start_;
+};
+
+/**
+ * One decoded result (client side).
+ */
+struct OpResult {
+    OpType type;
+    Status status;
+    int event_id;               // Create
+    std::vector<Event> events;  // Query
+};
+
+/**
+ * Decode a response payload.
+ *
+ * @return false if it is malformed or reports kMalformed
+ */
+bool parseResponse(const char* payload, size_t size, std::vector<OpResult>& results);
+
+}  // namespace BinaryProtocol
+
+/**
+ * Executes binary request payloads against a CalendarService (server
+ * side). Stateless like CommandProcessor: safe to share between threads.
+ */
+class BinaryProcessor {
+public:
+    explicit BinaryProcessor(CalendarService& calendar_service);
+
+    /**
+     * Run one request payload and append its response frame to out.
+     */
+    void execute(const char* payload, size_t size, std::string& out);
+
+private:
+    CalendarService& calendar_service_;
+};
+
+#endif // BINARY_PROTOCOL_H
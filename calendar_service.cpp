@@ -1,8 +1,299 @@
 #include "calendar_service.h"
 #include <algorithm>
 #include<bits/stdc++.h>
+#include "file_util.h"
+#include "timezone.h"
+#include <limits>
 #include <mutex>
-CalendarService::CalendarService() : next_event_id_(1) {
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+/**
+ * Fold a sealed log into the snapshot at snap_path, then delete the log.
+ *
+ * Runs without touching the live event set: the snapshot records are
+ * already sorted, so the log's changes are merged in with one linear pass
+ * (O(n + k log k) for n snapshot events and k logged changes).
+ *
+ * If a crash hits after the new snapshot is written but before the log is
+ * deleted, startup folds the same log in again. That is harmless: the
+ * snapshot already reflects every record, and re-applying a create or
+ * delete by key does not change it.
+ */
+bool compactLog(const std::string& snap_path, const std::string& log_path) {
+    SnapshotFile snapshot;
+    int next_event_id = 1;
+    if (::access(snap_path.c_str(), F_OK) == 0) {
+        if (!snapshot.open(snap_path)) {
+            return false;
+        }
+        next_event_id = snapshot.nextEventId();
+    }
+
+    // Net effect of the log, keyed like events_: (start_utc, id)
+    std::set<Event, EventComparator> created;
+    std::set<Event, EventComparator> deleted;
+    time_t archived_until = std::numeric_limits<time_t>::min();
+    bool ok = WriteAheadLog::replay(log_path, [&](const WalRecord& record) {
+        Event key(record.event_id, "", record.start_utc, record.end_utc);
+        if (record.type == WalRecord::Create) {
+            key.title = record.title;
+            created.insert(key);
+            next_event_id = std::max(next_event_id, record.event_id + 1);
+        } else if (record.type == WalRecord::Archive) {
+            // Everything ending by the cutoff now lives in an archive segment
+            archived_until = std::max(archived_until, record.start_utc);
+            for (auto it = created.begin(); it != created.end() && it->start_utc < record.start_utc;) {
+                it = (it->end_utc <= record.start_utc) ? created.erase(it) : std::next(it);
+            }
+        } else if (created.erase(key) == 0) {
+            deleted.insert(key);
+        }
+    });
+    if (!ok) {
+        return false;
+    }
+
+    EventComparator less;
+    std::vector<Event> merged;
+    merged.reserve(snapshot.size() + created.size());
+    auto c = created.begin();
+    for (size_t i = 0; i < snapshot.size(); i++) {
+        SnapshotEventView view = snapshot.event(i);
+        if (view.end_utc <= archived_until) {
+            continue;
+        }
+        Event event(view.id, std::string(view.title), view.start_utc, view.end_utc);
+        if (deleted.count(event) != 0) {
+            continue;
+        }
+        while (c != created.end() && less(*c, event)) {
+            merged.push_back(*c++);
+        }
+        if (c != created.end() && !less(event, *c)) {
+            ++c;  // Already in the snapshot (log folded in twice)
+        }
+        merged.push_back(std::move(event));
+    }
+    merged.insert(merged.end(), c, created.end());
+    snapshot.close();
+
+    if (!SnapshotFile::write(snap_path, merged, next_event_id)) {
+        return false;
+    }
+    if (::unlink(log_path.c_str()) != 0) {
+        return false;
+    }
+    FileUtil::syncParentDirectory(log_path);
+    return true;
+}
+
+}  // namespace
+
+CalendarService::CalendarService()
+    : next_event_id_(1), read_only_(false), checkpoint_running_(false), checkpoint_ok_(true) {
+}
+
+CalendarService::~CalendarService() {
+    if (checkpoint_thread_.joinable()) {
+        checkpoint_thread_.join();
+    }
+}
+
+bool CalendarService::openPersistence(const std::string& data_dir, const WalOptions& options) {
+    if (::mkdir(data_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        return false;
+    }
+    std::string wal_path = data_dir + "/calendar.wal";
+    std::string snap_path = data_dir + "/calendar.snap";
+    std::string sealed_path = data_dir + "/calendar.wal.ckpt";
+
+    std::lock_guard<std::mutex> lock(calendar_mutex_);
+
+    if (!archive_.open(data_dir + "/archive")) {
+        return false;
+    }
+
+    // A sealed log means a checkpoint did not finish; complete it first
+    if (::access(sealed_path.c_str(), F_OK) == 0 && !compactLog(snap_path, sealed_path)) {
+        return false;
+    }
+
+    // Start from the last checkpoint
+    if (!loadSnapshot(snap_path)) {
+        return false;
+    }
+
+    // Rebuild the rest of the state from the log, then keep appending to it
+    if (!WriteAheadLog::replay(wal_path, [this](const WalRecord& record) {
+            applyLogRecord(record);
+        })) {
+        return false;
+    }
+
+    // A crash between writing an archive segment and logging it leaves its
+    // events in the live set as well; drop them and log the move now
+    bool unlogged_archive = eraseArchived(archive_.archivedUntil()) > 0;
+
+    std::unique_ptr<WriteAheadLog> wal(new WriteAheadLog());
+    if (!wal->open(wal_path, options)) {
+        return false;
+    }
+    if (unlogged_archive) {
+        wal->append(WalRecord{WalRecord::Archive, 0, archive_.archivedUntil(), 0, ""});
+        if (!wal->sync()) {
+            return false;
+        }
+    }
+    wal_ = std::move(wal);
+    data_dir_ = data_dir;
+    return true;
+}
+
+bool CalendarService::openLsmStorage(const std::string& data_dir, const WalOptions& options,
+                                     const LsmOptions& lsm_options) {
+    if (::mkdir(data_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(calendar_mutex_);
+    std::unique_ptr<LsmStore> lsm(new LsmStore());
+    if (!lsm->open(data_dir + "/lsm", options, lsm_options)) {
+        return false;
+    }
+    next_event_id_ = std::max(next_event_id_, lsm->nextEventId());
+    lsm_ = std::move(lsm);
+    data_dir_ = data_dir;
+    return true;
+}
+
+bool CalendarService::loadSnapshot(const std::string& path) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        return errno == ENOENT;  // No checkpoint yet
+    }
+
+    SnapshotFile snapshot;
+    if (!snapshot.open(path)) {
+        return false;  // Refuse to start from a corrupt checkpoint
+    }
+
+    // Records are already in set order, so each is inserted at end() with
+    // the hint: no search down the tree. Every event still costs a tree node
+    // and, for titles past the inline buffer, a string allocation; those
+    // allocations are most of the load time (bench/snapshot_bench).
+    events_.clear();
+    for (size_t i = 0; i < snapshot.size(); i++) {
+        SnapshotEventView view = snapshot.event(i);
+        events_.emplace_hint(events_.end(), view.id, std::string(view.title),
+                             view.start_utc, view.end_utc);
+    }
+    next_event_id_ = std::max(next_event_id_, snapshot.nextEventId());
+    return true;
+}
+
+bool CalendarService::checkpoint() {
+    if (lsm_) {
+        return lsm_->flush();
+    }
+
+    std::lock_guard<std::mutex> guard(checkpoint_mutex_);
+    if (!wal_ || checkpoint_running_) {
+        return false;
+    }
+    if (checkpoint_thread_.joinable()) {
+        checkpoint_thread_.join();  // Finished; only reaps the thread
+    }
+
+    std::string snap_path = data_dir_ + "/calendar.snap";
+    std::string sealed_path = data_dir_ + "/calendar.wal.ckpt";
+
+    // If the last checkpoint failed its sealed log is still there: retry
+    // folding that one instead of sealing (and overwriting) another
+    if (::access(sealed_path.c_str(), F_OK) != 0 && !wal_->rotate(sealed_path)) {
+        return false;
+    }
+
+    checkpoint_running_ = true;
+    checkpoint_thread_ = std::thread([this, snap_path, sealed_path] {
+        bool ok = compactLog(snap_path, sealed_path);
+
+        std::lock_guard<std::mutex> guard(checkpoint_mutex_);
+        checkpoint_running_ = false;
+        checkpoint_ok_ = ok;
+        checkpoint_cv_.notify_all();
+    });
+    return true;
+}
+
+bool CalendarService::waitForCheckpoint() {
+    std::unique_lock<std::mutex> guard(checkpoint_mutex_);
+    checkpoint_cv_.wait(guard, [this] { return !checkpoint_running_; });
+    return checkpoint_ok_;
+}
+
+void CalendarService::applyLogRecord(const WalRecord& record) {
+    if (record.type == WalRecord::Create) {
+        events_.insert(Event(record.event_id, record.title, record.start_utc, record.end_utc));
+        next_event_id_ = std::max(next_event_id_, record.event_id + 1);
+    } else if (record.type == WalRecord::Archive) {
+        eraseArchived(record.start_utc);
+    } else {
+        // (start_utc, id) is the set's key, so no linear search is needed
+        events_.erase(Event(record.event_id, "", record.start_utc, record.start_utc));
+    }
+}
+
+size_t CalendarService::eraseArchived(time_t cutoff_utc) {
+    // Only events starting before the cutoff can end by it
+    size_t erased = 0;
+    for (auto it = events_.begin(); it != events_.end() && it->start_utc < cutoff_utc;) {
+        if (it->end_utc <= cutoff_utc) {
+            it = events_.erase(it);
+            erased++;
+        } else {
+            ++it;
+        }
+    }
+    return erased;
+}
+
+int CalendarService::archiveBefore(time_t cutoff_utc) {
+    uint64_t lsn;
+    int archived;
+    {
+        std::lock_guard<std::mutex> lock(calendar_mutex_);
+        if (!wal_ || lsm_ || read_only_) {
+            return -1;
+        }
+
+        std::vector<Event> past;
+        for (auto it = events_.begin(); it != events_.end() && it->start_utc < cutoff_utc; ++it) {
+            if (it->end_utc <= cutoff_utc) {
+                past.push_back(*it);
+            }
+        }
+        if (past.empty()) {
+            return 0;
+        }
+
+        // Segment first: once it is durable the events are safe even if
+        // the log record below never makes it (startup repairs that)
+        if (!archive_.addSegment(past)) {
+            return -1;
+        }
+        lsn = wal_->append(WalRecord{WalRecord::Archive, 0, archive_.archivedUntil(), 0, ""});
+        eraseArchived(archive_.archivedUntil());
+        archived = static_cast<int>(past.size());
+    }
+
+    if (!wal_->waitDurable(lsn)) {
+        enterReadOnly();
+        return -1;
+    }
+    return archived;
 }
 
 int CalendarService::getNextEventId() {
@@ -10,13 +301,82 @@ int CalendarService::getNextEventId() {
 }
 
 int CalendarService::createEvent(const std::string& title, time_t start_utc, time_t end_utc) {
+    int event_id;
+    uint64_t lsn = 0;
+    {
+        // Acquire lock for thread-safe operation
+        std::lock_guard<std::mutex> lock(calendar_mutex_);
+        event_id = insertEventLocked(title, start_utc, end_utc, lsn);
+        if (event_id == -1) {
+            return -1;
+        }
+    }
+
+    // Wait for durability outside the lock, so concurrent creates can
+    // share one fsync (group commit) instead of queueing behind each other
+    if (!waitDurable(lsn)) {
+        // Never acknowledge an event that is not on disk
+        std::lock_guard<std::mutex> lock(calendar_mutex_);
+        read_only_ = true;
+        if (lsm_) {
+            lsm_->rollback(Event(event_id, title, start_utc, end_utc));
+        } else {
+            events_.erase(Event(event_id, "", start_utc, start_utc));
+        }
+        return -1;
+    }
+
+    return event_id;
+}
+
+std::vector<int> CalendarService::createEvents(const std::vector<NewEvent>& events) {
+    std::vector<int> ids(events.size(), -1);
+    uint64_t lsn = 0;
+    {
+        std::lock_guard<std::mutex> lock(calendar_mutex_);
+        for (size_t i = 0; i < events.size(); i++) {
+            uint64_t event_lsn = 0;
+            ids[i] = insertEventLocked(events[i].title, events[i].start_utc, events[i].end_utc, event_lsn);
+            lsn = std::max(lsn, event_lsn);
+        }
+    }
+
+    // One wait covers the whole batch: the log is flushed in order
+    if (!waitDurable(lsn)) {
+        std::lock_guard<std::mutex> lock(calendar_mutex_);
+        read_only_ = true;
+        for (size_t i = 0; i < events.size(); i++) {
+            if (ids[i] == -1) {
+                continue;
+            }
+            if (lsm_) {
+                lsm_->rollback(Event(ids[i], events[i].title, events[i].start_utc, events[i].end_utc));
+            } else {
+                events_.erase(Event(ids[i], "", events[i].start_utc, events[i].start_utc));
+            }
+            ids[i] = -1;
+        }
+    }
+    return ids;
+}
+
+int CalendarService::insertEventLocked(const std::string& title, time_t start_utc, time_t end_utc,
+                                       uint64_t& lsn) {
     // Validate: start must be before end
-    if (start_utc >= end_utc) {
+    if (read_only_ || start_utc >= end_utc) {
         return -1;
     }
 
-    // Acquire lock for thread-safe operation
-    std::lock_guard<std::mutex> lock(calendar_mutex_);
+    // Binary clients send raw int64 times: keep to what can be listed and
+    // exported (years 0001-9998)
+    if (!TimezoneUtils::isRenderableUtc(start_utc) || !TimezoneUtils::isRenderableUtc(end_utc)) {
+        return -1;
+    }
+
+    // The archived past is read-only
+    if (end_utc <= archive_.archivedUntil()) {
+        return -1;
+    }
 
     // Check for conflicts
     if (hasConflict(start_utc, end_utc)) {
@@ -26,27 +386,120 @@ int CalendarService::createEvent(const std::string& title, time_t start_utc, tim
     // Create and insert event
     int event_id = getNextEventId();
     Event new_event(event_id, title, start_utc, end_utc);
-    events_.insert(new_event);
+    if (lsm_) {
+        lsn = lsm_->insert(new_event);
+    } else {
+        events_.insert(new_event);
+    }
 
+    // Log under the lock so the log order matches the order applied
+    if (wal_) {
+        lsn = wal_->append(WalRecord{WalRecord::Create, event_id, start_utc, end_utc, title});
+    }
     return event_id;
 }
 
-bool CalendarService::deleteEvent(int event_id) {
+bool CalendarService::waitDurable(uint64_t lsn) {
+    if (lsm_) {
+        return lsm_->waitDurable(lsn);
+    }
+    return !wal_ || wal_->waitDurable(lsn);
+}
+
+void CalendarService::enterReadOnly() {
+    std::lock_guard<std::mutex> lock(calendar_mutex_);
+    read_only_ = true;
+}
+
+bool CalendarService::isReadOnly() {
     std::lock_guard<std::mutex> lock(calendar_mutex_);
+    return read_only_;
+}
+
+bool CalendarService::deleteEvent(int event_id) {
+    uint64_t lsn = 0;
+    {
+        std::lock_guard<std::mutex> lock(calendar_mutex_);
+        if (!eraseEventLocked(event_id, lsn)) {
+            return false;
+        }
+    }
+
+    // Acknowledge only once the delete is durable. On failure the event
+    // is already gone from memory; read-only mode stops further drift
+    if (!waitDurable(lsn)) {
+        enterReadOnly();
+        return false;
+    }
+    return true;
+}
+
+std::vector<bool> CalendarService::deleteEvents(const std::vector<int>& event_ids) {
+    std::vector<bool> deleted(event_ids.size(), false);
+    uint64_t lsn = 0;
+    {
+        std::lock_guard<std::mutex> lock(calendar_mutex_);
+        for (size_t i = 0; i < event_ids.size(); i++) {
+            uint64_t event_lsn = 0;
+            deleted[i] = eraseEventLocked(event_ids[i], event_lsn);
+            lsn = std::max(lsn, event_lsn);
+        }
+    }
+
+    if (!waitDurable(lsn)) {
+        enterReadOnly();
+        deleted.assign(event_ids.size(), false);
+    }
+    return deleted;
+}
+
+bool CalendarService::eraseEventLocked(int event_id, uint64_t& lsn) {
+    if (read_only_) {
+        return false;
+    }
+    if (lsm_) {
+        return lsm_->erase(event_id, lsn);
+    }
 
     auto it = findEventById(event_id);
-    if (it != events_.end()) {
-        events_.erase(it);
-        return true;
+    if (it == events_.end()) {
+        return false;
     }
 
-    return false;
+    if (wal_) {
+        lsn = wal_->append(WalRecord{WalRecord::Delete, event_id, it->start_utc, 0, ""});
+    }
+    events_.erase(it);
+    return true;
 }
 
 std::vector<Event> CalendarService::getWeeklyEvents(time_t week_start_utc, time_t week_end_utc) {
     std::lock_guard<std::mutex> lock(calendar_mutex_);
 
     std::vector<Event> result;
+    collectEvents(week_start_utc, week_end_utc, result);
+    return result;
+}
+
+std::vector<std::vector<Event>> CalendarService::getEventsInRanges(
+    const std::vector<std::pair<time_t, time_t>>& ranges) {
+    std::lock_guard<std::mutex> lock(calendar_mutex_);
+
+    std::vector<std::vector<Event>> results(ranges.size());
+    for (size_t i = 0; i < ranges.size(); i++) {
+        collectEvents(ranges[i].first, ranges[i].second, results[i]);
+    }
+    return results;
+}
+
+void CalendarService::collectEvents(time_t week_start_utc, time_t week_end_utc, std::vector<Event>& result) {
+    if (lsm_) {
+        // Merged across the memtable and runs, already sorted
+        lsm_->query(week_start_utc, week_end_utc, result);
+        return;
+    }
+
+    size_t first = result.size();
 
     // Find first event that could overlap with the week
     // An event overlaps if: event.start < week_end AND event.end > week_start
@@ -71,20 +524,187 @@ std::vector<Event> CalendarService::getWeeklyEvents(time_t week_start_utc, time_
         ++it;
     }
 
+    // Past weeks may reach into the archive (a no-op for recent ranges)
+    std::vector<SnapshotEventView> archived;
+    archive_.query(week_start_utc, week_end_utc, archived);
+    if (!archived.empty()) {
+        size_t live = result.size();
+        for (const SnapshotEventView& view : archived) {
+            result.emplace_back(view.id, std::string(view.title), view.start_utc, view.end_utc);
+        }
+        std::inplace_merge(result.begin() + first, result.begin() + live, result.end(),
+                           EventComparator());
+    }
+}
+
+std::vector<SnapshotEventView> CalendarService::getArchivedEvents(time_t start_utc, time_t end_utc) {
+    std::lock_guard<std::mutex> lock(calendar_mutex_);
+
+    std::vector<SnapshotEventView> result;
+    archive_.query(start_utc, end_utc, result);
     return result;
 }
 
+std::set<Event, EventComparator>::const_iterator CalendarService::firstOverlapping(time_t start_utc) const {
+    auto it = events_.lower_bound(Event(0, "", start_utc, start_utc));
+    if (it != events_.begin() && std::prev(it)->end_utc > start_utc) {
+        --it;
+    }
+    return it;
+}
+
+uint64_t CalendarService::countEvents(time_t start_utc, time_t end_utc) {
+    std::lock_guard<std::mutex> lock(calendar_mutex_);
+
+    if (lsm_) {
+        std::vector<Event> events;
+        lsm_->query(start_utc, end_utc, events);
+        return events.size();
+    }
+    uint64_t total = archive_.count(start_utc, end_utc);
+    for (auto it = firstOverlapping(start_utc); it != events_.end() && it->start_utc < end_utc; ++it) {
+        total++;
+    }
+    return total;
+}
+
+int64_t CalendarService::sumDurations(time_t start_utc, time_t end_utc) {
+    std::lock_guard<std::mutex> lock(calendar_mutex_);
+
+    int64_t total = 0;
+    if (lsm_) {
+        std::vector<Event> events;
+        lsm_->query(start_utc, end_utc, events);
+        for (const Event& event : events) {
+            total += std::min(event.end_utc, end_utc) - std::max(event.start_utc, start_utc);
+        }
+        return total;
+    }
+    total = archive_.sumDurations(start_utc, end_utc);
+    for (auto it = firstOverlapping(start_utc); it != events_.end() && it->start_utc < end_utc; ++it) {
+        total += std::min(it->end_utc, end_utc) - std::max(it->start_utc, start_utc);
+    }
+    return total;
+}
+
+std::vector<int64_t> CalendarService::busyMinutesPerDay(const std::vector<time_t>& day_bounds) {
+    if (day_bounds.size() < 2) {
+        return std::vector<int64_t>();
+    }
+    std::vector<int64_t> busy(day_bounds.size() - 1, 0);
+    {
+        std::lock_guard<std::mutex> lock(calendar_mutex_);
+
+        if (lsm_) {
+            std::vector<Event> events;
+            lsm_->query(day_bounds.front(), day_bounds.back(), events);
+            for (const Event& event : events) {
+                addBusyInterval(event.start_utc, event.end_utc, day_bounds, busy);
+            }
+        }
+        archive_.addBusySecondsPerDay(day_bounds, busy);
+        for (auto it = firstOverlapping(day_bounds.front());
+             it != events_.end() && it->start_utc < day_bounds.back(); ++it) {
+            addBusyInterval(it->start_utc, it->end_utc, day_bounds, busy);
+        }
+    }
+    for (int64_t& seconds : busy) {
+        seconds /= 60;
+    }
+    return busy;
+}
+
+bool CalendarService::findFreeSlot(time_t from_utc, time_t until_utc, int64_t duration, time_t& slot_start) {
+    if (duration <= 0 || until_utc - from_utc < duration) {
+        return false;
+    }
+
+    std::vector<Event> events;
+    {
+        std::lock_guard<std::mutex> lock(calendar_mutex_);
+        collectEvents(from_utc, until_utc, events);
+    }
+
+    // Events never overlap, so in start order each one only pushes the
+    // earliest candidate forward
+    time_t candidate = from_utc;
+    for (const Event& event : events) {
+        if (event.start_utc - candidate >= duration) {
+            break;
+        }
+        candidate = std::max(candidate, event.end_utc);
+    }
+    if (until_utc - candidate < duration) {
+        return false;
+    }
+    slot_start = candidate;
+    return true;
+}
+
+void CalendarService::getEventsPage(time_t from_utc, size_t limit, std::vector<Event>& out) {
+    out.clear();
+    std::lock_guard<std::mutex> lock(calendar_mutex_);
+
+    if (lsm_) {
+        lsm_->page(from_utc, limit, out);
+        return;
+    }
+
+    Event search(0, "", from_utc, from_utc);
+    for (auto it = events_.lower_bound(search); it != events_.end() && out.size() < limit; ++it) {
+        out.push_back(*it);
+    }
+
+    std::vector<SnapshotEventView> archived;
+    archive_.page(from_utc, limit, archived);
+    if (!archived.empty()) {
+        size_t live = out.size();
+        for (const SnapshotEventView& view : archived) {
+            out.emplace_back(view.id, std::string(view.title), view.start_utc, view.end_utc);
+        }
+        std::inplace_merge(out.begin(), out.begin() + live, out.end(), EventComparator());
+        if (out.size() > limit) {
+            out.resize(limit);
+        }
+    }
+}
+
 std::vector<Event> CalendarService::getAllEvents() {
     std::lock_guard<std::mutex> lock(calendar_mutex_);
 
+    if (lsm_) {
+        std::vector<Event> result;
+        lsm_->query(std::numeric_limits<time_t>::min(), std::numeric_limits<time_t>::max(), result);
+        return result;
+    }
+
+    std::vector<SnapshotEventView> archived;
+    archive_.query(std::numeric_limits<time_t>::min(), std::numeric_limits<time_t>::max(), archived);
+
     std::vector<Event> result;
+    result.reserve(archived.size() + events_.size());
+    for (const SnapshotEventView& view : archived) {
+        result.emplace_back(view.id, std::string(view.title), view.start_utc, view.end_utc);
+    }
+    size_t archived_count = result.size();
     for (const auto& event : events_) {
         result.push_back(event);
     }
+    std::inplace_merge(result.begin(), result.begin() + archived_count, result.end(),
+                       EventComparator());
     return result;
 }
 
 bool CalendarService::hasConflict(time_t start_utc, time_t end_utc) const {
+    if (lsm_) {
+        return lsm_->overlaps(start_utc, end_utc);
+    }
+
+    // Archived events still occupy their time slots
+    if (archive_.overlaps(start_utc, end_utc)) {
+        return true;
+    }
+
     // Create a dummy event for searching
     Event search_event(0, "", start_utc, end_utc);
 
@@ -1,13 +1,29 @@
 #ifndef CALENDAR_SERVICE_H
 #define CALENDAR_SERVICE_H
 
+#include "archive.h"
 #include "event.h"
+#include "lsm.h"
+#include "snapshot.h"
+#include "wal.h"
+#include <condition_variable>
+#include <memory>
 #include <set>
 #include<bits/stdc++.h>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
+/**
+ * An event to create in a batch (see CalendarService::createEvents).
+ */
+struct NewEvent {
+    std::string title;
+    time_t start_utc;
+    time_t end_utc;
+};
+
 /**
  * CalendarService provides thread-safe calendar operations.
  * 
@@ -16,11 +32,72 @@
  * - Events stored in sorted set for efficient conflict detection
  * - All times stored in UTC internally
  * - Conflict detection only checks neighboring events (O(log n) complexity)
+ * - Optional write-ahead log: mutations are logged before they are
+ *   acknowledged, and replayed on startup (see openPersistence)
+ * - A failed log write makes the calendar read-only until restart: the
+ *   failed mutation is reported as failed, but a delete stays applied in
+ *   memory and its record may or may not have reached the disk, so memory
+ *   and the log can disagree. Refusing every later mutation keeps that
+ *   divergence from growing; the restart replays the log, which is the
+ *   truth.
  */
 class CalendarService {
 public:
     CalendarService();
-    ~CalendarService() = default;
+    ~CalendarService();
+
+    /**
+     * Make the calendar durable: load the last checkpoint and replay the
+     * write-ahead log in data_dir (creating the directory if needed), then
+     * log every later mutation there before acknowledging it.
+     *
+     * Call once, before any other operation.
+     *
+     * @param data_dir Directory holding calendar.snap and calendar.wal
+     * @param options Sync policy for the log
+     * @return false on an I/O error or a corrupt checkpoint
+     */
+    bool openPersistence(const std::string& data_dir, const WalOptions& options);
+
+    /**
+     * Make the calendar durable with the write-optimized LSM engine instead
+     * (see LsmStore): events live in data_dir/lsm, not in memory, and every
+     * operation below goes to the store. For ingest-heavy calendars whose
+     * size makes snapshots and an in-memory set too costly.
+     *
+     * Call once, before any other operation, instead of openPersistence.
+     * There is no archive tier in this mode.
+     *
+     * @return false on an I/O error or a corrupt store
+     */
+    bool openLsmStorage(const std::string& data_dir, const WalOptions& options,
+                        const LsmOptions& lsm_options);
+
+    /**
+     * Start a checkpoint in the background, so the next startup loads a
+     * binary snapshot (calendar.snap) instead of replaying the whole log.
+     *
+     * The point-in-time view is taken from the log, not from events_: the
+     * current log is sealed (renamed to calendar.wal.ckpt) and a background
+     * thread folds it into the previous snapshot, then deletes it. The only
+     * pause for writers is the flush + rename inside WriteAheadLog::rotate;
+     * calendar_mutex_ is never held while the snapshot is written.
+     *
+     * With the LSM engine this flushes the memtable to a run instead, and
+     * waits for it.
+     *
+     * @return false if persistence is not open, a checkpoint is already
+     *         running, or the log could not be sealed
+     */
+    bool checkpoint();
+
+    /**
+     * Wait for a running checkpoint to finish.
+     *
+     * @return false if the last checkpoint failed (its sealed log is kept
+     *         and retried by the next checkpoint or at startup)
+     */
+    bool waitForCheckpoint();
 
     /**
      * Create a new event.
@@ -28,7 +105,10 @@ public:
      * @param title Event title
      * @param start_utc Start time in UTC
      * @param end_utc End time in UTC
-     * @return Event ID on success, -1 on failure (conflict or invalid times)
+     * @return Event ID on success, -1 on failure (conflict, invalid times,
+     *         a time outside years 0001-9998, an end time inside the
+     *         archived past, the write-ahead log could not be written, or
+     *         the calendar is read-only)
      */
     int createEvent(const std::string& title, time_t start_utc, time_t end_utc);
 
@@ -36,24 +116,128 @@ public:
      * Delete an event by ID.
      * 
      * @param event_id Event ID to delete
-     * @return true if deleted, false if not found
+     * @return true if deleted, false if not found (archived events are
+     *         read-only), the deletion could not be written to the
+     *         write-ahead log, or the calendar is read-only
      */
     bool deleteEvent(int event_id);
 
+    /**
+     * Create several events under one lock acquisition, sharing one
+     * write-ahead log flush. Each event is checked as if created on its
+     * own, in order, so later events in the batch see earlier ones.
+     *
+     * @return One entry per event: its ID, or -1 where createEvent would
+     *         fail (all -1 if the log could not be written)
+     */
+    std::vector<int> createEvents(const std::vector<NewEvent>& events);
+
+    /**
+     * Delete several events under one lock acquisition, sharing one
+     * write-ahead log flush.
+     *
+     * @return One entry per ID, as deleteEvent would return
+     */
+    std::vector<bool> deleteEvents(const std::vector<int>& event_ids);
+
+    /**
+     * Run several range queries against one consistent view.
+     *
+     * @param ranges [start_utc, end_utc) pairs
+     * @return One sorted result per range, as getWeeklyEvents would return
+     */
+    std::vector<std::vector<Event>> getEventsInRanges(const std::vector<std::pair<time_t, time_t>>& ranges);
+
     /**
      * Get all events in a week.
      * 
      * @param week_start_utc Start of week in UTC
      * @param week_end_utc End of week in UTC
-     * @return Vector of events overlapping the week
+     * @return Vector of events overlapping the week, live and archived
      */
     std::vector<Event> getWeeklyEvents(time_t week_start_utc, time_t week_end_utc);
 
     /**
-     * Get all events (for debugging/testing).
+     * Zero-copy query of the archive tier alone. Titles point into the
+     * segment mappings and stay valid while the service exists.
+     *
+     * @return Archived events overlapping [start_utc, end_utc), sorted
+     */
+    std::vector<SnapshotEventView> getArchivedEvents(time_t start_utc, time_t end_utc);
+
+    /**
+     * Count live and archived events overlapping [start_utc, end_utc).
+     *
+     * This and the other reporting scans below read the archive through its
+     * delta-encoded column files: a few bytes per event, whole blocks
+     * outside the range skipped. Much cheaper than getAllEvents().
+     */
+    uint64_t countEvents(time_t start_utc, time_t end_utc);
+
+    /**
+     * Total event time inside [start_utc, end_utc), in seconds.
+     */
+    int64_t sumDurations(time_t start_utc, time_t end_utc);
+
+    /**
+     * Busy minutes per day.
+     *
+     * @param day_bounds Ascending day edges (e.g. local midnights); day i
+     *        is [day_bounds[i], day_bounds[i + 1])
+     * @return day_bounds.size() - 1 entries (empty if fewer than two bounds)
+     */
+    std::vector<int64_t> busyMinutesPerDay(const std::vector<time_t>& day_bounds);
+
+    /**
+     * Earliest gap of at least duration seconds inside [from_utc, until_utc)
+     * that overlaps no live or archived event.
+     *
+     * @param slot_start Set to the start of the gap on success
+     * @return false if there is no such gap (or duration is not positive)
+     */
+    bool findFreeSlot(time_t from_utc, time_t until_utc, int64_t duration, time_t& slot_start);
+
+    /**
+     * One page of a walk over every event, live and archived: the first
+     * limit events starting at or after from_utc, sorted, replacing the
+     * contents of out. Events never overlap, so their starts are distinct
+     * and the next page starts one second after the last start.
+     *
+     * Each page is read under its own short lock hold; events created or
+     * deleted between pages may or may not be seen.
+     */
+    void getEventsPage(time_t from_utc, size_t limit, std::vector<Event>& out);
+
+    /**
+     * Get all events, live and archived (for debugging/testing).
      */
     std::vector<Event> getAllEvents();
 
+    /**
+     * Move every event that ends at or before cutoff_utc out of memory into
+     * a new read-only archive segment (data_dir/archive). The events stay
+     * visible to queries and conflict checks but can no longer be deleted,
+     * and new events may not end inside the archived range.
+     *
+     * Blocks other operations while the segment is written.
+     *
+     * @return Number of events archived, or -1 if persistence is not open
+     *         (or uses the LSM engine), the calendar is read-only, or on an
+     *         I/O error
+     */
+    int archiveBefore(time_t cutoff_utc);
+
+    /**
+     * Has a write-ahead log failure made the calendar read-only? Every
+     * mutation fails from then on, until the process restarts.
+     */
+    bool isReadOnly();
+
+    /**
+     * Was the calendar opened with openLsmStorage?
+     */
+    bool usesLsmEngine() const { return lsm_ != nullptr; }
+
     /**
      * Get next available event ID.
      */
@@ -70,6 +254,49 @@ private:
     // Counter for event IDs
     int next_event_id_;
 
+    // Set by the first failed log write; guarded by calendar_mutex_
+    bool read_only_;
+
+    // Write-ahead log; null when running in memory only
+    std::unique_ptr<WriteAheadLog> wal_;
+
+    // LSM engine; when set it holds every event and events_, wal_ and
+    // archive_ stay unused
+    std::unique_ptr<LsmStore> lsm_;
+
+    // Read-only historical events; empty when running in memory only
+    EventArchive archive_;
+
+    // Directory given to openPersistence
+    std::string data_dir_;
+
+    // Background checkpoint state, guarded by checkpoint_mutex_
+    std::mutex checkpoint_mutex_;
+    std::condition_variable checkpoint_cv_;
+    std::thread checkpoint_thread_;
+    bool checkpoint_running_;
+    bool checkpoint_ok_;
+
+    /**
+     * Rebuild events_ from a snapshot file. Caller holds calendar_mutex_.
+     *
+     * @return true if there is no snapshot yet or it was loaded
+     */
+    bool loadSnapshot(const std::string& path);
+
+    /**
+     * Apply a logged mutation during replay (no conflict check, no logging).
+     */
+    void applyLogRecord(const WalRecord& record);
+
+    /**
+     * Remove live events ending at or before cutoff_utc (they are in the
+     * archive). Caller holds calendar_mutex_.
+     *
+     * @return Number removed
+     */
+    size_t eraseArchived(time_t cutoff_utc);
+
     /**
      * Check if a new event conflicts with existing events.
      * 
@@ -86,6 +313,46 @@ private:
      */
     bool hasConflict(time_t start_utc, time_t end_utc) const;
 
+    /**
+     * First live event that may overlap a range starting at start_utc: the
+     * last event starting before it if that one runs past it, else the
+     * first starting at or after it. Caller holds calendar_mutex_.
+     */
+    std::set<Event, EventComparator>::const_iterator firstOverlapping(time_t start_utc) const;
+
+    /**
+     * Append the live and archived events overlapping [start_utc, end_utc)
+     * to out, sorted. Caller holds calendar_mutex_.
+     */
+    void collectEvents(time_t start_utc, time_t end_utc, std::vector<Event>& out);
+
+    /**
+     * Validate, conflict-check, insert and log one event. Caller holds
+     * calendar_mutex_ and waits for durability afterwards.
+     *
+     * @param lsn Set to the log sequence number when logged
+     * @return Event ID, or -1
+     */
+    int insertEventLocked(const std::string& title, time_t start_utc, time_t end_utc, uint64_t& lsn);
+
+    /**
+     * Find, log and erase one event. Caller holds calendar_mutex_.
+     *
+     * @return false if not found
+     */
+    bool eraseEventLocked(int event_id, uint64_t& lsn);
+
+    /**
+     * Wait until everything logged up to lsn is durable (true without a log).
+     */
+    bool waitDurable(uint64_t lsn);
+
+    /**
+     * Refuse every later mutation after a log write failed (see the class
+     * comment). Takes calendar_mutex_.
+     */
+    void enterReadOnly();
+
     /**
      * Find event by ID (helper for deletion).
      */
@@ -0,0 +1,343 @@
+#include "columnar.h"
+#include "crc32c.h"
+#include "file_util.h"
+#include "varint.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The header and block index are written and mapped as raw structs
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "column format assumes a little-endian host");
+
+namespace {
+
+const char kMagic[8] = {'C', 'A', 'L', 'C', 'O', 'L', '0', '1'};
+const uint32_t kVersion = 1;
+
+struct ColumnHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t block_size;
+    uint64_t event_count;
+    uint64_t block_count;
+    uint64_t data_bytes;
+    uint32_t index_crc;
+    uint32_t data_crc;
+    uint32_t reserved[3];
+    uint32_t header_crc;  // CRC32C of the 60 bytes before it
+};
+static_assert(sizeof(ColumnHeader) == 64, "ColumnHeader must stay 64 bytes on disk");
+
+uint32_t headerCrc(const ColumnHeader& header) {
+    return crc32c(&header, offsetof(ColumnHeader, header_crc));
+}
+
+// Add [start_utc, end_utc) to the day buckets. day is a cursor: callers
+// feeding events in start order keep it, so finding the first bucket is
+// amortized O(1) instead of a binary search per event.
+void addToDays(int64_t start_utc, int64_t end_utc, const std::vector<time_t>& day_bounds,
+               std::vector<int64_t>& busy_seconds, size_t& day) {
+    int64_t s = std::max<int64_t>(start_utc, day_bounds.front());
+    int64_t e = std::min<int64_t>(end_utc, day_bounds.back());
+    if (s >= e) {
+        return;
+    }
+    while (day_bounds[day + 1] <= s) {
+        day++;
+    }
+    // Split at day boundaries; almost always a single iteration
+    for (size_t d = day; s < e; d++) {
+        int64_t piece_end = std::min<int64_t>(e, day_bounds[d + 1]);
+        busy_seconds[d] += piece_end - s;
+        s = piece_end;
+    }
+}
+
+}  // namespace
+
+ColumnSegment::ColumnSegment()
+    : map_(nullptr), map_size_(0), blocks_(nullptr), block_count_(0), data_(nullptr),
+      data_size_(0), count_(0) {
+}
+
+ColumnSegment::~ColumnSegment() {
+    close();
+}
+
+bool ColumnSegment::write(const std::string& path, const std::vector<Event>& events) {
+    std::vector<ColumnBlockInfo> blocks;
+    std::string data;
+
+    for (size_t first = 0; first < events.size(); first += kBlockSize) {
+        size_t last = std::min(events.size(), first + static_cast<size_t>(kBlockSize));
+        ColumnBlockInfo info;
+        std::memset(&info, 0, sizeof(info));
+        info.min_start = events[first].start_utc;
+        info.max_start = events[last - 1].start_utc;
+        info.max_end = events[first].end_utc;
+        info.data_offset = data.size();
+        info.count = static_cast<uint32_t>(last - first);
+
+        int64_t previous = info.min_start;
+        for (size_t i = first; i < last; i++) {
+            putVarint(data, static_cast<uint64_t>(events[i].start_utc - previous));
+            previous = events[i].start_utc;
+        }
+        for (size_t i = first; i < last; i++) {
+            putVarint(data, static_cast<uint64_t>(events[i].end_utc - events[i].start_utc));
+            info.total_duration += events[i].end_utc - events[i].start_utc;
+            info.max_end = std::max<int64_t>(info.max_end, events[i].end_utc);
+        }
+        int64_t previous_id = 0;
+        for (size_t i = first; i < last; i++) {
+            putVarint(data, zigzag(int64_t(events[i].id) - previous_id));
+            previous_id = events[i].id;
+        }
+
+        if (data.size() - info.data_offset > UINT32_MAX) {
+            return false;
+        }
+        info.data_length = static_cast<uint32_t>(data.size() - info.data_offset);
+        blocks.push_back(info);
+    }
+
+    ColumnHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.block_size = kBlockSize;
+    header.event_count = events.size();
+    header.block_count = blocks.size();
+    header.data_bytes = data.size();
+    header.index_crc = crc32c(blocks.data(), blocks.size() * sizeof(ColumnBlockInfo));
+    header.data_crc = crc32c(data.data(), data.size());
+    header.header_crc = headerCrc(header);
+
+    FileUtil::Piece pieces[] = {
+        {reinterpret_cast<const char*>(&header), sizeof(header)},
+        {reinterpret_cast<const char*>(blocks.data()), blocks.size() * sizeof(ColumnBlockInfo)},
+        {data.data(), data.size()},
+    };
+    return FileUtil::writeFileAtomically(path, pieces, 3);
+}
+
+bool ColumnSegment::open(const std::string& path, bool verify_contents) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(ColumnHeader)) {
+        ::close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    const char* base = static_cast<const char*>(map);
+    ColumnHeader header;
+    std::memcpy(&header, base, sizeof(header));
+
+    size_t body = size - sizeof(header);
+    bool ok = std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+              header.version == kVersion &&
+              header.block_size == kBlockSize &&
+              header.header_crc == headerCrc(header) &&
+              header.block_count <= body / sizeof(ColumnBlockInfo) &&
+              header.data_bytes == body - header.block_count * sizeof(ColumnBlockInfo);
+    const char* index = base + sizeof(header);
+    const char* data = index + (ok ? header.block_count * sizeof(ColumnBlockInfo) : 0);
+    if (ok) {
+        ok = crc32c(index, header.block_count * sizeof(ColumnBlockInfo)) == header.index_crc;
+    }
+    if (ok && verify_contents) {
+        ok = crc32c(data, header.data_bytes) == header.data_crc;
+    }
+    if (ok) {
+        // Block extents must lie inside the data area; checked once so
+        // decodeBlock only has to guard against malformed varints
+        const ColumnBlockInfo* blocks = reinterpret_cast<const ColumnBlockInfo*>(index);
+        uint64_t events = 0;
+        for (size_t i = 0; i < header.block_count && ok; i++) {
+            ok = blocks[i].count <= kBlockSize &&
+                 blocks[i].data_offset <= header.data_bytes &&
+                 blocks[i].data_length <= header.data_bytes - blocks[i].data_offset;
+            events += blocks[i].count;
+        }
+        ok = ok && events == header.event_count;
+    }
+    if (!ok) {
+        ::munmap(map, size);
+        return false;
+    }
+
+    map_ = map;
+    map_size_ = size;
+    blocks_ = reinterpret_cast<const ColumnBlockInfo*>(index);
+    block_count_ = static_cast<size_t>(header.block_count);
+    data_ = reinterpret_cast<const uint8_t*>(data);
+    data_size_ = static_cast<size_t>(header.data_bytes);
+    count_ = static_cast<size_t>(header.event_count);
+    return true;
+}
+
+void ColumnSegment::close() {
+    if (map_) {
+        ::munmap(map_, map_size_);
+    }
+    map_ = nullptr;
+    map_size_ = 0;
+    blocks_ = nullptr;
+    block_count_ = 0;
+    data_ = nullptr;
+    data_size_ = 0;
+    count_ = 0;
+}
+
+size_t ColumnSegment::decodeBlock(const ColumnBlockInfo& info, int64_t* starts,
+                                  int64_t* durations) const {
+    const uint8_t* p = data_ + info.data_offset;
+    const uint8_t* end = p + info.data_length;
+    uint64_t v;
+
+    int64_t start = info.min_start;
+    for (uint32_t i = 0; i < info.count; i++) {
+        if (!getVarint(p, end, v)) {
+            return 0;
+        }
+        start += static_cast<int64_t>(v);
+        starts[i] = start;
+    }
+    for (uint32_t i = 0; i < info.count; i++) {
+        if (!getVarint(p, end, v)) {
+            return i;
+        }
+        durations[i] = static_cast<int64_t>(v);
+    }
+    return info.count;
+}
+
+void ColumnSegment::blockRange(time_t start_utc, time_t end_utc, size_t& first, size_t& last) const {
+    const ColumnBlockInfo* begin = blocks_;
+    const ColumnBlockInfo* stop = blocks_ + block_count_;
+
+    // Blocks starting at or after the range end cannot overlap it
+    last = std::lower_bound(begin, stop, static_cast<int64_t>(end_utc),
+                            [](const ColumnBlockInfo& b, int64_t t) { return b.min_start < t; }) - begin;
+
+    // First block whose last event starts inside the range; earlier blocks
+    // only matter if an event runs into the range (at most one step back
+    // for a calendar without overlaps)
+    first = std::lower_bound(begin, stop, static_cast<int64_t>(start_utc),
+                             [](const ColumnBlockInfo& b, int64_t t) { return b.max_start < t; }) - begin;
+    while (first > 0 && blocks_[first - 1].max_end > start_utc) {
+        first--;
+    }
+    first = std::min(first, last);
+}
+
+uint64_t ColumnSegment::count(time_t start_utc, time_t end_utc) const {
+    size_t first, last;
+    blockRange(start_utc, end_utc, first, last);
+
+    int64_t starts[kBlockSize];
+    int64_t durations[kBlockSize];
+    uint64_t total = 0;
+    for (size_t b = first; b < last; b++) {
+        const ColumnBlockInfo& info = blocks_[b];
+        if (info.max_end <= start_utc) {
+            continue;
+        }
+        if (info.min_start >= start_utc && info.max_end <= end_utc) {
+            total += info.count;  // Entirely inside: no need to decode
+            continue;
+        }
+        size_t n = decodeBlock(info, starts, durations);
+        uint64_t hits = 0;
+        for (size_t i = 0; i < n; i++) {
+            hits += (starts[i] < end_utc) & (starts[i] + durations[i] > start_utc);
+        }
+        total += hits;
+    }
+    return total;
+}
+
+int64_t ColumnSegment::sumDurations(time_t start_utc, time_t end_utc) const {
+    size_t first, last;
+    blockRange(start_utc, end_utc, first, last);
+
+    int64_t starts[kBlockSize];
+    int64_t durations[kBlockSize];
+    int64_t total = 0;
+    for (size_t b = first; b < last; b++) {
+        const ColumnBlockInfo& info = blocks_[b];
+        if (info.max_end <= start_utc) {
+            continue;
+        }
+        if (info.min_start >= start_utc && info.max_end <= end_utc) {
+            total += info.total_duration;
+            continue;
+        }
+        size_t n = decodeBlock(info, starts, durations);
+        int64_t sum = 0;
+        for (size_t i = 0; i < n; i++) {
+            int64_t s = std::max<int64_t>(starts[i], start_utc);
+            int64_t e = std::min<int64_t>(starts[i] + durations[i], end_utc);
+            sum += std::max<int64_t>(e - s, 0);
+        }
+        total += sum;
+    }
+    return total;
+}
+
+void ColumnSegment::addBusySecondsPerDay(const std::vector<time_t>& day_bounds,
+                                         std::vector<int64_t>& busy_seconds) const {
+    const time_t start_utc = day_bounds.front();
+    const time_t end_utc = day_bounds.back();
+    size_t first, last;
+    blockRange(start_utc, end_utc, first, last);
+
+    int64_t starts[kBlockSize];
+    int64_t durations[kBlockSize];
+    size_t cursor = 0;
+    for (size_t b = first; b < last; b++) {
+        const ColumnBlockInfo& info = blocks_[b];
+        if (info.max_end <= start_utc) {
+            continue;
+        }
+        if (info.min_start >= start_utc) {
+            // Whole block inside one day: use its total, no decoding
+            size_t day = std::upper_bound(day_bounds.begin(), day_bounds.end(), info.min_start) -
+                         day_bounds.begin() - 1;
+            if (day + 1 < day_bounds.size() && info.max_end <= day_bounds[day + 1]) {
+                busy_seconds[day] += info.total_duration;
+                continue;
+            }
+        }
+
+        size_t n = decodeBlock(info, starts, durations);
+        for (size_t i = 0; i < n; i++) {
+            addToDays(starts[i], starts[i] + durations[i], day_bounds, busy_seconds, cursor);
+        }
+    }
+}
+
+void addBusyInterval(int64_t start_utc, int64_t end_utc, const std::vector<time_t>& day_bounds,
+                     std::vector<int64_t>& busy_seconds) {
+    size_t day = 0;
+    if (start_utc > day_bounds.front()) {
+        day = std::upper_bound(day_bounds.begin(), day_bounds.end(), start_utc) - day_bounds.begin() - 1;
+        day = std::min(day, day_bounds.size() - 2);
+    }
+    addToDays(start_utc, end_utc, day_bounds, busy_seconds, day);
+}
@@ -0,0 +1,128 @@
+#ifndef COLUMNAR_H
+#define COLUMNAR_H
+
+#include "event.h"
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+/**
+ * Per-block summary kept uncompressed in the block index, so a scan can
+ * skip a block (no overlap) or answer from it directly (block entirely
+ * inside the range) without decoding the columns.
+ */
+struct ColumnBlockInfo {
+    int64_t min_start;       // Start of the first event (blocks are sorted)
+    int64_t max_start;       // Start of the last event
+    int64_t max_end;         // Latest end in the block
+    int64_t total_duration;  // Sum of end - start, seconds
+    uint64_t data_offset;    // Into the data area
+    uint32_t data_length;
+    uint32_t count;
+};
+static_assert(sizeof(ColumnBlockInfo) == 48, "ColumnBlockInfo must stay 48 bytes on disk");
+
+/**
+ * Analytics copy of an archive segment, stored column by column.
+ *
+ * Events (sorted by start) are cut into blocks of kBlockSize. Each block
+ * stores three columns back to back, as LEB128 varints:
+ *   start:    delta from the previous start (first is 0 from min_start)
+ *   duration: end - start
+ *   id:       zigzag delta from the previous id (first from 0)
+ * Sorted starts and short meetings make most values one or two bytes, so
+ * a block is a small fraction of the 32-byte-per-event snapshot records
+ * and scans touch far fewer pages.
+ *
+ * Layout (little-endian): 64-byte header (magic "CALCOL01", counts,
+ * CRC32Cs), block index (block_count x ColumnBlockInfo), column data.
+ * Written atomically like SnapshotFile; read through mmap.
+ *
+ * Scans decode a block into plain arrays and aggregate them in branch-free
+ * loops over the whole block, which the compiler can vectorize.
+ */
+class ColumnSegment {
+public:
+    static const uint32_t kBlockSize = 1024;
+
+    ColumnSegment();
+    ~ColumnSegment();
+
+    ColumnSegment(const ColumnSegment&) = delete;
+    ColumnSegment& operator=(const ColumnSegment&) = delete;
+
+    /**
+     * Write events (sorted by EventComparator) as a column file.
+     *
+     * @return false on an I/O error (the previous file is left untouched)
+     */
+    static bool write(const std::string& path, const std::vector<Event>& events);
+
+    /**
+     * mmap a column file. The header and block index are always verified;
+     * verify_contents also checksums the column data.
+     *
+     * @return false if the file is missing, truncated or corrupt
+     */
+    bool open(const std::string& path, bool verify_contents = false);
+
+    void close();
+
+    size_t size() const { return count_; }
+
+    /**
+     * Number of events overlapping [start_utc, end_utc).
+     */
+    uint64_t count(time_t start_utc, time_t end_utc) const;
+
+    /**
+     * Total event time inside [start_utc, end_utc), in seconds. Events
+     * reaching past either edge count only their part inside the range.
+     */
+    int64_t sumDurations(time_t start_utc, time_t end_utc) const;
+
+    /**
+     * Add event time to per-day buckets. Bucket i covers
+     * [day_bounds[i], day_bounds[i + 1]); the caller picks the bounds
+     * (e.g. local midnights, so DST days have 23 or 25 hours). Events
+     * spanning several buckets are split between them.
+     *
+     * @param day_bounds Ascending bucket edges, at least two
+     * @param busy_seconds day_bounds.size() - 1 entries, added to
+     */
+    void addBusySecondsPerDay(const std::vector<time_t>& day_bounds,
+                              std::vector<int64_t>& busy_seconds) const;
+
+private:
+    void* map_;
+    size_t map_size_;
+    const ColumnBlockInfo* blocks_;
+    size_t block_count_;
+    const uint8_t* data_;
+    size_t data_size_;
+    size_t count_;
+
+    /**
+     * Decode the start and duration columns of a block.
+     *
+     * @return Number of events decoded (less than info.count if the data
+     *         is corrupt)
+     */
+    size_t decodeBlock(const ColumnBlockInfo& info, int64_t* starts, int64_t* durations) const;
+
+    /**
+     * Blocks [first, last) that may overlap [start_utc, end_utc).
+     */
+    void blockRange(time_t start_utc, time_t end_utc, size_t& first, size_t& last) const;
+};
+
+/**
+ * Add the part of [start_utc, end_utc) inside the buckets to busy_seconds
+ * (see ColumnSegment::addBusySecondsPerDay). Shared with callers that
+ * scan events held in memory.
+ */
+void addBusyInterval(int64_t start_utc, int64_t end_utc, const std::vector<time_t>& day_bounds,
+                     std::vector<int64_t>& busy_seconds);
+
+#endif // COLUMNAR_H
@@ -0,0 +1,441 @@
+#include "command_processor.h"
+#include "exporter.h"
+#include "importer.h"
+#include "render.h"
+#include "timezone.h"
+#include "tzdb.h"
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const char kReadOnlyError[] = "Error: Calendar is read-only after a write-ahead log failure; restart to recover.\n";
+
+bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v';
+}
+
+// A whole token as a decimal number in [min, max] ("+" allowed, as strtol did)
+bool parseNumber(std::string_view token, long min, long max, long& out) {
+    if (token.size() > 1 && token[0] == '+' && token[1] != '-') {
+        token.remove_prefix(1);
+    }
+    const char* end = token.data() + token.size();
+    std::from_chars_result parsed = std::from_chars(token.data(), end, out);
+    return parsed.ec == std::errc() && parsed.ptr == end && out >= min && out <= max;
+}
+
+}  // namespace
+
+CommandProcessor::CommandProcessor(CalendarService& calendar_service)
+    : calendar_service_(calendar_service) {
+}
+
+// Searched in order: the frequent commands first
+const CommandProcessor::Command CommandProcessor::kCommands[] = {
+    {"create", &CommandProcessor::handleCreate},
+    {"list", &CommandProcessor::handleList},
+    {"delete", &CommandProcessor::handleDelete},
+    {"free", &CommandProcessor::handleFree},
+    {"stats", &CommandProcessor::handleStats},
+    {"archive", &CommandProcessor::handleArchive},
+    {"checkpoint", &CommandProcessor::handleCheckpoint},
+    {"exit", &CommandProcessor::handleExit},
+};
+
+CommandStatus CommandProcessor::execute(std::string_view line, std::ostream& out) {
+    Tokens tokens;
+    if (!tokenize(line, tokens)) {
+        out << "Error: Unterminated quote.\n";
+        return CommandStatus::Error;
+    }
+    if (tokens.empty()) {
+        return CommandStatus::Ok;
+    }
+
+    for (const Command& command : kCommands) {
+        if (command.name == tokens[0]) {
+            return (this->*command.handler)(tokens, out);
+        }
+    }
+    for (const auto& command : extra_commands_) {
+        if (command.first == tokens[0]) {
+            return command.second(tokens, out);
+        }
+    }
+    out << "Error: Unknown command. Type 'exit' to quit.\n";
+    return CommandStatus::Error;
+}
+
+void CommandProcessor::addCommand(const std::string& name, CommandHandler handler) {
+    extra_commands_.emplace_back(name, std::move(handler));
+}
+
+void CommandProcessor::addFileCommands() {
+    addCommand("import", [this](const Tokens& tokens, std::ostream& out) { return handleImport(tokens, out); });
+    addCommand("export", [this](const Tokens& tokens, std::ostream& out) { return handleExport(tokens, out); });
+}
+
+void CommandProcessor::addReloadTzCommand() {
+    addCommand("reload-tz", [this](const Tokens& tokens, std::ostream& out) { return handleReloadTz(tokens, out); });
+}
+
+bool CommandProcessor::tokenize(std::string_view line, Tokens& tokens) {
+    tokens.clear();
+    size_t i = 0;
+    while (true) {
+        while (i < line.size() && isBlank(line[i])) {
+            i++;
+        }
+        if (i == line.size()) {
+            return true;
+        }
+        size_t begin = i;
+        if (line[i] == '"') {
+            // The closing quote is the first one followed by a blank or the end
+            size_t close = begin + 1;
+            while (close < line.size() &&
+                   (line[close] != '"' || (close + 1 < line.size() && !isBlank(line[close + 1])))) {
+                close++;
+            }
+            if (close == line.size()) {
+                return false;
+            }
+            tokens.push_back(line.substr(begin + 1, close - begin - 1));
+            i = close + 1;
+            continue;
+        }
+        while (i < line.size() && !isBlank(line[i])) {
+            i++;
+        }
+        tokens.push_back(line.substr(begin, i - begin));
+    }
+}
+
+std::string_view CommandProcessor::commandName(std::string_view line) {
+    size_t begin = 0;
+    while (begin < line.size() && isBlank(line[begin])) {
+        begin++;
+    }
+    size_t end = begin;
+    while (end < line.size() && !isBlank(line[end])) {
+        end++;
+    }
+    return line.substr(begin, end - begin);
+}
+
+CommandStatus CommandProcessor::handleExit(const Tokens&, std::ostream& out) {
+    out << "Goodbye!\n";
+    return CommandStatus::Exit;
+}
+
+CommandStatus CommandProcessor::handleList(const Tokens& tokens, std::ostream& out) {
+    if (tokens.size() > 1 && tokens[1] == "week") {
+        return handleListWeek(tokens, out);
+    }
+    out << "Error: Invalid list command. Use 'list week YYYY-MM-DD TZ [json]'\n";
+    return CommandStatus::Error;
+}
+
+CommandStatus CommandProcessor::handleCreate(const Tokens& tokens, std::ostream& out) {
+    if (tokens.size() != 6) {
+        out << "Error: Invalid create command. Usage: create \"Title\" YYYY-MM-DD HH:MM HH:MM TZ\n";
+        return CommandStatus::Error;
+    }
+
+    // Resolve the timezone once; every conversion below uses the handle
+    TzId tz = TimezoneUtils::resolveTimezone(std::string(tokens[5]));
+    if (!tz.isValid()) {
+        out << "Error: Invalid timezone. Use UTC, IST, PST or an IANA name (e.g. Europe/London)\n";
+        return CommandStatus::Error;
+    }
+
+    // Parse straight into structured values; no string round-trips
+    LocalDate date;
+    LocalTime start_time, end_time;
+    if (TimezoneUtils::parseDate(tokens[2], date) != ParseError::None ||
+        TimezoneUtils::parseTime(tokens[3], start_time) != ParseError::None ||
+        TimezoneUtils::parseTime(tokens[4], end_time) != ParseError::None) {
+        out << "Error: Invalid date or time format. Use YYYY-MM-DD and HH:MM\n";
+        return CommandStatus::Error;
+    }
+
+    // Convert to UTC. An end time at or before the start time means the
+    // event ends on the next day (e.g. 23:00-01:00).
+    UtcRange range;
+    if (!TimezoneUtils::eventRange(date, start_time, end_time, tz, range)) {
+        out << "Error: Invalid date or time format. Use YYYY-MM-DD and HH:MM\n";
+        return CommandStatus::Error;
+    }
+    time_t start_utc = range.start_utc;
+    time_t end_utc = range.end_utc;
+
+    int event_id = calendar_service_.createEvent(std::string(tokens[1]), start_utc, end_utc);
+
+    if (event_id == -1 && calendar_service_.isReadOnly()) {
+        out << kReadOnlyError;
+        return CommandStatus::Error;
+    }
+    if (event_id == -1) {
+        out << "Error: Failed to create event. Possible reasons:\n";
+        out << "  - End time must be after start time\n";
+        out << "  - Event conflicts with existing event\n";
+        return CommandStatus::Error;
+    }
+    out << "Event created successfully. ID: " << event_id << "\n";
+    return CommandStatus::Ok;
+}
+
+CommandStatus CommandProcessor::handleListWeek(const Tokens& tokens, std::ostream& out) {
+    bool json = tokens.size() == 5 && tokens[4] == "json";
+    if (tokens.size() != 4 && !json) {
+        out << "Error: Invalid list command. Usage: list week YYYY-MM-DD TZ [json]\n";
+        return CommandStatus::Error;
+    }
+
+    std::string tz_str(tokens[3]);
+
+    // Resolve the timezone once instead of per event
+    TzId tz = TimezoneUtils::resolveTimezone(tz_str);
+    if (!tz.isValid()) {
+        out << "Error: Invalid timezone. Use UTC, IST, PST or an IANA name (e.g. Europe/London)\n";
+        return CommandStatus::Error;
+    }
+
+    // Monday 00:00 to next Monday 00:00 in the user's timezone
+    UtcRange week;
+    LocalDate date;
+    if (TimezoneUtils::parseDate(tokens[2], date) != ParseError::None ||
+        !TimezoneUtils::weekBounds(date, tz, week)) {
+        out << "Error: Invalid date format. Use YYYY-MM-DD\n";
+        return CommandStatus::Error;
+    }
+
+    std::vector<Event> events = calendar_service_.getWeeklyEvents(week.start_utc, week.end_utc);
+
+    // One buffer, one write: big weeks were dominated by stream calls
+    std::string rendered;
+    renderEvents(events, tz, tz_str, json ? RenderFormat::Json : RenderFormat::Text, rendered);
+    out.write(rendered.data(), rendered.size());
+    return CommandStatus::Ok;
+}
+
+CommandStatus CommandProcessor::handleDelete(const Tokens& tokens, std::ostream& out) {
+    if (tokens.size() != 2) {
+        out << "Error: Invalid delete command. Usage: delete ID\n";
+        return CommandStatus::Error;
+    }
+
+    // from_chars instead of std::stoi: bad input must not throw out of a
+    // server worker
+    long parsed;
+    if (!parseNumber(tokens[1], 0, INT32_MAX, parsed)) {
+        out << "Error: Invalid event ID.\n";
+        return CommandStatus::Error;
+    }
+    int event_id = static_cast<int>(parsed);
+    bool deleted = calendar_service_.deleteEvent(event_id);
+
+    if (!deleted && calendar_service_.isReadOnly()) {
+        out << kReadOnlyError;
+        return CommandStatus::Error;
+    }
+    if (!deleted) {
+        out << "Error: Event " << event_id << " not found.\n";
+        return CommandStatus::Error;
+    }
+    out << "Event " << event_id << " deleted successfully.\n";
+    return CommandStatus::Ok;
+}
+
+CommandStatus CommandProcessor::handleArchive(const Tokens& tokens, std::ostream& out) {
+    if (tokens.size() != 3) {
+        out << "Error: Invalid archive command. Usage: archive YYYY-MM-DD TZ\n";
+        return CommandStatus::Error;
+    }
+
+    TzId tz = TimezoneUtils::resolveTimezone(std::string(tokens[2]));
+    if (!tz.isValid()) {
+        out << "Error: Invalid timezone. Use UTC, IST, PST or an IANA name (e.g. Europe/London)\n";
+        return CommandStatus::Error;
+    }
+    LocalDateTime midnight{};
+    if (TimezoneUtils::parseDate(std::string_view(tokens[1]), midnight.date) != ParseError::None) {
+        out << "Error: Invalid date format. Use YYYY-MM-DD\n";
+        return CommandStatus::Error;
+    }
+
+    // Everything that ended before that day starts
+    int archived = calendar_service_.archiveBefore(TimezoneUtils::toUTC(midnight, tz));
+    if (archived < 0 && calendar_service_.isReadOnly()) {
+        out << kReadOnlyError;
+        return CommandStatus::Error;
+    }
+    if (archived < 0) {
+        out << "Error: Archive failed (needs --data-dir).\n";
+        return CommandStatus::Error;
+    }
+    out << "Archived " << archived << " events.\n";
+    return CommandStatus::Ok;
+}
+
+CommandStatus CommandProcessor::handleStats(const Tokens& tokens, std::ostream& out) {
+    if (tokens.size() != 4) {
+        out << "Error: Invalid stats command. Usage: stats YYYY-MM-DD YYYY-MM-DD TZ\n";
+        return CommandStatus::Error;
+    }
+
+    TzId tz = TimezoneUtils::resolveTimezone(std::string(tokens[3]));
+    if (!tz.isValid()) {
+        out << "Error: Invalid timezone. Use UTC, IST, PST or an IANA name (e.g. Europe/London)\n";
+        return CommandStatus::Error;
+    }
+    LocalDate from, to;
+    if (TimezoneUtils::parseDate(std::string_view(tokens[1]), from) != ParseError::None ||
+        TimezoneUtils::parseDate(std::string_view(tokens[2]), to) != ParseError::None) {
+        out << "Error: Invalid date format. Use YYYY-MM-DD\n";
+        return CommandStatus::Error;
+    }
+    long long first_day = TimezoneUtils::daysFromCivil(from.year, from.month, from.day);
+    long long days = TimezoneUtils::daysFromCivil(to.year, to.month, to.day) - first_day + 1;
+    if (days < 1 || days > 3660) {
+        out << "Error: The range must be 1 to 3660 days.\n";
+        return CommandStatus::Error;
+    }
+
+    // Local midnights, so days with a DST change get their real length
+    std::vector<time_t> day_bounds;
+    day_bounds.reserve(days + 1);
+    for (long long d = 0; d <= days; d++) {
+        LocalDateTime midnight{TimezoneUtils::civilFromDays(first_day + d), LocalTime{0, 0}};
+        day_bounds.push_back(TimezoneUtils::toUTC(midnight, tz));
+    }
+
+    uint64_t count = calendar_service_.countEvents(day_bounds.front(), day_bounds.back());
+    int64_t busy_minutes = calendar_service_.sumDurations(day_bounds.front(), day_bounds.back()) / 60;
+    std::vector<int64_t> per_day = calendar_service_.busyMinutesPerDay(day_bounds);
+
+    out << "Events: " << count << "\n";
+    out << "Busy: " << busy_minutes / 60 << " h " << busy_minutes % 60 << " min\n";
+    for (size_t d = 0; d < per_day.size(); d++) {
+        if (per_day[d] > 0) {
+            LocalDate date = TimezoneUtils::civilFromDays(first_day + static_cast<long long>(d));
+            char label[16];
+            std::snprintf(label, sizeof(label), "%04d-%02d-%02d", date.year, date.month, date.day);
+            out << "  " << label << ": " << per_day[d] << " min\n";
+        }
+    }
+    return CommandStatus::Ok;
+}
+
+CommandStatus CommandProcessor::handleFree(const Tokens& tokens, std::ostream& out) {
+    if (tokens.size() != 4) {
+        out << "Error: Invalid free command. Usage: free YYYY-MM-DD MINUTES TZ\n";
+        return CommandStatus::Error;
+    }
+
+    TzId tz = TimezoneUtils::resolveTimezone(std::string(tokens[3]));
+    if (!tz.isValid()) {
+        out << "Error: Invalid timezone. Use UTC, IST, PST or an IANA name (e.g. Europe/London)\n";
+        return CommandStatus::Error;
+    }
+    LocalDateTime midnight{};
+    if (TimezoneUtils::parseDate(std::string_view(tokens[1]), midnight.date) != ParseError::None) {
+        out << "Error: Invalid date format. Use YYYY-MM-DD\n";
+        return CommandStatus::Error;
+    }
+    long minutes;
+    if (!parseNumber(tokens[2], 1, 24 * 60, minutes)) {
+        out << "Error: Invalid duration. Use 1 to 1440 minutes.\n";
+        return CommandStatus::Error;
+    }
+
+    // The local day, which is not always 24 hours long
+    time_t day_start = TimezoneUtils::toUTC(midnight, tz);
+    midnight.date = TimezoneUtils::addDays(midnight.date, 1);
+    time_t day_end = TimezoneUtils::toUTC(midnight, tz);
+
+    time_t slot_start;
+    if (!calendar_service_.findFreeSlot(day_start, day_end, minutes * 60, slot_start)) {
+        out << "No free slot of " << minutes << " minutes on " << tokens[1] << ".\n";
+        return CommandStatus::Ok;
+    }
+    const size_t width = TimezoneUtils::kLocalTimestampLength;
+    time_t times[2] = {slot_start, slot_start + minutes * 60};
+    char stamps[2 * width];
+    TimezoneUtils::formatLocalBatch(times, 2, tz, stamps);
+    out << "Free slot: ";
+    out.write(stamps, width) << " - ";
+    out.write(stamps + width, width) << " " << tokens[3] << "\n";
+    return CommandStatus::Ok;
+}
+
+CommandStatus CommandProcessor::handleImport(const Tokens& tokens, std::ostream& out) {
+    if (tokens.size() != 2) {
+        out << "Error: Invalid import command. Usage: import PATH\n";
+        return CommandStatus::Error;
+    }
+
+    ImportResult result;
+    if (!importEvents(calendar_service_, std::string(tokens[1]), 0, result)) {
+        out << "Error: Cannot read " << tokens[1] << ": " << std::strerror(errno) << "\n";
+        return CommandStatus::Error;
+    }
+    char summary[160];
+    std::snprintf(summary, sizeof(summary), "Imported %llu of %llu rows in %.2f s (%.0f rows/s).\n",
+                  static_cast<unsigned long long>(result.imported), static_cast<unsigned long long>(result.rows),
+                  result.seconds, result.seconds > 0 ? result.rows / result.seconds : 0.0);
+    out << summary;
+    if (result.invalid > 0 || result.rejected > 0) {
+        out << "Skipped " << result.invalid << " invalid and " << result.rejected << " rejected rows:\n";
+        for (size_t i = 0; i < result.problems.size() && i < 10; i++) {
+            out << "  line " << result.problems[i].line << ": " << result.problems[i].reason << "\n";
+        }
+    }
+    return CommandStatus::Ok;
+}
+
+CommandStatus CommandProcessor::handleExport(const Tokens& tokens, std::ostream& out) {
+    if (tokens.size() != 2) {
+        out << "Error: Invalid export command. Usage: export PATH\n";
+        return CommandStatus::Error;
+    }
+
+    std::string path(tokens[1]);
+    ExportResult result;
+    if (!exportEvents(calendar_service_, path, exportFormatFor(path), result)) {
+        if (result.unwritable_event_id >= 0) {
+            out << "Error: Cannot export event " << result.unwritable_event_id
+                << ": its time is outside years 0000-9999. Nothing was written.\n";
+        } else {
+            out << "Error: Cannot write " << tokens[1] << ": " << std::strerror(errno) << "\n";
+        }
+        return CommandStatus::Error;
+    }
+    char summary[160];
+    std::snprintf(summary, sizeof(summary), "Exported %llu events (%llu bytes) in %.2f s (%.0f events/s).\n",
+                  static_cast<unsigned long long>(result.events), static_cast<unsigned long long>(result.bytes),
+                  result.seconds, result.seconds > 0 ? result.events / result.seconds : 0.0);
+    out << summary;
+    return CommandStatus::Ok;
+}
+
+CommandStatus CommandProcessor::handleCheckpoint(const Tokens&, std::ostream& out) {
+    if (!calendar_service_.checkpoint()) {
+        out << "Error: Cannot start checkpoint (needs --data-dir; one may already be running).\n";
+        return CommandStatus::Error;
+    }
+    out << (calendar_service_.usesLsmEngine() ? "Memtable flushed to a run.\n"
+                                              : "Checkpoint started in the background.\n");
+    return CommandStatus::Ok;
+}
+
+CommandStatus CommandProcessor::handleReloadTz(const Tokens&, std::ostream& out) {
+    size_t reloaded = TzDatabase::instance().reload();
+    out << "Reloaded " << reloaded << " timezone" << (reloaded == 1 ? "" : "s") << " from "
+        << TzDatabase::instance().directory() << ".\n";
+    return CommandStatus::Ok;
+}
@@ -0,0 +1,134 @@
+#ifndef COMMAND_PROCESSOR_H
+#define COMMAND_PROCESSOR_H
+
+#include "calendar_service.h"
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * Outcome of one command line.
+ */
+enum class CommandStatus {
+    Ok,     // Done (also for blank lines)
+    Error,  // An "Error: ..." message was written
+    Exit    // The client asked to end the session
+};
+
+/**
+ * The calendar's text command grammar, independent of where the lines
+ * come from and where the replies go. Shared by the interactive CLI and
+ * the TCP server.
+ *
+ * Commands:
+ *   create "Title" YYYY-MM-DD HH:MM HH:MM TZ
+ *   list week YYYY-MM-DD TZ [json]
+ *   delete ID
+ *   checkpoint (with --data-dir)
+ *   archive YYYY-MM-DD TZ (with --data-dir)
+ *   stats YYYY-MM-DD YYYY-MM-DD TZ
+ *   free YYYY-MM-DD MINUTES TZ
+ *   reload-tz (re-read the zoneinfo files; see TzDatabase::reload; only after addReloadTzCommand)
+ *   import PATH (CSV or .ics; see importer.h; only after addFileCommands)
+ *   export PATH (CSV, or iCalendar for .ics; see exporter.h; only after addFileCommands)
+ *   exit
+ *
+ * Lines are split by tokenize() into views of the line and dispatched
+ * through a table of command names (see kCommands in the .cpp), so a
+ * command costs no string copies before its handler runs.
+ *
+ * Holds no state besides the commands added with addCommand: one
+ * processor may execute commands from many threads at once
+ * (CalendarService does the locking).
+ */
+class CommandProcessor {
+public:
+    /**
+     * Tokens of one line: views into it, valid while the line is.
+     */
+    typedef std::vector<std::string_view> Tokens;
+
+    /**
+     * A command a front end adds to the grammar (e.g. the CLI's demo).
+     */
+    typedef std::function<CommandStatus(const Tokens& tokens, std::ostream& out)> CommandHandler;
+
+    explicit CommandProcessor(CalendarService& calendar_service);
+
+    /**
+     * Parse and run one command line, writing the reply to out.
+     */
+    CommandStatus execute(std::string_view line, std::ostream& out);
+
+    /**
+     * Add a command after the built-in ones (which win on a name clash).
+     * Call before the processor is shared between threads.
+     */
+    void addCommand(const std::string& name, CommandHandler handler);
+
+    /**
+     * Add the commands that read or replace files by path (import,
+     * export). They run with the process's file access, so only a front
+     * end whose user is local (the CLI) adds them; the server never does.
+     * Same threading rule as addCommand.
+     */
+    void addFileCommands();
+
+    /**
+     * Add reload-tz. It re-parses every loaded zone on the calling thread,
+     * which would stall a server's event loop or worker, so only the CLI
+     * adds it; servers reload on SIGHUP instead (see reloadTimezones).
+     * Same threading rule as addCommand.
+     */
+    void addReloadTzCommand();
+
+    /**
+     * Split a line at runs of spaces and tabs. A token starting with a
+     * double quote runs to the next quote that ends a word, and is
+     * returned without the quotes and with its inner spacing intact:
+     *   create "Team  sync" 2025-01-10 ...  ->  create | Team  sync | 2025-01-10 | ...
+     *
+     * @return false if a quote is never closed (tokens then holds the
+     *         tokens before it)
+     */
+    static bool tokenize(std::string_view line, Tokens& tokens);
+
+    /**
+     * The first word of a line, for front ends that route some commands
+     * themselves (empty for a blank line).
+     */
+    static std::string_view commandName(std::string_view line);
+
+private:
+    CalendarService& calendar_service_;
+    std::vector<std::pair<std::string, CommandHandler>> extra_commands_;
+
+    typedef CommandStatus (CommandProcessor::*Handler)(const Tokens& tokens, std::ostream& out);
+
+    /**
+     * A built-in command: its name and handler.
+     */
+    struct Command {
+        std::string_view name;
+        Handler handler;
+    };
+    static const Command kCommands[];
+
+    CommandStatus handleExit(const Tokens& tokens, std::ostream& out);
+    CommandStatus handleList(const Tokens& tokens, std::ostream& out);
+    CommandStatus handleCreate(const Tokens& tokens, std::ostream& out);
+    CommandStatus handleListWeek(const Tokens& tokens, std::ostream& out);
+    CommandStatus handleDelete(const Tokens& tokens, std::ostream& out);
+    CommandStatus handleArchive(const Tokens& tokens, std::ostream& out);
+    CommandStatus handleStats(const Tokens& tokens, std::ostream& out);
+    CommandStatus handleFree(const Tokens& tokens, std::ostream& out);
+    CommandStatus handleImport(const Tokens& tokens, std::ostream& out);
+    CommandStatus handleExport(const Tokens& tokens, std::ostream& out);
+    CommandStatus handleCheckpoint(const Tokens& tokens, std::ostream& out);
+    CommandStatus handleReloadTz(const Tokens& tokens, std::ostream& out);
+};
+
+#endif // COMMAND_PROCESSOR_H
@@ -0,0 +1,19 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * CRC-32C (Castagnoli) checksum, as used by iSCSI, ext4 and most storage
+ * engines. Protects write-ahead log records and snapshot files against
+ * torn writes and bit rot.
+ *
+ * @param data Bytes to checksum
+ * @param length Number of bytes
+ * @param crc Previous result when checksumming in pieces (0 to start)
+ * @return Updated checksum
+ */
+uint32_t crc32c(const void* data, size_t length, uint32_t crc = 0);
+
+#endif // CRC32C_H
@@ -0,0 +1,233 @@
+#include "exporter.h"
+#include "file_util.h"
+#include "timezone.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <limits>
+#include <strings.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Events read per lock hold
+const size_t kPageEvents = 4096;
+
+// The buffer is written out once it holds this much
+const size_t kWriteBytes = 1 << 20;
+
+// iCalendar content lines are at most 75 octets before the CRLF
+const size_t kIcsLineOctets = 75;
+
+/**
+ * Formats into one buffer kept across pages and writes it out in large
+ * chunks; the first write error sticks.
+ */
+class OutputBuffer {
+public:
+    explicit OutputBuffer(int fd) : fd_(fd), bytes_(0), ok_(true) { buffer_.reserve(kWriteBytes + 4096); }
+
+    std::string& text() { return buffer_; }
+
+    void flushIfFull() {
+        if (buffer_.size() >= kWriteBytes) {
+            flush();
+        }
+    }
+
+    bool flush() {
+        if (ok_ && !buffer_.empty()) {
+            ok_ = FileUtil::writeAll(fd_, buffer_.data(), buffer_.size());
+            bytes_ += buffer_.size();
+        }
+        buffer_.clear();
+        return ok_;
+    }
+
+    bool ok() const { return ok_; }
+    uint64_t bytes() const { return bytes_; }
+
+private:
+    int fd_;
+    std::string buffer_;
+    uint64_t bytes_;
+    bool ok_;
+};
+
+// "YYYY-MM-DD HH:MM" in UTC; false for years past 9999
+bool writeUtcStamp(time_t t, char* out) {
+    return TimezoneUtils::writeLocalTimestamp(static_cast<long long>(t), out);
+}
+
+// False (appending nothing) if a time is outside years 0000-9999
+bool appendCsvRow(std::string& out, const Event& event) {
+    char start[TimezoneUtils::kLocalTimestampLength];
+    char end[TimezoneUtils::kLocalTimestampLength];
+    if (!writeUtcStamp(event.start_utc, start) || !writeUtcStamp(event.end_utc, end)) {
+        return false;
+    }
+    out.push_back('"');
+    for (char c : event.title) {
+        if (c == '"') {
+            out.push_back('"');
+        }
+        out.push_back(c);
+    }
+    out += "\",";
+    out.append(start, sizeof(start));
+    out.push_back(',');
+    out.append(end, sizeof(end));
+    out += ",UTC\n";
+    return true;
+}
+
+const size_t kIcsTimeLength = 16;
+
+// YYYYMMDDTHHMMSSZ (kIcsTimeLength chars); false outside years 0000-9999
+bool writeIcsTime(time_t t, char* ics) {
+    char stamp[TimezoneUtils::kLocalTimestampLength];
+    if (!writeUtcStamp(t, stamp)) {
+        return false;
+    }
+    long long seconds = ((static_cast<long long>(t) % 60) + 60) % 60;
+    const char fields[kIcsTimeLength] = {stamp[0], stamp[1], stamp[2], stamp[3], stamp[5], stamp[6], stamp[8],
+                                         stamp[9], 'T', stamp[11], stamp[12], stamp[14], stamp[15],
+                                         static_cast<char>('0' + seconds / 10), static_cast<char>('0' + seconds % 10),
+                                         'Z'};
+    std::memcpy(ics, fields, kIcsTimeLength);
+    return true;
+}
+
+// Append a property line, folding it without splitting UTF-8 sequences
+void appendFolded(std::string& out, const std::string& line) {
+    size_t start = 0;
+    size_t room = kIcsLineOctets;
+    while (line.size() - start > room) {
+        size_t cut = start + room;
+        while (cut > start + 1 && (static_cast<unsigned char>(line[cut]) & 0xC0) == 0x80) {
+            cut--;
+        }
+        out.append(line, start, cut - start);
+        out += "\r\n ";
+        start = cut;
+        room = kIcsLineOctets - 1;  // The leading space counts
+    }
+    out.append(line, start, std::string::npos);
+    out += "\r\n";
+}
+
+// False (appending nothing) if a time is outside years 0000-9999
+bool appendIcsEvent(std::string& out, std::string& line, const Event& event, const std::string& dtstamp) {
+    char start[kIcsTimeLength];
+    char end[kIcsTimeLength];
+    if (!writeIcsTime(event.start_utc, start) || !writeIcsTime(event.end_utc, end)) {
+        return false;
+    }
+    out += "BEGIN:VEVENT\r\nUID:";
+    out += std::to_string(event.id);
+    out += "@calendar\r\nDTSTAMP:";
+    out += dtstamp;
+    out += "\r\nDTSTART:";
+    out.append(start, sizeof(start));
+    out += "\r\nDTEND:";
+    out.append(end, sizeof(end));
+    out += "\r\n";
+
+    // TEXT escapes (RFC 5545 3.3.11). A line break (LF, CR or CRLF) is
+    // written as backslash-n, so it cannot end the property line early
+    line = "SUMMARY:";
+    const std::string& title = event.title;
+    for (size_t i = 0; i < title.size(); i++) {
+        char c = title[i];
+        if (c == '\r' || c == '\n') {
+            if (c == '\r' && i + 1 < title.size() && title[i + 1] == '\n') {
+                i++;
+            }
+            line += "\\n";
+            continue;
+        }
+        if (c == '\\' || c == ',' || c == ';') {
+            line.push_back('\\');
+        }
+        line.push_back(c);
+    }
+    appendFolded(out, line);
+    out += "END:VEVENT\r\n";
+    return true;
+}
+
+}  // namespace
+
+ExportResult::ExportResult() : events(0), bytes(0), seconds(0), unwritable_event_id(-1) {
+}
+
+ExportFormat exportFormatFor(const std::string& path) {
+    bool ics = path.size() >= 4 && strcasecmp(path.c_str() + path.size() - 4, ".ics") == 0;
+    return ics ? ExportFormat::Ics : ExportFormat::Csv;
+}
+
+bool exportEvents(CalendarService& calendar_service, const std::string& path, ExportFormat format,
+                  ExportResult& result) {
+    auto started = std::chrono::steady_clock::now();
+    result = ExportResult();
+
+    std::string tmp_path = path + ".tmp";
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    OutputBuffer output(fd);
+    std::string& out = output.text();
+    std::string line;
+    std::string dtstamp;
+    if (format == ExportFormat::Ics) {
+        char now[kIcsTimeLength];
+        writeIcsTime(time(nullptr), now);
+        dtstamp.assign(now, sizeof(now));
+        out += "BEGIN:VCALENDAR\r\nVERSION:2.0\r\nPRODID:-//calendar//export//EN\r\n";
+    } else {
+        out += "title,start,end,tz\n";
+    }
+
+    std::vector<Event> page;
+    time_t from = std::numeric_limits<time_t>::min();
+    bool written = true;
+    do {
+        calendar_service.getEventsPage(from, kPageEvents, page);
+        for (const Event& event : page) {
+            written = format == ExportFormat::Ics ? appendIcsEvent(out, line, event, dtstamp)
+                                                  : appendCsvRow(out, event);
+            if (!written) {
+                result.unwritable_event_id = event.id;
+                break;
+            }
+            result.events++;
+            output.flushIfFull();
+        }
+        if (!page.empty()) {
+            from = page.back().start_utc + 1;
+        }
+    } while (written && page.size() == kPageEvents && output.ok());
+
+    if (format == ExportFormat::Ics) {
+        out += "END:VCALENDAR\r\n";
+    }
+    bool ok = written && output.flush() && ::fdatasync(fd) == 0;
+    int saved = written ? errno : EOVERFLOW;
+    ::close(fd);
+    if (!ok || ::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        saved = ok ? errno : saved;
+        ::unlink(tmp_path.c_str());
+        errno = saved;
+        return false;
+    }
+    FileUtil::syncParentDirectory(path);
+    result.bytes = output.bytes();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include "calendar_service.h"
+#include <cstdint>
+#include <string>
+
+enum class ExportFormat { Csv, Ics };
+
+struct ExportResult {
+    uint64_t events;
+    uint64_t bytes;
+    double seconds;
+    int unwritable_event_id;  // >= 0: export failed at this event, its time is outside years 0000-9999
+
+    ExportResult();
+};
+
+/**
+ * The format export picks for a path: iCalendar for a .ics extension,
+ * CSV otherwise (the same rule as importEvents).
+ */
+ExportFormat exportFormatFor(const std::string& path);
+
+/**
+ * Write every event, live and archived, to a file that importEvents reads
+ * back:
+ * - CSV: a title,start,end,tz header, then one "Title",YYYY-MM-DD HH:MM,
+ *   YYYY-MM-DD HH:MM,UTC row per event (seconds are dropped).
+ * - iCalendar: one VEVENT per event with UTC DTSTART/DTEND, UID id@calendar
+ *   and SUMMARY escaped (line breaks as \n) and folded at 75 bytes.
+ *
+ * Memory stays constant in the calendar size: the events are read in
+ * pages (CalendarService::getEventsPage), each under a short lock hold,
+ * and formatted into one reusable buffer that goes out in large writes.
+ * The file is written as "<path>.tmp", fsynced and renamed over path at
+ * the end, then the directory is fsynced so the rename survives a crash.
+ * Not a point-in-time snapshot: events changed during the export may or
+ * may not appear.
+ *
+ * @return false on an I/O error (errno is kept) or at an event whose time
+ *         has no four-digit year (errno EOVERFLOW, unwritable_event_id set;
+ *         only events stored before creates checked their range); path is
+ *         left untouched either way
+ */
+bool exportEvents(CalendarService& calendar_service, const std::string& path, ExportFormat format,
+                  ExportResult& result);
+
+#endif // EXPORTER_H
@@ -0,0 +1,49 @@
+#ifndef FILE_UTIL_H
+#define FILE_UTIL_H
+
+#include <cstddef>
+#include <string>
+#include <sys/types.h>
+
+/**
+ * Small POSIX file helpers shared by the persistence code.
+ */
+namespace FileUtil {
+
+/**
+ * write() until every byte is written, retrying on EINTR and short writes.
+ *
+ * @return false on an I/O error
+ */
+bool writeAll(int fd, const char* data, size_t size);
+
+/**
+ * pwrite() until every byte is written at offset, like writeAll.
+ *
+ * @return false on an I/O error
+ */
+bool writeAllAt(int fd, const char* data, size_t size, off_t offset);
+
+/**
+ * fsync the directory containing path, making a newly created or renamed
+ * directory entry durable.
+ */
+void syncParentDirectory(const std::string& path);
+
+/**
+ * Replace path with data atomically: write "<path>.tmp", fsync, rename
+ * over path, fsync the directory. A crash leaves the old or the new file.
+ *
+ * @param pieces Buffers written back to back
+ * @param count Number of buffers
+ * @return false on an I/O error (path is left untouched)
+ */
+struct Piece {
+    const char* data;
+    size_t size;
+};
+bool writeFileAtomically(const std::string& path, const Piece* pieces, size_t count);
+
+}  // namespace FileUtil
+
+#endif // FILE_UTIL_H
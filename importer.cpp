@@ -0,0 +1,621 @@
+#include "importer.h"
+#include "timezone.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+// Events handed to CalendarService::createEvents at a time: large enough to
+// share one log flush, small enough not to hold the calendar lock for long
+const size_t kInsertBatch = 65536;
+
+const size_t kMaxProblems = 20;
+
+struct Row {
+    time_t start_utc;
+    time_t end_utc;
+    uint64_t line;
+    std::string title;
+};
+
+bool rowBefore(const Row& a, const Row& b) {
+    return a.start_utc != b.start_utc ? a.start_utc < b.start_utc : a.line < b.line;
+}
+
+/**
+ * One thread's share of the file. Lines are chunk-relative until the
+ * chunks are stitched back together.
+ */
+struct Chunk {
+    const char* begin;
+    const char* end;
+    bool first;
+    uint64_t lines;
+    uint64_t records;
+    uint64_t invalid;
+    std::vector<Row> rows;
+    std::vector<ImportProblem> problems;
+
+    Chunk(const char* b, const char* e, bool is_first)
+        : begin(b), end(e), first(is_first), lines(0), records(0), invalid(0) {}
+
+    void reject(uint64_t line, const char* reason) {
+        invalid++;
+        if (problems.size() < kMaxProblems) {
+            problems.push_back(ImportProblem{line, reason});
+        }
+    }
+};
+
+// "\n" or "\r\n" terminated lines of a chunk, numbered from 1
+class LineReader {
+public:
+    LineReader(const char* begin, const char* end) : p_(begin), end_(end), line_(0) {}
+
+    bool next(std::string_view& line) {
+        if (p_ >= end_) {
+            return false;
+        }
+        const char* newline = static_cast<const char*>(std::memchr(p_, '\n', end_ - p_));
+        const char* stop = newline ? newline : end_;
+        line = std::string_view(p_, stop - p_);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        p_ = newline ? newline + 1 : end_;
+        line_++;
+        return true;
+    }
+
+    // iCalendar folding: a line starting with a space or tab continues the last
+    bool continues() const { return p_ < end_ && (*p_ == ' ' || *p_ == '\t'); }
+
+    uint64_t line() const { return line_; }
+
+private:
+    const char* p_;
+    const char* end_;
+    uint64_t line_;
+};
+
+// Remembers the last zone name: files rarely mix many
+class ZoneCache {
+public:
+    ZoneCache() : valid_(false) {}
+
+    bool lookup(std::string_view name, TzId& tz) {
+        if (!valid_ || name != name_) {
+            name_.assign(name.data(), name.size());
+            tz_ = TimezoneUtils::resolveTimezone(name_);
+            valid_ = true;
+        }
+        tz = tz_;
+        return tz.isValid();
+    }
+
+private:
+    std::string name_;
+    TzId tz_;
+    bool valid_;
+};
+
+// ---------------------------------------------------------------------------
+// CSV
+
+// Split on commas outside double quotes; false on an unterminated quote
+bool splitCsv(std::string_view line, std::vector<std::string_view>& fields) {
+    fields.clear();
+    size_t start = 0;
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); i++) {
+        if (line[i] == '"') {
+            quoted = !quoted;
+        } else if (line[i] == ',' && !quoted) {
+            fields.push_back(line.substr(start, i - start));
+            start = i + 1;
+        }
+    }
+    fields.push_back(line.substr(start));
+    return !quoted;
+}
+
+void unquoteCsv(std::string_view field, std::string& out) {
+    out.clear();
+    if (field.size() < 2 || field.front() != '"' || field.back() != '"') {
+        out.assign(field.data(), field.size());
+        return;
+    }
+    field = field.substr(1, field.size() - 2);
+    for (size_t i = 0; i < field.size(); i++) {
+        out.push_back(field[i]);
+        if (field[i] == '"' && i + 1 < field.size() && field[i + 1] == '"') {
+            i++;
+        }
+    }
+}
+
+// Imported titles reach text clients in list replies like created ones,
+// where a control character (a newline above all) would break the framing
+bool isPrintableTitle(const std::string& title) {
+    for (char c : title) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (byte < 0x20 || byte == 0x7F) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// "YYYY-MM-DD HH:MM" or "YYYY-MM-DDTHH:MM"
+bool parseStamp(std::string_view s, LocalDateTime& out) {
+    return s.size() == 16 && (s[10] == ' ' || s[10] == 'T') &&
+           TimezoneUtils::parseDate(s.substr(0, 10), out.date) == ParseError::None &&
+           TimezoneUtils::parseTime(s.substr(11, 5), out.time) == ParseError::None;
+}
+
+void parseCsvChunk(Chunk& chunk) {
+    LineReader reader(chunk.begin, chunk.end);
+    ZoneCache zones;
+    std::vector<std::string_view> fields;
+    std::string value;
+    std::string_view line;
+    while (reader.next(line)) {
+        if (line.empty()) {
+            continue;
+        }
+        if (chunk.first && reader.line() == 1 && line.size() >= 6 && strncasecmp(line.data(), "title,", 6) == 0) {
+            continue;  // Header
+        }
+        chunk.records++;
+        uint64_t at = reader.line();
+        if (!splitCsv(line, fields) || fields.size() < 3 || fields.size() > 4) {
+            chunk.reject(at, "expected title,start,end[,tz]");
+            continue;
+        }
+
+        TzId tz;
+        unquoteCsv(fields.size() == 4 ? fields[3] : std::string_view("UTC"), value);
+        if (!zones.lookup(value, tz)) {
+            chunk.reject(at, "unknown timezone");
+            continue;
+        }
+        LocalDateTime start, end;
+        unquoteCsv(fields[1], value);
+        bool ok = parseStamp(value, start);
+        unquoteCsv(fields[2], value);
+        if (!ok || !parseStamp(value, end)) {
+            chunk.reject(at, "invalid date or time");
+            continue;
+        }
+        Row row;
+        row.start_utc = TimezoneUtils::toUTC(start, tz);
+        row.end_utc = TimezoneUtils::toUTC(end, tz);
+        if (row.end_utc <= row.start_utc) {
+            chunk.reject(at, "end is not after start");
+            continue;
+        }
+        row.line = at;
+        unquoteCsv(fields[0], row.title);
+        if (!isPrintableTitle(row.title)) {
+            chunk.reject(at, "title contains a control character");
+            continue;
+        }
+        chunk.rows.push_back(std::move(row));
+    }
+    chunk.lines = reader.line();
+}
+
+// ---------------------------------------------------------------------------
+// iCalendar
+
+struct IcsTime {
+    bool present;
+    bool date_only;
+    LocalDateTime local;
+    int seconds;
+    bool utc;             // Trailing Z
+    std::string tzid;     // Empty: UTC or floating
+
+    IcsTime() : present(false), date_only(false), local(), seconds(0), utc(false) {}
+};
+
+bool parseDigits(std::string_view s, int& out) {
+    out = 0;
+    for (char c : s) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        out = out * 10 + (c - '0');
+    }
+    return !s.empty();
+}
+
+// YYYYMMDD or YYYYMMDDTHHMMSS[Z], through the fixed-width date parsers
+bool parseIcsValue(std::string_view value, IcsTime& out) {
+    if (value.size() < 8) {
+        return false;
+    }
+    char date[10] = {value[0], value[1], value[2], value[3], '-', value[4], value[5], '-', value[6], value[7]};
+    if (TimezoneUtils::parseDate(std::string_view(date, 10), out.local.date) != ParseError::None) {
+        return false;
+    }
+    out.present = true;
+    if (value.size() == 8) {
+        out.date_only = true;
+        out.local.time = LocalTime{0, 0};
+        return true;
+    }
+    out.utc = value.size() == 16 && value[15] == 'Z';
+    if ((value.size() != 15 && !out.utc) || value[8] != 'T') {
+        return false;
+    }
+    char time[5] = {value[9], value[10], ':', value[11], value[12]};
+    return TimezoneUtils::parseTime(std::string_view(time, 5), out.local.time) == ParseError::None &&
+           parseDigits(value.substr(13, 2), out.seconds) && out.seconds < 60;
+}
+
+bool resolveIcsTime(const IcsTime& t, ZoneCache& zones, time_t& out) {
+    if (t.utc || t.tzid.empty()) {
+        out = static_cast<time_t>(TimezoneUtils::toLocalSeconds(t.local.date, t.local.time)) + t.seconds;
+        return true;
+    }
+    TzId tz;
+    if (!zones.lookup(t.tzid, tz)) {
+        return false;
+    }
+    out = TimezoneUtils::toUTC(t.local, tz) + t.seconds;
+    return true;
+}
+
+// [+]P[nW][nD][T[nH][nM][nS]]
+bool parseDuration(std::string_view s, int64_t& seconds) {
+    if (!s.empty() && s[0] == '+') {
+        s.remove_prefix(1);
+    }
+    if (s.size() < 3 || s[0] != 'P') {
+        return false;
+    }
+    seconds = 0;
+    bool in_time = false;
+    int64_t number = -1;
+    for (size_t i = 1; i < s.size(); i++) {
+        char c = s[i];
+        if (c >= '0' && c <= '9') {
+            number = (number < 0 ? 0 : number) * 10 + (c - '0');
+            if (number > 100000000) {
+                return false;
+            }
+            continue;
+        }
+        if (c == 'T' && !in_time && number < 0) {
+            in_time = true;
+            continue;
+        }
+        if (number < 0) {
+            return false;
+        }
+        int64_t unit = !in_time && c == 'W' ? 7 * 86400
+                     : !in_time && c == 'D' ? 86400
+                     : in_time && c == 'H'  ? 3600
+                     : in_time && c == 'M'  ? 60
+                     : in_time && c == 'S'  ? 1
+                                            : 0;
+        if (unit == 0) {
+            return false;
+        }
+        seconds += number * unit;
+        number = -1;
+    }
+    return number < 0;
+}
+
+void unescapeIcsText(std::string_view value, std::string& out) {
+    out.clear();
+    for (size_t i = 0; i < value.size(); i++) {
+        if (value[i] == '\\' && i + 1 < value.size()) {
+            char next = value[++i];
+            // Titles are single-line: newlines become spaces
+            out.push_back(next == 'n' || next == 'N' ? ' ' : next);
+        } else {
+            out.push_back(value[i]);
+        }
+    }
+}
+
+void parseIcsChunk(Chunk& chunk) {
+    LineReader reader(chunk.begin, chunk.end);
+    ZoneCache zones;
+    std::string folded;
+    std::string_view line;
+    bool in_event = false;
+    int depth = 0;  // Components (VALARM, ...) open inside the VEVENT
+    uint64_t event_line = 0;
+    std::string title;
+    IcsTime start, end;
+    int64_t duration = -1;
+    bool malformed = false;
+
+    while (reader.next(line)) {
+        if (reader.continues()) {
+            folded.assign(line.data(), line.size());
+            std::string_view more;
+            while (reader.continues() && reader.next(more)) {
+                folded.append(more.data() + 1, more.size() - 1);
+            }
+            line = folded;
+        }
+
+        if (line == "BEGIN:VEVENT") {
+            in_event = true;
+            depth = 0;
+            event_line = reader.line();
+            title.clear();
+            start = IcsTime();
+            end = IcsTime();
+            duration = -1;
+            malformed = false;
+            continue;
+        }
+        if (!in_event) {
+            continue;
+        }
+        if (line == "END:VEVENT") {
+            in_event = false;
+            chunk.records++;
+            Row row;
+            if (malformed || !start.present) {
+                chunk.reject(event_line, "missing or invalid DTSTART, DTEND or DURATION");
+                continue;
+            }
+            if (!resolveIcsTime(start, zones, row.start_utc)) {
+                chunk.reject(event_line, "unknown timezone");
+                continue;
+            }
+            if (end.present) {
+                if (!resolveIcsTime(end, zones, row.end_utc)) {
+                    chunk.reject(event_line, "unknown timezone");
+                    continue;
+                }
+            } else if (duration >= 0) {
+                row.end_utc = row.start_utc + duration;
+            } else if (start.date_only) {
+                // All-day event without an end: that one day
+                IcsTime next_day = start;
+                next_day.local.date = TimezoneUtils::addDays(start.local.date, 1);
+                resolveIcsTime(next_day, zones, row.end_utc);
+            } else {
+                chunk.reject(event_line, "missing or invalid DTSTART, DTEND or DURATION");
+                continue;
+            }
+            if (row.end_utc <= row.start_utc) {
+                chunk.reject(event_line, "end is not after start");
+                continue;
+            }
+            if (!isPrintableTitle(title)) {
+                chunk.reject(event_line, "title contains a control character");
+                continue;
+            }
+            row.line = event_line;
+            row.title = std::move(title);
+            chunk.rows.push_back(std::move(row));
+            continue;
+        }
+
+        // Properties of nested components (an alarm's SUMMARY, DURATION,
+        // ...) are not the event's
+        if (line.substr(0, 6) == "BEGIN:") {
+            depth++;
+            continue;
+        }
+        if (line.substr(0, 4) == "END:") {
+            depth -= depth > 0 ? 1 : 0;
+            continue;
+        }
+        if (depth > 0) {
+            continue;
+        }
+
+        // NAME[;PARAM=VALUE...]:VALUE, where parameter values may be quoted
+        size_t colon = std::string_view::npos;
+        bool quoted = false;
+        for (size_t i = 0; i < line.size(); i++) {
+            if (line[i] == '"') {
+                quoted = !quoted;
+            } else if (line[i] == ':' && !quoted) {
+                colon = i;
+                break;
+            }
+        }
+        if (colon == std::string_view::npos) {
+            continue;
+        }
+        std::string_view head = line.substr(0, colon);
+        std::string_view value = line.substr(colon + 1);
+        std::string_view name = head.substr(0, head.find(';'));
+
+        if (name == "SUMMARY") {
+            unescapeIcsText(value, title);
+        } else if (name == "DTSTART" || name == "DTEND") {
+            IcsTime& t = name == "DTSTART" ? start : end;
+            t = IcsTime();
+            size_t tzid = head.find(";TZID=");
+            if (tzid != std::string_view::npos) {
+                std::string_view zone = head.substr(tzid + 6);
+                zone = zone.substr(0, zone.find(';'));
+                if (zone.size() >= 2 && zone.front() == '"' && zone.back() == '"') {
+                    zone = zone.substr(1, zone.size() - 2);
+                }
+                t.tzid.assign(zone.data(), zone.size());
+            }
+            malformed = malformed || !parseIcsValue(value, t);
+        } else if (name == "DURATION") {
+            malformed = malformed || !parseDuration(value, duration);
+        }
+    }
+    chunk.lines = reader.line();
+}
+
+// ---------------------------------------------------------------------------
+
+bool looksLikeIcs(const std::string& path, const char* data, size_t size) {
+    if (path.size() >= 4 && strcasecmp(path.c_str() + path.size() - 4, ".ics") == 0) {
+        return true;
+    }
+    const char kBegin[] = "BEGIN:VCALENDAR";
+    size_t skip = size >= 3 && std::memcmp(data, "\xEF\xBB\xBF", 3) == 0 ? 3 : 0;  // UTF-8 BOM
+    return size - skip >= sizeof(kBegin) - 1 && std::memcmp(data + skip, kBegin, sizeof(kBegin) - 1) == 0;
+}
+
+// Start of the first record at or after pos
+const char* recordStart(const char* pos, const char* begin, const char* end, bool ics) {
+    if (pos <= begin) {
+        return begin;
+    }
+    if (!ics) {
+        const char* newline = static_cast<const char*>(std::memchr(pos - 1, '\n', end - (pos - 1)));
+        return newline ? newline + 1 : end;
+    }
+    std::string_view rest(pos - 1, end - (pos - 1));
+    size_t found = rest.find("\nBEGIN:VEVENT");
+    return found == std::string_view::npos ? end : rest.data() + found + 1;
+}
+
+void addProblem(std::vector<ImportProblem>& problems, uint64_t line, const std::string& reason) {
+    if (problems.size() < kMaxProblems) {
+        problems.push_back(ImportProblem{line, reason});
+    }
+}
+
+}  // namespace
+
+ImportResult::ImportResult() : rows(0), imported(0), invalid(0), rejected(0), seconds(0) {
+}
+
+bool importEvents(CalendarService& calendar_service, const std::string& path, int threads, ImportResult& result) {
+    auto started = std::chrono::steady_clock::now();
+    result = ImportResult();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    errno = 0;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        int saved = errno;
+        if (saved == 0 || !S_ISREG(st.st_mode)) {
+            saved = S_ISDIR(st.st_mode) ? EISDIR : EINVAL;
+        }
+        ::close(fd);
+        errno = saved;
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    if (size == 0) {
+        ::close(fd);
+        return true;
+    }
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int saved = errno;
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        errno = saved;
+        return false;
+    }
+    ::madvise(map, size, MADV_SEQUENTIAL);
+    const char* data = static_cast<const char*>(map);
+    bool ics = looksLikeIcs(path, data, size);
+
+    // One chunk per thread, at least 1 MiB each, cut on record starts
+    if (threads <= 0) {
+        unsigned cores = std::thread::hardware_concurrency();
+        threads = cores > 0 ? static_cast<int>(cores) : 4;
+    }
+    size_t count = std::max<size_t>(1, std::min<size_t>(threads, size / (1 << 20)));
+    std::vector<Chunk> chunks;
+    const char* begin = data;
+    for (size_t i = 1; i <= count; i++) {
+        const char* end = i == count ? data + size : recordStart(data + size * i / count, begin, data + size, ics);
+        if (end > begin) {
+            chunks.emplace_back(begin, end, begin == data);
+            begin = end;
+        }
+    }
+
+    std::vector<std::thread> workers;
+    for (Chunk& chunk : chunks) {
+        workers.emplace_back([&chunk, ics] {
+            if (ics) {
+                parseIcsChunk(chunk);
+            } else {
+                parseCsvChunk(chunk);
+            }
+            std::sort(chunk.rows.begin(), chunk.rows.end(), rowBefore);
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    ::munmap(map, size);
+
+    // Stitch: file-wide line numbers, then one sorted sequence
+    std::vector<Row> rows;
+    std::vector<size_t> bounds;
+    uint64_t first_line = 0;
+    for (Chunk& chunk : chunks) {
+        result.rows += chunk.records;
+        result.invalid += chunk.invalid;
+        for (ImportProblem& problem : chunk.problems) {
+            addProblem(result.problems, problem.line + first_line, problem.reason);
+        }
+        size_t merged = rows.size();
+        for (Row& row : chunk.rows) {
+            row.line += first_line;
+            rows.push_back(std::move(row));
+        }
+        std::inplace_merge(rows.begin(), rows.begin() + merged, rows.end(), rowBefore);
+        first_line += chunk.lines;
+        std::vector<Row>().swap(chunk.rows);
+    }
+
+    std::vector<NewEvent> batch;
+    std::vector<uint64_t> rejected;
+    for (size_t offset = 0; offset < rows.size(); offset += kInsertBatch) {
+        size_t stop = std::min(rows.size(), offset + kInsertBatch);
+        batch.clear();
+        for (size_t i = offset; i < stop; i++) {
+            batch.push_back(NewEvent{std::move(rows[i].title), rows[i].start_utc, rows[i].end_utc});
+        }
+        std::vector<int> ids = calendar_service.createEvents(batch);
+        for (size_t i = 0; i < ids.size(); i++) {
+            if (ids[i] >= 0) {
+                result.imported++;
+            } else {
+                result.rejected++;
+                rejected.push_back(rows[offset + i].line);
+            }
+        }
+    }
+
+    // Report the earliest lines of either kind
+    size_t keep = std::min(rejected.size(), kMaxProblems);
+    std::partial_sort(rejected.begin(), rejected.begin() + keep, rejected.end());
+    for (size_t i = 0; i < keep; i++) {
+        result.problems.push_back(ImportProblem{rejected[i], "conflicts with another event or the archived past"});
+    }
+    std::sort(result.problems.begin(), result.problems.end(),
+              [](const ImportProblem& a, const ImportProblem& b) { return a.line < b.line; });
+    if (result.problems.size() > kMaxProblems) {
+        result.problems.resize(kMaxProblems);
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return true;
+}
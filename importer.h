@@ -0,0 +1,52 @@
+#ifndef IMPORTER_H
+#define IMPORTER_H
+
+#include "calendar_service.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * A row the import skipped.
+ */
+struct ImportProblem {
+    uint64_t line;       // 1-based line of the row (of BEGIN:VEVENT for .ics)
+    std::string reason;
+};
+
+struct ImportResult {
+    uint64_t rows;       // Records found in the file
+    uint64_t imported;
+    uint64_t invalid;    // Unparsable, or ending before they start
+    uint64_t rejected;   // Refused by the calendar: conflicts, archived past
+    double seconds;
+    std::vector<ImportProblem> problems;  // The first few, by line
+
+    ImportResult();
+};
+
+/**
+ * Bulk-load events from a file into the calendar.
+ *
+ * Formats, chosen by the .ics extension or a leading BEGIN:VCALENDAR:
+ * - CSV, one event per line: title,start,end[,tz] with times as
+ *   "YYYY-MM-DD HH:MM" (or "YYYY-MM-DDTHH:MM") local to tz (default UTC).
+ *   Fields may be double-quoted ("" inside for a quote); a first line
+ *   starting with "title," is a header. Rows may not span lines.
+ * - iCalendar: every VEVENT's SUMMARY, DTSTART and DTEND or DURATION
+ *   (those of components nested in it, such as VALARM, are skipped).
+ *   Times may be UTC (...Z), carry a TZID parameter, be floating (taken as
+ *   UTC) or be dates (all-day). Folded lines and text escapes are handled.
+ *
+ * The file is mmap'd and split into one chunk per thread on record
+ * boundaries; the chunks are parsed in parallel, each sorted by start
+ * time, merged, and inserted in large createEvents batches. Sorted input
+ * keeps the index inserts local and makes conflicts inside the file
+ * deterministic: the earlier-starting event (then the earlier line) wins.
+ *
+ * @param threads Parser threads (0: one per core)
+ * @return false if the file cannot be read (errno is kept)
+ */
+bool importEvents(CalendarService& calendar_service, const std::string& path, int threads, ImportResult& result);
+
+#endif // IMPORTER_H
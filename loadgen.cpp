@@ -0,0 +1,594 @@
+#include "loadgen.h"
+#include "binary_protocol.h"
+#include "timezone.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <string_view>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_set>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Monday 2030-01-07 UTC: day 0 of the load's calendar
+const long long kFirstDay = TimezoneUtils::daysFromCivil(2030, 1, 7);
+
+const char* const kOpNames[kLoadOpCount] = {"create", "list", "delete", "free"};
+
+struct PlannedOp {
+    LoadOp type;
+    int64_t slot;     // Create: slot index over the whole range
+    bool fresh;       // Create: a slot this connection did not hold
+    int event_id;     // Delete
+    int day;          // List, free
+};
+
+// A request on the wire, answered in order
+struct Pending {
+    Clock::time_point issued;  // Scheduled time (open loop) or send time
+    std::vector<PlannedOp> ops;
+};
+
+std::string dayString(int day) {
+    LocalDate date = TimezoneUtils::civilFromDays(kFirstDay + day);
+    char buf[40];  // Fits any int fields (-Wformat-truncation at -O2)
+    std::snprintf(buf, sizeof(buf), "%04d-%02d-%02d", date.year, date.month, date.day);
+    return buf;
+}
+
+time_t dayStart(int day) {
+    return static_cast<time_t>((kFirstDay + day) * 86400LL);
+}
+
+class Client {
+public:
+    Client(const LoadOptions& options, int index)
+        : options_(options), index_(index), fd_(-1), in_pos_(0), scan_pos_(0),
+          rng_(options.seed * 1000003 + static_cast<uint64_t>(index)), slots_per_day_(1440 / options.slot_minutes),
+          broken_(false) {
+        lanes_ = std::max(1, slots_per_day_ / options.connections);
+    }
+
+    ~Client() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+
+    bool connect(std::string& error);
+    void runClosed(Clock::time_point end);
+    void runOpen(Clock::time_point start, Clock::time_point end);
+
+    // Receiving side's results
+    LoadReport report;
+
+private:
+    const LoadOptions& options_;
+    int index_;
+    int fd_;
+    std::string in_;
+    size_t in_pos_;
+    size_t scan_pos_;  // Text: no reply terminator before here
+    std::mt19937_64 rng_;
+    int slots_per_day_;
+    int lanes_;
+    bool broken_;
+
+    // Shared by the sending and receiving threads in open loop
+    std::mutex mutex_;
+    std::deque<Pending> in_flight_;
+    std::unordered_set<int64_t> held_slots_;             // Created or being created
+    std::vector<std::pair<int, int64_t>> created_;       // Acknowledged (ID, slot)
+
+    bool sendAll(const std::string& data);
+    bool fill();
+    bool nextReply(std::string_view& reply);
+
+    int pickDay();
+    PlannedOp plan();
+    void encode(const std::vector<PlannedOp>& ops, std::string& out);
+
+    // Send one request scheduled at `issued`
+    bool issue(Clock::time_point issued);
+
+    // Read and account for the oldest outstanding request's reply
+    bool complete();
+    void recordOp(const PlannedOp& op, bool ok, int event_id);
+};
+
+bool Client::connect(std::string& error) {
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(options_.port));
+    if (::inet_pton(AF_INET, options_.host.c_str(), &addr.sin_addr) != 1) {
+        error = "Invalid address " + options_.host;
+        return false;
+    }
+    fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0 || ::connect(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+        error = "Cannot connect to " + options_.host + ":" + std::to_string(options_.port) + ": " +
+                std::strerror(errno);
+        return false;
+    }
+    int one = 1;
+    ::setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (options_.binary && !sendAll(std::string(1, static_cast<char>(BinaryProtocol::kMagic)))) {
+        error = "Cannot send to the server";
+        return false;
+    }
+    if (options_.calendars > 0) {
+        std::string calendar = "lg-" + std::to_string(index_ % options_.calendars);
+        std::string use;
+        if (options_.binary) {
+            BinaryProtocol::RequestBuilder builder;
+            builder.addUse(calendar);
+            use = builder.finish();
+        } else {
+            use = "use " + calendar + "\n";
+        }
+        std::string_view reply;
+        std::vector<BinaryProtocol::OpResult> results;
+        bool ok = sendAll(use) && nextReply(reply);
+        if (ok && options_.binary) {
+            ok = BinaryProtocol::parseResponse(reply.data(), reply.size(), results) && results.size() == 1 &&
+                 results[0].status == BinaryProtocol::kOk;
+        } else if (ok) {
+            ok = reply.compare(0, 6, "Error:") != 0;
+        }
+        if (!ok) {
+            error = "Server does not take \"use\" (start it with --shards)";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Client::sendAll(const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd_, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool Client::fill() {
+    if (in_pos_ > 0 && in_pos_ * 2 >= in_.size()) {
+        in_.erase(0, in_pos_);
+        scan_pos_ -= std::min(scan_pos_, in_pos_);
+        in_pos_ = 0;
+    }
+    char buf[64 * 1024];
+    while (true) {
+        ssize_t n = ::recv(fd_, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        in_.append(buf, static_cast<size_t>(n));
+        return true;
+    }
+}
+
+bool Client::nextReply(std::string_view& reply) {
+    while (true) {
+        const char* data = in_.data() + in_pos_;
+        size_t size = in_.size() - in_pos_;
+        if (options_.binary) {
+            size_t header_size, payload_size;
+            int found = BinaryProtocol::findFrame(data, size, SIZE_MAX, header_size, payload_size);
+            if (found < 0) {
+                return false;
+            }
+            if (found > 0) {
+                reply = std::string_view(data + header_size, payload_size);
+                in_pos_ += header_size + payload_size;
+                return true;
+            }
+        } else if (size >= 2 && data[0] == '.' && data[1] == '\n') {
+            reply = std::string_view();
+            in_pos_ += 2;
+            scan_pos_ = in_pos_;
+            return true;
+        } else {
+            // A reply ends with a line holding a single "."
+            size_t end = in_.find("\n.\n", std::max(in_pos_, scan_pos_));
+            if (end != std::string::npos) {
+                reply = std::string_view(data, end + 1 - in_pos_);
+                in_pos_ = end + 3;
+                scan_pos_ = in_pos_;
+                return true;
+            }
+            scan_pos_ = in_.size() >= 2 ? in_.size() - 2 : 0;
+        }
+        if (!fill()) {
+            return false;
+        }
+    }
+}
+
+int Client::pickDay() {
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    int range = coin(rng_) < options_.locality ? options_.hot_days : options_.days;
+    return static_cast<int>(rng_() % static_cast<uint64_t>(range));
+}
+
+PlannedOp Client::plan() {
+    int total = 0;
+    for (int weight : options_.weights) {
+        total += weight;
+    }
+    int pick = static_cast<int>(rng_() % static_cast<uint64_t>(total));
+    int type = 0;
+    while (pick >= options_.weights[type]) {
+        pick -= options_.weights[type++];
+    }
+
+    PlannedOp op = {static_cast<LoadOp>(type), -1, false, -1, 0};
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (op.type == kLoadDelete) {
+        if (!created_.empty()) {
+            size_t victim = rng_() % created_.size();
+            op.event_id = created_[victim].first;
+            held_slots_.erase(created_[victim].second);
+            created_[victim] = created_.back();
+            created_.pop_back();
+            return op;
+        }
+        op.type = kLoadCreate;  // Nothing to delete yet
+    }
+    if (op.type != kLoadCreate) {
+        op.day = pickDay();
+        return op;
+    }
+
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    if (!created_.empty() && coin(rng_) < options_.conflict_rate) {
+        op.slot = created_[rng_() % created_.size()].second;  // Certain conflict
+        return op;
+    }
+    for (int attempt = 0; attempt < 8; attempt++) {
+        int lane = static_cast<int>(rng_() % static_cast<uint64_t>(lanes_));
+        int in_day = (index_ + lane * options_.connections) % slots_per_day_;
+        op.slot = static_cast<int64_t>(pickDay()) * slots_per_day_ + in_day;
+        if (held_slots_.insert(op.slot).second) {
+            op.fresh = true;
+            break;
+        }
+    }
+    return op;
+}
+
+void Client::encode(const std::vector<PlannedOp>& ops, std::string& out) {
+    if (!options_.binary) {
+        const PlannedOp& op = ops.front();
+        char line[128];
+        if (op.type == kLoadCreate) {
+            int day = static_cast<int>(op.slot / slots_per_day_);
+            int minute = static_cast<int>(op.slot % slots_per_day_) * options_.slot_minutes;
+            int end = (minute + options_.slot_minutes) % 1440;  // 00:00 is the next day
+            std::snprintf(line, sizeof(line), "create \"lg-%d\" %s %02d:%02d %02d:%02d UTC\n", index_,
+                          dayString(day).c_str(), minute / 60, minute % 60, end / 60, end % 60);
+        } else if (op.type == kLoadDelete) {
+            std::snprintf(line, sizeof(line), "delete %d\n", op.event_id);
+        } else if (op.type == kLoadList) {
+            std::snprintf(line, sizeof(line), "list week %s UTC\n", dayString(op.day).c_str());
+        } else {
+            std::snprintf(line, sizeof(line), "free %s %d UTC\n", dayString(op.day).c_str(),
+                          options_.slot_minutes);
+        }
+        out.append(line);
+        return;
+    }
+
+    BinaryProtocol::RequestBuilder builder;
+    for (const PlannedOp& op : ops) {
+        if (op.type == kLoadCreate) {
+            time_t start = dayStart(0) + static_cast<time_t>(op.slot) * options_.slot_minutes * 60;
+            builder.addCreate("lg-" + std::to_string(index_), start, start + options_.slot_minutes * 60);
+        } else if (op.type == kLoadDelete) {
+            builder.addDelete(op.event_id);
+        } else {
+            // Monday to Monday, as "list week" would ask
+            time_t week = dayStart(op.day - op.day % 7);
+            builder.addQuery(week, week + 7 * 86400);
+        }
+    }
+    out.append(builder.finish());
+}
+
+bool Client::issue(Clock::time_point issued) {
+    Pending pending;
+    pending.issued = issued;
+    int count = options_.binary ? options_.batch : 1;
+    for (int i = 0; i < count; i++) {
+        pending.ops.push_back(plan());
+    }
+    std::string request;
+    encode(pending.ops, request);
+    {
+        // Queued before it is sent, so the reply always finds it
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_flight_.push_back(std::move(pending));
+    }
+    return sendAll(request);
+}
+
+bool Client::complete() {
+    std::string_view reply;
+    if (!nextReply(reply)) {
+        return false;
+    }
+    Clock::time_point now = Clock::now();
+    Pending pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (in_flight_.empty()) {
+            return false;  // A reply nobody asked for
+        }
+        pending = std::move(in_flight_.front());
+        in_flight_.pop_front();
+    }
+    uint64_t nanos = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now - pending.issued).count());
+    report.requests++;
+    report.all.record(nanos);
+    for (const PlannedOp& op : pending.ops) {
+        report.latency[op.type].record(nanos);
+    }
+
+    if (!options_.binary) {
+        const PlannedOp& op = pending.ops.front();
+        bool ok = reply.compare(0, 6, "Error:") != 0;
+        int event_id = -1;
+        if (op.type == kLoadCreate && ok) {
+            size_t at = reply.find("ID: ");
+            ok = at != std::string_view::npos;
+            event_id = ok ? std::atoi(std::string(reply.substr(at + 4)).c_str()) : -1;
+        }
+        recordOp(op, ok, event_id);
+        return true;
+    }
+
+    std::vector<BinaryProtocol::OpResult> results;
+    if (!BinaryProtocol::parseResponse(reply.data(), reply.size(), results) ||
+        results.size() != pending.ops.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        recordOp(pending.ops[i], results[i].status == BinaryProtocol::kOk, results[i].event_id);
+    }
+    return true;
+}
+
+void Client::recordOp(const PlannedOp& op, bool ok, int event_id) {
+    report.ops[op.type]++;
+    if (!ok) {
+        report.failed[op.type]++;
+    }
+    if (op.type != kLoadCreate || !op.fresh) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ok) {
+        created_.emplace_back(event_id, op.slot);
+    } else {
+        held_slots_.erase(op.slot);
+    }
+}
+
+void Client::runClosed(Clock::time_point end) {
+    size_t outstanding = 0;
+    while (!broken_ && outstanding < static_cast<size_t>(options_.pipeline)) {
+        broken_ = !issue(Clock::now());
+        outstanding++;
+    }
+    while (!broken_ && outstanding > 0) {
+        broken_ = !complete();
+        outstanding--;
+        if (!broken_ && Clock::now() < end) {
+            broken_ = !issue(Clock::now());
+            outstanding++;
+        }
+    }
+    report.broken_connections = broken_ ? 1 : 0;
+}
+
+void Client::runOpen(Clock::time_point start, Clock::time_point end) {
+    std::thread receiver([this] {
+        // Until the server closes after answering everything
+        while (complete()) {
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        broken_ = broken_ || !in_flight_.empty();
+    });
+
+    std::exponential_distribution<double> gap(options_.rate / options_.connections);
+    Clock::time_point next = start;
+    while (true) {
+        next += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(gap(rng_)));
+        if (next >= end) {
+            break;
+        }
+        std::this_thread::sleep_until(next);
+        if (!issue(next)) {
+            break;
+        }
+    }
+    ::shutdown(fd_, SHUT_WR);
+    receiver.join();
+    report.broken_connections = broken_ ? 1 : 0;
+}
+
+}  // namespace
+
+LatencyHistogram::LatencyHistogram()
+    : counts_(bucketOf(UINT64_MAX) + 1, 0), total_(0), max_(0) {
+}
+
+size_t LatencyHistogram::bucketOf(uint64_t value) {
+    const uint64_t sub_buckets = 1ULL << kSubBucketBits;
+    if (value < sub_buckets) {
+        return static_cast<size_t>(value);
+    }
+    int shift = 63 - __builtin_clzll(value) - kSubBucketBits;
+    return static_cast<size_t>((shift + 1) * sub_buckets + ((value >> shift) & (sub_buckets - 1)));
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t bucket) {
+    const uint64_t sub_buckets = 1ULL << kSubBucketBits;
+    if (bucket < sub_buckets) {
+        return bucket;
+    }
+    int shift = static_cast<int>(bucket / sub_buckets) - 1;
+    uint64_t lower = (sub_buckets + bucket % sub_buckets) << shift;
+    return lower + ((1ULL << shift) - 1);
+}
+
+void LatencyHistogram::record(uint64_t nanos) {
+    counts_[bucketOf(nanos)]++;
+    total_++;
+    max_ = std::max(max_, nanos);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < counts_.size(); i++) {
+        counts_[i] += other.counts_[i];
+    }
+    total_ += other.total_;
+    max_ = std::max(max_, other.max_);
+}
+
+uint64_t LatencyHistogram::percentile(double quantile) const {
+    if (total_ == 0) {
+        return 0;
+    }
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(quantile * total_)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); i++) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return std::min(bucketUpperBound(i), max_);
+        }
+    }
+    return max_;
+}
+
+LoadOptions::LoadOptions()
+    : host("127.0.0.1"), port(7070), connections(16), duration_seconds(10), rate(0), pipeline(1),
+      binary(false), batch(1), weights{40, 40, 10, 10}, conflict_rate(0.05), locality(0.8), days(365),
+      hot_days(7), slot_minutes(15), calendars(0), seed(1) {
+}
+
+LoadReport::LoadReport()
+    : seconds(0), requests(0), ops{}, failed{}, broken_connections(0) {
+}
+
+bool runLoad(const LoadOptions& options, LoadReport& report, std::string& error) {
+    std::vector<std::unique_ptr<Client>> clients;
+    for (int i = 0; i < options.connections; i++) {
+        clients.emplace_back(new Client(options, i));
+        if (!clients.back()->connect(error)) {
+            return false;
+        }
+    }
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::seconds(options.duration_seconds);
+    std::vector<std::thread> threads;
+    for (auto& client : clients) {
+        Client* c = client.get();
+        if (options.rate > 0) {
+            threads.emplace_back([c, start, end] { c->runOpen(start, end); });
+        } else {
+            threads.emplace_back([c, end] { c->runClosed(end); });
+        }
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    report.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (auto& client : clients) {
+        const LoadReport& part = client->report;
+        report.requests += part.requests;
+        for (int op = 0; op < kLoadOpCount; op++) {
+            report.ops[op] += part.ops[op];
+            report.failed[op] += part.failed[op];
+            report.latency[op].merge(part.latency[op]);
+        }
+        report.all.merge(part.all);
+        report.broken_connections += part.broken_connections;
+    }
+    return true;
+}
+
+void printLoadReport(const LoadOptions& options, const LoadReport& report, std::ostream& out) {
+    char line[160];
+    if (options.rate > 0) {
+        std::snprintf(line, sizeof(line), "Open loop: %.0f requests/s target over %d connections", options.rate,
+                      options.connections);
+    } else {
+        std::snprintf(line, sizeof(line), "Closed loop: %d connections x %d in flight", options.connections,
+                      options.pipeline);
+    }
+    out << line << ", " << (options.binary ? "binary protocol, " + std::to_string(options.batch) + " ops/frame"
+                                           : std::string("text protocol"))
+        << "\n";
+
+    uint64_t ops = 0;
+    for (uint64_t count : report.ops) {
+        ops += count;
+    }
+    double seconds = report.seconds > 0 ? report.seconds : 1;
+    std::snprintf(line, sizeof(line), "%.2f s: %llu requests (%.0f/s), %llu operations (%.0f/s)\n", report.seconds,
+                  static_cast<unsigned long long>(report.requests), report.requests / seconds,
+                  static_cast<unsigned long long>(ops), ops / seconds);
+    out << line;
+    if (report.broken_connections > 0) {
+        out << "Warning: " << report.broken_connections << " connections ended early\n";
+    }
+
+    // Latencies in microseconds; per operation in binary mode means per frame carrying it
+    std::snprintf(line, sizeof(line), "%-8s %10s %8s %10s %10s %10s %10s\n", "op", "count", "failed", "p50 us",
+                  "p99 us", "p999 us", "max us");
+    out << line;
+    auto row = [&](const char* name, uint64_t count, const char* failed, const LatencyHistogram& latency) {
+        std::snprintf(line, sizeof(line), "%-8s %10llu %8s %10.1f %10.1f %10.1f %10.1f\n", name,
+                      static_cast<unsigned long long>(count), failed, latency.percentile(0.5) / 1000.0,
+                      latency.percentile(0.99) / 1000.0, latency.percentile(0.999) / 1000.0,
+                      latency.max() / 1000.0);
+        out << line;
+    };
+    for (int op = 0; op < kLoadOpCount; op++) {
+        if (report.ops[op] > 0) {
+            row(kOpNames[op], report.ops[op], std::to_string(report.failed[op]).c_str(), report.latency[op]);
+        }
+    }
+    row("request", report.requests, "", report.all);
+}
@@ -0,0 +1,104 @@
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Latency histogram with bounded relative error: power-of-two ranges, each
+ * split into 64 linear buckets, so any recorded value is reported within
+ * 1/64 (under 2%) without storing samples.
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(uint64_t nanos);
+    void merge(const LatencyHistogram& other);
+
+    uint64_t count() const { return total_; }
+    uint64_t max() const { return max_; }
+
+    /**
+     * @param quantile In [0, 1], e.g. 0.999
+     * @return Upper bound of the bucket holding that rank, in nanoseconds
+     *         (0 if nothing was recorded)
+     */
+    uint64_t percentile(double quantile) const;
+
+private:
+    static const int kSubBucketBits = 6;
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_;
+    uint64_t max_;
+
+    static size_t bucketOf(uint64_t value);
+    static uint64_t bucketUpperBound(size_t bucket);
+};
+
+enum LoadOp { kLoadCreate, kLoadList, kLoadDelete, kLoadFree, kLoadOpCount };
+
+/**
+ * What calendar-loadgen replays against a server.
+ *
+ * Times: events go on a grid of slot_minutes slots over `days` days from
+ * Monday 2030-01-07 UTC. With probability `locality` an operation targets
+ * one of the first hot_days days instead of any day. Each connection
+ * creates events only in its own lane of slots, so creates conflict only
+ * when asked to (conflict_rate: re-create a slot this connection already
+ * holds) or when there are more connections than slots per day.
+ */
+struct LoadOptions {
+    std::string host;
+    int port;
+    int connections;
+    int duration_seconds;
+
+    // Open loop: requests per second over all connections, sent on a
+    // Poisson schedule whatever the server's speed; latency counts from the
+    // scheduled time. 0: closed loop, `pipeline` requests in flight per
+    // connection, each reply triggering the next request.
+    double rate;
+    int pipeline;
+
+    bool binary;
+    int batch;  // Operations per binary frame
+
+    int weights[kLoadOpCount];  // Relative frequency of each operation
+    double conflict_rate;
+    double locality;
+    int days;
+    int hot_days;
+    int slot_minutes;
+    int calendars;  // > 0: spread connections over "use lg-N" calendars
+    uint64_t seed;
+
+    LoadOptions();
+};
+
+struct LoadReport {
+    double seconds;             // From the first request to the last reply
+    uint64_t requests;          // Lines or frames answered
+    uint64_t ops[kLoadOpCount];
+    uint64_t failed[kLoadOpCount];  // Conflicts, missing IDs, errors
+    LatencyHistogram latency[kLoadOpCount];
+    LatencyHistogram all;       // Per request
+    int broken_connections;     // Closed early or sent an unreadable reply
+
+    LoadReport();
+};
+
+/**
+ * Connect every client, replay the mix for options.duration_seconds and
+ * wait for the outstanding replies.
+ *
+ * @return false (with a message in error) if a connection cannot be made
+ */
+bool runLoad(const LoadOptions& options, LoadReport& report, std::string& error);
+
+void printLoadReport(const LoadOptions& options, const LoadReport& report, std::ostream& out);
+
+#endif // LOADGEN_H
@@ -0,0 +1,163 @@
+#include "loadgen.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+/**
+ * calendar-loadgen: replay an operation mix against calendar-server and
+ * report throughput and latency percentiles (see LoadOptions).
+ */
+
+namespace {
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --host ADDR           Server address (default 127.0.0.1)\n"
+              << "  --port N              Server port (default 7070)\n"
+              << "  --connections N       Client connections (default 16)\n"
+              << "  --duration S          Seconds of load (default 10)\n"
+              << "  --rate R              Open loop: R requests/s over all connections, Poisson\n"
+              << "                        arrivals (default 0: closed loop)\n"
+              << "  --pipeline N          Closed loop: requests in flight per connection (default 1)\n"
+              << "  --binary              Binary protocol (no free-slot operations)\n"
+              << "  --batch N             Binary: operations per frame (default 1)\n"
+              << "  --mix create=W,list=W,delete=W,free=W\n"
+              << "                        Relative operation weights (default 40,40,10,10)\n"
+              << "  --conflict-rate P     Share of creates aimed at a taken slot (default 0.05)\n"
+              << "  --locality P          Share of operations on the hot days (default 0.8)\n"
+              << "  --days N              Days the events spread over (default 365)\n"
+              << "  --hot-days N          Days of the hot set (default 7)\n"
+              << "  --slot-minutes N      Event length and grid, dividing 1440 (default 15)\n"
+              << "  --calendars N         Spread connections over N calendars with \"use\" (either protocol)\n"
+              << "                        (server started with --shards; default 0: one)\n"
+              << "  --seed N              Random seed (default 1)\n";
+}
+
+bool parseMix(const std::string& spec, int weights[kLoadOpCount]) {
+    const char* const names[kLoadOpCount] = {"create", "list", "delete", "free"};
+    for (int op = 0; op < kLoadOpCount; op++) {
+        weights[op] = 0;
+    }
+    std::istringstream in(spec);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        size_t equals = item.find('=');
+        if (equals == std::string::npos) {
+            return false;
+        }
+        std::string name = item.substr(0, equals);
+        char* end = nullptr;
+        long weight = std::strtol(item.c_str() + equals + 1, &end, 10);
+        if (*end != '\0' || weight < 0 || weight > 1000000) {
+            return false;
+        }
+        int op = 0;
+        while (op < kLoadOpCount && name != names[op]) {
+            op++;
+        }
+        if (op == kLoadOpCount) {
+            return false;
+        }
+        weights[op] = static_cast<int>(weight);
+    }
+    int total = 0;
+    for (int op = 0; op < kLoadOpCount; op++) {
+        total += weights[op];
+    }
+    return total > 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    LoadOptions options;
+    bool mix_given = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--binary") {
+            options.binary = true;
+            continue;
+        }
+        if (i + 1 < argc) {
+            const char* value = argv[++i];
+            bool ok = true;
+            if (arg == "--host") {
+                options.host = value;
+            } else if (arg == "--port") {
+                options.port = std::atoi(value);
+                ok = options.port > 0 && options.port <= 65535;
+            } else if (arg == "--connections") {
+                options.connections = std::atoi(value);
+                ok = options.connections > 0;
+            } else if (arg == "--duration") {
+                options.duration_seconds = std::atoi(value);
+                ok = options.duration_seconds > 0;
+            } else if (arg == "--rate") {
+                options.rate = std::atof(value);
+                ok = options.rate >= 0;
+            } else if (arg == "--pipeline") {
+                options.pipeline = std::atoi(value);
+                ok = options.pipeline > 0;
+            } else if (arg == "--batch") {
+                options.batch = std::atoi(value);
+                ok = options.batch > 0;
+            } else if (arg == "--mix") {
+                ok = mix_given = parseMix(value, options.weights);
+            } else if (arg == "--conflict-rate") {
+                options.conflict_rate = std::atof(value);
+                ok = options.conflict_rate >= 0 && options.conflict_rate <= 1;
+            } else if (arg == "--locality") {
+                options.locality = std::atof(value);
+                ok = options.locality >= 0 && options.locality <= 1;
+            } else if (arg == "--days") {
+                options.days = std::atoi(value);
+                ok = options.days > 0 && options.days <= 36500;
+            } else if (arg == "--hot-days") {
+                options.hot_days = std::atoi(value);
+                ok = options.hot_days > 0;
+            } else if (arg == "--slot-minutes") {
+                options.slot_minutes = std::atoi(value);
+                ok = options.slot_minutes > 0 && 1440 % options.slot_minutes == 0;
+            } else if (arg == "--calendars") {
+                options.calendars = std::atoi(value);
+                ok = options.calendars >= 0;
+            } else if (arg == "--seed") {
+                options.seed = std::strtoull(value, nullptr, 10);
+            } else {
+                ok = false;
+            }
+            if (ok) {
+                continue;
+            }
+        }
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    if (options.hot_days > options.days) {
+        options.hot_days = options.days;
+    }
+    if (options.binary) {
+        // The binary protocol has no free-slot operation
+        if (mix_given && options.weights[kLoadFree] > 0) {
+            std::cerr << "Error: free-slot operations need the text protocol\n";
+            return 2;
+        }
+        options.weights[kLoadFree] = 0;
+    } else if (options.batch != 1) {
+        std::cerr << "Error: --batch needs --binary\n";
+        return 2;
+    }
+
+    LoadReport report;
+    std::string error;
+    if (!runLoad(options, report, error)) {
+        std::cerr << "Error: " << error << "\n";
+        return 1;
+    }
+    printLoadReport(options, report, std::cout);
+    return report.broken_connections > 0 ? 1 : 0;
+}
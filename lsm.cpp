@@ -0,0 +1,722 @@
+#include "lsm.h"
+#include "file_util.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <dirent.h>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <queue>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char kManifestHeader[] = "calendar-lsm 1";
+
+Event keyOf(int id, time_t start_utc) {
+    return Event(id, "", start_utc, start_utc);
+}
+
+bool recordLess(const SnapshotRecord& r, const Event& key) {
+    if (r.start_utc != key.start_utc) {
+        return r.start_utc < key.start_utc;
+    }
+    return r.id < key.id;
+}
+
+bool recordKeyLess(const SnapshotRecord& a, const SnapshotRecord& b) {
+    if (a.start_utc != b.start_utc) {
+        return a.start_utc < b.start_utc;
+    }
+    return a.id < b.id;
+}
+
+// Merge sorted runs into one sorted stream, calling emit(file, index) for
+// each record kept until it returns false. An event and the tombstone that
+// deletes it (same key, in a newer input) are both dropped; a tombstone
+// meeting no event is kept only if keep_orphans (its event may be in a run
+// older than the inputs).
+template <typename Emit>
+bool mergeRecords(const std::vector<const SnapshotFile*>& files, bool keep_orphans, Emit emit) {
+    // Min-heap of (file, next index), ordered by the record there
+    typedef std::pair<size_t, size_t> Cursor;
+    auto record = [&files](const Cursor& c) -> const SnapshotRecord& { return files[c.first]->records()[c.second]; };
+    auto later = [&record](const Cursor& a, const Cursor& b) { return recordKeyLess(record(b), record(a)); };
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(later)> heap(later);
+    for (size_t f = 0; f < files.size(); f++) {
+        if (files[f]->size() > 0) {
+            heap.push(Cursor(f, 0));
+        }
+    }
+    auto advance = [&files, &heap](Cursor c) {
+        if (++c.second < files[c.first]->size()) {
+            heap.push(c);
+        }
+    };
+
+    while (!heap.empty()) {
+        Cursor least = heap.top();
+        heap.pop();
+        // Keys are unique per run, so an equal key is the other half of a
+        // deletion
+        if (!heap.empty() && !recordKeyLess(record(least), record(heap.top()))) {
+            Cursor twin = heap.top();
+            heap.pop();
+            advance(least);
+            advance(twin);
+            continue;
+        }
+        if ((!record(least).isTombstone() || keep_orphans) && !emit(*files[least.first], least.second)) {
+            return false;
+        }
+        advance(least);
+    }
+    return true;
+}
+
+// Parse "<prefix>NNNNNN<suffix>"; returns the number or -1
+long long fileNumber(const std::string& name, const std::string& prefix, const std::string& suffix) {
+    if (name.size() <= prefix.size() + suffix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+        return -1;
+    }
+    long long number = 0;
+    for (size_t i = prefix.size(); i < name.size() - suffix.size(); i++) {
+        if (name[i] < '0' || name[i] > '9' || number > 99999999999LL) {
+            return -1;
+        }
+        number = number * 10 + (name[i] - '0');
+    }
+    return number;
+}
+
+std::vector<long long> listNumbered(const std::string& dir, const std::string& prefix,
+                                    const std::string& suffix) {
+    std::vector<long long> numbers;
+    DIR* d = ::opendir(dir.c_str());
+    if (!d) {
+        return numbers;
+    }
+    while (struct dirent* entry = ::readdir(d)) {
+        long long number = fileNumber(entry->d_name, prefix, suffix);
+        if (number >= 0) {
+            numbers.push_back(number);
+        }
+    }
+    ::closedir(d);
+    std::sort(numbers.begin(), numbers.end());
+    return numbers;
+}
+
+}  // namespace
+
+LsmStore::LsmStore()
+    : next_log_number_(1), flushed_log_number_(0), next_run_number_(1), next_event_id_(1),
+      stopping_(false), busy_(false), failed_(false) {
+}
+
+LsmStore::~LsmStore() {
+    close();
+}
+
+std::string LsmStore::logPath(uint64_t number) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "wal-%06llu.log", static_cast<unsigned long long>(number));
+    return dir_ + "/" + name;
+}
+
+std::string LsmStore::runPath(int number) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "run-%06d.snap", number);
+    return dir_ + "/" + name;
+}
+
+bool LsmStore::open(const std::string& dir, const WalOptions& wal_options, const LsmOptions& options) {
+    close();
+    if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        return false;
+    }
+    dir_ = dir;
+    options_ = options;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    memtable_.clear();
+    tombstones_.clear();
+    memtable_ids_.clear();
+    frozen_.reset();
+    runs_.clear();
+    next_log_number_ = 1;
+    flushed_log_number_ = 0;
+    next_run_number_ = 1;
+    next_event_id_ = 1;
+    failed_ = false;
+    stopping_ = false;
+
+    std::vector<int> run_numbers;
+    if (!readManifest(run_numbers)) {
+        return false;
+    }
+    for (int number : run_numbers) {
+        std::shared_ptr<const Run> run = openRun(number);
+        if (!run) {
+            return false;
+        }
+        next_event_id_ = std::max(next_event_id_, run->file->nextEventId());
+        runs_.push_back(run);
+    }
+
+    // Leftovers of an interrupted flush or merge
+    for (long long number : listNumbered(dir_, "run-", ".snap")) {
+        if (std::find(run_numbers.begin(), run_numbers.end(), number) == run_numbers.end()) {
+            ::unlink(runPath(static_cast<int>(number)).c_str());
+        }
+        next_run_number_ = std::max<long long>(next_run_number_, number + 1);
+    }
+
+    // Sealed logs not yet in a run, oldest first, then the current log
+    next_log_number_ = flushed_log_number_ + 1;
+    for (long long number : listNumbered(dir_, "wal-", ".log")) {
+        uint64_t n = static_cast<uint64_t>(number);
+        if (n <= flushed_log_number_) {
+            ::unlink(logPath(n).c_str());
+            continue;
+        }
+        if (!replayLog(logPath(n))) {
+            return false;
+        }
+        next_log_number_ = std::max(next_log_number_, n + 1);
+    }
+    if (!replayLog(dir_ + "/wal.log") || !wal_.open(dir_ + "/wal.log", wal_options)) {
+        return false;
+    }
+
+    worker_ = std::thread(&LsmStore::workerLoop, this);
+    if (memtable_.size() + tombstones_.size() >= options_.memtable_limit) {
+        freezeLocked();
+    }
+    return true;
+}
+
+void LsmStore::close() {
+    if (worker_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        work_cv_.notify_all();
+        worker_.join();
+    }
+    wal_.close();
+}
+
+bool LsmStore::readManifest(std::vector<int>& run_numbers) {
+    std::ifstream in(dir_ + "/MANIFEST");
+    if (!in) {
+        flushed_log_number_ = 0;
+        return true;  // Fresh store
+    }
+    std::string line;
+    if (!std::getline(in, line) || line != kManifestHeader) {
+        return false;
+    }
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        long long value;
+        if (!(fields >> key >> value) || value < 0) {
+            return false;
+        }
+        if (key == "flushed_log") {
+            flushed_log_number_ = static_cast<uint64_t>(value);
+        } else if (key == "next_run") {
+            next_run_number_ = static_cast<int>(value);
+        } else if (key == "run") {
+            run_numbers.push_back(static_cast<int>(value));
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LsmStore::writeManifest(const std::vector<int>& run_numbers, uint64_t flushed_log_number) {
+    std::ostringstream out;
+    out << kManifestHeader << "\n";
+    out << "flushed_log " << flushed_log_number << "\n";
+    out << "next_run " << next_run_number_ << "\n";
+    for (int number : run_numbers) {
+        out << "run " << number << "\n";
+    }
+    std::string text = out.str();
+    FileUtil::Piece piece = {text.data(), text.size()};
+    return FileUtil::writeFileAtomically(dir_ + "/MANIFEST", &piece, 1);
+}
+
+std::shared_ptr<const LsmStore::Run> LsmStore::openRun(int number) const {
+    std::shared_ptr<Run> run(new Run());
+    run->number = number;
+    run->file.reset(new SnapshotFile());
+    // Runs are read sparsely by queries; only the header is verified
+    if (!run->file->open(runPath(number), false)) {
+        return nullptr;
+    }
+
+    const SnapshotRecord* records = run->file->records();
+    size_t n = run->file->size();
+    run->min_start = n > 0 ? records[0].start_utc : 0;
+    run->max_start = n > 0 ? records[n - 1].start_utc : -1;
+    run->max_end = std::numeric_limits<time_t>::min();
+    // Events in a run do not overlap, so the last one ends last
+    for (size_t i = n; i > 0; i--) {
+        if (!records[i - 1].isTombstone()) {
+            run->max_end = records[i - 1].end_utc;
+            break;
+        }
+    }
+    run->by_id.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        if (!records[i].isTombstone()) {
+            run->by_id.emplace_back(records[i].id, static_cast<uint32_t>(i));
+        }
+    }
+    std::sort(run->by_id.begin(), run->by_id.end());
+    return run;
+}
+
+bool LsmStore::replayLog(const std::string& path) {
+    return WriteAheadLog::replay(path, [this](const WalRecord& record) {
+        if (record.type == WalRecord::Create) {
+            memtable_.insert(Event(record.event_id, record.title, record.start_utc, record.end_utc));
+            memtable_ids_[record.event_id] = record.start_utc;
+            next_event_id_ = std::max(next_event_id_, record.event_id + 1);
+        } else if (record.type == WalRecord::Delete) {
+            Event key = keyOf(record.event_id, record.start_utc);
+            if (memtable_.erase(key) != 0) {
+                memtable_ids_.erase(record.event_id);
+            } else {
+                tombstones_.insert(key);  // The event is in a run
+            }
+        }
+    });
+}
+
+int LsmStore::nextEventId() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return next_event_id_;
+}
+
+size_t LsmStore::runCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return runs_.size();
+}
+
+bool LsmStore::deletedAbove(const Event& key, int run_level) const {
+    if (tombstones_.count(key) != 0) {
+        return true;
+    }
+    if (run_level < 0) {
+        return false;
+    }
+    if (frozen_ && frozen_->tombstones.count(key) != 0) {
+        return true;
+    }
+    for (int i = 0; i < run_level; i++) {
+        const Run& run = *runs_[i];
+        if (key.start_utc < run.min_start || key.start_utc > run.max_start) {
+            continue;
+        }
+        const SnapshotRecord* begin = run.file->records();
+        const SnapshotRecord* end = begin + run.file->size();
+        const SnapshotRecord* it = std::lower_bound(begin, end, key, recordLess);
+        if (it != end && it->start_utc == key.start_utc && it->id == key.id && it->isTombstone()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename Visit>
+void LsmStore::forEachOverlapping(time_t start_utc, time_t end_utc, Visit visit) const {
+    Event search = keyOf(0, start_utc);
+
+    // Memtable events are never shadowed: deleting one erases it
+    auto it = memtable_.lower_bound(search);
+    if (it != memtable_.begin() && std::prev(it)->end_utc > start_utc) {
+        --it;
+    }
+    for (; it != memtable_.end() && it->start_utc < end_utc; ++it) {
+        if (!visit(SnapshotEventView{it->id, it->start_utc, it->end_utc, it->title})) {
+            return;
+        }
+    }
+
+    if (frozen_) {
+        const EventSet& events = frozen_->events;
+        auto f = events.lower_bound(search);
+        if (f != events.begin() && std::prev(f)->end_utc > start_utc) {
+            --f;
+        }
+        for (; f != events.end() && f->start_utc < end_utc; ++f) {
+            if (!deletedAbove(*f, -1) &&
+                !visit(SnapshotEventView{f->id, f->start_utc, f->end_utc, f->title})) {
+                return;
+            }
+        }
+    }
+
+    for (size_t level = 0; level < runs_.size(); level++) {
+        const Run& run = *runs_[level];
+        if (run.min_start >= end_utc || run.max_end <= start_utc) {
+            continue;  // Time filter: the run cannot overlap the range
+        }
+        const SnapshotRecord* records = run.file->records();
+        size_t n = run.file->size();
+        size_t i = std::lower_bound(records, records + n, start_utc,
+                                    [](const SnapshotRecord& r, time_t t) { return r.start_utc < t; }) -
+                   records;
+        // The last event starting before the range may run into it;
+        // tombstones in between have no extent
+        size_t back = i;
+        while (back > 0 && records[back - 1].isTombstone()) {
+            back--;
+        }
+        if (back > 0 && records[back - 1].end_utc > start_utc) {
+            i = back - 1;
+        }
+        for (; i < n && records[i].start_utc < end_utc; i++) {
+            if (records[i].isTombstone()) {
+                continue;
+            }
+            SnapshotEventView view = run.file->event(i);
+            if (!deletedAbove(keyOf(view.id, view.start_utc), static_cast<int>(level)) && !visit(view)) {
+                return;
+            }
+        }
+    }
+}
+
+bool LsmStore::overlaps(time_t start_utc, time_t end_utc) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool found = false;
+    forEachOverlapping(start_utc, end_utc, [&found](const SnapshotEventView&) {
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+void LsmStore::query(time_t start_utc, time_t end_utc, std::vector<Event>& out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t first = out.size();
+    forEachOverlapping(start_utc, end_utc, [&out](const SnapshotEventView& view) {
+        out.emplace_back(view.id, std::string(view.title), view.start_utc, view.end_utc);
+        return true;
+    });
+    std::sort(out.begin() + first, out.end(), EventComparator());
+}
+
+void LsmStore::page(time_t from_utc, size_t limit, std::vector<Event>& out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t first = out.size();
+    Event search = keyOf(0, from_utc);
+
+    // Every level's first limit live events hold the merged first limit
+    size_t taken = 0;
+    for (auto it = memtable_.lower_bound(search); it != memtable_.end() && taken < limit; ++it, taken++) {
+        out.push_back(*it);
+    }
+    if (frozen_) {
+        taken = 0;
+        const EventSet& events = frozen_->events;
+        for (auto it = events.lower_bound(search); it != events.end() && taken < limit; ++it) {
+            if (!deletedAbove(*it, -1)) {
+                out.push_back(*it);
+                taken++;
+            }
+        }
+    }
+    for (size_t level = 0; level < runs_.size(); level++) {
+        const Run& run = *runs_[level];
+        if (run.max_start < from_utc) {
+            continue;
+        }
+        const SnapshotRecord* records = run.file->records();
+        size_t n = run.file->size();
+        size_t i = std::lower_bound(records, records + n, search, recordLess) - records;
+        for (taken = 0; i < n && taken < limit; i++) {
+            if (records[i].isTombstone()) {
+                continue;
+            }
+            SnapshotEventView view = run.file->event(i);
+            if (!deletedAbove(keyOf(view.id, view.start_utc), static_cast<int>(level))) {
+                out.emplace_back(view.id, std::string(view.title), view.start_utc, view.end_utc);
+                taken++;
+            }
+        }
+    }
+
+    std::sort(out.begin() + first, out.end(), EventComparator());
+    if (out.size() - first > limit) {
+        out.resize(first + limit);
+    }
+}
+
+uint64_t LsmStore::insert(const Event& event) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t lsn = wal_.append(WalRecord{WalRecord::Create, event.id, event.start_utc, event.end_utc,
+                                         event.title});
+    memtable_.insert(event);
+    memtable_ids_[event.id] = event.start_utc;
+    next_event_id_ = std::max(next_event_id_, event.id + 1);
+    if (memtable_.size() + tombstones_.size() >= options_.memtable_limit) {
+        freezeLocked();
+    }
+    return lsn;
+}
+
+void LsmStore::rollback(const Event& event) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (memtable_.erase(event) != 0) {
+        memtable_ids_.erase(event.id);
+        return;
+    }
+    // Frozen since: its sealed log or run may hold the create, so delete it
+    // like a live event. Not logged (the log just failed); the flush of
+    // this memtable writes the tombstone to a run
+    tombstones_.insert(keyOf(event.id, event.start_utc));
+}
+
+bool LsmStore::erase(int event_id, uint64_t& lsn) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // An event lives in exactly one level: stop at the one indexing its ID
+    auto live = memtable_ids_.find(event_id);
+    if (live != memtable_ids_.end()) {
+        lsn = wal_.append(WalRecord{WalRecord::Delete, event_id, live->second, 0, ""});
+        memtable_.erase(keyOf(event_id, live->second));
+        memtable_ids_.erase(live);
+        return true;
+    }
+
+    Event key;
+    bool found = false;
+    if (frozen_) {
+        auto it = frozen_->ids.find(event_id);
+        if (it != frozen_->ids.end()) {
+            key = keyOf(event_id, it->second);
+            if (deletedAbove(key, -1)) {
+                return false;
+            }
+            found = true;
+        }
+    }
+    for (size_t level = 0; level < runs_.size() && !found; level++) {
+        const Run& run = *runs_[level];
+        auto it = std::lower_bound(run.by_id.begin(), run.by_id.end(), std::make_pair(event_id, uint32_t(0)));
+        if (it == run.by_id.end() || it->first != event_id) {
+            continue;
+        }
+        const SnapshotRecord& record = run.file->records()[it->second];
+        key = keyOf(record.id, record.start_utc);
+        if (deletedAbove(key, static_cast<int>(level))) {
+            return false;
+        }
+        found = true;
+    }
+    if (!found) {
+        return false;
+    }
+
+    lsn = wal_.append(WalRecord{WalRecord::Delete, event_id, key.start_utc, 0, ""});
+    tombstones_.insert(key);
+    if (memtable_.size() + tombstones_.size() >= options_.memtable_limit) {
+        freezeLocked();
+    }
+    return true;
+}
+
+bool LsmStore::waitDurable(uint64_t lsn) {
+    return wal_.waitDurable(lsn);
+}
+
+void LsmStore::freezeLocked() {
+    if (frozen_ || failed_ || (memtable_.empty() && tombstones_.empty())) {
+        return;  // Still writing the previous one: the memtable keeps growing
+    }
+    uint64_t number = next_log_number_;
+    if (!wal_.rotate(logPath(number))) {
+        return;
+    }
+    next_log_number_++;
+
+    std::shared_ptr<Frozen> frozen(new Frozen());
+    frozen->events.swap(memtable_);
+    frozen->tombstones.swap(tombstones_);
+    frozen->ids.swap(memtable_ids_);
+    frozen->log_number = number;
+    frozen->next_event_id = next_event_id_;
+    frozen_ = frozen;
+    work_cv_.notify_one();
+}
+
+bool LsmStore::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Wait out a flush in progress, then freeze whatever accumulated since
+    idle_cv_.wait(lock, [this] { return failed_ || !frozen_; });
+    freezeLocked();
+    idle_cv_.wait(lock, [this] {
+        size_t first;
+        return failed_ || (!frozen_ && !busy_ && mergeCandidateLocked(first) == 0);
+    });
+    return !failed_;
+}
+
+void LsmStore::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        work_cv_.wait(lock, [this] {
+            size_t first;
+            return stopping_ || (!failed_ && (frozen_ || mergeCandidateLocked(first) > 0));
+        });
+        if (stopping_) {
+            break;
+        }
+        busy_ = true;
+        bool ok = frozen_ ? flushFrozen(lock) : mergeRuns(lock);
+        busy_ = false;
+        if (!ok) {
+            failed_ = true;
+        }
+        idle_cv_.notify_all();
+    }
+}
+
+bool LsmStore::flushFrozen(std::unique_lock<std::mutex>& lock) {
+    std::shared_ptr<const Frozen> frozen = frozen_;
+    int number = next_run_number_++;
+    lock.unlock();
+
+    // The frozen memtable is immutable: write it without the lock
+    std::vector<Event> events(frozen->events.begin(), frozen->events.end());
+    std::vector<Event> tombstones(frozen->tombstones.begin(), frozen->tombstones.end());
+    bool ok = SnapshotFile::write(runPath(number), events, frozen->next_event_id, tombstones);
+    std::shared_ptr<const Run> run = ok ? openRun(number) : nullptr;
+
+    lock.lock();
+    if (!run) {
+        return false;
+    }
+    // Swap the frozen memtable for the run in one step, so readers see
+    // these events exactly once
+    runs_.insert(runs_.begin(), run);
+    frozen_.reset();
+    flushed_log_number_ = frozen->log_number;
+
+    std::vector<int> run_numbers;
+    for (const auto& r : runs_) {
+        run_numbers.push_back(r->number);
+    }
+    lock.unlock();
+    ok = writeManifest(run_numbers, frozen->log_number);
+    if (ok) {
+        ::unlink(logPath(frozen->log_number).c_str());
+        FileUtil::syncParentDirectory(dir_ + "/MANIFEST");
+    }
+    lock.lock();
+    return ok;
+}
+
+size_t LsmStore::mergeCandidateLocked(size_t& first) const {
+    size_t width = std::max<size_t>(options_.merge_width, 2);
+    // Runs smaller than a memtable (forced flushes) all share the first tier
+    auto weight = [this](size_t level) { return std::max(runs_[level]->file->size(), options_.memtable_limit); };
+
+    // A window grows over older runs at most twice its largest. It is due
+    // when width of its runs are at least half the largest: the output is
+    // then twice any input's size or more, which bounds the rewrites of an
+    // event by the log of the store's size. Smaller runs caught in between
+    // ride along instead of being stranded between bigger neighbours.
+    for (size_t begin = 0; begin + width <= runs_.size(); begin++) {
+        size_t largest = weight(begin);
+        size_t end = begin + 1;
+        while (end < runs_.size() && weight(end) <= 2 * largest) {
+            largest = std::max(largest, weight(end));
+            end++;
+        }
+        size_t peers = 0;
+        for (size_t level = begin; level < end; level++) {
+            peers += 2 * weight(level) >= largest ? 1 : 0;
+        }
+        if (peers >= width) {
+            first = begin;
+            return end - begin;
+        }
+    }
+    return 0;
+}
+
+bool LsmStore::mergeRuns(std::unique_lock<std::mutex>& lock) {
+    size_t first = 0;
+    size_t count = mergeCandidateLocked(first);
+    if (count == 0) {
+        return true;
+    }
+    std::vector<std::shared_ptr<const Run>> inputs(runs_.begin() + first, runs_.begin() + first + count);
+    // Tombstones can only refer to older runs: with the oldest in the merge,
+    // one that meets no event refers to nothing
+    bool keep_orphans = first + count < runs_.size();
+    int number = next_run_number_++;
+    lock.unlock();
+
+    std::vector<const SnapshotFile*> files;
+    int next_event_id = 1;
+    for (const auto& run : inputs) {
+        files.push_back(run->file.get());
+        next_event_id = std::max(next_event_id, run->file->nextEventId());
+    }
+
+    // Two passes over the same merge: size the output, then stream it
+    size_t records = 0;
+    size_t title_bytes = 0;
+    mergeRecords(files, keep_orphans, [&](const SnapshotFile& file, size_t i) {
+        records++;
+        title_bytes += file.records()[i].isTombstone() ? 0 : file.event(i).title.size();
+        return true;
+    });
+    SnapshotWriter writer;
+    bool ok = writer.open(runPath(number), records, title_bytes) &&
+              mergeRecords(files, keep_orphans, [&writer](const SnapshotFile& file, size_t i) {
+                  return writer.add(file.event(i), file.records()[i].isTombstone());
+              }) &&
+              writer.finish(next_event_id);
+    std::shared_ptr<const Run> run = ok ? openRun(number) : nullptr;
+
+    lock.lock();
+    if (!run) {
+        return false;
+    }
+    // The merged run takes the inputs' place among the levels
+    auto position = std::find(runs_.begin(), runs_.end(), inputs.front());
+    position = runs_.erase(position, position + inputs.size());
+    runs_.insert(position, run);
+
+    std::vector<int> run_numbers;
+    for (const auto& r : runs_) {
+        run_numbers.push_back(r->number);
+    }
+    uint64_t flushed = flushed_log_number_;
+    lock.unlock();
+    ok = writeManifest(run_numbers, flushed);
+    if (ok) {
+        for (const auto& input : inputs) {
+            ::unlink(runPath(input->number).c_str());
+        }
+    }
+    files.clear();
+    inputs.clear();  // Unmaps the inputs; no reader can reach them any more
+    lock.lock();
+    return ok;
+}
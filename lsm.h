@@ -0,0 +1,250 @@
+#ifndef LSM_H
+#define LSM_H
+
+#include "event.h"
+#include "snapshot.h"
+#include "wal.h"
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct LsmOptions {
+    size_t memtable_limit;  // Events + tombstones in the memtable before it is flushed
+    size_t merge_width;     // Adjacent runs of similar size merged into one
+
+    LsmOptions() : memtable_limit(100000), merge_width(4) {}
+};
+
+/**
+ * Write-optimized event storage (log-structured merge).
+ *
+ * Levels, newest first:
+ * - memtable: the usual ordered set of events plus a set of tombstones
+ *   (deletions of events stored in older levels)
+ * - frozen memtable: a full memtable being written out, read-only
+ * - runs: immutable sorted files in the snapshot format, mmap'd; tombstones
+ *   are records with SnapshotRecord::kTombstone
+ *
+ * Writes only touch the write-ahead log and the memtable, so their cost
+ * does not grow with the calendar. When the memtable reaches
+ * memtable_limit it is frozen (the log is sealed with it) and a background
+ * thread writes it as a new run.
+ *
+ * Compaction is size-tiered: once merge_width adjacent runs are of similar
+ * size (within a factor of two, runs smaller than a memtable counting as
+ * memtable-sized), the same thread merges them, and any smaller runs
+ * between them, into one run that takes their place. Each event is thus rewritten about once per tier,
+ * O(log(events / memtable_limit)) times, rather than by every merge. The
+ * merge streams the inputs into a SnapshotWriter, so it holds no events
+ * in memory. An event and the tombstone deleting it are dropped when both
+ * are in the merge; a tombstone is dropped with no event once the merge
+ * includes the oldest run.
+ *
+ * Each event key (start_utc, id) is created once, so an event exists in
+ * exactly one level and a tombstone only ever refers to an older level.
+ * Every level also indexes its events by ID, so erase looks an ID up level
+ * by level and stops at the one holding it.
+ * Queries merge the levels: every run has a [min start, max end] filter
+ * that skips it for ranges it cannot overlap, and a run's candidates are
+ * checked against the tombstones of newer levels.
+ *
+ * Files in the directory:
+ *   MANIFEST         runs in use and the last log number they include
+ *   wal.log          current log
+ *   wal-NNNNNN.log   sealed logs not yet written to a run
+ *   run-NNNNNN.snap  runs
+ * Recovery opens the runs named in MANIFEST and replays the sealed logs
+ * it does not cover, then wal.log. Files left over from an interrupted
+ * flush or merge are ignored and deleted.
+ *
+ * Thread-safe. Conflict check + insert is not atomic here; callers that
+ * need it serialize (CalendarService holds its mutex).
+ */
+class LsmStore {
+public:
+    LsmStore();
+    ~LsmStore();
+
+    LsmStore(const LsmStore&) = delete;
+    LsmStore& operator=(const LsmStore&) = delete;
+
+    /**
+     * Recover the store in dir (creating it if needed) and start the
+     * background thread.
+     *
+     * @return false on an I/O error or a corrupt file
+     */
+    bool open(const std::string& dir, const WalOptions& wal_options, const LsmOptions& options);
+
+    /**
+     * Stop the background thread and close the log. A frozen memtable that
+     * was not written yet is recovered from its sealed log on reopen.
+     */
+    void close();
+
+    /**
+     * One past the highest event ID ever stored (valid after open).
+     */
+    int nextEventId();
+
+    /**
+     * Does any live event overlap [start_utc, end_utc)?
+     */
+    bool overlaps(time_t start_utc, time_t end_utc);
+
+    /**
+     * Live events overlapping [start_utc, end_utc), sorted, appended to out.
+     */
+    void query(time_t start_utc, time_t end_utc, std::vector<Event>& out);
+
+    /**
+     * The first limit live events starting at or after from_utc, sorted,
+     * appended to out. Reads at most limit events per level.
+     */
+    void page(time_t from_utc, size_t limit, std::vector<Event>& out);
+
+    /**
+     * Log and insert an event (may freeze the memtable).
+     *
+     * @return Log sequence number for waitDurable
+     */
+    uint64_t insert(const Event& event);
+
+    /**
+     * Undo an insert whose log record never became durable. If the memtable
+     * was frozen since, the event is hidden by a tombstone, which a later
+     * flush makes durable.
+     */
+    void rollback(const Event& event);
+
+    /**
+     * Log and apply the deletion of a live event.
+     *
+     * @param lsn Set to the log sequence number for waitDurable
+     * @return false if no live event has this ID
+     */
+    bool erase(int event_id, uint64_t& lsn);
+
+    bool waitDurable(uint64_t lsn);
+
+    /**
+     * Write the memtable to a run now and wait until the background thread
+     * is idle (including any merge that triggers).
+     *
+     * @return false if the background thread hit an I/O error
+     */
+    bool flush();
+
+    /**
+     * Number of runs on disk (for status output and tuning).
+     */
+    size_t runCount();
+
+private:
+    typedef std::set<Event, EventComparator> EventSet;
+
+    struct Run {
+        int number;
+        std::unique_ptr<SnapshotFile> file;
+        // Time filter: no event in the run starts before min_start or
+        // after max_start, and none ends after max_end
+        time_t min_start;
+        time_t max_start;
+        time_t max_end;
+        // (event ID, record index) of every event, sorted by ID, for erase
+        std::vector<std::pair<int, uint32_t>> by_id;
+    };
+
+    struct Frozen {
+        EventSet events;
+        EventSet tombstones;
+        std::unordered_map<int, time_t> ids;  // Event ID -> start_utc
+        uint64_t log_number;  // Sealed log holding exactly these changes
+        int next_event_id;
+    };
+
+    std::string dir_;
+    LsmOptions options_;
+    WriteAheadLog wal_;
+
+    std::mutex mutex_;
+    std::condition_variable work_cv_;  // Background thread has something to do
+    std::condition_variable idle_cv_;  // Background thread finished a job
+
+    EventSet memtable_;
+    EventSet tombstones_;
+    std::unordered_map<int, time_t> memtable_ids_;  // Event ID -> start_utc of memtable_
+    std::shared_ptr<const Frozen> frozen_;
+    std::vector<std::shared_ptr<const Run>> runs_;  // Newest first
+
+    uint64_t next_log_number_;
+    uint64_t flushed_log_number_;  // Every sealed log up to this is in a run
+    int next_run_number_;
+    int next_event_id_;
+
+    std::thread worker_;
+    bool stopping_;
+    bool busy_;
+    bool failed_;  // Sticky background I/O error; flushing stops
+
+    std::string logPath(uint64_t number) const;
+    std::string runPath(int number) const;
+
+    /**
+     * Map a run file and compute its time filter and ID index.
+     */
+    std::shared_ptr<const Run> openRun(int number) const;
+
+    /**
+     * Atomically record the current runs and flushed log number. Called by
+     * the background thread only, without mutex_ (contents passed in).
+     */
+    bool writeManifest(const std::vector<int>& run_numbers, uint64_t flushed_log_number);
+
+    bool readManifest(std::vector<int>& run_numbers);
+
+    /**
+     * Replay a log into the memtable. Caller holds mutex_ (or is opening).
+     */
+    bool replayLog(const std::string& path);
+
+    /**
+     * Seal the log and hand the memtable to the background thread, unless
+     * a frozen memtable is still pending. Caller holds mutex_.
+     */
+    void freezeLocked();
+
+    /**
+     * Is the event with this key deleted by a tombstone in a level newer
+     * than run index run_level (-1: the frozen memtable)? Caller holds mutex_.
+     */
+    bool deletedAbove(const Event& key, int run_level) const;
+
+    /**
+     * Visit live events of every level overlapping [start_utc, end_utc)
+     * until visit returns false. Caller holds mutex_.
+     */
+    template <typename Visit>
+    void forEachOverlapping(time_t start_utc, time_t end_utc, Visit visit) const;
+
+    void workerLoop();
+    bool flushFrozen(std::unique_lock<std::mutex>& lock);
+    bool mergeRuns(std::unique_lock<std::mutex>& lock);
+
+    /**
+     * The newest window of runs due for a merge: sets first to the index
+     * of its newest run and returns its length, or 0 if none is due.
+     * Caller holds mutex_.
+     */
+    size_t mergeCandidateLocked(size_t& first) const;
+};
+
+#endif // LSM_H
@@ -1,209 +1,39 @@
 #include <iostream>
 #include <sstream>
-#include <iomanip>
 #include <string>
 #include <vector>
 #include <mutex>
 #include <thread>
 #include <atomic>
+#include <cstdio>
+#include <cstdlib>
 #include <ctime>
+#include <chrono>
 #include "calendar_service.h"
-#include "timezone.h"
+#include "command_processor.h"
+#include "storage_options.h"
 
 /**
  * CLI interface for the Calendar Management System.
  * 
- * Commands:
- *   create "Title" YYYY-MM-DD HH:MM HH:MM TZ
- *   list week YYYY-MM-DD TZ
- *   delete ID
+ * Reads commands from stdin and runs them through CommandProcessor (see
+ * command_processor.h for the grammar), plus:
  *   demo (concurrency demonstration)
- *   exit
+ *
+ * With --batch, stdin is a command file: no banner or prompt, buffered
+ * output, and a non-zero exit status if any command failed.
  */
 
+/**
+ * What --batch prints: every reply, only the replies of failed commands
+ * (--quiet), or only a closing count (--summary).
+ */
+enum class BatchOutput { All, Errors, Summary };
+
 class CLI {
 private:
     CalendarService calendar_service_;
-
-    /**
-     * Split a string by whitespace, handling quoted strings.
-     */
-    std::vector<std::string> parseCommand(const std::string& line) {
-        std::vector<std::string> tokens;
-        std::istringstream iss(line);
-        std::string token;
-        bool in_quotes = false;
-        std::string quoted_token;
-
-        while (iss >> token) {
-            if (token.front() == '"') {
-                in_quotes = true;
-                quoted_token = token.substr(1);  // Remove leading quote
-                if (token.back() == '"' && token.length() > 1) {
-                    // Single token in quotes
-                    quoted_token = quoted_token.substr(0, quoted_token.length() - 1);
-                    tokens.push_back(quoted_token);
-                    in_quotes = false;
-                }
-            } else if (in_quotes) {
-                quoted_token += " " + token;
-                if (token.back() == '"') {
-                    quoted_token = quoted_token.substr(0, quoted_token.length() - 1);
-                    tokens.push_back(quoted_token);
-                    in_quotes = false;
-                }
-            } else {
-                tokens.push_back(token);
-            }
-        }
-
-        return tokens;
-    }
-
-    /**
-     * Calculate week start (Monday) and end (Sunday) for a given date.
-     */
-    void calculateWeekBounds(const std::string& date_str, const std::string& tz_str,
-                             time_t& week_start_utc, time_t& week_end_utc) {
-        // Convert date at midnight (00:00) to UTC
-        time_t date_utc = TimezoneUtils::localToUTC(date_str, "00:00", tz_str);
-        if (date_utc == -1) {
-            week_start_utc = -1;
-            week_end_utc = -1;
-            return;
-        }
-
-        // Get day of week (0=Sunday, 1=Monday, ..., 6=Saturday)
-        struct tm* tm_utc = gmtime(&date_utc);
-        if (!tm_utc) {
-            week_start_utc = -1;
-            week_end_utc = -1;
-            return;
-        }
-        int day_of_week = tm_utc->tm_wday;
-        
-        // Calculate days to Monday (if Sunday, go back 6 days; otherwise go back (day-1) days)
-        int days_to_monday = (day_of_week == 0) ? 6 : (day_of_week - 1);
-        
-        // Week start: Monday 00:00:00 UTC
-        week_start_utc = date_utc - (days_to_monday * 24LL * 3600LL);
-        
-        // Week end: Monday 00:00:00 UTC of next week
-        week_end_utc = week_start_utc + (7LL * 24LL * 3600LL);
-    }
-
-    void handleCreate(const std::vector<std::string>& tokens) {
-        if (tokens.size() != 6) {
-            std::cout << "Error: Invalid create command. Usage: create \"Title\" YYYY-MM-DD HH:MM HH:MM TZ\n";
-            return;
-        }
-
-        std::string title = tokens[1];
-        std::string date_str = tokens[2];
-        std::string start_time_str = tokens[3];
-        std::string end_time_str = tokens[4];
-        std::string tz_str = tokens[5];
-
-        if (!TimezoneUtils::isValidTimezone(tz_str)) {
-            std::cout << "Error: Invalid timezone. Supported: UTC, IST, PST\n";
-            return;
-        }
-
-        // Convert to UTC
-        time_t start_utc = TimezoneUtils::localToUTC(date_str, start_time_str, tz_str);
-        time_t end_utc = TimezoneUtils::localToUTC(date_str, end_time_str, tz_str);
-
-        if (start_utc == -1 || end_utc == -1) {
-            std::cout << "Error: Invalid date or time format. Use YYYY-MM-DD and HH:MM\n";
-            return;
-        }
-
-        // Handle case where end time is on next day
-        if (end_utc <= start_utc) {
-            // Try next day
-            struct tm* tm_start = gmtime(&start_utc);
-            struct tm tm_end = *tm_start;
-            tm_end.tm_mday += 1;
-            time_t next_day = mktime(&tm_end);
-            if (next_day != -1) {
-                // Recalculate end_utc with next day
-                std::ostringstream oss;
-                oss << std::setfill('0')
-                    << std::setw(4) << (tm_end.tm_year + 1900) << "-"
-                    << std::setw(2) << (tm_end.tm_mon + 1) << "-"
-                    << std::setw(2) << tm_end.tm_mday;
-                std::string next_date_str = oss.str();
-                end_utc = TimezoneUtils::localToUTC(next_date_str, end_time_str, tz_str);
-            }
-        }
-
-        int event_id = calendar_service_.createEvent(title, start_utc, end_utc);
-
-        if (event_id == -1) {
-            std::cout << "Error: Failed to create event. Possible reasons:\n";
-            std::cout << "  - End time must be after start time\n";
-            std::cout << "  - Event conflicts with existing event\n";
-        } else {
-            std::cout << "Event created successfully. ID: " << event_id << "\n";
-        }
-    }
-
-    void handleListWeek(const std::vector<std::string>& tokens) {
-        if (tokens.size() != 4) {
-            std::cout << "Error: Invalid list command. Usage: list week YYYY-MM-DD TZ\n";
-            return;
-        }
-
-        std::string date_str = tokens[2];
-        std::string tz_str = tokens[3];
-
-        if (!TimezoneUtils::isValidTimezone(tz_str)) {
-            std::cout << "Error: Invalid timezone. Supported: UTC, IST, PST\n";
-            return;
-        }
-
-        time_t week_start_utc, week_end_utc;
-        calculateWeekBounds(date_str, tz_str, week_start_utc, week_end_utc);
-
-        if (week_start_utc == -1) {
-            std::cout << "Error: Invalid date format. Use YYYY-MM-DD\n";
-            return;
-        }
-
-        std::vector<Event> events = calendar_service_.getWeeklyEvents(week_start_utc, week_end_utc);
-
-        if (events.empty()) {
-            std::cout << "No events found for this week.\n";
-        } else {
-            std::cout << "\nWeekly Events:\n";
-            std::cout << "----------------------------------------\n";
-            for (const auto& event : events) {
-                std::string start_local = TimezoneUtils::utcToLocal(event.start_utc, tz_str);
-                std::string end_local = TimezoneUtils::utcToLocal(event.end_utc, tz_str);
-                std::cout << "ID: " << event.id << "\n";
-                std::cout << "Title: " << event.title << "\n";
-                std::cout << "Start: " << start_local << " " << tz_str << "\n";
-                std::cout << "End: " << end_local << " " << tz_str << "\n";
-                std::cout << "----------------------------------------\n";
-            }
-        }
-    }
-
-    void handleDelete(const std::vector<std::string>& tokens) {
-        if (tokens.size() != 2) {
-            std::cout << "Error: Invalid delete command. Usage: delete ID\n";
-            return;
-        }
-
-        int event_id = std::stoi(tokens[1]);
-        bool deleted = calendar_service_.deleteEvent(event_id);
-
-        if (deleted) {
-            std::cout << "Event " << event_id << " deleted successfully.\n";
-        } else {
-            std::cout << "Error: Event " << event_id << " not found.\n";
-        }
-    }
+    CommandProcessor processor_;
 
     /**
      * Concurrency demonstration: spawn two threads attempting to create overlapping events.
@@ -246,57 +76,161 @@ private:
     }
 
 public:
+    CLI() : processor_(calendar_service_) {
+        // demo prints from its own threads, so it stays CLI-only
+        processor_.addCommand("demo", [this](const CommandProcessor::Tokens&, std::ostream&) {
+            handleDemo();
+            return CommandStatus::Ok;
+        });
+        processor_.addFileCommands();
+        processor_.addReloadTzCommand();
+    }
+
+    /**
+     * Enable persistence as the flags ask (see openStorage).
+     */
+    bool openStorage(const StorageOptions& options) {
+        return ::openStorage(calendar_service_, options);
+    }
+
     void run() {
         std::cout << "=== Calendar Management System ===\n";
         std::cout << "Commands:\n";
         std::cout << "  create \"Title\" YYYY-MM-DD HH:MM HH:MM TZ\n";
-        std::cout << "  list week YYYY-MM-DD TZ\n";
+        std::cout << "  list week YYYY-MM-DD TZ [json]\n";
         std::cout << "  delete ID\n";
+        std::cout << "  checkpoint (snapshot events, empty the log; needs --data-dir)\n";
+        std::cout << "  archive YYYY-MM-DD TZ (move events before that date to read-only storage)\n";
+        std::cout << "  stats YYYY-MM-DD YYYY-MM-DD TZ (event count and busy time per day)\n";
+        std::cout << "  free YYYY-MM-DD MINUTES TZ (earliest free slot that day)\n";
+        std::cout << "  reload-tz (re-read the timezone files after a tzdata update)\n";
+        std::cout << "  import PATH (bulk-load a CSV or .ics file)\n";
+        std::cout << "  export PATH (write every event as CSV, or iCalendar for .ics)\n";
         std::cout << "  demo (concurrency demonstration)\n";
         std::cout << "  exit\n\n";
 
         std::string line;
         while (true) {
             std::cout << "> ";
-            std::getline(std::cin, line);
+            if (!std::getline(std::cin, line)) {
+                break;
+            }
 
             if (line.empty()) {
                 continue;
             }
 
-            std::vector<std::string> tokens = parseCommand(line);
+            if (processor_.execute(line, std::cout) == CommandStatus::Exit) {
+                break;
+            }
+        }
+    }
 
-            if (tokens.empty()) {
+    /**
+     * Run every command on stdin until end of input or "exit".
+     *
+     * @return Exit status: 0 if every command succeeded, else 1
+     */
+    int runBatch(BatchOutput output) {
+        // Terminal niceties cost more than the commands on large files
+        std::ios::sync_with_stdio(false);
+        std::cin.tie(nullptr);
+        // Static: the streams keep using them until exit
+        static char in_buffer[1 << 20];
+        static char out_buffer[1 << 20];
+        std::cin.rdbuf()->pubsetbuf(in_buffer, sizeof(in_buffer));
+        std::cout.rdbuf()->pubsetbuf(out_buffer, sizeof(out_buffer));
+
+        // Failed commands' replies are kept aside in quiet mode; the summary
+        // writes to a stream without a buffer, which drops everything
+        std::ostringstream reply;
+        std::ostream discard(nullptr);
+        std::ostream& out = output == BatchOutput::All ? std::cout
+                            : output == BatchOutput::Errors ? static_cast<std::ostream&>(reply)
+                                                            : discard;
+
+        auto started = std::chrono::steady_clock::now();
+        uint64_t line_number = 0, commands = 0, failed = 0;
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            line_number++;
+            // Blank lines are not commands
+            if (CommandProcessor::commandName(line).empty()) {
                 continue;
             }
+            commands++;
 
-            std::string command = tokens[0];
-
-            if (command == "exit") {
-                std::cout << "Goodbye!\n";
-                break;
-            } else if (command == "create") {
-                handleCreate(tokens);
-            } else if (command == "list") {
-                if (tokens.size() > 1 && tokens[1] == "week") {
-                    handleListWeek(tokens);
-                } else {
-                    std::cout << "Error: Invalid list command. Use 'list week YYYY-MM-DD TZ'\n";
+            CommandStatus status = processor_.execute(line, out);
+            if (status == CommandStatus::Error) {
+                failed++;
+                if (output == BatchOutput::Errors) {
+                    std::cerr << "line " << line_number << ": " << reply.str();
                 }
-            } else if (command == "delete") {
-                handleDelete(tokens);
-            } else if (command == "demo") {
-                handleDemo();
-            } else {
-                std::cout << "Error: Unknown command. Type 'exit' to quit.\n";
             }
+            if (output == BatchOutput::Errors) {
+                reply.str(std::string());
+            }
+            if (status == CommandStatus::Exit) {
+                break;
+            }
+        }
+        std::cout.flush();
+
+        if (output == BatchOutput::Summary) {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            char summary[160];
+            std::snprintf(summary, sizeof(summary), "%llu commands, %llu failed, %.2f s (%.0f commands/s)\n",
+                          static_cast<unsigned long long>(commands), static_cast<unsigned long long>(failed),
+                          seconds, seconds > 0 ? commands / seconds : 0.0);
+            std::cerr << summary;
         }
+        return failed > 0 ? 1 : 0;
     }
 };
 
-int main() {
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--batch [--quiet | --summary]] [--data-dir DIR]"
+              << " [--sync every|batched|interval] [--sync-interval-ms N] [--engine memory|lsm]"
+              << " [--memtable-limit N]\n"
+              << "  --batch               Run the commands on stdin without prompts; exit status 1\n"
+              << "                        if any failed\n"
+              << "  --quiet               With --batch: print only failed commands (to stderr)\n"
+              << "  --summary             With --batch: print only a closing count (to stderr)\n"
+              << storageUsage();
+}
+
+int main(int argc, char* argv[]) {
+    StorageOptions storage;
+    bool batch = false;
+    BatchOutput output = BatchOutput::All;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        FlagResult result = parseStorageFlag(argc, argv, i, storage);
+        if (result == FlagResult::Consumed) {
+            continue;
+        }
+        if (result == FlagResult::Unknown && (arg == "--batch" || arg == "--quiet" || arg == "--summary")) {
+            batch = true;
+            if (arg == "--quiet") {
+                output = BatchOutput::Errors;
+            } else if (arg == "--summary") {
+                output = BatchOutput::Summary;
+            }
+            continue;
+        }
+        printUsage(argv[0]);
+        return 2;
+    }
+
     CLI cli;
+    if (!cli.openStorage(storage)) {
+        std::cerr << "Error: Cannot open data directory " << storage.data_dir << "\n";
+        return 1;
+    }
+    if (batch) {
+        return cli.runBatch(output);
+    }
     cli.run();
     return 0;
 }
-
@@ -0,0 +1,100 @@
+#include "render.h"
+#include <charconv>
+
+namespace {
+
+const char kRule[] = "----------------------------------------\n";
+
+void appendInt(std::string& out, int value) {
+    char digits[16];
+    char* end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+    out.append(digits, end - digits);
+}
+
+void appendJsonString(std::string& out, const std::string& value) {
+    static const char kHex[] = "0123456789abcdef";
+    out.push_back('"');
+    for (char c : value) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (byte < 0x20) {
+            out += "\\u00";
+            out.push_back(kHex[byte >> 4]);
+            out.push_back(kHex[byte & 0xF]);
+        } else {
+            out.push_back(c);
+        }
+    }
+    out.push_back('"');
+}
+
+}  // namespace
+
+void renderEvents(const std::vector<Event>& events, TzId tz, const std::string& tz_label, RenderFormat format,
+                  std::string& out) {
+    out.clear();
+    bool json = format == RenderFormat::Json;
+    if (events.empty() && !json) {
+        out = "No events found for this week.\n";
+        return;
+    }
+
+    // All the stamps first: stamps[2i] is the start of event i, 2i + 1 its end
+    const size_t width = TimezoneUtils::kLocalTimestampLength;
+    std::vector<time_t> times(events.size() * 2);
+    for (size_t i = 0; i < events.size(); i++) {
+        times[2 * i] = events[i].start_utc;
+        times[2 * i + 1] = events[i].end_utc;
+    }
+    std::string stamps(times.size() * width, ' ');
+    if (!times.empty()) {
+        TimezoneUtils::formatLocalBatch(times.data(), times.size(), tz, &stamps[0]);
+    }
+
+    // Fixed text per event plus the variable parts: one allocation
+    size_t estimate = 64 + tz_label.size();
+    for (const Event& event : events) {
+        estimate += 128 + 2 * tz_label.size() + event.title.size();
+    }
+    out.reserve(estimate);
+
+    if (json) {
+        out += "{\"tz\":";
+        appendJsonString(out, tz_label);
+        out += ",\"events\":[";
+        for (size_t i = 0; i < events.size(); i++) {
+            out += i == 0 ? "{\"id\":" : ",{\"id\":";
+            appendInt(out, events[i].id);
+            out += ",\"title\":";
+            appendJsonString(out, events[i].title);
+            out += ",\"start\":\"";
+            out.append(stamps, 2 * i * width, width);
+            out += "\",\"end\":\"";
+            out.append(stamps, (2 * i + 1) * width, width);
+            out += "\"}";
+        }
+        out += "]}\n";
+        return;
+    }
+
+    out += "\nWeekly Events:\n";
+    out += kRule;
+    for (size_t i = 0; i < events.size(); i++) {
+        out += "ID: ";
+        appendInt(out, events[i].id);
+        out += "\nTitle: ";
+        out += events[i].title;
+        out += "\nStart: ";
+        out.append(stamps, 2 * i * width, width);
+        out.push_back(' ');
+        out += tz_label;
+        out += "\nEnd: ";
+        out.append(stamps, (2 * i + 1) * width, width);
+        out.push_back(' ');
+        out += tz_label;
+        out.push_back('\n');
+        out += kRule;
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "event.h"
+#include "timezone.h"
+#include <string>
+#include <vector>
+
+enum class RenderFormat { Text, Json };
+
+/**
+ * Format a sorted result set, times shown in tz and labelled tz_label,
+ * into out (replacing its contents), ready for a single write.
+ *
+ * Text is the listing the CLI has always printed. JSON is one line:
+ *   {"tz":"UTC","events":[{"id":1,"title":"...","start":"YYYY-MM-DD HH:MM","end":"..."}]}
+ *
+ * Every timestamp is converted in one formatLocalBatch pass and every
+ * byte is appended to out, which is sized up front: no streams and no
+ * per-event allocations. Reusing out across calls keeps its capacity.
+ */
+void renderEvents(const std::vector<Event>& events, TzId tz, const std::string& tz_label, RenderFormat format,
+                  std::string& out);
+
+#endif // RENDER_H
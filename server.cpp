@@ -0,0 +1,284 @@
+#include "server.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sstream>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// epoll user data for the two non-connection descriptors; connection IDs
+// start above them
+const uint64_t kListenerId = 0;
+const uint64_t kWakeId = 1;
+
+// Requests handed to a worker in one task; bounds the reply latency of a
+// connection behind a long pipeline
+const size_t kMaxRequestsPerTask = 64;
+
+const char kReplyTerminator[] = ".\n";
+
+}  // namespace
+
+CalendarServer::CalendarServer(CalendarService& calendar_service, const ServerOptions& options)
+    : processor_(calendar_service), binary_processor_(calendar_service), options_(options), listen_fd_(-1), epoll_fd_(-1), wake_fd_(-1),
+      port_(0), stopping_(false), next_connection_id_(2), workers_stopping_(false) {
+}
+
+CalendarServer::~CalendarServer() {
+    for (auto& entry : connections_) {
+        ::close(entry.second->fd);
+    }
+    if (listen_fd_ >= 0) {
+        ::close(listen_fd_);
+    }
+    if (wake_fd_ >= 0) {
+        ::close(wake_fd_);
+    }
+    if (epoll_fd_ >= 0) {
+        ::close(epoll_fd_);
+    }
+}
+
+bool CalendarServer::listen() {
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(options_.port));
+    if (::inet_pton(AF_INET, options_.bind_address.c_str(), &addr.sin_addr) != 1) {
+        errno = EINVAL;
+        return false;
+    }
+
+    listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        return false;
+    }
+    int one = 1;
+    ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (::bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(listen_fd_, SOMAXCONN) != 0) {
+        return false;
+    }
+    socklen_t len = sizeof(addr);
+    ::getsockname(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), &len);
+    port_ = ntohs(addr.sin_port);
+
+    epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd_ < 0 || wake_fd_ < 0) {
+        return false;
+    }
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = kListenerId;
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev) != 0) {
+        return false;
+    }
+    ev.data.u64 = kWakeId;
+    return ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev) == 0;
+}
+
+void CalendarServer::stop() {
+    stopping_ = true;
+    uint64_t one = 1;
+    ssize_t ignored = ::write(wake_fd_, &one, sizeof(one));
+    (void)ignored;
+}
+
+void CalendarServer::reloadTimezones() {
+    tz_reloader_.request();
+}
+
+void CalendarServer::run() {
+    for (int i = 0; i < options_.worker_threads; i++) {
+        workers_.emplace_back(&CalendarServer::workerLoop, this);
+    }
+
+    struct epoll_event events[128];
+    while (!stopping_) {
+        int n = ::epoll_wait(epoll_fd_, events, 128, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            uint64_t id = events[i].data.u64;
+            if (id == kListenerId) {
+                acceptConnections();
+                continue;
+            }
+            if (id == kWakeId) {
+                uint64_t count;
+                while (::read(wake_fd_, &count, sizeof(count)) > 0) {
+                }
+                drainCompletions();
+                continue;
+            }
+
+            // A connection closed earlier in this batch may still have an
+            // event in it
+            auto it = connections_.find(id);
+            if (it == connections_.end()) {
+                continue;
+            }
+            ServerConnection& connection = *it->second;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                closeConnection(connection);  // Replies can no longer be delivered
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                connection.writeOutput();
+            }
+            if (events[i].events & EPOLLIN) {
+                connection.readInput(options_);
+            }
+            dispatch(connection);  // New requests, or replies drained below the limit
+            refresh(connection);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(task_mutex_);
+        workers_stopping_ = true;
+    }
+    task_cv_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+    workers_.clear();
+    while (!connections_.empty()) {
+        closeConnection(*connections_.begin()->second);
+    }
+}
+
+void CalendarServer::acceptConnections() {
+    while (true) {
+        int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;  // EAGAIN: no more for now; anything else: retry on the next event
+        }
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        uint64_t id = next_connection_id_++;
+        std::unique_ptr<ServerConnection> connection(new ServerConnection(fd, id));
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = id;
+        if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            ::close(fd);
+            continue;
+        }
+        connection->epoll_events = EPOLLIN;
+        connections_[id] = std::move(connection);
+    }
+}
+
+void CalendarServer::dispatch(ServerConnection& connection) {
+    if (connection.busy || connection.requests.empty() || connection.throttled(options_)) {
+        return;
+    }
+
+    Task task;
+    task.connection_id = connection.id;
+    task.binary = connection.protocol == ServerConnection::Protocol::Binary;
+    while (!connection.requests.empty() && task.requests.size() < kMaxRequestsPerTask) {
+        task.requests.push_back(std::move(connection.requests.front()));
+        connection.requests.pop_front();
+    }
+    connection.busy = true;
+    {
+        std::lock_guard<std::mutex> lock(task_mutex_);
+        tasks_.push_back(std::move(task));
+    }
+    task_cv_.notify_one();
+}
+
+void CalendarServer::drainCompletions() {
+    std::vector<Completion> completions;
+    {
+        std::lock_guard<std::mutex> lock(completion_mutex_);
+        completions.swap(completions_);
+    }
+
+    for (Completion& completion : completions) {
+        auto it = connections_.find(completion.connection_id);
+        if (it == connections_.end()) {
+            continue;
+        }
+        ServerConnection& connection = *it->second;
+        connection.busy = false;
+        connection.output.append(completion.output);
+        if (completion.exit) {
+            connection.read_closed = true;
+            connection.requests.clear();
+        }
+        connection.writeOutput();
+        dispatch(connection);
+        refresh(connection);
+    }
+}
+
+void CalendarServer::refresh(ServerConnection& connection) {
+    if (connection.finished()) {
+        closeConnection(connection);
+    } else {
+        connection.updateInterest(epoll_fd_, options_);
+    }
+}
+
+void CalendarServer::closeConnection(ServerConnection& connection) {
+    // A worker may still hold a task of it; its completion is dropped
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection.fd, nullptr);
+    ::close(connection.fd);
+    connections_.erase(connection.id);
+}
+
+void CalendarServer::workerLoop() {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(task_mutex_);
+            task_cv_.wait(lock, [this] { return workers_stopping_ || !tasks_.empty(); });
+            if (workers_stopping_) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+
+        Completion completion;
+        completion.connection_id = task.connection_id;
+        completion.exit = false;
+        if (task.binary) {
+            for (const std::string& frame : task.requests) {
+                binary_processor_.execute(frame.data(), frame.size(), completion.output);
+            }
+        } else {
+            std::ostringstream out;
+            for (const std::string& line : task.requests) {
+                CommandStatus status = processor_.execute(line, out);
+                out << kReplyTerminator;
+                if (status == CommandStatus::Exit) {
+                    completion.exit = true;
+                    break;
+                }
+            }
+            completion.output = out.str();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(completion_mutex_);
+            completions_.push_back(std::move(completion));
+        }
+        uint64_t one = 1;
+        ssize_t ignored = ::write(wake_fd_, &one, sizeof(one));
+        (void)ignored;
+    }
+}
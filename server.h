@@ -0,0 +1,145 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "binary_protocol.h"
+#include "calendar_service.h"
+#include "command_processor.h"
+#include "server_connection.h"
+#include "tzdb.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * TCP front end speaking the CLI's command grammar (see CommandProcessor).
+ *
+ * Protocol: the client sends command lines ("\n" or "\r\n" terminated);
+ * for each line the server sends the text the CLI would print, followed by
+ * a line holding a single ".". Clients may pipeline: send any number of
+ * lines without waiting, and the replies come back in the same order.
+ * "exit" replies "Goodbye!" and closes the connection.
+ *
+ * A connection whose first byte is BinaryProtocol::kMagic speaks the
+ * binary protocol instead: length-prefixed frames, each carrying a batch
+ * of operations, answered by one frame each (see binary_protocol.h).
+ * Everything below applies to frames as it does to lines.
+ *
+ * Threads:
+ * - one event loop thread (the caller of run()) owns every socket: a
+ *   non-blocking, level-triggered epoll loop accepts, reads, splits lines
+ *   and writes replies. Connection state is only touched by this thread.
+ * - worker_threads workers execute commands against the shared
+ *   CalendarService. A connection's queued lines go to a worker as one
+ *   task and the connection gets no second task until that one finishes,
+ *   which keeps its replies in order while different connections run in
+ *   parallel. Workers hand replies back through a queue and wake the loop
+ *   with an eventfd.
+ *
+ * A client that stops reading its replies is throttled: once
+ * max_pending_output bytes are waiting, its requests are neither read nor
+ * executed until it catches up.
+ */
+class CalendarServer {
+public:
+    CalendarServer(CalendarService& calendar_service, const ServerOptions& options);
+    ~CalendarServer();
+
+    CalendarServer(const CalendarServer&) = delete;
+    CalendarServer& operator=(const CalendarServer&) = delete;
+
+    /**
+     * Bind and listen.
+     *
+     * @return false if the socket cannot be set up (errno is kept)
+     */
+    bool listen();
+
+    /**
+     * Port actually bound (after listen; useful with port 0).
+     */
+    int port() const { return port_; }
+
+    /**
+     * Serve until stop() is called, then close every connection.
+     */
+    void run();
+
+    /**
+     * Make run() return. Async-signal-safe.
+     */
+    void stop();
+
+    /**
+     * Re-read the zoneinfo files (TzDatabase::reload) on a thread of its
+     * own, so the event loop and workers keep serving meanwhile.
+     * Async-signal-safe: calendar-server calls it on SIGHUP.
+     */
+    void reloadTimezones();
+
+private:
+    struct Task {
+        uint64_t connection_id;
+        bool binary;
+        std::vector<std::string> requests;
+    };
+
+    struct Completion {
+        uint64_t connection_id;
+        std::string output;
+        bool exit;  // The task ended with an exit command
+    };
+
+    CommandProcessor processor_;
+    BinaryProcessor binary_processor_;
+    ServerOptions options_;
+
+    int listen_fd_;
+    int epoll_fd_;
+    int wake_fd_;  // eventfd: completions are ready, or stop() was called
+    int port_;
+    std::atomic<bool> stopping_;
+    TzReloadThread tz_reloader_;
+
+    // Event loop thread only
+    std::unordered_map<uint64_t, std::unique_ptr<ServerConnection>> connections_;
+    uint64_t next_connection_id_;
+
+    // Worker pool
+    std::vector<std::thread> workers_;
+    std::mutex task_mutex_;
+    std::condition_variable task_cv_;
+    std::deque<Task> tasks_;
+    bool workers_stopping_;
+
+    std::mutex completion_mutex_;
+    std::vector<Completion> completions_;
+
+    void acceptConnections();
+
+    /**
+     * Hand the connection's queued lines to a worker unless one already
+     * has a task of it or the client is too far behind on replies.
+     */
+    void dispatch(ServerConnection& connection);
+
+    void drainCompletions();
+
+    /**
+     * Update the epoll interest set after a state change, or close the
+     * connection once it has nothing left to do.
+     */
+    void refresh(ServerConnection& connection);
+
+    void closeConnection(ServerConnection& connection);
+
+    void workerLoop();
+};
+
+#endif // SERVER_H
@@ -0,0 +1,132 @@
+#include "server_connection.h"
+#include "binary_protocol.h"
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// Stop reading from a connection with this many requests still queued
+const size_t kMaxQueuedRequests = 1024;
+
+}  // namespace
+
+void ServerConnection::readInput(const ServerOptions& options) {
+    // Split after every chunk, so the length checks run before the next
+    // read, and leave what a client sends past its request quota in the
+    // socket. A chunk can overshoot either bound by at most its own size.
+    char buf[64 * 1024];
+    while (!read_closed && requests.size() < kMaxQueuedRequests) {
+        ssize_t n = ::read(fd, buf, sizeof(buf));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                read_closed = true;
+                requests.clear();
+            }
+            break;
+        }
+        if (n == 0) {
+            read_closed = true;  // Still answer what was sent
+            break;
+        }
+        input.append(buf, static_cast<size_t>(n));
+        if (!splitInput(options) || static_cast<size_t>(n) < sizeof(buf)) {
+            break;
+        }
+    }
+}
+
+bool ServerConnection::splitInput(const ServerOptions& options) {
+    if (protocol == Protocol::Unknown && !input.empty()) {
+        if (static_cast<uint8_t>(input[0]) == BinaryProtocol::kMagic) {
+            protocol = Protocol::Binary;
+            input.erase(0, 1);
+        } else {
+            protocol = Protocol::Text;
+        }
+    }
+    bool ok = protocol == Protocol::Binary ? splitFrames(options) : splitLines(options);
+    if (!ok) {
+        // Not a client of this protocol; drop it after the replies so far
+        read_closed = true;
+        input.clear();
+    }
+    return ok;
+}
+
+bool ServerConnection::splitLines(const ServerOptions& options) {
+    size_t begin = 0;
+    size_t newline;
+    while ((newline = input.find('\n', begin)) != std::string::npos) {
+        size_t end = newline;
+        if (end > begin && input[end - 1] == '\r') {
+            end--;
+        }
+        requests.emplace_back(input, begin, end - begin);
+        begin = newline + 1;
+    }
+    input.erase(0, begin);
+    return input.size() <= options.max_line_length;
+}
+
+bool ServerConnection::splitFrames(const ServerOptions& options) {
+    size_t begin = 0;
+    while (true) {
+        size_t header_size, payload_size;
+        int found = BinaryProtocol::findFrame(input.data() + begin, input.size() - begin,
+                                              options.max_frame_size, header_size, payload_size);
+        if (found < 0) {
+            return false;
+        }
+        if (found == 0) {
+            break;
+        }
+        requests.emplace_back(input, begin + header_size, payload_size);
+        begin += header_size + payload_size;
+    }
+    input.erase(0, begin);
+    return true;
+}
+
+void ServerConnection::writeOutput() {
+    while (pendingOutput() > 0) {
+        ssize_t n = ::send(fd, output.data() + output_pos, pendingOutput(), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                // Peer is gone: nothing more can be delivered
+                read_closed = true;
+                requests.clear();
+                output.clear();
+                output_pos = 0;
+            }
+            return;
+        }
+        output_pos += static_cast<size_t>(n);
+    }
+    output.clear();
+    output_pos = 0;
+}
+
+void ServerConnection::updateInterest(int epoll_fd, const ServerOptions& options) {
+    uint32_t events = 0;
+    if (!read_closed && requests.size() < kMaxQueuedRequests && !throttled(options)) {
+        events |= EPOLLIN;
+    }
+    if (pendingOutput() > 0) {
+        events |= EPOLLOUT;
+    }
+    if (events != epoll_events) {
+        struct epoll_event ev = {};
+        ev.events = events;
+        ev.data.u64 = id;
+        ::epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+        epoll_events = events;
+    }
+}
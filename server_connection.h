@@ -0,0 +1,99 @@
+#ifndef SERVER_CONNECTION_H
+#define SERVER_CONNECTION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+struct ServerOptions {
+    std::string bind_address;   // IPv4 address to listen on
+    int port;                   // 0: any free port (see CalendarServer::port)
+    int worker_threads;         // Threads executing commands (pool mode)
+    size_t max_line_length;     // Longer request lines close the connection
+    size_t max_frame_size;      // Same for binary request frames
+    size_t max_pending_output;  // Stop reading from a client this far behind on replies
+    size_t max_open_calendars;  // Sharded mode: calendars a shard keeps open at once
+
+    ServerOptions()
+        : bind_address("127.0.0.1"), port(7070), worker_threads(4), max_line_length(64 * 1024),
+          max_frame_size(16 * 1024 * 1024), max_pending_output(4 * 1024 * 1024), max_open_calendars(64) {}
+};
+
+/**
+ * One client socket of a server event loop: buffered input split into
+ * requests (text lines or binary frame payloads, decided by the first
+ * byte), and buffered replies. Owned and only touched by one loop thread.
+ */
+struct ServerConnection {
+    enum class Protocol {
+        Unknown,  // Nothing received yet
+        Text,
+        Binary
+    };
+
+    int fd;
+    uint64_t id;
+    std::string input;                // Received bytes not yet split into requests
+    Protocol protocol;
+    std::deque<std::string> requests;  // Lines or frame payloads not yet executed
+    std::string output;               // Replies not yet written
+    size_t output_pos;                // Bytes of output already written
+    bool busy;                        // A request of this connection is executing elsewhere
+    bool read_closed;                 // Peer shut down its side, or sent exit
+    uint32_t epoll_events;            // Current interest set
+    std::string calendar;             // Selected calendar (sharded mode)
+
+    ServerConnection(int socket_fd, uint64_t connection_id)
+        : fd(socket_fd), id(connection_id), protocol(Protocol::Unknown), output_pos(0), busy(false),
+          read_closed(false), epoll_events(0) {}
+
+    /**
+     * Read what the socket has and split off complete requests, stopping
+     * early once enough requests are queued (the rest waits in the socket
+     * until they drain). A protocol violation (over-long line or frame)
+     * stops reading; the replies owed so far are still sent.
+     */
+    void readInput(const ServerOptions& options);
+
+    /**
+     * Write as much pending output as the socket takes. If the peer is
+     * gone, drops everything so the connection can be closed.
+     */
+    void writeOutput();
+
+    size_t pendingOutput() const { return output.size() - output_pos; }
+
+    /**
+     * Too far behind on replies to execute more of its requests.
+     */
+    bool throttled(const ServerOptions& options) const {
+        return pendingOutput() >= options.max_pending_output;
+    }
+
+    /**
+     * Nothing left to read, execute or write: close it.
+     */
+    bool finished() const {
+        return read_closed && !busy && requests.empty() && pendingOutput() == 0;
+    }
+
+    /**
+     * Ask epoll for exactly the events that can be acted on (the loops are
+     * level-triggered, so asking for more would spin).
+     */
+    void updateInterest(int epoll_fd, const ServerOptions& options);
+
+private:
+    /**
+     * Split input into requests in the connection's protocol (decided
+     * here on the first byte).
+     *
+     * @return false on a protocol violation (reading is then closed)
+     */
+    bool splitInput(const ServerOptions& options);
+    bool splitLines(const ServerOptions& options);
+    bool splitFrames(const ServerOptions& options);
+};
+
+#endif // SERVER_CONNECTION_H
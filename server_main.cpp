@@ -0,0 +1,155 @@
+#include "calendar_service.h"
+#include "server.h"
+#include "sharded_server.h"
+#include "storage_options.h"
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+/**
+ * calendar-server: the calendar over TCP (see CalendarServer for the
+ * protocol). Storage flags are the same as the CLI's.
+ */
+
+namespace {
+
+CalendarServer* g_server = nullptr;
+ShardedServer* g_sharded_server = nullptr;
+
+void handleSignal(int) {
+    if (g_server) {
+        g_server->stop();
+    }
+    if (g_sharded_server) {
+        g_sharded_server->stop();
+    }
+}
+
+// SIGHUP: tzdata was updated; re-read it without a restart
+void handleHangup(int) {
+    if (g_server) {
+        g_server->reloadTimezones();
+    }
+    if (g_sharded_server) {
+        g_sharded_server->reloadTimezones();
+    }
+}
+
+void installSignalHandlers() {
+    struct sigaction action = {};
+    action.sa_handler = handleSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    struct sigaction hangup = {};
+    hangup.sa_handler = handleHangup;
+    hangup.sa_flags = SA_RESTART;
+    sigaction(SIGHUP, &hangup, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+}
+
+void printListenError(const ServerOptions& options) {
+    std::cerr << "Error: Cannot listen on " << options.bind_address << ":" << options.port << ": "
+              << std::strerror(errno) << "\n";
+}
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--bind ADDR] [--port N] [--threads N | --shards N] [storage flags]\n"
+              << "  --bind ADDR           IPv4 address to listen on (default 127.0.0.1)\n"
+              << "  --port N              TCP port (default 7070; 0 picks a free one)\n"
+              << "  --threads N           Worker threads executing commands (default: one per core)\n"
+              << "  --shards N            Thread-per-core mode: N event loops, each owning a share\n"
+              << "                        of the calendars (selected with \"use NAME\")\n"
+              << "  --max-calendars N     With --shards: calendars each shard keeps open (default 64;\n"
+              << "                        with --data-dir the least recently used one is closed)\n"
+              << storageUsage();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    StorageOptions storage;
+    ServerOptions options;
+    unsigned cores = std::thread::hardware_concurrency();
+    options.worker_threads = cores > 0 ? static_cast<int>(cores) : 4;
+    int shards = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        FlagResult result = parseStorageFlag(argc, argv, i, storage);
+        if (result == FlagResult::Consumed) {
+            continue;
+        }
+        if (result == FlagResult::Unknown && i + 1 < argc) {
+            if (arg == "--bind") {
+                options.bind_address = argv[++i];
+                continue;
+            }
+            if (arg == "--port") {
+                options.port = std::atoi(argv[++i]);
+                if (options.port >= 0 && options.port <= 65535) {
+                    continue;
+                }
+            } else if (arg == "--threads") {
+                options.worker_threads = std::atoi(argv[++i]);
+                if (options.worker_threads > 0) {
+                    continue;
+                }
+            } else if (arg == "--max-calendars") {
+                int max_calendars = std::atoi(argv[++i]);
+                if (max_calendars > 0) {
+                    options.max_open_calendars = static_cast<size_t>(max_calendars);
+                    continue;
+                }
+            } else if (arg == "--shards") {
+                shards = std::atoi(argv[++i]);
+                if (shards > 0) {
+                    continue;
+                }
+            }
+        }
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    if (shards > 0) {
+        // Each calendar opens its own storage under the data directory
+        ShardedServer server(storage, options, shards);
+        if (!server.listen()) {
+            printListenError(options);
+            return 1;
+        }
+        g_sharded_server = &server;
+        installSignalHandlers();
+        std::cout << "Listening on " << options.bind_address << ":" << server.port() << " with " << shards
+                  << " shards\n"
+                  << std::flush;
+        server.run();
+        g_sharded_server = nullptr;
+        return 0;
+    }
+
+    CalendarService calendar_service;
+    if (!openStorage(calendar_service, storage)) {
+        std::cerr << "Error: Cannot open data directory " << storage.data_dir << "\n";
+        return 1;
+    }
+
+    CalendarServer server(calendar_service, options);
+    if (!server.listen()) {
+        printListenError(options);
+        return 1;
+    }
+
+    g_server = &server;
+    installSignalHandlers();
+
+    std::cout << "Listening on " << options.bind_address << ":" << server.port() << " with "
+              << options.worker_threads << " worker threads\n"
+              << std::flush;
+    server.run();
+    g_server = nullptr;
+    return 0;
+}
@@ -0,0 +1,473 @@
+#include "sharded_server.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// epoll user data for the two non-connection descriptors of a shard
+const uint64_t kListenerId = 0;
+const uint64_t kWakeId = 1;
+
+// Messages in flight from one shard to another before the sender buffers
+const size_t kQueueCapacity = 4096;
+
+// Requests of one connection forwarded together, as CalendarServer's tasks
+const size_t kMaxRequestsPerMessage = 64;
+
+const char kDefaultCalendar[] = "default";
+const char kReplyTerminator[] = ".\n";
+
+bool validCalendarName(const std::string& name) {
+    if (name.empty() || name.size() > 64) {
+        return false;
+    }
+    for (char c : name) {
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' ||
+              c == '_')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Connection-level requests, run by the shard the connection is on
+bool isUse(bool binary, const std::string& request, std::string& name) {
+    if (binary) {
+        return BinaryProtocol::parseUse(request.data(), request.size(), name);
+    }
+    if (CommandProcessor::commandName(request) != "use") {
+        return false;
+    }
+    CommandProcessor::Tokens tokens;
+    name.clear();
+    if (CommandProcessor::tokenize(request, tokens) && tokens.size() == 2) {
+        name.assign(tokens[1].data(), tokens[1].size());
+    }
+    return true;
+}
+
+bool isExit(bool binary, const std::string& request) {
+    return !binary && CommandProcessor::commandName(request) == "exit";
+}
+
+void wakeUp(int fd) {
+    uint64_t one = 1;
+    ssize_t ignored = ::write(fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+}  // namespace
+
+ShardedServer::ShardedServer(const StorageOptions& storage, const ServerOptions& options, int shard_count)
+    : storage_(storage), options_(options), port_(0), stopping_(false) {
+    for (int i = 0; i < shard_count; i++) {
+        std::unique_ptr<Shard> shard(new Shard());
+        shard->index = i;
+        shard->outbox.resize(shard_count);
+        shard->wake.assign(shard_count, false);
+        for (int from = 0; from < shard_count; from++) {
+            shard->inbound.emplace_back(new SpscQueue<Message>(kQueueCapacity));
+        }
+        shards_.push_back(std::move(shard));
+    }
+}
+
+ShardedServer::~ShardedServer() {
+    for (auto& shard : shards_) {
+        for (auto& entry : shard->connections) {
+            ::close(entry.second->fd);
+        }
+        for (int fd : {shard->listen_fd, shard->wake_fd, shard->epoll_fd}) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+    }
+}
+
+bool ShardedServer::listen() {
+    if (!storage_.data_dir.empty() && ::mkdir(storage_.data_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        return false;
+    }
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    if (::inet_pton(AF_INET, options_.bind_address.c_str(), &addr.sin_addr) != 1) {
+        errno = EINVAL;
+        return false;
+    }
+
+    port_ = options_.port;
+    for (auto& shard : shards_) {
+        // With port 0 the first shard picks the port and the rest join it
+        addr.sin_port = htons(static_cast<uint16_t>(port_));
+        shard->listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (shard->listen_fd < 0) {
+            return false;
+        }
+        int one = 1;
+        ::setsockopt(shard->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (::setsockopt(shard->listen_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0 ||
+            ::bind(shard->listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::listen(shard->listen_fd, SOMAXCONN) != 0) {
+            return false;
+        }
+        socklen_t len = sizeof(addr);
+        ::getsockname(shard->listen_fd, reinterpret_cast<struct sockaddr*>(&addr), &len);
+        port_ = ntohs(addr.sin_port);
+
+        shard->epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+        shard->wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (shard->epoll_fd < 0 || shard->wake_fd < 0) {
+            return false;
+        }
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = kListenerId;
+        if (::epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, shard->listen_fd, &ev) != 0) {
+            return false;
+        }
+        ev.data.u64 = kWakeId;
+        if (::epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, shard->wake_fd, &ev) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ShardedServer::stop() {
+    stopping_ = true;
+    for (auto& shard : shards_) {
+        wakeUp(shard->wake_fd);
+    }
+}
+
+void ShardedServer::reloadTimezones() {
+    tz_reloader_.request();
+}
+
+void ShardedServer::run() {
+    unsigned cores = std::thread::hardware_concurrency();
+    for (auto& shard : shards_) {
+        Shard* s = shard.get();
+        s->thread = std::thread(&ShardedServer::runShard, this, std::ref(*s));
+        if (cores > 0) {
+            // Best effort: the shard still works unpinned
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(static_cast<unsigned>(s->index) % cores, &cpus);
+            pthread_setaffinity_np(s->thread.native_handle(), sizeof(cpus), &cpus);
+        }
+    }
+    for (auto& shard : shards_) {
+        shard->thread.join();
+    }
+}
+
+int ShardedServer::shardOf(const std::string& calendar) const {
+    // FNV-1a: stable across runs and platforms, unlike std::hash
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : calendar) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ULL;
+    }
+    return static_cast<int>(hash % shards_.size());
+}
+
+void ShardedServer::runShard(Shard& shard) {
+    struct epoll_event events[128];
+    while (!stopping_) {
+        // Messages waiting for room in a full queue: come back soon
+        bool backlog = false;
+        for (const auto& pending : shard.outbox) {
+            backlog = backlog || !pending.empty();
+        }
+        int n = ::epoll_wait(shard.epoll_fd, events, 128, backlog ? 1 : -1);
+        if (n < 0 && errno != EINTR) {
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            uint64_t id = events[i].data.u64;
+            if (id == kListenerId) {
+                acceptConnections(shard);
+                continue;
+            }
+            if (id == kWakeId) {
+                uint64_t count;
+                while (::read(shard.wake_fd, &count, sizeof(count)) > 0) {
+                }
+                continue;  // The queues are polled below
+            }
+
+            auto it = shard.connections.find(id);
+            if (it == shard.connections.end()) {
+                continue;
+            }
+            ServerConnection& connection = *it->second;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                closeConnection(shard, connection);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                connection.writeOutput();
+            }
+            if (events[i].events & EPOLLIN) {
+                connection.readInput(options_);
+            }
+            dispatch(shard, connection);
+            refresh(shard, connection);
+        }
+
+        receive(shard);
+        flushOutbox(shard);
+        // One eventfd write per peer per iteration, however many messages
+        for (size_t to = 0; to < shards_.size(); to++) {
+            if (shard.wake[to]) {
+                shard.wake[to] = false;
+                wakeUp(shards_[to]->wake_fd);
+            }
+        }
+    }
+
+    while (!shard.connections.empty()) {
+        closeConnection(shard, *shard.connections.begin()->second);
+    }
+}
+
+void ShardedServer::acceptConnections(Shard& shard) {
+    while (true) {
+        int fd = ::accept4(shard.listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        uint64_t id = shard.next_connection_id++;
+        std::unique_ptr<ServerConnection> connection(new ServerConnection(fd, id));
+        connection->calendar = kDefaultCalendar;
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = id;
+        if (::epoll_ctl(shard.epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            ::close(fd);
+            continue;
+        }
+        connection->epoll_events = EPOLLIN;
+        shard.connections[id] = std::move(connection);
+    }
+}
+
+void ShardedServer::dispatch(Shard& shard, ServerConnection& connection) {
+    bool binary = connection.protocol == ServerConnection::Protocol::Binary;
+    while (!connection.busy && !connection.requests.empty()) {
+        if (connection.throttled(options_)) {
+            // Replies of requests run inline pile up here: send them first
+            connection.writeOutput();
+            if (connection.throttled(options_)) {
+                break;
+            }
+        }
+
+        // Connection-level commands never leave this shard
+        std::string name;
+        if (isUse(binary, connection.requests.front(), name)) {
+            connection.requests.pop_front();
+            bool valid = validCalendarName(name);
+            if (valid) {
+                connection.calendar = name;
+            }
+            if (binary) {
+                BinaryProtocol::appendUseResponse(valid ? BinaryProtocol::kOk : BinaryProtocol::kFailed,
+                                                  connection.output);
+                continue;
+            }
+            connection.output += valid ? "Using calendar " + name + ".\n"
+                                       : std::string("Error: Invalid use command. Usage: use NAME "
+                                                     "(letters, digits, '-' and '_')\n");
+            connection.output += kReplyTerminator;
+            continue;
+        }
+        if (isExit(binary, connection.requests.front())) {
+            connection.output += "Goodbye!\n";
+            connection.output += kReplyTerminator;
+            connection.read_closed = true;
+            connection.requests.clear();
+            break;
+        }
+
+        int owner = shardOf(connection.calendar);
+        if (owner == shard.index) {
+            std::string request = std::move(connection.requests.front());
+            connection.requests.pop_front();
+            if (execute(shard, connection.calendar, binary, request, connection.output)) {
+                connection.read_closed = true;
+                connection.requests.clear();
+            }
+            continue;
+        }
+
+        // Forward the run of requests up to the next connection-level one
+        Message message;
+        message.binary = binary;
+        message.from_shard = shard.index;
+        message.connection_id = connection.id;
+        message.calendar = connection.calendar;
+        do {
+            message.requests.push_back(std::move(connection.requests.front()));
+            connection.requests.pop_front();
+        } while (!connection.requests.empty() && message.requests.size() < kMaxRequestsPerMessage &&
+                 !isUse(binary, connection.requests.front(), name) && !isExit(binary, connection.requests.front()));
+        send(shard, owner, message);
+        connection.busy = true;
+    }
+    connection.writeOutput();
+}
+
+bool ShardedServer::execute(Shard& shard, const std::string& name, bool binary, const std::string& request,
+                            std::string& out) {
+    Calendar* target = calendar(shard, name);
+    if (binary) {
+        if (target) {
+            target->binary_processor.execute(request.data(), request.size(), out);
+        } else {
+            BinaryProtocol::appendFrame(std::string(1, static_cast<char>(BinaryProtocol::kMalformed)), out);
+        }
+        return false;
+    }
+
+    CommandStatus status = CommandStatus::Error;
+    if (target) {
+        std::ostringstream reply;
+        status = target->processor.execute(request, reply);
+        out += reply.str();
+    } else {
+        out += "Error: Cannot open calendar " + name + " (storage failed, or too many calendars open).\n";
+    }
+    out += kReplyTerminator;
+    return status == CommandStatus::Exit;
+}
+
+ShardedServer::Calendar* ShardedServer::calendar(Shard& shard, const std::string& name) {
+    auto it = shard.calendars.find(name);
+    if (it != shard.calendars.end()) {
+        it->second->last_used = ++shard.calendar_clock;
+        return it->second.get();
+    }
+    if (shard.calendars.size() >= options_.max_open_calendars && !closeIdleCalendar(shard)) {
+        return nullptr;
+    }
+
+    std::unique_ptr<Calendar> created(new Calendar());
+    StorageOptions storage = storage_;
+    if (!storage.data_dir.empty()) {
+        storage.data_dir += "/" + name;
+    }
+    if (!openStorage(created->service, storage)) {
+        return nullptr;  // Not cached: the next request retries
+    }
+    Calendar* result = created.get();
+    result->last_used = ++shard.calendar_clock;
+    shard.calendars[name] = std::move(created);
+    return result;
+}
+
+bool ShardedServer::closeIdleCalendar(Shard& shard) {
+    if (storage_.data_dir.empty() || shard.calendars.empty()) {
+        return false;
+    }
+    auto oldest = shard.calendars.begin();
+    for (auto it = shard.calendars.begin(); it != shard.calendars.end(); ++it) {
+        if (it->second->last_used < oldest->second->last_used) {
+            oldest = it;
+        }
+    }
+    // Closing syncs its log; connections name calendars, so none dangles
+    shard.calendars.erase(oldest);
+    return true;
+}
+
+void ShardedServer::send(Shard& shard, int to, Message& message) {
+    // Behind earlier messages that did not fit, to keep the order
+    SpscQueue<Message>& queue = *shards_[to]->inbound[shard.index];
+    if (!shard.outbox[to].empty() || !queue.push(message)) {
+        shard.outbox[to].push_back(std::move(message));
+    }
+    shard.wake[to] = true;
+}
+
+void ShardedServer::flushOutbox(Shard& shard) {
+    for (size_t to = 0; to < shard.outbox.size(); to++) {
+        std::vector<Message>& pending = shard.outbox[to];
+        if (pending.empty()) {
+            continue;
+        }
+        SpscQueue<Message>& queue = *shards_[to]->inbound[shard.index];
+        size_t sent = 0;
+        while (sent < pending.size() && queue.push(pending[sent])) {
+            sent++;
+        }
+        pending.erase(pending.begin(), pending.begin() + sent);
+        shard.wake[to] = shard.wake[to] || sent > 0;
+    }
+}
+
+void ShardedServer::receive(Shard& shard) {
+    Message message;
+    for (size_t from = 0; from < shard.inbound.size(); from++) {
+        SpscQueue<Message>& queue = *shard.inbound[from];
+        while (queue.pop(message)) {
+            if (!message.is_reply) {
+                Message reply;
+                reply.is_reply = true;
+                reply.connection_id = message.connection_id;
+                for (const std::string& request : message.requests) {
+                    if (execute(shard, message.calendar, message.binary, request, reply.payload)) {
+                        reply.exit = true;
+                        break;
+                    }
+                }
+                send(shard, message.from_shard, reply);
+                continue;
+            }
+
+            auto it = shard.connections.find(message.connection_id);
+            if (it == shard.connections.end()) {
+                continue;  // Closed while the request was away
+            }
+            ServerConnection& connection = *it->second;
+            connection.busy = false;
+            connection.output += message.payload;
+            if (message.exit) {
+                connection.read_closed = true;
+                connection.requests.clear();
+            }
+            dispatch(shard, connection);
+            refresh(shard, connection);
+        }
+    }
+}
+
+void ShardedServer::refresh(Shard& shard, ServerConnection& connection) {
+    if (connection.finished()) {
+        closeConnection(shard, connection);
+    } else {
+        connection.updateInterest(shard.epoll_fd, options_);
+    }
+}
+
+void ShardedServer::closeConnection(Shard& shard, ServerConnection& connection) {
+    ::epoll_ctl(shard.epoll_fd, EPOLL_CTL_DEL, connection.fd, nullptr);
+    ::close(connection.fd);
+    shard.connections.erase(connection.id);
+}
@@ -0,0 +1,183 @@
+#ifndef SHARDED_SERVER_H
+#define SHARDED_SERVER_H
+
+#include "binary_protocol.h"
+#include "calendar_service.h"
+#include "command_processor.h"
+#include "server_connection.h"
+#include "spsc_queue.h"
+#include "storage_options.h"
+#include "tzdb.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Thread-per-core, shared-nothing variant of CalendarServer for hosting
+ * many calendars.
+ *
+ * Speaks the same text and binary protocols, plus one text command:
+ *   use NAME   select calendar NAME for the following requests
+ *              (letters, digits, '-' and '_'; the default is "default")
+ * and its binary counterpart, a frame holding a single kUse op.
+ * With --data-dir, calendar NAME is stored in DIR/NAME.
+ *
+ * An open calendar costs a log file, its syncer thread and memory, so a
+ * shard keeps at most max_open_calendars open. With --data-dir the least
+ * recently used one is closed to make room (and reopened from disk when
+ * next used); without it closing would lose events, so opening another
+ * calendar fails instead.
+ *
+ * Each shard is one thread (pinned to a core where possible) with its own
+ * epoll loop and its own listening socket on the shared port
+ * (SO_REUSEPORT: the kernel spreads new connections over the shards).
+ * Every calendar belongs to exactly one shard, chosen by a hash of its
+ * name, and only that shard's thread ever touches its CalendarService, so
+ * the service's mutex is never contended and no lock is shared between
+ * shards.
+ *
+ * A request for a calendar of another shard is forwarded to it over a
+ * lock-free single-producer/single-consumer queue (one per ordered pair
+ * of shards) and the reply comes back the same way; an eventfd wakes the
+ * receiving loop. A connection waits for a forwarded request's reply
+ * before running its next request, so replies stay in order.
+ *
+ * Commands run on the loop thread itself. A command that waits for an
+ * fsync stalls its shard meanwhile: --sync interval suits this mode best.
+ */
+class ShardedServer {
+public:
+    ShardedServer(const StorageOptions& storage, const ServerOptions& options, int shard_count);
+    ~ShardedServer();
+
+    ShardedServer(const ShardedServer&) = delete;
+    ShardedServer& operator=(const ShardedServer&) = delete;
+
+    /**
+     * Bind every shard's listening socket.
+     *
+     * @return false if a socket cannot be set up (errno is kept)
+     */
+    bool listen();
+
+    int port() const { return port_; }
+
+    /**
+     * Run every shard on its own thread until stop() is called.
+     */
+    void run();
+
+    /**
+     * Make run() return. Async-signal-safe.
+     */
+    void stop();
+
+    /**
+     * Re-read the zoneinfo files (TzDatabase::reload, which is
+     * process-wide) on a thread of its own, so no shard stalls.
+     * Async-signal-safe: for SIGHUP.
+     */
+    void reloadTimezones();
+
+private:
+    /**
+     * A run of one connection's requests forwarded to the calendar's shard,
+     * or their replies.
+     */
+    struct Message {
+        bool is_reply;
+        bool binary;
+        bool exit;          // Reply: the requests ended with "exit"
+        int from_shard;     // Request: where to send the reply
+        uint64_t connection_id;
+        std::string calendar;
+        std::vector<std::string> requests;  // Lines or frame payloads
+        std::string payload;                // Reply: every reply, in order
+
+        Message() : is_reply(false), binary(false), exit(false), from_shard(0), connection_id(0) {}
+    };
+
+    /**
+     * A calendar and its command front ends, owned by one shard.
+     */
+    struct Calendar {
+        CalendarService service;
+        CommandProcessor processor;
+        BinaryProcessor binary_processor;
+        uint64_t last_used;  // Shard's calendar_clock at the last request
+
+        Calendar() : processor(service), binary_processor(service), last_used(0) {}
+    };
+
+    struct Shard {
+        int index;
+        int listen_fd;
+        int epoll_fd;
+        int wake_fd;
+        std::thread thread;
+
+        std::unordered_map<uint64_t, std::unique_ptr<ServerConnection>> connections;
+        uint64_t next_connection_id;
+        std::unordered_map<std::string, std::unique_ptr<Calendar>> calendars;
+        uint64_t calendar_clock;  // Ticks once per calendar lookup
+
+        // inbound[i]: messages from shard i. outbox[i]: messages for shard
+        // i that did not fit its queue yet
+        std::vector<std::unique_ptr<SpscQueue<Message>>> inbound;
+        std::vector<std::vector<Message>> outbox;
+        std::vector<bool> wake;  // Shards sent to since they were last woken
+
+        Shard() : index(0), listen_fd(-1), epoll_fd(-1), wake_fd(-1), next_connection_id(2), calendar_clock(0) {}
+    };
+
+    StorageOptions storage_;
+    ServerOptions options_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    int port_;
+    std::atomic<bool> stopping_;
+    TzReloadThread tz_reloader_;
+
+    int shardOf(const std::string& calendar) const;
+
+    void runShard(Shard& shard);
+    void acceptConnections(Shard& shard);
+
+    /**
+     * Run the connection's queued requests in order until some have to be
+     * forwarded (the connection then waits for their replies).
+     */
+    void dispatch(Shard& shard, ServerConnection& connection);
+
+    /**
+     * Execute a request against a calendar owned by this shard.
+     *
+     * @return true if the request was "exit"
+     */
+    bool execute(Shard& shard, const std::string& calendar, bool binary, const std::string& request,
+                 std::string& out);
+
+    /**
+     * The calendar, opened on first use. Null if its storage cannot be
+     * opened, or the shard is at max_open_calendars and cannot close one.
+     */
+    Calendar* calendar(Shard& shard, const std::string& name);
+
+    /**
+     * Close the shard's least recently used calendar.
+     *
+     * @return false if calendars live only in memory (nothing is closed)
+     */
+    bool closeIdleCalendar(Shard& shard);
+
+    void send(Shard& shard, int to, Message& message);
+    void receive(Shard& shard);
+    void flushOutbox(Shard& shard);
+
+    void refresh(Shard& shard, ServerConnection& connection);
+    void closeConnection(Shard& shard, ServerConnection& connection);
+};
+
+#endif // SHARDED_SERVER_H
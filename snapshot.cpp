@@ -0,0 +1,286 @@
+#include "snapshot.h"
+#include "crc32c.h"
+#include "file_util.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Records and the header are written and mapped as raw structs
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "snapshot format assumes a little-endian host");
+
+namespace {
+
+const char kMagic[8] = {'C', 'A', 'L', 'S', 'N', 'A', 'P', '1'};
+const uint32_t kVersion = 1;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t event_count;
+    uint64_t title_bytes;
+    int32_t next_event_id;
+    uint32_t records_crc;
+    uint32_t titles_crc;
+    uint32_t reserved[4];
+    uint32_t header_crc;  // CRC32C of the 60 bytes before it
+};
+static_assert(sizeof(SnapshotHeader) == 64, "SnapshotHeader must stay 64 bytes on disk");
+
+uint32_t headerCrc(const SnapshotHeader& header) {
+    return crc32c(&header, offsetof(SnapshotHeader, header_crc));
+}
+
+}  // namespace
+
+SnapshotFile::SnapshotFile()
+    : map_(nullptr), map_size_(0), records_(nullptr), titles_(nullptr), title_bytes_(0),
+      count_(0), next_event_id_(1) {
+}
+
+SnapshotFile::~SnapshotFile() {
+    close();
+}
+
+bool SnapshotFile::write(const std::string& path, const std::vector<Event>& events,
+                         int next_event_id, const std::vector<Event>& tombstones) {
+    std::vector<SnapshotRecord> records;
+    records.reserve(events.size() + tombstones.size());
+    std::string titles;
+
+    // Merge the two sorted inputs into one sorted record array
+    EventComparator less;
+    size_t e = 0;
+    size_t t = 0;
+    while (e < events.size() || t < tombstones.size()) {
+        bool tombstone = e == events.size() ||
+                         (t < tombstones.size() && less(tombstones[t], events[e]));
+        const Event& event = tombstone ? tombstones[t++] : events[e++];
+        size_t title_size = tombstone ? 0 : event.title.size();
+        if (titles.size() + title_size > UINT32_MAX) {
+            return false;  // Title offsets are 32-bit
+        }
+        SnapshotRecord r;
+        r.start_utc = static_cast<int64_t>(event.start_utc);
+        r.end_utc = static_cast<int64_t>(event.end_utc);
+        r.id = event.id;
+        r.title_offset = static_cast<uint32_t>(titles.size());
+        r.title_length = static_cast<uint32_t>(title_size);
+        r.flags = tombstone ? SnapshotRecord::kTombstone : 0;
+        titles.append(event.title, 0, title_size);
+        records.push_back(r);
+    }
+
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.record_size = sizeof(SnapshotRecord);
+    header.event_count = records.size();
+    header.title_bytes = titles.size();
+    header.next_event_id = next_event_id;
+    header.records_crc = crc32c(records.data(), records.size() * sizeof(SnapshotRecord));
+    header.titles_crc = crc32c(titles.data(), titles.size());
+    header.header_crc = headerCrc(header);
+
+    FileUtil::Piece pieces[] = {
+        {reinterpret_cast<const char*>(&header), sizeof(header)},
+        {reinterpret_cast<const char*>(records.data()), records.size() * sizeof(SnapshotRecord)},
+        {titles.data(), titles.size()},
+    };
+    return FileUtil::writeFileAtomically(path, pieces, 3);
+}
+
+bool SnapshotFile::open(const std::string& path, bool verify_contents) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+        ::close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    // Loading reads the file front to back once; sparse readers jump around
+    ::madvise(map, size, verify_contents ? MADV_SEQUENTIAL : MADV_RANDOM);
+
+    const char* base = static_cast<const char*>(map);
+    SnapshotHeader header;
+    std::memcpy(&header, base, sizeof(header));
+
+    bool ok = std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+              header.version == kVersion &&
+              header.record_size == sizeof(SnapshotRecord) &&
+              header.header_crc == headerCrc(header) &&
+              header.event_count <= (size - sizeof(header)) / sizeof(SnapshotRecord) &&
+              header.title_bytes ==
+                  size - sizeof(header) - header.event_count * sizeof(SnapshotRecord);
+    if (ok) {
+        const char* records = base + sizeof(header);
+        const char* titles = records + header.event_count * sizeof(SnapshotRecord);
+        if (verify_contents) {
+            ok = crc32c(records, header.event_count * sizeof(SnapshotRecord)) == header.records_crc &&
+                 crc32c(titles, header.title_bytes) == header.titles_crc;
+        }
+        if (ok) {
+            records_ = reinterpret_cast<const SnapshotRecord*>(records);
+            titles_ = titles;
+            title_bytes_ = static_cast<size_t>(header.title_bytes);
+        }
+    }
+    if (!ok) {
+        ::munmap(map, size);
+        return false;
+    }
+
+    map_ = map;
+    map_size_ = size;
+    count_ = static_cast<size_t>(header.event_count);
+    next_event_id_ = header.next_event_id;
+    return true;
+}
+
+void SnapshotFile::close() {
+    if (map_) {
+        ::munmap(map_, map_size_);
+    }
+    map_ = nullptr;
+    map_size_ = 0;
+    records_ = nullptr;
+    titles_ = nullptr;
+    title_bytes_ = 0;
+    count_ = 0;
+    next_event_id_ = 1;
+}
+
+namespace {
+
+// Bytes gathered per buffer before a write
+const size_t kWriterBufferSize = 1 << 20;
+
+}  // namespace
+
+SnapshotWriter::SnapshotWriter()
+    : fd_(-1), record_count_(0), title_bytes_(0), records_added_(0), titles_added_(0),
+      records_offset_(0), titles_offset_(0), records_crc_(0), titles_crc_(0) {
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    abandon();
+}
+
+void SnapshotWriter::abandon() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        ::unlink((path_ + ".tmp").c_str());
+        fd_ = -1;
+    }
+}
+
+bool SnapshotWriter::open(const std::string& path, size_t record_count, size_t title_bytes) {
+    abandon();
+    if (title_bytes > UINT32_MAX) {
+        return false;  // Title offsets are 32-bit
+    }
+    path_ = path;
+    fd_ = ::open((path + ".tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        return false;
+    }
+    record_count_ = record_count;
+    title_bytes_ = title_bytes;
+    records_added_ = 0;
+    titles_added_ = 0;
+    records_buffer_.clear();
+    titles_buffer_.clear();
+    records_buffer_.reserve(kWriterBufferSize);
+    titles_buffer_.reserve(kWriterBufferSize);
+    records_offset_ = sizeof(SnapshotHeader);
+    titles_offset_ = records_offset_ + static_cast<off_t>(record_count * sizeof(SnapshotRecord));
+    records_crc_ = 0;
+    titles_crc_ = 0;
+    return true;
+}
+
+bool SnapshotWriter::flushBuffers() {
+    records_crc_ = crc32c(records_buffer_.data(), records_buffer_.size(), records_crc_);
+    titles_crc_ = crc32c(titles_buffer_.data(), titles_buffer_.size(), titles_crc_);
+    bool ok = FileUtil::writeAllAt(fd_, records_buffer_.data(), records_buffer_.size(), records_offset_) &&
+              FileUtil::writeAllAt(fd_, titles_buffer_.data(), titles_buffer_.size(), titles_offset_);
+    records_offset_ += static_cast<off_t>(records_buffer_.size());
+    titles_offset_ += static_cast<off_t>(titles_buffer_.size());
+    records_buffer_.clear();
+    titles_buffer_.clear();
+    return ok;
+}
+
+bool SnapshotWriter::add(const SnapshotEventView& event, bool tombstone) {
+    size_t title_size = tombstone ? 0 : event.title.size();
+    if (fd_ < 0 || records_added_ == record_count_ || title_size > title_bytes_ - titles_added_) {
+        return false;
+    }
+    SnapshotRecord r;
+    r.start_utc = static_cast<int64_t>(event.start_utc);
+    r.end_utc = static_cast<int64_t>(event.end_utc);
+    r.id = event.id;
+    r.title_offset = static_cast<uint32_t>(titles_added_);
+    r.title_length = static_cast<uint32_t>(title_size);
+    r.flags = tombstone ? SnapshotRecord::kTombstone : 0;
+    records_buffer_.append(reinterpret_cast<const char*>(&r), sizeof(r));
+    titles_buffer_.append(event.title.data(), title_size);
+    records_added_++;
+    titles_added_ += title_size;
+
+    if (records_buffer_.size() >= kWriterBufferSize || titles_buffer_.size() >= kWriterBufferSize) {
+        return flushBuffers();
+    }
+    return true;
+}
+
+bool SnapshotWriter::finish(int next_event_id) {
+    if (fd_ < 0) {
+        return false;
+    }
+    bool ok = records_added_ == record_count_ && titles_added_ == title_bytes_ && flushBuffers();
+
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.record_size = sizeof(SnapshotRecord);
+    header.event_count = record_count_;
+    header.title_bytes = title_bytes_;
+    header.next_event_id = next_event_id;
+    header.records_crc = records_crc_;
+    header.titles_crc = titles_crc_;
+    header.header_crc = headerCrc(header);
+    ok = ok && FileUtil::writeAllAt(fd_, reinterpret_cast<const char*>(&header), sizeof(header), 0) &&
+         ::fsync(fd_) == 0;
+    if (!ok) {
+        abandon();
+        return false;
+    }
+
+    std::string tmp_path = path_ + ".tmp";
+    ok = ::close(fd_) == 0;
+    fd_ = -1;
+    ok = ok && std::rename(tmp_path.c_str(), path_.c_str()) == 0;
+    if (!ok) {
+        ::unlink(tmp_path.c_str());
+        return false;
+    }
+    FileUtil::syncParentDirectory(path_);
+    return true;
+}
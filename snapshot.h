@@ -0,0 +1,180 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "event.h"
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Fixed-width on-disk event record. Records are sorted by (start_utc, id),
+ * the same order as EventComparator, so a loader can build the in-memory
+ * index without sorting.
+ */
+struct SnapshotRecord {
+    // flags: the record marks a deletion of an event stored in an older
+    // file (LSM runs only; checkpoints and archive segments never have it)
+    static const uint32_t kTombstone = 1;
+
+    int64_t start_utc;
+    int64_t end_utc;
+    int32_t id;
+    uint32_t title_offset;  // Into the title blob
+    uint32_t title_length;
+    uint32_t flags;
+
+    bool isTombstone() const { return (flags & kTombstone) != 0; }
+};
+static_assert(sizeof(SnapshotRecord) == 32, "SnapshotRecord must stay 32 bytes on disk");
+
+/**
+ * Read-only view of an event stored in a snapshot file. The title points
+ * into the file mapping and is valid while the SnapshotFile is open.
+ */
+struct SnapshotEventView {
+    int id;
+    time_t start_utc;
+    time_t end_utc;
+    std::string_view title;
+};
+
+/**
+ * Compact binary checkpoint of a calendar.
+ *
+ * Layout (little-endian, as written by x86/ARM hosts):
+ *   header (64 bytes): magic "CALSNAP1", version, counts, next event ID,
+ *                      CRC32C of the record array, of the title blob and
+ *                      of the header itself
+ *   records:           event_count x SnapshotRecord, sorted
+ *   title blob:        all titles back to back
+ *
+ * Files are written to "<path>.tmp", fsynced and renamed over the old
+ * file, so a crash leaves either the old or the new snapshot intact.
+ * Reading mmaps the file; records and titles are used in place.
+ */
+class SnapshotFile {
+public:
+    SnapshotFile();
+    ~SnapshotFile();
+
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+    /**
+     * Write a snapshot atomically.
+     *
+     * @param path Destination file
+     * @param events Events sorted by EventComparator
+     * @param next_event_id ID counter to restore on load
+     * @param tombstones Deletion markers (sorted keys) merged into the
+     *        record array with SnapshotRecord::kTombstone set
+     * @return false on an I/O error (the previous file is left untouched)
+     */
+    static bool write(const std::string& path, const std::vector<Event>& events, int next_event_id,
+                      const std::vector<Event>& tombstones = std::vector<Event>());
+
+    /**
+     * mmap a snapshot and verify its checksums.
+     *
+     * @param path File to open
+     * @param verify_contents Also checksum the records and titles. That
+     *        reads the whole file; pass false for large files that are
+     *        queried sparsely (only the header is checked then)
+     * @return false if the file is missing, truncated or corrupt
+     */
+    bool open(const std::string& path, bool verify_contents = true);
+
+    void close();
+
+    size_t size() const { return count_; }
+    int nextEventId() const { return next_event_id_; }
+
+    /**
+     * Event i (0 <= i < size()), zero-copy. A title pointing outside the
+     * blob (possible only in an unverified file) reads as empty.
+     */
+    SnapshotEventView event(size_t i) const {
+        const SnapshotRecord& r = records_[i];
+        std::string_view title;
+        if (r.title_offset <= title_bytes_ && r.title_length <= title_bytes_ - r.title_offset) {
+            title = std::string_view(titles_ + r.title_offset, r.title_length);
+        }
+        return SnapshotEventView{r.id, static_cast<time_t>(r.start_utc),
+                                 static_cast<time_t>(r.end_utc), title};
+    }
+
+    /**
+     * Raw sorted record array (size() entries), for binary searches.
+     */
+    const SnapshotRecord* records() const { return records_; }
+
+private:
+    void* map_;
+    size_t map_size_;
+    const SnapshotRecord* records_;
+    const char* titles_;
+    size_t title_bytes_;
+    size_t count_;
+    int next_event_id_;
+};
+
+/**
+ * Writes a snapshot file record by record, for outputs too large to build
+ * in memory first (LSM merges). The record count and title bytes must be
+ * known up front: they fix where the titles start, so records and titles
+ * are each streamed through a small buffer to their place in the file.
+ * Same atomic replace as SnapshotFile::write.
+ */
+class SnapshotWriter {
+public:
+    SnapshotWriter();
+    ~SnapshotWriter();  // Deletes an unfinished file
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    /**
+     * Start "<path>.tmp" for exactly record_count records whose titles
+     * total title_bytes.
+     *
+     * @return false on an I/O error or if the titles do not fit 32-bit offsets
+     */
+    bool open(const std::string& path, size_t record_count, size_t title_bytes);
+
+    /**
+     * Append the next record (in EventComparator order). A tombstone's
+     * title is not stored.
+     *
+     * @return false on an I/O error or past the announced sizes
+     */
+    bool add(const SnapshotEventView& event, bool tombstone);
+
+    /**
+     * Write the header, fsync and rename over the destination.
+     *
+     * @return false on an I/O error, or if fewer records or title bytes
+     *         were added than announced (the old file is left untouched)
+     */
+    bool finish(int next_event_id);
+
+private:
+    std::string path_;
+    int fd_;
+    size_t record_count_;
+    size_t title_bytes_;
+    size_t records_added_;
+    size_t titles_added_;
+    std::string records_buffer_;
+    std::string titles_buffer_;
+    off_t records_offset_;  // Where each buffer goes when flushed
+    off_t titles_offset_;
+    uint32_t records_crc_;
+    uint32_t titles_crc_;
+
+    bool flushBuffers();
+    void abandon();
+};
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,83 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * Bounded lock-free queue for exactly one producer thread and one consumer
+ * thread (a ring buffer with acquire/release indices).
+ *
+ * Each side caches the other side's index and only reloads it when the
+ * cached value says the queue is full (producer) or empty (consumer), so
+ * in the common case a push or pop touches no cache line the other core
+ * is writing.
+ */
+template <typename T>
+class SpscQueue {
+public:
+    /**
+     * @param capacity Rounded up to a power of two
+     */
+    explicit SpscQueue(size_t capacity) : head_(0), cached_tail_(0), tail_(0), cached_head_(0) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots_.resize(size);
+        mask_ = size - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    /**
+     * Producer only.
+     *
+     * @return false (item untouched) if the queue is full
+     */
+    bool push(T& item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ > mask_) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ > mask_) {
+                return false;
+            }
+        }
+        slots_[tail & mask_] = std::move(item);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Consumer only.
+     *
+     * @return false if the queue is empty
+     */
+    bool pop(T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_) {
+                return false;
+            }
+        }
+        item = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::vector<T> slots_;
+    size_t mask_;
+
+    // One cache line per side: its own index plus its copy of the other's
+    alignas(64) std::atomic<size_t> head_;  // Written by the consumer
+    size_t cached_tail_;                    // Consumer's last view of tail_
+    alignas(64) std::atomic<size_t> tail_;  // Written by the producer
+    size_t cached_head_;                    // Producer's last view of head_
+};
+
+#endif // SPSC_QUEUE_H
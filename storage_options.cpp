@@ -0,0 +1,63 @@
+#include "storage_options.h"
+#include <cstdlib>
+
+FlagResult parseStorageFlag(int argc, char* argv[], int& i, StorageOptions& options) {
+    std::string arg = argv[i];
+    if (arg != "--data-dir" && arg != "--sync" && arg != "--sync-interval-ms" && arg != "--engine" &&
+        arg != "--memtable-limit") {
+        return FlagResult::Unknown;
+    }
+    if (i + 1 >= argc) {
+        return FlagResult::Invalid;
+    }
+    std::string value = argv[++i];
+
+    if (arg == "--data-dir") {
+        options.data_dir = value;
+    } else if (arg == "--sync") {
+        if (value == "every") {
+            options.wal.sync_policy = WalSyncPolicy::EveryOp;
+        } else if (value == "batched") {
+            options.wal.sync_policy = WalSyncPolicy::Batched;
+        } else if (value == "interval") {
+            options.wal.sync_policy = WalSyncPolicy::Interval;
+        } else {
+            return FlagResult::Invalid;
+        }
+    } else if (arg == "--sync-interval-ms") {
+        options.wal.interval_ms = std::atoi(value.c_str());
+        if (options.wal.interval_ms <= 0) {
+            return FlagResult::Invalid;
+        }
+    } else if (arg == "--engine") {
+        if (value != "memory" && value != "lsm") {
+            return FlagResult::Invalid;
+        }
+        options.use_lsm = value == "lsm";
+    } else {
+        int limit = std::atoi(value.c_str());
+        if (limit <= 0) {
+            return FlagResult::Invalid;
+        }
+        options.lsm.memtable_limit = static_cast<size_t>(limit);
+    }
+    return FlagResult::Consumed;
+}
+
+const char* storageUsage() {
+    return "  --data-dir DIR        Keep events in DIR (snapshot + write-ahead log); default: in memory only\n"
+           "  --sync POLICY         every: fsync each change; batched: group commit (default);\n"
+           "                        interval: fsync in the background\n"
+           "  --sync-interval-ms N  Background fsync period for --sync interval (default 100)\n"
+           "  --engine ENGINE       memory: all events in memory (default); lsm: write-optimized\n"
+           "                        on-disk runs, for ingest-heavy calendars (needs --data-dir)\n"
+           "  --memtable-limit N    LSM changes buffered in memory before a flush (default 100000)\n";
+}
+
+bool openStorage(CalendarService& calendar_service, const StorageOptions& options) {
+    if (options.use_lsm) {
+        return !options.data_dir.empty() &&
+               calendar_service.openLsmStorage(options.data_dir, options.wal, options.lsm);
+    }
+    return options.data_dir.empty() || calendar_service.openPersistence(options.data_dir, options.wal);
+}
@@ -0,0 +1,47 @@
+#ifndef STORAGE_OPTIONS_H
+#define STORAGE_OPTIONS_H
+
+#include "calendar_service.h"
+#include "lsm.h"
+#include "wal.h"
+#include <string>
+
+/**
+ * How a calendar process stores its events, from the command line flags
+ * shared by every binary (--data-dir, --sync, --engine, ...).
+ */
+struct StorageOptions {
+    std::string data_dir;  // Empty: in memory only
+    WalOptions wal;
+    LsmOptions lsm;
+    bool use_lsm;
+
+    StorageOptions() : use_lsm(false) {}
+};
+
+enum class FlagResult {
+    Consumed,  // argv[i] (and its value) was a storage flag; i now points at the last one used
+    Unknown,   // Not a storage flag
+    Invalid    // A storage flag with a bad or missing value
+};
+
+/**
+ * Try to parse argv[i] as a storage flag.
+ */
+FlagResult parseStorageFlag(int argc, char* argv[], int& i, StorageOptions& options);
+
+/**
+ * Usage lines for the storage flags (each ends with a newline).
+ */
+const char* storageUsage();
+
+/**
+ * Open the storage the options describe: in memory (nothing to do),
+ * snapshot + write-ahead log, or the LSM engine.
+ *
+ * @return false if the flags are inconsistent or the data directory
+ *         cannot be opened
+ */
+bool openStorage(CalendarService& calendar_service, const StorageOptions& options);
+
+#endif // STORAGE_OPTIONS_H
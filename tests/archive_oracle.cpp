@@ -0,0 +1,261 @@
+// The archive tier against a plain sorted list of events: random creates,
+// deletes, archiveBefore calls and restarts, with range queries, pages
+// and archive-only queries checked across the cutoff.
+#include "calendar_service.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void fail(const char* what, long long value) {
+    if (failures++ < 10) {
+        std::printf("FAIL %s (%lld)\n", what, value);
+    }
+}
+
+// What the calendar should hold: every event, sorted by start, and which
+// of them are archived
+struct Model {
+    std::vector<Event> events;
+    std::vector<bool> archived;  // Parallel to events
+    time_t archived_until = 0;   // Latest end of an archived event
+
+    bool overlapsAny(time_t start_utc, time_t end_utc) const {
+        for (const Event& event : events) {
+            if (event.start_utc < end_utc && event.end_utc > start_utc) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool canCreate(time_t start_utc, time_t end_utc) const {
+        return end_utc > archived_until && !overlapsAny(start_utc, end_utc);
+    }
+
+    void add(const Event& event) {
+        auto it = std::lower_bound(events.begin(), events.end(), event, EventComparator());
+        archived.insert(archived.begin() + (it - events.begin()), false);
+        events.insert(it, event);
+    }
+
+    bool remove(int id) {
+        for (size_t i = 0; i < events.size(); i++) {
+            if (events[i].id == id) {
+                if (archived[i]) {
+                    return false;  // The archive is read-only
+                }
+                events.erase(events.begin() + i);
+                archived.erase(archived.begin() + i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int archiveBefore(time_t cutoff_utc) {
+        int moved = 0;
+        for (size_t i = 0; i < events.size(); i++) {
+            if (!archived[i] && events[i].end_utc <= cutoff_utc) {
+                archived[i] = true;
+                archived_until = std::max(archived_until, events[i].end_utc);
+                moved++;
+            }
+        }
+        return moved;
+    }
+
+    std::vector<Event> overlapping(time_t start_utc, time_t end_utc, bool archived_only) const {
+        std::vector<Event> out;
+        for (size_t i = 0; i < events.size(); i++) {
+            if (events[i].start_utc < end_utc && events[i].end_utc > start_utc && (archived[i] || !archived_only)) {
+                out.push_back(events[i]);
+            }
+        }
+        return out;
+    }
+};
+
+bool sameEvents(const std::vector<Event>& a, const std::vector<Event>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].id != b[i].id || a[i].title != b[i].title || a[i].start_utc != b[i].start_utc ||
+            a[i].end_utc != b[i].end_utc) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool sameEvents(const std::vector<SnapshotEventView>& a, const std::vector<Event>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].id != b[i].id || a[i].title != b[i].title || a[i].start_utc != b[i].start_utc ||
+            a[i].end_utc != b[i].end_utc) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::unique_ptr<CalendarService> openCalendar(const std::string& dir) {
+    std::unique_ptr<CalendarService> calendar(new CalendarService());
+    WalOptions wal;
+    wal.sync_policy = WalSyncPolicy::Interval;
+    if (!calendar->openPersistence(dir, wal)) {
+        fail("open calendar", 0);
+        return nullptr;
+    }
+    return calendar;
+}
+
+// Walk every event in pages of the given size
+bool walkMatches(CalendarService& calendar, const Model& model, size_t limit) {
+    std::vector<Event> walked;
+    std::vector<Event> page;
+    time_t from = std::numeric_limits<time_t>::min();
+    do {
+        calendar.getEventsPage(from, limit, page);
+        walked.insert(walked.end(), page.begin(), page.end());
+        if (!page.empty()) {
+            from = page.back().start_utc + 1;
+        }
+    } while (page.size() == limit);
+    return sameEvents(walked, model.events);
+}
+
+void checkRandomMix(const std::string& dir, std::mt19937& rng) {
+    Model model;
+    std::unique_ptr<CalendarService> calendar = openCalendar(dir);
+    if (!calendar) {
+        return;
+    }
+
+    // Two years of quarter-hour slots; the cutoff sweeps forward through
+    // them, so creates keep landing on both sides of it
+    const time_t kBase = 1735689600;  // 2025-01-01
+    const time_t kSpan = 2 * 365 * 86400;
+    time_t cutoff = kBase;
+    auto randomTime = [&rng, &cutoff, kBase, kSpan]() {
+        if (rng() % 2 == 0) {
+            return cutoff - 7 * 86400 + static_cast<time_t>(rng() % (14 * 96)) * 900;
+        }
+        return kBase + static_cast<time_t>(rng() % (kSpan / 900)) * 900;
+    };
+
+    for (int op = 0; op < 20000; op++) {
+        unsigned roll = rng() % 1000;
+        if (roll < 550) {
+            time_t start = randomTime();
+            time_t end = start + 900 * static_cast<time_t>(1 + rng() % 8);
+            std::string title = "Event " + std::to_string(op);
+            bool expected = model.canCreate(start, end);
+            int id = calendar->createEvent(title, start, end);
+            if ((id >= 0) != expected) {
+                fail("create", op);
+            }
+            if (id >= 0) {
+                model.add(Event(id, title, start, end));
+            }
+        } else if (roll < 700) {
+            if (model.events.empty()) {
+                continue;
+            }
+            int id = model.events[rng() % model.events.size()].id;
+            if (calendar->deleteEvent(id) != model.remove(id)) {
+                fail("delete", id);
+            }
+        } else if (roll < 800) {
+            time_t start = randomTime();
+            time_t end = start + static_cast<time_t>(rng() % (14 * 86400));
+            if (!sameEvents(calendar->getWeeklyEvents(start, end), model.overlapping(start, end, false))) {
+                fail("range", op);
+            }
+            if (!sameEvents(calendar->getArchivedEvents(start, end), model.overlapping(start, end, true))) {
+                fail("archived range", op);
+            }
+        } else if (roll < 900) {
+            time_t from = randomTime();
+            size_t limit = 1 + rng() % 40;
+            std::vector<Event> page;
+            calendar->getEventsPage(from, limit, page);
+            std::vector<Event> expected;
+            for (const Event& event : model.events) {
+                if (event.start_utc >= from && expected.size() < limit) {
+                    expected.push_back(event);
+                }
+            }
+            if (!sameEvents(page, expected)) {
+                fail("page", op);
+            }
+        } else if (roll < 990) {
+            if (!sameEvents(calendar->getAllEvents(), model.events)) {
+                fail("all events", op);
+            }
+        } else if (roll < 997) {
+            // Mostly forward, sometimes behind what is archived already
+            time_t next = cutoff + static_cast<time_t>(rng() % (30 * 96)) * 900 - 5 * 86400;
+            int expected = model.archiveBefore(next);
+            if (calendar->archiveBefore(next) != expected) {
+                fail("archiveBefore", op);
+            }
+            cutoff = std::max(cutoff, next);
+        } else {
+            // Restart: the segments plus the log's Archive records
+            calendar.reset();
+            calendar = openCalendar(dir);
+            if (!calendar) {
+                return;
+            }
+        }
+    }
+
+    if (!walkMatches(*calendar, model, 1) || !walkMatches(*calendar, model, 97)) {
+        fail("page walk", 0);
+    }
+    size_t archived = static_cast<size_t>(std::count(model.archived.begin(), model.archived.end(), true));
+    if (archived == 0 || archived == model.events.size()) {
+        fail("events on both sides of the cutoff", static_cast<long long>(archived));
+    }
+    calendar.reset();
+    calendar = openCalendar(dir);
+    if (calendar && !sameEvents(calendar->getAllEvents(), model.events)) {
+        fail("all events after restart", 0);
+    }
+}
+
+}  // namespace
+
+int main() {
+    char dir[] = "/tmp/archive_oracle.XXXXXX";
+    if (::mkdtemp(dir) == nullptr) {
+        std::perror("archive_oracle: mkdtemp");
+        return 1;
+    }
+    std::mt19937 rng(20250310);
+    checkRandomMix(dir, rng);
+
+    std::string cleanup = "rm -rf " + std::string(dir);
+    if (std::system(cleanup.c_str()) != 0) {
+        std::printf("archive_oracle: cannot remove %s\n", dir);
+    }
+    if (failures > 0) {
+        std::printf("archive_oracle: %d failures\n", failures);
+        return 1;
+    }
+    std::printf("archive_oracle: OK\n");
+    return 0;
+}
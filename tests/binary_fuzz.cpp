@@ -0,0 +1,172 @@
+// The binary protocol: request frames built by RequestBuilder round-trip
+// through BinaryProcessor and parseResponse, and corrupted payloads are
+// answered by exactly one well-formed frame without crashing.
+#include "binary_protocol.h"
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void fail(const char* what, long long value) {
+    if (failures++ < 10) {
+        std::printf("FAIL %s (%lld)\n", what, value);
+    }
+}
+
+// Strip the length prefix of the single frame in data
+bool payloadOf(const std::string& data, std::string& payload) {
+    size_t header_size, payload_size;
+    if (BinaryProtocol::findFrame(data.data(), data.size(), data.size(), header_size, payload_size) != 1 ||
+        header_size + payload_size != data.size()) {
+        return false;
+    }
+    payload = data.substr(header_size);
+    return true;
+}
+
+// Creates in free slots, then a query that must return them; creates that
+// conflict, carry control characters or lie outside years 0001-9998 fail
+void checkRoundTrip() {
+    CalendarService calendar;
+    BinaryProcessor processor(calendar);
+    BinaryProtocol::RequestBuilder builder;
+    const time_t base = 1893456000;  // 2030-01-01
+    for (int i = 0; i < 50; i++) {
+        builder.addCreate("event " + std::to_string(i), base + i * 3600, base + i * 3600 + 1800);
+    }
+    builder.addCreate("conflict", base + 60, base + 120);
+    builder.addCreate("two\nlines", base - 7200, base - 3600);
+    builder.addCreate("bell\x07", base - 7200, base - 3600);
+    // Raw int64 times outside years 0001-9998 cannot be listed or exported
+    builder.addCreate("far future", 320000000000LL, 320000003600LL);
+    builder.addCreate("far past", -70000000000LL, -69999996400LL);
+    std::string request = builder.finish();
+
+    std::string payload, response, response_payload;
+    std::vector<BinaryProtocol::OpResult> results;
+    if (!payloadOf(request, payload)) {
+        fail("request frame", 0);
+        return;
+    }
+    processor.execute(payload.data(), payload.size(), response);
+    if (!payloadOf(response, response_payload) ||
+        !BinaryProtocol::parseResponse(response_payload.data(), response_payload.size(), results) ||
+        results.size() != 55) {
+        fail("create response", static_cast<long long>(results.size()));
+        return;
+    }
+    for (int i = 0; i < 50; i++) {
+        if (results[i].type != BinaryProtocol::kCreate || results[i].status != BinaryProtocol::kOk) {
+            fail("create result", i);
+        }
+    }
+    if (results[50].status != BinaryProtocol::kFailed) {
+        fail("conflicting create accepted", 50);
+    }
+    if (results[51].status != BinaryProtocol::kFailed || results[52].status != BinaryProtocol::kFailed) {
+        fail("title with a control character accepted", 51);
+    }
+    if (results[53].status != BinaryProtocol::kFailed || results[54].status != BinaryProtocol::kFailed) {
+        fail("time outside the renderable years accepted", 53);
+    }
+
+    builder.addQuery(base, base + 50 * 3600);
+    builder.addDelete(results[0].event_id);
+    builder.addDelete(results[0].event_id);
+    std::string query = builder.finish();
+    response.clear();
+    if (!payloadOf(query, payload)) {
+        fail("query frame", 0);
+        return;
+    }
+    processor.execute(payload.data(), payload.size(), response);
+    if (!payloadOf(response, response_payload) ||
+        !BinaryProtocol::parseResponse(response_payload.data(), response_payload.size(), results) ||
+        results.size() != 3 || results[0].events.size() != 50) {
+        fail("query response", static_cast<long long>(results.size()));
+        return;
+    }
+    for (int i = 0; i < 50; i++) {
+        const Event& event = results[0].events[i];
+        if (event.title != "event " + std::to_string(i) || event.start_utc != base + i * 3600 ||
+            event.end_utc != base + i * 3600 + 1800) {
+            fail("queried event", i);
+        }
+    }
+    if (results[1].status != BinaryProtocol::kOk || results[2].status != BinaryProtocol::kFailed) {
+        fail("delete results", 0);
+    }
+}
+
+// Valid requests with bytes flipped, cut short or extended
+void checkCorruption() {
+    CalendarService calendar;
+    BinaryProcessor processor(calendar);
+    std::mt19937 rng(20250310);
+    for (int round = 0; round < 200000; round++) {
+        BinaryProtocol::RequestBuilder builder;
+        int ops = 1 + static_cast<int>(rng() % 6);
+        for (int i = 0; i < ops; i++) {
+            time_t start = 1893456000 + static_cast<time_t>(rng() % 1000000);
+            switch (rng() % 3) {
+            case 0:
+                builder.addCreate(std::string(rng() % 20, 'x'), start, start + 1 + rng() % 7200);
+                break;
+            case 1:
+                builder.addDelete(static_cast<int>(rng() % 100));
+                break;
+            default:
+                builder.addQuery(start, start + rng() % 86400);
+            }
+        }
+        std::string payload;
+        payloadOf(builder.finish(), payload);
+        int edits = 1 + static_cast<int>(rng() % 3);
+        for (int i = 0; i < edits; i++) {
+            size_t at = rng() % (payload.size() + 1);
+            switch (rng() % 3) {
+            case 0:
+                if (at < payload.size()) {
+                    payload[at] = static_cast<char>(rng());
+                }
+                break;
+            case 1:
+                payload.resize(at);
+                break;
+            default:
+                payload.insert(at, 1, static_cast<char>(rng()));
+            }
+        }
+
+        std::string response, response_payload;
+        std::vector<BinaryProtocol::OpResult> results;
+        processor.execute(payload.data(), payload.size(), response);
+        if (!payloadOf(response, response_payload) || response_payload.empty()) {
+            fail("response frame", round);
+            continue;
+        }
+        bool parsed = BinaryProtocol::parseResponse(response_payload.data(), response_payload.size(), results);
+        if (parsed == (response_payload[0] == static_cast<char>(BinaryProtocol::kMalformed))) {
+            fail("response status", round);
+        }
+        // The client decoder must survive garbage too
+        BinaryProtocol::parseResponse(payload.data(), payload.size(), results);
+    }
+}
+
+}  // namespace
+
+int main() {
+    checkRoundTrip();
+    checkCorruption();
+    if (failures != 0) {
+        std::printf("binary_fuzz: %d failures\n", failures);
+        return 1;
+    }
+    std::printf("binary_fuzz: OK\n");
+    return 0;
+}
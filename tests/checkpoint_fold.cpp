@@ -0,0 +1,283 @@
+// Checkpoints fold the sealed log (calendar.wal.ckpt) into calendar.snap
+// in the background. A process killed at random points of the fold, a log
+// folded twice (crash between writing the snapshot and deleting the log)
+// and a failed fold retried by the next checkpoint must all reopen with
+// the events the calendar had acknowledged.
+#include "calendar_service.h"
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void fail(const char* what, long long value) {
+    if (failures++ < 10) {
+        std::printf("FAIL %s (%lld)\n", what, value);
+    }
+}
+
+bool sameEvents(const std::vector<Event>& a, const std::vector<Event>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].id != b[i].id || a[i].title != b[i].title || a[i].start_utc != b[i].start_utc ||
+            a[i].end_utc != b[i].end_utc) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool exists(const std::string& path) {
+    return ::access(path.c_str(), F_OK) == 0;
+}
+
+bool copyFile(const std::string& from, const std::string& to) {
+    std::string command = "cp " + from + " " + to;
+    return std::system(command.c_str()) == 0;
+}
+
+std::unique_ptr<CalendarService> openCalendar(const std::string& dir) {
+    std::unique_ptr<CalendarService> calendar(new CalendarService());
+    if (!calendar->openPersistence(dir, WalOptions())) {
+        fail("open calendar", 0);
+        return nullptr;
+    }
+    return calendar;
+}
+
+// The same creates (in batches, one fsync each) and, optionally, deletes
+// of earlier events for the same seed, in hour slots from first_slot on
+void addEvents(CalendarService& calendar, unsigned seed, int first_slot, int count, bool deletes = true) {
+    std::mt19937 rng(seed);
+    const time_t kBase = 1735689600;  // 2025-01-01
+    std::vector<NewEvent> batch;
+    for (int i = 0; i < count; i++) {
+        time_t start = kBase + static_cast<time_t>(first_slot + i) * 3600;
+        batch.push_back(NewEvent{"Event " + std::to_string(first_slot + i), start,
+                                 start + 60 * static_cast<time_t>(1 + rng() % 60)});
+        if (batch.size() == 1000 || i + 1 == count) {
+            for (int id : calendar.createEvents(batch)) {
+                if (id < 0) {
+                    fail("create", first_slot + i);
+                }
+            }
+            batch.clear();
+        }
+    }
+    std::vector<Event> events = deletes ? calendar.getAllEvents() : std::vector<Event>();
+    std::vector<int> ids;
+    for (size_t i = 0; i < events.size(); i += 1 + rng() % 12) {
+        ids.push_back(events[i].id);
+    }
+    calendar.deleteEvents(ids);  // Archived ones stay
+
+}
+
+// A calendar with a snapshot, an archive segment and a log, whose next
+// checkpoint folds about 10000 changes; returns the events after it
+std::vector<Event> prepare(CalendarService& calendar) {
+    addEvents(calendar, 1, 0, 3000);
+    if (!calendar.checkpoint() || !calendar.waitForCheckpoint()) {
+        fail("first checkpoint", 0);
+    }
+    addEvents(calendar, 2, 3000, 6000);
+    if (calendar.archiveBefore(1735689600 + 2000 * 3600) <= 0) {
+        fail("archiveBefore", 0);
+    }
+    addEvents(calendar, 3, 9000, 3000);
+    return calendar.getAllEvents();
+}
+
+// Kill a process doing the above at increasing delays after its
+// checkpoint started, while it keeps creating events (no deletes, so
+// what survives is a prefix of the reference history)
+void checkInterruptedFold(const std::string& base) {
+    std::vector<Event> expected;
+    {
+        std::unique_ptr<CalendarService> reference = openCalendar(base + "/reference");
+        if (!reference) {
+            return;
+        }
+        prepare(*reference);
+        reference->checkpoint();
+        addEvents(*reference, 4, 12000, 500, false);
+        reference->waitForCheckpoint();
+        expected = reference->getAllEvents();
+    }
+
+    int interrupted = 0;
+    const int kRounds = 10;
+    for (int round = 0; round < kRounds; round++) {
+        std::string dir = base + "/killed" + std::to_string(round);
+        int ready[2];
+        if (::pipe(ready) != 0) {
+            fail("pipe", round);
+            return;
+        }
+        pid_t child = ::fork();
+        if (child == 0) {
+            ::close(ready[0]);
+            std::unique_ptr<CalendarService> calendar(new CalendarService());
+            if (!calendar->openPersistence(dir, WalOptions())) {
+                std::_Exit(1);
+            }
+            prepare(*calendar);
+            char byte = 1;
+            if (!calendar->checkpoint() || ::write(ready[1], &byte, 1) != 1) {
+                std::_Exit(1);
+            }
+            addEvents(*calendar, 4, 12000, 500, false);
+            calendar->waitForCheckpoint();
+            ::pause();  // Killed, at the latest, here
+            std::_Exit(0);
+        }
+        ::close(ready[1]);
+        char byte = 0;
+        if (child < 0 || ::read(ready[0], &byte, 1) != 1) {
+            fail("child setup", round);
+            ::close(ready[0]);
+            return;
+        }
+        ::close(ready[0]);
+        ::usleep(static_cast<useconds_t>(round * round * 1000));
+        ::kill(child, SIGKILL);
+        int status;
+        ::waitpid(child, &status, 0);
+
+        // Everything up to the checkpoint was acknowledged; of the batch
+        // created during it, any prefix may have reached the log
+        interrupted += exists(dir + "/calendar.wal.ckpt") ? 1 : 0;
+        std::unique_ptr<CalendarService> reopened = openCalendar(dir);
+        if (!reopened) {
+            return;
+        }
+        if (exists(dir + "/calendar.wal.ckpt")) {
+            fail("sealed log left after startup", round);
+        }
+        std::vector<Event> events = reopened->getAllEvents();
+        std::vector<Event> acknowledged;
+        for (const Event& event : expected) {
+            if (event.start_utc < 1735689600 + 12000LL * 3600) {
+                acknowledged.push_back(event);
+            }
+        }
+        if (events.size() < acknowledged.size() || events.size() > expected.size() ||
+            !sameEvents(std::vector<Event>(events.begin(), events.begin() + acknowledged.size()), acknowledged) ||
+            !sameEvents(events, std::vector<Event>(expected.begin(), expected.begin() + events.size()))) {
+            fail("events after an interrupted fold", round);
+        }
+    }
+    if (interrupted == 0) {
+        std::printf("checkpoint_fold: no kill landed inside a fold\n");
+    }
+}
+
+// The snapshot is written but the sealed log survives (crash right before
+// the unlink): the next startup folds it in again without changes
+void checkFoldedTwice(const std::string& base) {
+    std::string dir = base + "/twice";
+    std::vector<Event> expected;
+    {
+        std::unique_ptr<CalendarService> calendar = openCalendar(dir);
+        if (!calendar) {
+            return;
+        }
+        expected = prepare(*calendar);
+    }
+    // Seal the log by hand, keeping a copy, and let startup fold it
+    if (std::rename((dir + "/calendar.wal").c_str(), (dir + "/calendar.wal.ckpt").c_str()) != 0 ||
+        !copyFile(dir + "/calendar.wal.ckpt", dir + "/sealed.copy")) {
+        fail("seal log", 0);
+        return;
+    }
+    for (int open = 0; open < 2; open++) {
+        std::unique_ptr<CalendarService> calendar = openCalendar(dir);
+        if (!calendar || !sameEvents(calendar->getAllEvents(), expected)) {
+            fail("events after folding", open);
+            return;
+        }
+        if (open == 0 && !copyFile(dir + "/sealed.copy", dir + "/calendar.wal.ckpt")) {
+            fail("restore sealed log", 0);
+            return;
+        }
+    }
+}
+
+// A fold that cannot write the snapshot keeps its sealed log; mutations
+// go on, and the next checkpoint folds that log instead of sealing another
+void checkFailedFoldRetried(const std::string& base) {
+    std::string dir = base + "/retry";
+    std::vector<Event> expected;
+    {
+        std::unique_ptr<CalendarService> calendar = openCalendar(dir);
+        if (!calendar) {
+            return;
+        }
+        prepare(*calendar);
+
+        // Files may not grow past 64 KiB: the fresh log fits, the snapshot not
+        struct rlimit saved;
+        ::getrlimit(RLIMIT_FSIZE, &saved);
+        struct rlimit limit = saved;
+        limit.rlim_cur = 64 * 1024;
+        std::signal(SIGXFSZ, SIG_IGN);
+        ::setrlimit(RLIMIT_FSIZE, &limit);
+        bool started = calendar->checkpoint();
+        bool folded = calendar->waitForCheckpoint();
+        addEvents(*calendar, 5, 30000, 300, false);
+        ::setrlimit(RLIMIT_FSIZE, &saved);
+
+        if (!started || folded || !exists(dir + "/calendar.wal.ckpt")) {
+            fail("failed fold keeps its sealed log", folded);
+        }
+        if (calendar->isReadOnly()) {
+            fail("read-only after a failed fold", 0);
+        }
+        if (!calendar->checkpoint() || !calendar->waitForCheckpoint() || exists(dir + "/calendar.wal.ckpt")) {
+            fail("retried fold", 0);
+        }
+        addEvents(*calendar, 6, 31000, 300);
+        expected = calendar->getAllEvents();
+    }
+    std::unique_ptr<CalendarService> reopened = openCalendar(dir);
+    if (reopened && !sameEvents(reopened->getAllEvents(), expected)) {
+        fail("events after a retried fold", 0);
+    }
+}
+
+}  // namespace
+
+int main() {
+    char dir[] = "/tmp/checkpoint_fold.XXXXXX";
+    if (::mkdtemp(dir) == nullptr) {
+        std::perror("checkpoint_fold: mkdtemp");
+        return 1;
+    }
+    std::string base = dir;
+    // Forks first, while this process has no other threads
+    checkInterruptedFold(base);
+    checkFoldedTwice(base);
+    checkFailedFoldRetried(base);
+
+    std::string cleanup = "rm -rf " + base;
+    if (std::system(cleanup.c_str()) != 0) {
+        std::printf("checkpoint_fold: cannot remove %s\n", dir);
+    }
+    if (failures > 0) {
+        std::printf("checkpoint_fold: %d failures\n", failures);
+        return 1;
+    }
+    std::printf("checkpoint_fold: OK\n");
+    return 0;
+}
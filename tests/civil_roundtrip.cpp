@@ -0,0 +1,103 @@
+// Civil date arithmetic (TimezoneUtils::daysFromCivil / civilFromDays) and
+// the libc-free utcToLocal, checked exhaustively over a wide date range.
+#include "timezone.h"
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void fail(const char* what, long long value) {
+    if (failures++ < 10) {
+        std::printf("FAIL %s at %lld\n", what, value);
+    }
+}
+
+// Every day in +/-2190 years of the epoch: the round trip returns the same
+// day count, and consecutive days step through the calendar one at a time
+void checkRoundTrip() {
+    const long long span = 2190LL * 146097 / 400;
+    LocalDate previous = TimezoneUtils::civilFromDays(-span - 1);
+    for (long long days = -span; days <= span; days++) {
+        LocalDate date = TimezoneUtils::civilFromDays(days);
+        if (TimezoneUtils::daysFromCivil(date.year, date.month, date.day) != days) {
+            fail("round trip", days);
+        }
+        if (date.month < 1 || date.month > 12 || date.day < 1 ||
+            date.day > TimezoneUtils::daysInMonth(date.year, date.month)) {
+            fail("field range", days);
+        }
+        bool next_day = date.year == previous.year && date.month == previous.month && date.day == previous.day + 1;
+        bool next_month = date.year == previous.year && date.month == previous.month + 1 && date.day == 1 &&
+                          previous.day == TimezoneUtils::daysInMonth(previous.year, previous.month);
+        bool next_year = date.year == previous.year + 1 && date.month == 1 && date.day == 1 &&
+                         previous.month == 12 && previous.day == 31;
+        if (!next_day && !next_month && !next_year) {
+            fail("successor", days);
+        }
+        if (TimezoneUtils::weekdayFromDays(days) != ((days % 7 + 7) % 7 + 4) % 7) {
+            fail("weekday", days);
+        }
+        previous = date;
+    }
+}
+
+// utcToLocal in UTC against gmtime_r, every 6997 seconds from 1970 to 2106
+void checkAgainstGmtime() {
+    for (long long t = 0; t < 4294967296LL; t += 6997) {
+        time_t utc = static_cast<time_t>(t);
+        struct tm tm;
+        gmtime_r(&utc, &tm);
+        char expected[32];
+        std::strftime(expected, sizeof(expected), "%Y-%m-%d %H:%M", &tm);
+        if (TimezoneUtils::utcToLocal(utc, "UTC") != expected) {
+            fail("utcToLocal vs gmtime_r", t);
+        }
+    }
+}
+
+// Conversions from several threads at once give the single-threaded answer
+// (gmtime's shared buffer used to make this racy)
+void checkThreads() {
+    std::vector<std::thread> threads;
+    std::vector<int> mismatches(4, 0);
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([i, &mismatches] {
+            TzId utc = TimezoneUtils::resolveTimezone("UTC");
+            for (long long t = i * 86399LL; t < 4000000000LL; t += 3599993) {
+                LocalDateTime local;
+                TimezoneUtils::toLocal(static_cast<time_t>(t), utc, local);
+                long long seconds = TimezoneUtils::toLocalSeconds(local.date, local.time);
+                if (seconds != t - t % 60) {
+                    mismatches[i]++;
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    for (int i = 0; i < 4; i++) {
+        if (mismatches[i] != 0) {
+            fail("threaded toLocal", i);
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    checkRoundTrip();
+    checkAgainstGmtime();
+    checkThreads();
+    if (failures != 0) {
+        std::printf("civil_roundtrip: %d failures\n", failures);
+        return 1;
+    }
+    std::printf("civil_roundtrip: OK\n");
+    return 0;
+}
@@ -0,0 +1,169 @@
+// countEvents, sumDurations and busyMinutesPerDay read archived events
+// from column files, skipping or summarizing whole blocks. Checked
+// against sums over getAllEvents() for random ranges and day grids,
+// with several multi-block segments plus live events.
+#include "calendar_service.h"
+#include "columnar.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void fail(const char* what, long long value) {
+    if (failures++ < 10) {
+        std::printf("FAIL %s (%lld)\n", what, value);
+    }
+}
+
+int64_t overlap(const Event& event, time_t start_utc, time_t end_utc) {
+    return std::max<int64_t>(0, std::min(event.end_utc, end_utc) - std::max(event.start_utc, start_utc));
+}
+
+// A time near the events: often exactly on an event edge, which is where
+// block summaries and range ends meet
+time_t randomTime(std::mt19937& rng, const std::vector<Event>& events, time_t first, time_t last) {
+    unsigned roll = rng() % 4;
+    const Event& event = events[rng() % events.size()];
+    if (roll == 0) {
+        return event.start_utc;
+    }
+    if (roll == 1) {
+        return event.end_utc;
+    }
+    return first - 86400 + static_cast<time_t>(rng() % static_cast<uint64_t>(last - first + 2 * 86400));
+}
+
+void checkScans(CalendarService& calendar, std::mt19937& rng, const char* when) {
+    std::vector<Event> events = calendar.getAllEvents();
+    if (events.empty()) {
+        fail(when, 0);
+        return;
+    }
+    time_t first = events.front().start_utc;
+    time_t last = events.back().end_utc;
+
+    for (int round = 0; round < 2000; round++) {
+        time_t a = randomTime(rng, events, first, last);
+        time_t b = rng() % 8 == 0 ? a : randomTime(rng, events, first, last);
+        time_t start = std::min(a, b);
+        time_t end = std::max(a, b);
+        if (round == 0) {
+            start = first - 1;  // Everything
+            end = last + 1;
+        }
+
+        uint64_t count = 0;
+        int64_t seconds = 0;
+        for (const Event& event : events) {
+            if (event.start_utc < end && event.end_utc > start) {
+                count++;
+                seconds += overlap(event, start, end);
+            }
+        }
+        if (calendar.countEvents(start, end) != count) {
+            fail(when, start);
+        }
+        if (calendar.sumDurations(start, end) != seconds) {
+            fail(when, end);
+        }
+
+        // A grid of days with uneven lengths (DST days are 23 or 25 hours)
+        std::vector<time_t> bounds(1, start);
+        size_t days = rng() % 40;
+        for (size_t i = 0; i < days; i++) {
+            bounds.push_back(bounds.back() + 86400 + (static_cast<time_t>(rng() % 3) - 1) * 3600);
+        }
+        std::vector<Event> in_grid;
+        for (const Event& event : events) {
+            if (event.start_utc < bounds.back() && event.end_utc > bounds.front()) {
+                in_grid.push_back(event);
+            }
+        }
+        std::vector<int64_t> busy(bounds.size() > 1 ? bounds.size() - 1 : 0, 0);
+        for (size_t day = 0; day + 1 < bounds.size(); day++) {
+            for (const Event& event : in_grid) {
+                busy[day] += overlap(event, bounds[day], bounds[day + 1]);
+            }
+            busy[day] /= 60;
+        }
+        if (calendar.busyMinutesPerDay(bounds) != busy) {
+            fail(when, static_cast<long long>(days));
+        }
+    }
+}
+
+std::unique_ptr<CalendarService> openCalendar(const std::string& dir) {
+    std::unique_ptr<CalendarService> calendar(new CalendarService());
+    WalOptions wal;
+    wal.sync_policy = WalSyncPolicy::Interval;
+    if (!calendar->openPersistence(dir, wal)) {
+        fail("open calendar", 0);
+        return nullptr;
+    }
+    return calendar;
+}
+
+}  // namespace
+
+int main() {
+    char dir[] = "/tmp/columnar_oracle.XXXXXX";
+    if (::mkdtemp(dir) == nullptr) {
+        std::perror("columnar_oracle: mkdtemp");
+        return 1;
+    }
+    std::mt19937 rng(20250310);
+
+    std::unique_ptr<CalendarService> calendar = openCalendar(dir);
+    if (calendar) {
+        // Back-to-back events of 1 s to 3 h with gaps of 0 s to 2 days,
+        // archived in three segments of more than one column block each
+        const size_t kEvents = 5 * ColumnSegment::kBlockSize;
+        time_t t = 1735689600;  // 2025-01-01
+        std::vector<time_t> cutoffs;
+        for (size_t i = 0; i < kEvents; i++) {
+            t += rng() % 4 == 0 ? 0 : static_cast<time_t>(rng() % (2 * 86400));
+            time_t end = t + 1 + static_cast<time_t>(rng() % (3 * 3600));
+            if (calendar->createEvent("Event " + std::to_string(i), t, end) < 0) {
+                fail("create", static_cast<long long>(i));
+            }
+            t = end;
+            if (i == kEvents / 4 || i == kEvents / 2 || i == kEvents * 3 / 4) {
+                cutoffs.push_back(end);
+            }
+        }
+        checkScans(*calendar, rng, "live only");
+        for (time_t cutoff : cutoffs) {
+            if (calendar->archiveBefore(cutoff) <= 0) {
+                fail("archiveBefore", cutoff);
+            }
+            checkScans(*calendar, rng, "after archiving");
+        }
+
+        // Column files opened from disk
+        calendar.reset();
+        calendar = openCalendar(dir);
+        if (calendar) {
+            checkScans(*calendar, rng, "after restart");
+        }
+    }
+
+    std::string cleanup = "rm -rf " + std::string(dir);
+    if (std::system(cleanup.c_str()) != 0) {
+        std::printf("columnar_oracle: cannot remove %s\n", dir);
+    }
+    if (failures > 0) {
+        std::printf("columnar_oracle: %d failures\n", failures);
+        return 1;
+    }
+    std::printf("columnar_oracle: OK\n");
+    return 0;
+}
@@ -0,0 +1,115 @@
+// CommandProcessor's tokenizer and command table.
+#include "command_processor.h"
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void fail(const char* what, const std::string& line) {
+    if (failures++ < 10) {
+        std::printf("FAIL %s: \"%s\"\n", what, line.c_str());
+    }
+}
+
+void expectTokens(const std::string& line, const std::vector<std::string>& expected) {
+    CommandProcessor::Tokens tokens;
+    if (!CommandProcessor::tokenize(line, tokens)) {
+        fail("tokenize rejected", line);
+        return;
+    }
+    if (tokens.size() != expected.size()) {
+        fail("token count", line);
+        return;
+    }
+    for (size_t i = 0; i < tokens.size(); i++) {
+        if (tokens[i] != expected[i]) {
+            fail("token", line);
+        }
+        // Views into the line, not copies
+        if (!tokens[i].empty() && (tokens[i].data() < line.data() || tokens[i].data() >= line.data() + line.size())) {
+            fail("token does not point into the line", line);
+        }
+    }
+}
+
+std::string run(CommandProcessor& processor, const std::string& line, CommandStatus expected) {
+    std::ostringstream out;
+    if (processor.execute(line, out) != expected) {
+        fail("status", line);
+    }
+    return out.str();
+}
+
+}  // namespace
+
+int main() {
+    expectTokens("", {});
+    expectTokens(" \t \r\n", {});
+    expectTokens("delete 42", {"delete", "42"});
+    expectTokens("  list\tweek  2025-03-10 UTC  ", {"list", "week", "2025-03-10", "UTC"});
+    expectTokens("create \"Team  sync\" 2025-01-10 09:00 10:00 UTC",
+                 {"create", "Team  sync", "2025-01-10", "09:00", "10:00", "UTC"});
+    expectTokens("create \"a\" x", {"create", "a", "x"});
+    expectTokens("create \"\" x", {"create", "", "x"});
+    expectTokens("create \"say \"hi\" now\" x", {"create", "say \"hi", "now\"", "x"});
+    expectTokens("create \"ends here\"", {"create", "ends here"});
+    expectTokens("a\"b c", {"a\"b", "c"});
+
+    CommandProcessor::Tokens tokens;
+    for (const char* line : {"create \"open", "create \"", "x \"a\"b"}) {
+        if (CommandProcessor::tokenize(line, tokens)) {
+            fail("unterminated quote accepted", line);
+        }
+    }
+
+    if (CommandProcessor::commandName("  create \"x\"") != "create" || CommandProcessor::commandName(" \t") != "" ||
+        CommandProcessor::commandName("exit") != "exit") {
+        fail("commandName", "");
+    }
+
+    // Dispatch: built-in commands, added commands, unknown names
+    CalendarService calendar;
+    CommandProcessor processor(calendar);
+    processor.addCommand("ping", [](const CommandProcessor::Tokens& tokens, std::ostream& out) {
+        out << "pong " << tokens.size() << "\n";
+        return CommandStatus::Ok;
+    });
+    processor.addCommand("exit", [](const CommandProcessor::Tokens&, std::ostream& out) {
+        out << "shadowed\n";
+        return CommandStatus::Ok;
+    });
+    if (run(processor, "ping a \"b c\"", CommandStatus::Ok) != "pong 3\n") {
+        fail("added command", "ping");
+    }
+    if (run(processor, "exit", CommandStatus::Exit) != "Goodbye!\n") {
+        fail("built-in command must win", "exit");
+    }
+    if (run(processor, "   ", CommandStatus::Ok) != "") {
+        fail("blank line", "");
+    }
+    if (run(processor, "pingx", CommandStatus::Error).find("Unknown command") == std::string::npos) {
+        fail("unknown command", "pingx");
+    }
+    if (run(processor, "create \"x 2025", CommandStatus::Error) != "Error: Unterminated quote.\n") {
+        fail("unterminated quote", "create");
+    }
+    std::string created = run(processor, "create \"Team  sync\" 2025-01-10 09:00 10:00 UTC", CommandStatus::Ok);
+    std::string listed = run(processor, "list week 2025-01-10 UTC", CommandStatus::Ok);
+    if (created.find("ID: 1") == std::string::npos || listed.find("Title: Team  sync") == std::string::npos) {
+        fail("quoted title spacing", listed);
+    }
+    run(processor, "delete 1", CommandStatus::Ok);
+    run(processor, "delete 1", CommandStatus::Error);
+    run(processor, "delete 99999999999", CommandStatus::Error);
+
+    if (failures != 0) {
+        std::printf("command_tokenize: %d failures\n", failures);
+        return 1;
+    }
+    std::printf("command_tokenize: OK\n");
+    return 0;
+}
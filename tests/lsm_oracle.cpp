@@ -0,0 +1,254 @@
+// The LSM engine against the in-memory calendar: a random mix of creates,
+// deletes, flushes and reopens must leave both with the same events. Also
+// checks that size-tiered merges bound the run count, that deleted events
+// and their tombstones leave the disk, and that a rollback after the
+// memtable was frozen survives a flush and a reopen.
+#include "calendar_service.h"
+#include "lsm.h"
+#include "snapshot.h"
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void fail(const char* what, long long value) {
+    if (failures++ < 10) {
+        std::printf("FAIL %s (%lld)\n", what, value);
+    }
+}
+
+bool sameEvents(const std::vector<Event>& a, const std::vector<Event>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].id != b[i].id || a[i].title != b[i].title || a[i].start_utc != b[i].start_utc ||
+            a[i].end_utc != b[i].end_utc) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Records (events and tombstones) in every run file of an LSM directory
+size_t recordsOnDisk(const std::string& dir) {
+    size_t records = 0;
+    DIR* listing = ::opendir(dir.c_str());
+    if (!listing) {
+        return 0;
+    }
+    while (struct dirent* entry = ::readdir(listing)) {
+        std::string name = entry->d_name;
+        if (name.compare(0, 4, "run-") == 0 && name.size() > 5 && name.compare(name.size() - 5, 5, ".snap") == 0) {
+            SnapshotFile run;
+            if (run.open(dir + "/" + name)) {
+                records += run.size();
+            }
+        }
+    }
+    ::closedir(listing);
+    return records;
+}
+
+std::unique_ptr<CalendarService> openLsm(const std::string& dir, const LsmOptions& options) {
+    std::unique_ptr<CalendarService> calendar(new CalendarService());
+    WalOptions wal;
+    wal.sync_policy = WalSyncPolicy::Interval;
+    if (!calendar->openLsmStorage(dir, wal, options)) {
+        fail("open LSM calendar", 0);
+        return nullptr;
+    }
+    return calendar;
+}
+
+// Creates (some conflicting), deletes (some of unknown IDs), flushes and
+// reopens, applied to both calendars; every reply and every read must match
+void checkRandomMix(const std::string& dir, std::mt19937& rng) {
+    LsmOptions options;
+    options.memtable_limit = 64;
+    options.merge_width = 3;
+    CalendarService oracle;
+    std::unique_ptr<CalendarService> lsm = openLsm(dir, options);
+    if (!lsm) {
+        return;
+    }
+
+    const time_t kBase = 1735689600;  // 2025-01-01
+    std::vector<int> ids;
+    for (int op = 0; op < 15000; op++) {
+        unsigned roll = rng() % 100;
+        if (roll < 55 || ids.empty()) {
+            // Hour slots in a year, so a fair share of creates conflict
+            time_t start = kBase + static_cast<time_t>(rng() % 8760) * 3600 + static_cast<time_t>(rng() % 4) * 900;
+            time_t end = start + 900 * static_cast<time_t>(1 + rng() % 4);
+            std::string title = "Event " + std::to_string(op);
+            int expected = oracle.createEvent(title, start, end);
+            int got = lsm->createEvent(title, start, end);
+            if (got != expected) {
+                fail("create", op);
+            }
+            if (expected >= 0) {
+                ids.push_back(expected);
+            }
+        } else if (roll < 90) {
+            // Mostly live IDs, sometimes one deleted already or never used
+            int id = rng() % 8 == 0 ? static_cast<int>(rng() % (ids.back() + 10)) : ids[rng() % ids.size()];
+            if (oracle.deleteEvent(id) != lsm->deleteEvent(id)) {
+                fail("delete", id);
+            }
+        } else if (roll < 97) {
+            time_t from = kBase + static_cast<time_t>(rng() % 8760) * 3600;
+            time_t until = from + static_cast<time_t>(rng() % (24 * 14)) * 3600;
+            if (!sameEvents(oracle.getWeeklyEvents(from, until), lsm->getWeeklyEvents(from, until))) {
+                fail("range", op);
+            }
+        } else if (roll < 99) {
+            if (!lsm->checkpoint()) {
+                fail("flush", op);
+            }
+        } else {
+            // Recovery: MANIFEST runs, then sealed logs, then wal.log
+            lsm.reset();
+            lsm = openLsm(dir, options);
+            if (!lsm) {
+                return;
+            }
+        }
+    }
+    if (!sameEvents(oracle.getAllEvents(), lsm->getAllEvents())) {
+        fail("all events", 0);
+    }
+    lsm.reset();
+    lsm = openLsm(dir, options);
+    if (lsm && !sameEvents(oracle.getAllEvents(), lsm->getAllEvents())) {
+        fail("all events after reopen", 0);
+    }
+    if (lsm && oracle.createEvent("Last", kBase - 3600, kBase) != lsm->createEvent("Last", kBase - 3600, kBase)) {
+        fail("ID after reopen", 0);
+    }
+}
+
+// Many flushes merge into a few runs, and deleting everything then
+// merging down to the oldest run leaves no records behind
+void checkMergeAndTombstones(const std::string& dir) {
+    const int kMemtables = 32;
+    LsmOptions options;
+    options.memtable_limit = 64;
+    options.merge_width = 2;
+    LsmStore store;
+    if (!store.open(dir, WalOptions(), options)) {
+        fail("open store", 0);
+        return;
+    }
+    int events = kMemtables * static_cast<int>(options.memtable_limit);
+    for (int id = 1; id <= events; id++) {
+        store.insert(Event(id, "t", id * 100, id * 100 + 50));
+    }
+    store.flush();
+    if (store.runCount() >= static_cast<size_t>(kMemtables) / 2) {
+        fail("runs after merging", static_cast<long long>(store.runCount()));
+    }
+    if (recordsOnDisk(dir) != static_cast<size_t>(events)) {
+        fail("records after inserting", static_cast<long long>(recordsOnDisk(dir)));
+    }
+
+    uint64_t lsn;
+    for (int id = 1; id <= events; id++) {
+        if (!store.erase(id, lsn)) {
+            fail("erase", id);
+        }
+    }
+    store.flush();
+    std::vector<Event> left;
+    store.query(0, static_cast<time_t>(events + 1) * 100, left);
+    if (!left.empty()) {
+        fail("events after erasing all", static_cast<long long>(left.size()));
+    }
+    // The last merge takes the tombstone runs and the event runs together
+    if (recordsOnDisk(dir) != 0) {
+        fail("records after erasing all", static_cast<long long>(recordsOnDisk(dir)));
+    }
+}
+
+// An insert that freezes the memtable, then rolled back (its log record
+// failed): hidden at once, and still gone after a flush and a reopen
+void checkRollbackAfterFreeze(const std::string& dir) {
+    LsmOptions options;
+    options.memtable_limit = 8;
+    {
+        LsmStore store;
+        if (!store.open(dir, WalOptions(), options)) {
+            fail("open store", 0);
+            return;
+        }
+        for (int id = 1; id <= 8; id++) {
+            store.insert(Event(id, "t", id * 100, id * 100 + 50));
+        }
+        store.rollback(Event(8, "t", 800, 850));  // Frozen by its own insert
+        store.rollback(Event(3, "t", 300, 350));
+        store.insert(Event(9, "t", 900, 950));
+        store.rollback(Event(9, "t", 900, 950));  // Still in the memtable
+        std::vector<Event> live;
+        store.query(0, 10000, live);
+        if (live.size() != 6) {
+            fail("events after rollback", static_cast<long long>(live.size()));
+        }
+        uint64_t lsn;
+        if (store.erase(8, lsn) || store.erase(9, lsn)) {
+            fail("erase of a rolled back event", 0);
+        }
+        if (!store.flush()) {
+            fail("flush after rollback", 0);
+        }
+    }
+    LsmStore reopened;
+    if (!reopened.open(dir, WalOptions(), options)) {
+        fail("reopen store", 0);
+        return;
+    }
+    std::vector<Event> live;
+    reopened.query(0, 10000, live);
+    std::vector<int> expected = {1, 2, 4, 5, 6, 7};
+    if (live.size() != expected.size()) {
+        fail("events after reopen", static_cast<long long>(live.size()));
+        return;
+    }
+    for (size_t i = 0; i < live.size(); i++) {
+        if (live[i].id != expected[i]) {
+            fail("event after reopen", live[i].id);
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    char dir[] = "/tmp/lsm_oracle.XXXXXX";
+    if (::mkdtemp(dir) == nullptr) {
+        std::perror("lsm_oracle: mkdtemp");
+        return 1;
+    }
+    std::string base = dir;
+    std::mt19937 rng(20250310);
+    checkRandomMix(base + "/mix", rng);
+    checkMergeAndTombstones(base + "/merge");
+    checkRollbackAfterFreeze(base + "/rollback");
+
+    std::string cleanup = "rm -rf " + base;
+    if (std::system(cleanup.c_str()) != 0) {
+        std::printf("lsm_oracle: cannot remove %s\n", dir);
+    }
+    if (failures > 0) {
+        std::printf("lsm_oracle: %d failures\n", failures);
+        return 1;
+    }
+    std::printf("lsm_oracle: OK\n");
+    return 0;
+}
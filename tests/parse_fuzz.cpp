@@ -0,0 +1,204 @@
+// Fuzz the fixed-format parsers (TimezoneUtils::parseDate / parseTime)
+// against the istringstream parsers they replaced, and check that they
+// never allocate.
+#include "timezone.h"
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+
+namespace {
+
+size_t allocations = 0;
+
+}  // namespace
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+int failures = 0;
+
+void fail(const char* what, const std::string& input) {
+    if (failures++ < 10) {
+        std::printf("FAIL %s: \"%s\"\n", what, input.c_str());
+    }
+}
+
+// The parsers before the rewrite, verbatim apart from the output type
+bool oldParseDate(const std::string& s, LocalDate& out) {
+    if (s.length() != 10) {
+        return false;
+    }
+    std::istringstream iss(s);
+    char dash1, dash2;
+    int year, month, day;
+    if (!(iss >> year >> dash1 >> month >> dash2 >> day)) {
+        return false;
+    }
+    if (dash1 != '-' || dash2 != '-') {
+        return false;
+    }
+    if (year < 1970 || month < 1 || month > 12 || day < 1 || day > 31) {
+        return false;
+    }
+    out = LocalDate{year, month, day};
+    return true;
+}
+
+bool oldParseTime(const std::string& s, LocalTime& out) {
+    if (s.length() != 5) {
+        return false;
+    }
+    std::istringstream iss(s);
+    char colon;
+    int hour, minute;
+    if (!(iss >> hour >> colon >> minute)) {
+        return false;
+    }
+    if (colon != ':') {
+        return false;
+    }
+    if (hour < 0 || hour > 23 || minute < 0 || minute > 59) {
+        return false;
+    }
+    out = LocalTime{hour, minute};
+    return true;
+}
+
+// Digits everywhere except the separators, at their fixed positions
+bool fixedWidth(const std::string& s, const char* pattern) {
+    if (s.size() != std::char_traits<char>::length(pattern)) {
+        return false;
+    }
+    for (size_t i = 0; i < s.size(); i++) {
+        bool ok = pattern[i] == 'd' ? (s[i] >= '0' && s[i] <= '9') : s[i] == pattern[i];
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A plausible input, then up to three characters replaced, inserted or
+// removed, drawn from characters istream treats specially
+std::string mutate(std::mt19937& rng, std::string s) {
+    static const char kAlphabet[] = "0123456789-:+ x\t.";
+    int edits = static_cast<int>(rng() % 4);
+    for (int i = 0; i < edits; i++) {
+        char c = kAlphabet[rng() % (sizeof(kAlphabet) - 1)];
+        size_t at = rng() % (s.size() + 1);
+        switch (rng() % 3) {
+        case 0:
+            if (at < s.size()) {
+                s[at] = c;
+            }
+            break;
+        case 1:
+            s.insert(s.begin() + at, c);
+            break;
+        default:
+            if (at < s.size()) {
+                s.erase(at, 1);
+            }
+        }
+    }
+    return s;
+}
+
+void checkDate(const std::string& input) {
+    LocalDate fresh = {0, 0, 0};
+    LocalDate old = {0, 0, 0};
+    size_t before = allocations;
+    ParseError error = TimezoneUtils::parseDate(std::string_view(input), fresh);
+    if (allocations != before) {
+        fail("parseDate allocated", input);
+    }
+    bool old_ok = oldParseDate(input, old);
+    if (error == ParseError::None) {
+        if (!old_ok || old.year != fresh.year || old.month != fresh.month || old.day != fresh.day) {
+            fail("parseDate accepts what the old parser did not", input);
+        }
+    } else if (old_ok) {
+        // Only non-fixed-width input and dates that do not exist may now fail
+        bool exists = old.day <= TimezoneUtils::daysInMonth(old.year, old.month);
+        if (fixedWidth(input, "dddd-dd-dd") && exists) {
+            fail("parseDate rejects a valid date", input);
+        }
+        if (fixedWidth(input, "dddd-dd-dd") && error != ParseError::InvalidDate) {
+            fail("parseDate error code", input);
+        }
+    }
+}
+
+void checkTime(const std::string& input) {
+    LocalTime fresh = {0, 0};
+    LocalTime old = {0, 0};
+    size_t before = allocations;
+    ParseError error = TimezoneUtils::parseTime(std::string_view(input), fresh);
+    if (allocations != before) {
+        fail("parseTime allocated", input);
+    }
+    bool old_ok = oldParseTime(input, old);
+    if (error == ParseError::None) {
+        if (!old_ok || old.hour != fresh.hour || old.minute != fresh.minute) {
+            fail("parseTime accepts what the old parser did not", input);
+        }
+    } else if (old_ok && fixedWidth(input, "dd:dd")) {
+        fail("parseTime rejects a valid time", input);
+    }
+}
+
+}  // namespace
+
+int main() {
+    // Every date 1970-2199 with days 1-31, including Feb 30 and Apr 31
+    for (int year = 1970; year < 2200; year++) {
+        for (int month = 1; month <= 12; month++) {
+            for (int day = 1; day <= 31; day++) {
+                char s[16];
+                std::snprintf(s, sizeof(s), "%04d-%02d-%02d", year, month, day);
+                LocalDate date;
+                ParseError expected = day <= TimezoneUtils::daysInMonth(year, month) ? ParseError::None
+                                                                                     : ParseError::InvalidDate;
+                if (TimezoneUtils::parseDate(std::string_view(s), date) != expected) {
+                    fail("calendar date", s);
+                }
+            }
+        }
+    }
+
+    std::mt19937 rng(20250310);
+    for (int i = 0; i < 1000000; i++) {
+        char date[16];
+        std::snprintf(date, sizeof(date), "%04d-%02d-%02d", 1960 + int(rng() % 120), int(rng() % 14),
+                      int(rng() % 33));
+        checkDate(mutate(rng, date));
+        char time[8];
+        std::snprintf(time, sizeof(time), "%02d:%02d", int(rng() % 26), int(rng() % 62));
+        checkTime(mutate(rng, time));
+    }
+
+    if (failures != 0) {
+        std::printf("parse_fuzz: %d failures\n", failures);
+        return 1;
+    }
+    std::printf("parse_fuzz: OK\n");
+    return 0;
+}
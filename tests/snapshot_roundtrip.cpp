@@ -0,0 +1,225 @@
+// calendar.snap written and read back: random events (titles of any bytes,
+// empty or long) with tombstones and the ID counter, loaded through
+// openPersistence; and every truncation or flipped bit refused on open.
+#include "calendar_service.h"
+#include "snapshot.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void fail(const char* what, long long value) {
+    if (failures++ < 10) {
+        std::printf("FAIL %s (%lld)\n", what, value);
+    }
+}
+
+bool sameEvent(const SnapshotEventView& view, const Event& event) {
+    return view.id == event.id && view.title == event.title && view.start_utc == event.start_utc &&
+           view.end_utc == event.end_utc;
+}
+
+bool sameEvents(const std::vector<Event>& a, const std::vector<Event>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].id != b[i].id || a[i].title != b[i].title || a[i].start_utc != b[i].start_utc ||
+            a[i].end_utc != b[i].end_utc) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string randomTitle(std::mt19937& rng) {
+    size_t length;
+    switch (rng() % 8) {
+        case 0: length = 0; break;
+        case 1: length = 100 + rng() % 5000; break;
+        default: length = rng() % 40; break;
+    }
+    std::string title;
+    for (size_t i = 0; i < length; i++) {
+        title.push_back(static_cast<char>(rng() % 4 == 0 ? rng() % 256 : ' ' + rng() % 95));
+    }
+    return title;
+}
+
+// Sorted, non-overlapping events from before 1970 on, with distinct IDs
+// up to count * 2
+std::vector<Event> randomEvents(std::mt19937& rng, size_t count) {
+    std::vector<Event> events;
+    time_t t = -2208988800;  // 1900-01-01
+    for (size_t i = 0; i < count; i++) {
+        t += static_cast<time_t>(rng() % (400 * 86400));
+        time_t end = t + 1 + static_cast<time_t>(rng() % 86400);
+        events.emplace_back(static_cast<int>(2 * i + 1 + rng() % 2), randomTitle(rng), t, end);
+        t = end;
+    }
+    return events;
+}
+
+std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::string& path, const std::string& bytes) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+// Events and tombstones come back merged in key order, byte for byte
+void checkRoundTrip(const std::string& dir, std::mt19937& rng) {
+    std::string path = dir + "/roundtrip.snap";
+    for (int round = 0; round < 40; round++) {
+        size_t count = round < 2 ? static_cast<size_t>(round) : rng() % 3000;
+        std::vector<Event> all = randomEvents(rng, count + count / 4);
+        std::vector<Event> events;
+        std::vector<Event> tombstones;
+        for (const Event& event : all) {
+            bool tombstone = round % 2 == 1 && rng() % 5 == 0;
+            (tombstone ? tombstones : events).push_back(event);
+        }
+        int next_id = static_cast<int>(2 * all.size() + 1 + rng() % 100);
+        if (!SnapshotFile::write(path, events, next_id, tombstones)) {
+            fail("write", round);
+            continue;
+        }
+        SnapshotFile snapshot;
+        if (!snapshot.open(path)) {
+            fail("open", round);
+            continue;
+        }
+        if (snapshot.size() != all.size() || snapshot.nextEventId() != next_id) {
+            fail("size or next ID", round);
+            continue;
+        }
+        size_t e = 0;
+        size_t t = 0;
+        for (size_t i = 0; i < snapshot.size(); i++) {
+            bool tombstone = snapshot.records()[i].isTombstone();
+            const Event& expected = tombstone ? tombstones[t++] : events[e++];
+            SnapshotEventView view = snapshot.event(i);
+            if (tombstone ? view.id != expected.id || view.start_utc != expected.start_utc || !view.title.empty()
+                          : !sameEvent(view, expected)) {
+                fail("record", round);
+                break;
+            }
+        }
+        if (e != events.size() || t != tombstones.size()) {
+            fail("records per kind", round);
+        }
+    }
+}
+
+// openPersistence builds the event set from the snapshot alone
+void checkLoad(const std::string& base, std::mt19937& rng) {
+    std::string dir = base + "/load";
+    if (::mkdir(dir.c_str(), 0755) != 0) {
+        fail("mkdir", 0);
+        return;
+    }
+    std::vector<Event> events = randomEvents(rng, 5000);
+    int next_id = 20000;
+    if (!SnapshotFile::write(dir + "/calendar.snap", events, next_id)) {
+        fail("write", 0);
+        return;
+    }
+    CalendarService calendar;
+    if (!calendar.openPersistence(dir, WalOptions())) {
+        fail("openPersistence", 0);
+        return;
+    }
+    if (!sameEvents(calendar.getAllEvents(), events)) {
+        fail("events after load", 0);
+    }
+    if (calendar.createEvent("Next", 4102444800, 4102448400) != next_id) {  // 2100-01-01
+        fail("ID after load", 0);
+    }
+}
+
+// Every cut short or extended file and every flipped bit fails to open;
+// a calendar refuses to start from such a file
+void checkCorruption(const std::string& base, std::mt19937& rng) {
+    std::string dir = base + "/corrupt";
+    if (::mkdir(dir.c_str(), 0755) != 0) {
+        fail("mkdir", 0);
+        return;
+    }
+    std::string path = dir + "/calendar.snap";
+    std::vector<Event> events = randomEvents(rng, 100);
+    if (!SnapshotFile::write(path, events, 500)) {
+        fail("write", 0);
+        return;
+    }
+    const std::string good = readFile(path);
+
+    std::vector<std::string> damaged;
+    for (size_t length = 0; length < good.size(); length += 1 + length / 8) {
+        damaged.push_back(good.substr(0, length));
+    }
+    damaged.push_back(good.substr(0, good.size() - 1));
+    damaged.push_back(good + '\0');
+    for (size_t offset = 0; offset < good.size(); offset += offset < 64 ? 1 : 1 + rng() % 97) {
+        std::string flipped = good;
+        flipped[offset] = static_cast<char>(flipped[offset] ^ (1 << (rng() % 8)));
+        damaged.push_back(flipped);
+    }
+
+    for (size_t i = 0; i < damaged.size(); i++) {
+        writeFile(path, damaged[i]);
+        SnapshotFile snapshot;
+        if (snapshot.open(path)) {
+            fail("damaged file opened", static_cast<long long>(i));
+        }
+        if (i % 16 == 0) {
+            CalendarService calendar;
+            if (calendar.openPersistence(dir, WalOptions())) {
+                fail("calendar started from a damaged file", static_cast<long long>(i));
+            }
+        }
+    }
+
+    writeFile(path, good);
+    CalendarService calendar;
+    if (!calendar.openPersistence(dir, WalOptions()) || !sameEvents(calendar.getAllEvents(), events)) {
+        fail("restored file", 0);
+    }
+}
+
+}  // namespace
+
+int main() {
+    char dir[] = "/tmp/snapshot_roundtrip.XXXXXX";
+    if (::mkdtemp(dir) == nullptr) {
+        std::perror("snapshot_roundtrip: mkdtemp");
+        return 1;
+    }
+    std::string base = dir;
+    std::mt19937 rng(20250310);
+    checkRoundTrip(base, rng);
+    checkLoad(base, rng);
+    checkCorruption(base, rng);
+
+    std::string cleanup = "rm -rf " + base;
+    if (std::system(cleanup.c_str()) != 0) {
+        std::printf("snapshot_roundtrip: cannot remove %s\n", dir);
+    }
+    if (failures > 0) {
+        std::printf("snapshot_roundtrip: %d failures\n", failures);
+        return 1;
+    }
+    std::printf("snapshot_roundtrip: OK\n");
+    return 0;
+}
@@ -0,0 +1,81 @@
+// The per-thread transition cache in TimezoneUtils against uncached
+// lookups on the same zone tables, for conversions in mixed order.
+#include "timezone.h"
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void fail(const char* what, const std::string& zone, long long value) {
+    if (failures++ < 10) {
+        std::printf("FAIL %s in %s at %lld\n", what, zone.c_str(), value);
+    }
+}
+
+}  // namespace
+
+int main() {
+    const char* dir = std::getenv("TZDIR");
+    std::string zoneinfo = dir ? dir : "/usr/share/zoneinfo";
+    // Half-hour offsets, southern DST, a skipped day (Apia 2011-12-30)
+    const char* names[] = {"America/New_York", "Europe/London", "Australia/Lord_Howe", "Pacific/Apia",
+                           "Asia/Kolkata"};
+
+    std::vector<std::string> zone_names;
+    std::vector<TzId> ids;
+    std::vector<std::unique_ptr<ZoneInfo>> tables;
+    for (const char* name : names) {
+        std::unique_ptr<ZoneInfo> table = ZoneInfo::loadTZif(name, zoneinfo + "/" + name);
+        TzId tz = TimezoneUtils::resolveTimezone(name);
+        if (!table || !tz.isValid()) {
+            std::printf("tz_cache: %s not installed, skipped\n", name);
+            continue;
+        }
+        zone_names.push_back(name);
+        ids.push_back(tz);
+        tables.push_back(std::move(table));
+    }
+    if (tables.empty()) {
+        std::printf("tz_cache: no zoneinfo, skipped\n");
+        return 0;
+    }
+
+    // Per zone, a cursor that mostly steps forward by up to a day (the
+    // cache's case) and sometimes jumps anywhere in 1900-2100
+    std::mt19937_64 rng(20250310);
+    const long long kFirst = -2208988800LL;
+    const long long kSpan = 6311433600LL;
+    std::vector<long long> cursor(tables.size(), 0);
+    for (int i = 0; i < 10000000; i++) {
+        size_t z = rng() % tables.size();
+        long long& t = cursor[z];
+        t = rng() % 16 == 0 ? kFirst + static_cast<long long>(rng() % kSpan) : t + static_cast<long long>(rng() % 86400);
+
+        if (TimezoneUtils::getOffsetSeconds(ids[z], static_cast<time_t>(t)) != tables[z]->offsetAtUtc(t)) {
+            fail("UTC offset", zone_names[z], t);
+        }
+
+        // t read as a local wall-clock time, minute precision
+        long long local = t - ((t % 60) + 60) % 60;
+        long long days = (local >= 0 ? local : local - 86399) / 86400;
+        long long seconds = local - days * 86400;
+        LocalDateTime wall = {TimezoneUtils::civilFromDays(days),
+                              {static_cast<int>(seconds / 3600), static_cast<int>(seconds % 3600 / 60)}};
+        if (TimezoneUtils::toUTC(wall, ids[z]) != local - tables[z]->offsetForLocal(local)) {
+            fail("local to UTC", zone_names[z], local);
+        }
+    }
+
+    if (failures != 0) {
+        std::printf("tz_cache: %d failures\n", failures);
+        return 1;
+    }
+    std::printf("tz_cache: OK (%zu zones)\n", tables.size());
+    return 0;
+}
@@ -0,0 +1,158 @@
+// TzDatabase::reload racing conversions on many threads, more live reader
+// threads than one block of reader slots, and TzReloadThread. Meant to be
+// run under -fsanitize=address and -fsanitize=thread as well.
+#include "timezone.h"
+#include "tzdb.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::atomic<int> failures{0};
+
+void fail(const char* what, const std::string& zone, long long value) {
+    if (failures++ < 10) {
+        std::printf("FAIL %s in %s at %lld\n", what, zone.c_str(), value);
+    }
+}
+
+struct Zone {
+    std::string name;
+    TzId id;
+    std::unique_ptr<ZoneInfo> table;  // Loaded directly: what every reload must reproduce
+};
+
+// Conversions on several threads while another reloads over and over
+void checkConcurrentReload(const std::vector<Zone>& zones) {
+    TzDatabase& db = TzDatabase::instance();
+    unsigned long long before = db.generation();
+    std::atomic<bool> done{false};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 8; t++) {
+        readers.emplace_back([&zones, &done, t] {
+            std::mt19937_64 rng(20250310 + t);
+            const long long kFirst = -2208988800LL;
+            const long long kSpan = 6311433600LL;
+            for (int i = 0; i < 200000 || !done; i++) {
+                const Zone& zone = zones[rng() % zones.size()];
+                long long at = kFirst + static_cast<long long>(rng() % kSpan);
+                if (TimezoneUtils::getOffsetSeconds(zone.id, static_cast<time_t>(at)) != zone.table->offsetAtUtc(at)) {
+                    fail("offset during reload", zone.name, at);
+                }
+            }
+        });
+    }
+    const int kReloads = 200;
+    for (int i = 0; i < kReloads; i++) {
+        if (db.reload() < zones.size()) {
+            fail("zones re-read", "", i);
+        }
+    }
+    done = true;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    if (db.generation() < before + kReloads) {
+        fail("generation after reloads", "", static_cast<long long>(db.generation()));
+    }
+}
+
+// Every thread holds a ReadGuard until all of them hold one, so they need
+// more slots than one block has at the same time
+void checkManyReaderThreads(const std::vector<Zone>& zones) {
+    const int kThreads = 1100;
+    TzDatabase& db = TzDatabase::instance();
+    std::mutex mutex;
+    std::condition_variable all_in;
+    int inside = 0;
+    std::atomic<bool> done{false};
+    std::thread reloader([&db, &done] {
+        while (!done) {
+            db.reload();
+        }
+    });
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreads; i++) {
+        threads.emplace_back([&, i] {
+            const Zone& zone = zones[i % zones.size()];
+            TzDatabase::ReadGuard guard(db);
+            std::unique_lock<std::mutex> lock(mutex);
+            if (++inside == kThreads) {
+                all_in.notify_all();
+            }
+            all_in.wait(lock, [&] { return inside == kThreads; });
+            const ZoneInfo* table = guard.zone(zone.id);
+            if (!table || table->offsetAtUtc(0) != zone.table->offsetAtUtc(0)) {
+                fail("zone under a guard", zone.name, i);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    done = true;
+    reloader.join();
+}
+
+void checkReloadThread() {
+    TzDatabase& db = TzDatabase::instance();
+    unsigned long long before = db.generation();
+    {
+        TzReloadThread reloader;
+        for (int i = 0; i < 100; i++) {
+            reloader.request();
+        }
+        // Requests merge, so this only waits for the first reload
+        while (db.generation() == before) {
+            std::this_thread::yield();
+        }
+    }
+    // Destroying it again right away must not hang either
+    TzReloadThread idle;
+    (void)idle;
+}
+
+}  // namespace
+
+int main() {
+    const char* dir = std::getenv("TZDIR");
+    std::string zoneinfo = dir ? dir : "/usr/share/zoneinfo";
+    const char* names[] = {"America/New_York", "Europe/London", "Australia/Lord_Howe", "Asia/Kolkata"};
+
+    std::vector<Zone> zones;
+    for (const char* name : names) {
+        Zone zone;
+        zone.name = name;
+        zone.table = ZoneInfo::loadTZif(name, zoneinfo + "/" + name);
+        zone.id = TzDatabase::instance().resolve(name);
+        if (!zone.table || !zone.id.isValid()) {
+            std::printf("tz_reload_stress: %s not installed, skipped\n", name);
+            continue;
+        }
+        zones.push_back(std::move(zone));
+    }
+    if (zones.empty()) {
+        std::printf("tz_reload_stress: no zoneinfo, skipped\n");
+        return 0;
+    }
+
+    checkConcurrentReload(zones);
+    checkManyReaderThreads(zones);
+    checkReloadThread();
+
+    if (failures > 0) {
+        std::printf("tz_reload_stress: %d failures\n", failures.load());
+        return 1;
+    }
+    std::printf("tz_reload_stress: OK (%zu zones)\n", zones.size());
+    return 0;
+}
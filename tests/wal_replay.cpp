@@ -0,0 +1,351 @@
+// The write-ahead log: what replay recovers from logs written under each
+// sync policy, cut off mid-record or corrupted, appended to by many
+// threads at once, and the calendar going read-only after a failed write.
+#include "calendar_service.h"
+#include "wal.h"
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+std::atomic<int> failures{0};
+
+void fail(const char* what, long long value) {
+    if (failures++ < 10) {
+        std::printf("FAIL %s (%lld)\n", what, value);
+    }
+}
+
+bool sameRecord(const WalRecord& a, const WalRecord& b) {
+    return a.type == b.type && a.event_id == b.event_id && a.start_utc == b.start_utc &&
+           a.end_utc == b.end_utc && a.title == b.title;
+}
+
+WalRecord randomRecord(std::mt19937& rng, int id) {
+    WalRecord record;
+    record.type = static_cast<WalRecord::Type>(1 + rng() % 3);
+    record.event_id = id;
+    record.start_utc = static_cast<time_t>(static_cast<long long>(rng()) * 60 - (1LL << 37));
+    record.end_utc = record.start_utc + static_cast<time_t>(rng() % 86400);
+    // Mostly short titles, sometimes empty or a few KB, any bytes
+    size_t length = rng() % 8 == 0 ? rng() % 4096 : rng() % 40;
+    for (size_t i = 0; i < length; i++) {
+        record.title.push_back(static_cast<char>(rng()));
+    }
+    return record;
+}
+
+bool replayAll(const std::string& path, std::vector<WalRecord>& out) {
+    out.clear();
+    return WriteAheadLog::replay(path, [&out](const WalRecord& record) { out.push_back(record); });
+}
+
+long long fileSize(const std::string& path) {
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0 ? static_cast<long long>(st.st_size) : -1;
+}
+
+// Write records and return the file offset where each one ends
+std::vector<long long> writeLog(const std::string& path, const std::vector<WalRecord>& records,
+                                const WalOptions& options) {
+    std::vector<long long> ends;
+    ::unlink(path.c_str());
+    WriteAheadLog log;
+    if (!log.open(path, options)) {
+        fail("open", 0);
+        return ends;
+    }
+    for (const WalRecord& record : records) {
+        // Sync each record so its end offset can be read back
+        if (!log.waitDurable(log.append(record)) || !log.sync()) {
+            fail("append", record.event_id);
+        }
+        ends.push_back(fileSize(path));
+    }
+    log.close();
+    return ends;
+}
+
+// The first count records of expected, in order, and nothing else
+void expectPrefix(const std::vector<WalRecord>& got, const std::vector<WalRecord>& expected, size_t count,
+                  const char* what) {
+    if (got.size() != count) {
+        fail(what, static_cast<long long>(got.size()));
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!sameRecord(got[i], expected[i])) {
+            fail(what, static_cast<long long>(i));
+            return;
+        }
+    }
+}
+
+void checkReplay(const std::string& dir, std::mt19937& rng) {
+    std::vector<WalRecord> got;
+    if (!replayAll(dir + "/missing.wal", got) || !got.empty()) {
+        fail("missing log is empty", 0);
+    }
+
+    const WalSyncPolicy policies[] = {WalSyncPolicy::EveryOp, WalSyncPolicy::Batched, WalSyncPolicy::Interval};
+    for (WalSyncPolicy policy : policies) {
+        std::vector<WalRecord> records;
+        for (int i = 0; i < 500; i++) {
+            records.push_back(randomRecord(rng, i));
+        }
+        WalOptions options;
+        options.sync_policy = policy;
+        options.interval_ms = 5;
+        std::string path = dir + "/replay.wal";
+        writeLog(path, records, options);
+        if (!replayAll(path, got)) {
+            fail("replay", static_cast<long long>(policy));
+        }
+        expectPrefix(got, records, records.size(), "replayed records");
+
+        // Reopening appends after what is there
+        WriteAheadLog log;
+        records.push_back(randomRecord(rng, 500));
+        if (!log.open(path, options) || !log.waitDurable(log.append(records.back()))) {
+            fail("append after reopen", static_cast<long long>(policy));
+        }
+        log.close();
+        replayAll(path, got);
+        expectPrefix(got, records, records.size(), "records after reopen");
+    }
+}
+
+// Cut the log anywhere: replay keeps the whole records before the cut and
+// truncates the file to their end, so the next append lands after them
+void checkTornTail(const std::string& dir, std::mt19937& rng) {
+    std::vector<WalRecord> records;
+    for (int i = 0; i < 200; i++) {
+        records.push_back(randomRecord(rng, i));
+    }
+    std::string path = dir + "/torn.wal";
+    std::string full = dir + "/torn.full";
+    std::vector<long long> ends = writeLog(full, records, WalOptions());
+    if (ends.size() != records.size()) {
+        return;
+    }
+
+    std::vector<WalRecord> got;
+    for (int round = 0; round < 300; round++) {
+        long long cut = static_cast<long long>(rng() % (ends.back() + 1));
+        std::string copy = "cp " + full + " " + path;
+        if (std::system(copy.c_str()) != 0 || ::truncate(path.c_str(), cut) != 0) {
+            fail("copy log", cut);
+            return;
+        }
+        size_t whole = 0;
+        while (whole < ends.size() && ends[whole] <= cut) {
+            whole++;
+        }
+        long long kept = whole == 0 ? 0 : ends[whole - 1];
+
+        if (!replayAll(path, got)) {
+            fail("replay torn log", cut);
+        }
+        expectPrefix(got, records, whole, "records before the cut");
+        if (fileSize(path) != kept) {
+            fail("torn tail truncated", cut);
+        }
+
+        WriteAheadLog log;
+        WalRecord next = randomRecord(rng, 1000);
+        if (!log.open(path, WalOptions()) || !log.waitDurable(log.append(next))) {
+            fail("append after torn tail", cut);
+        }
+        log.close();
+        replayAll(path, got);
+        if (got.size() != whole + 1 || !sameRecord(got.back(), next)) {
+            fail("append after torn tail replays", cut);
+        }
+    }
+}
+
+// Change one byte of one record: replay stops right before that record
+void checkCorruption(const std::string& dir, std::mt19937& rng) {
+    std::vector<WalRecord> records;
+    for (int i = 0; i < 200; i++) {
+        records.push_back(randomRecord(rng, i));
+    }
+    std::string path = dir + "/corrupt.wal";
+    std::string full = dir + "/corrupt.full";
+    std::vector<long long> ends = writeLog(full, records, WalOptions());
+    if (ends.size() != records.size()) {
+        return;
+    }
+
+    std::vector<WalRecord> got;
+    for (int round = 0; round < 300; round++) {
+        size_t victim = rng() % records.size();
+        long long begin = victim == 0 ? 0 : ends[victim - 1];
+        long long offset = begin + static_cast<long long>(rng() % (ends[victim] - begin));
+
+        std::string copy = "cp " + full + " " + path;
+        FILE* file = std::system(copy.c_str()) == 0 ? std::fopen(path.c_str(), "r+b") : nullptr;
+        if (!file || std::fseek(file, offset, SEEK_SET) != 0) {
+            fail("open for corruption", offset);
+            return;
+        }
+        int byte = std::fgetc(file);
+        std::fseek(file, offset, SEEK_SET);
+        std::fputc(byte ^ static_cast<int>(1 + rng() % 255), file);
+        std::fclose(file);
+
+        if (!replayAll(path, got)) {
+            fail("replay corrupt log", offset);
+        }
+        expectPrefix(got, records, victim, "records before the corruption");
+        if (fileSize(path) != begin) {
+            fail("corrupt record truncated", offset);
+        }
+    }
+}
+
+// Group commit: threads appending and waiting at once each get every
+// record durable, in the order the log handed out sequence numbers
+void checkGroupCommit(const std::string& dir) {
+    const int kThreads = 8;
+    const int kPerThread = 400;
+    std::string path = dir + "/group.wal";
+    ::unlink(path.c_str());
+    WriteAheadLog log;
+    if (!log.open(path, WalOptions())) {
+        fail("open group log", 0);
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&log, t] {
+            for (int i = 0; i < kPerThread; i++) {
+                WalRecord record{WalRecord::Create, t * kPerThread + i, i, i + 1, std::to_string(t)};
+                if (!log.waitDurable(log.append(record))) {
+                    fail("group commit wait", t);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    log.close();
+
+    std::vector<WalRecord> got;
+    replayAll(path, got);
+    if (got.size() != static_cast<size_t>(kThreads * kPerThread)) {
+        fail("group commit records", static_cast<long long>(got.size()));
+        return;
+    }
+    std::vector<int> next(kThreads, 0);
+    for (const WalRecord& record : got) {
+        int t = record.event_id / kPerThread;
+        if (record.title != std::to_string(t) || record.start_utc != next[t]++) {
+            fail("group commit order", record.event_id);
+            return;
+        }
+    }
+}
+
+// A write the file size limit refuses fails the log for good: the create
+// is not acknowledged, every later mutation is refused, and a restart
+// recovers exactly the acknowledged events
+void checkReadOnlyAfterFailure(const std::string& dir) {
+    std::string data_dir = dir + "/calendar";
+    std::vector<int> acknowledged;
+    {
+        CalendarService calendar;
+        if (!calendar.openPersistence(data_dir, WalOptions())) {
+            fail("open calendar", 0);
+            return;
+        }
+        for (int i = 0; i < 50; i++) {
+            int id = calendar.createEvent("Event " + std::to_string(i), 1000000 + i * 3600, 1000000 + i * 3600 + 1800);
+            if (id < 0) {
+                fail("create before the failure", i);
+            }
+            acknowledged.push_back(id);
+        }
+        if (!calendar.deleteEvent(acknowledged.back())) {
+            fail("delete before the failure", 0);
+        }
+        acknowledged.pop_back();
+
+        // Every later write to the log now fails with EFBIG
+        struct rlimit saved;
+        ::getrlimit(RLIMIT_FSIZE, &saved);
+        struct rlimit limit = saved;
+        limit.rlim_cur = static_cast<rlim_t>(fileSize(data_dir + "/calendar.wal"));
+        std::signal(SIGXFSZ, SIG_IGN);
+        ::setrlimit(RLIMIT_FSIZE, &limit);
+        int refused = calendar.createEvent("Lost", 5000000, 5001800);
+        ::setrlimit(RLIMIT_FSIZE, &saved);
+
+        if (refused != -1 || !calendar.isReadOnly()) {
+            fail("create after a failed write", refused);
+        }
+        if (calendar.getAllEvents().size() != acknowledged.size()) {
+            fail("unacknowledged create rolled back", static_cast<long long>(calendar.getAllEvents().size()));
+        }
+        // The log stays failed with room on disk again
+        if (calendar.createEvent("Later", 6000000, 6001800) != -1 || calendar.deleteEvent(acknowledged[0])) {
+            fail("mutation while read-only", 0);
+        }
+    }
+
+    CalendarService reopened;
+    if (!reopened.openPersistence(data_dir, WalOptions())) {
+        fail("reopen calendar", 0);
+        return;
+    }
+    std::vector<Event> events = reopened.getAllEvents();
+    if (events.size() != acknowledged.size()) {
+        fail("events after restart", static_cast<long long>(events.size()));
+        return;
+    }
+    for (size_t i = 0; i < events.size(); i++) {
+        if (events[i].id != acknowledged[i]) {
+            fail("event after restart", events[i].id);
+        }
+    }
+    if (reopened.isReadOnly() || reopened.createEvent("After restart", 7000000, 7001800) < 0) {
+        fail("writable after restart", 0);
+    }
+}
+
+}  // namespace
+
+int main() {
+    char dir[] = "/tmp/wal_replay.XXXXXX";
+    if (::mkdtemp(dir) == nullptr) {
+        std::perror("wal_replay: mkdtemp");
+        return 1;
+    }
+    std::mt19937 rng(20250310);
+    checkReplay(dir, rng);
+    checkTornTail(dir, rng);
+    checkCorruption(dir, rng);
+    checkGroupCommit(dir);
+    checkReadOnlyAfterFailure(dir);
+
+    std::string cleanup = "rm -rf " + std::string(dir);
+    if (std::system(cleanup.c_str()) != 0) {
+        std::printf("wal_replay: cannot remove %s\n", dir);
+    }
+    if (failures > 0) {
+        std::printf("wal_replay: %d failures\n", failures.load());
+        return 1;
+    }
+    std::printf("wal_replay: OK\n");
+    return 0;
+}
@@ -1,189 +1,491 @@
 #include "timezone.h"
-#include <sstream>
-#include <iomanip>
+#include "tzdb.h"
+#include <cstring>
 #include <stdexcept>
 #include <mutex>
 
 
-// Fixed timezone offsets in seconds
-// UTC: 0
+// Short names accepted by the CLI since the first version. They map onto
+// IANA zones so that e.g. PST follows US daylight saving time. If the
+// zoneinfo files are not installed they fall back to their fixed offsets:
 // IST: +5:30 = 19800 seconds
 // PST: -8:00 = -28800 seconds
+struct ZoneAlias {
+    const char* abbreviation;
+    const char* iana_name;
+    int fixed_offset;
+};
 
-int TimezoneUtils::getOffsetSeconds(const std::string& tz_str) {
+static constexpr ZoneAlias kZoneAliases[] = {
+    {"IST", "Asia/Kolkata", IstZone::kOffsetSeconds},
+    {"PST", "America/Los_Angeles", PstFixedZone::kOffsetSeconds},
+};
+
+TzId TimezoneUtils::resolveTimezone(const std::string& tz_str) {
+    TzDatabase& db = TzDatabase::instance();
+
+    // UTC never needs a file
     if (tz_str == "UTC") {
-        return 0;
-    } else if (tz_str == "IST") {
-        return 19800;  // +5:30
-    } else if (tz_str == "PST") {
-        return -28800;  // -8:00
+        return db.resolveFixed("UTC", 0);
+    }
+
+    for (const ZoneAlias& alias : kZoneAliases) {
+        if (tz_str == alias.abbreviation) {
+            TzId id = db.resolve(alias.iana_name);
+            return id.isValid() ? id : db.resolveFixed(alias.abbreviation, alias.fixed_offset);
+        }
+    }
+
+    return db.resolve(tz_str);
+}
+
+// Per-thread cache of the last offset interval seen for each zone.
+//
+// Conversions usually come in runs of nearby instants (a week of events,
+// the occurrences of a recurring meeting), and those nearly always fall in
+// the same DST interval. Remembering the interval's bounds turns the binary
+// search into two compares. Being thread_local, it needs no locking.
+// Direct-mapped by zone id; a collision simply evicts the other zone.
+// Entries are tagged with the database generation, so a hot reload of the
+// tables invalidates them.
+namespace {
+
+// A zone looked up for the duration of one conversion call. Holding the
+// read guard keeps a concurrent TzDatabase::reload() from freeing it.
+struct ZoneRef {
+    TzDatabase::ReadGuard guard;
+    const ZoneInfo* zone;  // nullptr for an invalid handle
+    unsigned long long generation;
+
+    explicit ZoneRef(TzId tz)
+        : guard(TzDatabase::instance()), zone(guard.zone(tz)), generation(guard.generation()) {}
+};
+
+struct CachedInterval {
+    int tz_id;
+    unsigned long long generation;  // 0 = empty (generations start at 1)
+    OffsetInterval interval;
+
+    bool holds(TzId tz, const ZoneRef& ref) const {
+        return tz_id == tz.value && generation == ref.generation;
+    }
+    void store(TzId tz, const ZoneRef& ref, const OffsetInterval& fresh) {
+        tz_id = tz.value;
+        generation = ref.generation;
+        interval = fresh;
+    }
+};
+
+const int kIntervalCacheSlots = 16;
+thread_local CachedInterval t_interval_cache[kIntervalCacheSlots];
+
+// Longest wall-clock jump between adjacent offsets is about a day (Samoa
+// skipped 2011-12-30); two days of margin keeps the local fast path safe.
+const long long kLocalFastPathMargin = 2 * 86400LL;
+
+inline CachedInterval& cacheSlot(TzId tz) {
+    return t_interval_cache[tz.value & (kIntervalCacheSlots - 1)];
+}
+
+// Offset at a UTC instant, served from the per-thread cache when possible
+inline int cachedOffsetAtUtc(TzId tz, const ZoneRef& ref, long long utc) {
+    CachedInterval& slot = cacheSlot(tz);
+    if (!slot.holds(tz, ref) || utc < slot.interval.begin_utc || utc >= slot.interval.end_utc) {
+        slot.store(tz, ref, ref.zone->intervalAt(utc));
     }
-    throw std::invalid_argument("Invalid timezone: " + tz_str);
+    return slot.interval.offset_seconds;
+}
+
+// Offset for a local wall-clock time. The cached interval answers directly
+// when the resulting instant is well inside it: then no neighbouring
+// interval can also claim that wall-clock time (no DST gap or overlap).
+inline int cachedOffsetForLocal(TzId tz, const ZoneRef& ref, long long local) {
+    CachedInterval& slot = cacheSlot(tz);
+    if (slot.holds(tz, ref)) {
+        long long utc = local - slot.interval.offset_seconds;
+        if (utc - kLocalFastPathMargin >= slot.interval.begin_utc &&
+            utc + kLocalFastPathMargin < slot.interval.end_utc) {
+            return slot.interval.offset_seconds;
+        }
+    }
+    int offset = ref.zone->offsetForLocal(local);
+    slot.store(tz, ref, ref.zone->intervalAt(local - offset));
+    return offset;
+}
+
+}  // namespace
+
+int TimezoneUtils::getOffsetSeconds(const std::string& tz_str) {
+    return getOffsetSeconds(tz_str, time(nullptr));
+}
+
+int TimezoneUtils::getOffsetSeconds(const std::string& tz_str, time_t utc_time) {
+    TzId tz = resolveTimezone(tz_str);
+    if (!tz.isValid()) {
+        throw std::invalid_argument("Invalid timezone: " + tz_str);
+    }
+    return getOffsetSeconds(tz, utc_time);
+}
+
+int TimezoneUtils::getOffsetSeconds(TzId tz, time_t utc_time) {
+    ZoneRef ref(tz);
+    return ref.zone ? cachedOffsetAtUtc(tz, ref, utc_time) : 0;
 }
 
 bool TimezoneUtils::isValidTimezone(const std::string& tz_str) {
-    return tz_str == "UTC" || tz_str == "IST" || tz_str == "PST";
+    return resolveTimezone(tz_str).isValid();
 }
 
-bool TimezoneUtils::parseDate(const std::string& date_str, struct tm& tm_out) {
+// Value of the decimal digit at s[pos], or -1 if it is not a digit.
+static inline int digitAt(std::string_view s, size_t pos) {
+    unsigned d = static_cast<unsigned char>(s[pos]) - '0';
+    return d <= 9 ? static_cast<int>(d) : -1;
+}
+
+// Parse the fixed-width decimal field s[pos, pos + width).
+// Returns -1 if any character is not a digit.
+static inline int fixedField(std::string_view s, size_t pos, size_t width) {
+    int value = 0;
+    for (size_t i = 0; i < width; i++) {
+        int d = digitAt(s, pos + i);
+        if (d < 0) {
+            return -1;
+        }
+        value = value * 10 + d;
+    }
+    return value;
+}
+
+ParseError TimezoneUtils::parseDate(std::string_view date_str, LocalDate& out) noexcept {
     // Format: YYYY-MM-DD
-    if (date_str.length() != 10) {
-        return false;
+    if (date_str.size() != 10) {
+        return ParseError::BadLength;
     }
-    
-    std::istringstream iss(date_str);
-    char dash1, dash2;
-    int year, month, day;
-    
-    if (!(iss >> year >> dash1 >> month >> dash2 >> day)) {
-        return false;
+    if (date_str[4] != '-' || date_str[7] != '-') {
+        return ParseError::BadSyntax;
     }
-    
-    if (dash1 != '-' || dash2 != '-') {
-        return false;
+
+    int year = fixedField(date_str, 0, 4);
+    int month = fixedField(date_str, 5, 2);
+    int day = fixedField(date_str, 8, 2);
+    if (year < 0 || month < 0 || day < 0) {
+        return ParseError::BadSyntax;
     }
-    
-    if (year < 1970 || month < 1 || month > 12 || day < 1 || day > 31) {
+
+    if (year < 1970 || month < 1 || month > 12 || day < 1) {
+        return ParseError::OutOfRange;
+    }
+    if (day > daysInMonth(year, month)) {
+        return ParseError::InvalidDate;
+    }
+
+    out.year = year;
+    out.month = month;
+    out.day = day;
+    return ParseError::None;
+}
+
+ParseError TimezoneUtils::parseTime(std::string_view time_str, LocalTime& out) noexcept {
+    // Format: HH:MM
+    if (time_str.size() != 5) {
+        return ParseError::BadLength;
+    }
+    if (time_str[2] != ':') {
+        return ParseError::BadSyntax;
+    }
+
+    int hour = fixedField(time_str, 0, 2);
+    int minute = fixedField(time_str, 3, 2);
+    if (hour < 0 || minute < 0) {
+        return ParseError::BadSyntax;
+    }
+
+    if (hour > 23 || minute > 59) {
+        return ParseError::OutOfRange;
+    }
+
+    out.hour = hour;
+    out.minute = minute;
+    return ParseError::None;
+}
+
+bool TimezoneUtils::parseDate(const std::string& date_str, struct tm& tm_out) {
+    LocalDate date;
+    if (parseDate(std::string_view(date_str), date) != ParseError::None) {
         return false;
     }
-    
-    tm_out.tm_year = year - 1900;  // tm_year is years since 1900
-    tm_out.tm_mon = month - 1;      // tm_mon is 0-11
-    tm_out.tm_mday = day;
+
+    tm_out.tm_year = date.year - 1900;  // tm_year is years since 1900
+    tm_out.tm_mon = date.month - 1;     // tm_mon is 0-11
+    tm_out.tm_mday = date.day;
     tm_out.tm_hour = 0;
     tm_out.tm_min = 0;
     tm_out.tm_sec = 0;
     tm_out.tm_isdst = -1;  // Let system determine DST
-    
+
     return true;
 }
 
 bool TimezoneUtils::parseTime(const std::string& time_str, struct tm& tm_out) {
-    // Format: HH:MM
-    if (time_str.length() != 5) {
+    LocalTime time;
+    if (parseTime(std::string_view(time_str), time) != ParseError::None) {
         return false;
     }
-    
-    std::istringstream iss(time_str);
-    char colon;
-    int hour, minute;
-    
-    if (!(iss >> hour >> colon >> minute)) {
-        return false;
-    }
-    
-    if (colon != ':') {
-        return false;
-    }
-    
-    if (hour < 0 || hour > 23 || minute < 0 || minute > 59) {
-        return false;
-    }
-    
-    tm_out.tm_hour = hour;
-    tm_out.tm_min = minute;
+
+    tm_out.tm_hour = time.hour;
+    tm_out.tm_min = time.minute;
     tm_out.tm_sec = 0;
-    
+
     return true;
 }
 
-// Helper function to calculate days since epoch for a given date
-static int daysSinceEpoch(int year, int month, int day) {
-    // Algorithm to calculate days since 1970-01-01
-    // Accounts for leap years
-    int days = 0;
-    
-    // Days from 1970 to year
-    for (int y = 1970; y < year; y++) {
-        days += 365;
-        if ((y % 4 == 0 && y % 100 != 0) || (y % 400 == 0)) {
-            days++;  // Leap year
-        }
-    }
-    
-    // Days from Jan 1 to month in the given year
-    int days_in_month[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
-    bool is_leap = (year % 4 == 0 && year % 100 != 0) || (year % 400 == 0);
-    if (is_leap) {
-        days_in_month[1] = 29;
-    }
-    
-    for (int m = 0; m < month - 1; m++) {
-        days += days_in_month[m];
-    }
-    
-    days += (day - 1);
-    return days;
-}
+// Compile-time checks of the civil calendar math
+static_assert(TimezoneUtils::daysFromCivil(1970, 1, 1) == 0, "epoch is day 0");
+static_assert(TimezoneUtils::daysFromCivil(2000, 3, 1) == 11017, "after a 400-year leap day");
+static_assert(TimezoneUtils::daysFromCivil(1969, 12, 31) == -1, "days before the epoch are negative");
+static_assert(TimezoneUtils::civilFromDays(11016).month == 2 &&
+              TimezoneUtils::civilFromDays(11016).day == 29, "2000-02-29 exists");
+static_assert(TimezoneUtils::civilFromDays(-719468).year == 0, "round trip reaches year 0");
+static_assert(TimezoneUtils::daysInMonth(1900, 2) == 28 && TimezoneUtils::daysInMonth(2024, 2) == 29,
+              "century and 4-year leap rules");
+static_assert(TimezoneUtils::weekdayFromDays(0) == 4, "1970-01-01 was a Thursday");
+static_assert(IstZone::localToUTC(LocalDate{2025, 1, 10}, LocalTime{14, 0}) == 1736497800,
+              "2025-01-10 14:00 IST is 08:30 UTC");
 
 time_t TimezoneUtils::localToUTC(const std::string& date_str, 
                                  const std::string& time_str, 
                                  const std::string& tz_str) {
-    if (!isValidTimezone(tz_str)) {
+    return localToUTC(date_str, time_str, resolveTimezone(tz_str));
+}
+
+time_t TimezoneUtils::localToUTC(const std::string& date_str,
+                                 const std::string& time_str,
+                                 TzId tz) {
+    LocalDate date;
+    LocalTime time;
+
+    // Parse date and time straight from the caller's buffers
+    if (parseDate(std::string_view(date_str), date) != ParseError::None) {
         return -1;
     }
-    
-    struct tm tm_local = {0};
-    
-    // Parse date
-    if (!parseDate(date_str, tm_local)) {
+    if (parseTime(std::string_view(time_str), time) != ParseError::None) {
         return -1;
     }
-    
-    // Parse time
-    if (!parseTime(time_str, tm_local)) {
+
+    return toUTC(LocalDateTime{date, time}, tz);
+}
+
+time_t TimezoneUtils::toUTC(const LocalDateTime& local, TzId tz) {
+    ZoneRef ref(tz);
+    if (!ref.zone) {
         return -1;
     }
-    
+
     // Manually calculate UTC time_t
     // This avoids issues with mktime interpreting tm as local time
-    int year = tm_local.tm_year + 1900;
-    int month = tm_local.tm_mon + 1;
-    int day = tm_local.tm_mday;
-    int hour = tm_local.tm_hour;
-    int minute = tm_local.tm_min;
-    
-    // Calculate days since epoch (1970-01-01)
-    int days = daysSinceEpoch(year, month, day);
+    long long local_time = toLocalSeconds(local.date, local.time);
     
-    // Calculate total seconds
-    time_t utc_time = days * 24LL * 3600LL + hour * 3600LL + minute * 60LL;
-    
-    // Get timezone offset
-    int offset_seconds = getOffsetSeconds(tz_str);
+    // Get the offset in effect at that wall-clock time (DST-aware)
+    int offset_seconds = cachedOffsetForLocal(tz, ref, local_time);
     
     // Convert to UTC: subtract the offset (because local time = UTC + offset)
-    utc_time = utc_time - offset_seconds;
-    
-    return utc_time;
+    return static_cast<time_t>(local_time - offset_seconds);
+}
+
+bool TimezoneUtils::toLocal(time_t utc_time, TzId tz, LocalDateTime& out) {
+    ZoneRef ref(tz);
+    if (!ref.zone) {
+        return false;
+    }
+
+    long long local_time = static_cast<long long>(utc_time) + cachedOffsetAtUtc(tz, ref, utc_time);
+    long long days = local_time / 86400;
+    long long secs_of_day = local_time % 86400;
+    if (secs_of_day < 0) {
+        secs_of_day += 86400;
+        days -= 1;
+    }
+    out.date = civilFromDays(days);
+    out.time.hour = static_cast<int>(secs_of_day / 3600);
+    out.time.minute = static_cast<int>((secs_of_day % 3600) / 60);
+    return true;
+}
+
+bool TimezoneUtils::eventRange(const LocalDate& date, const LocalTime& start,
+                               const LocalTime& end, TzId tz, UtcRange& out) {
+    // Overnight: the end wall-clock time belongs to the next local day
+    bool overnight = end.hour * 60 + end.minute <= start.hour * 60 + start.minute;
+    LocalDate end_date = overnight ? addDays(date, 1) : date;
+
+    out.start_utc = toUTC(LocalDateTime{date, start}, tz);
+    out.end_utc = toUTC(LocalDateTime{end_date, end}, tz);
+    return out.start_utc != -1 && out.end_utc != -1;
+}
+
+// Per-thread memo of computed week bounds, direct-mapped by (zone, week).
+// A week number counts Mondays since 1970-01-05, the first Monday after
+// the epoch, so it identifies the local week independently of the day.
+namespace {
+
+struct CachedWeek {
+    int tz_id;
+    unsigned long long generation;  // 0 = empty
+    long long week;
+    UtcRange range;
+};
+
+const int kWeekCacheSlots = 64;
+thread_local CachedWeek t_week_cache[kWeekCacheSlots];
+
+const long long kFirstMondayDays = 4;  // 1970-01-05
+
+}  // namespace
+
+bool TimezoneUtils::weekBounds(const LocalDate& date, TzId tz, UtcRange& out) {
+    ZoneRef ref(tz);
+    if (!ref.zone) {
+        return false;
+    }
+
+    // Monday of the local week: weekday 0 = Sunday, so Sunday goes back 6 days
+    long long days = daysFromCivil(date.year, date.month, date.day);
+    long long monday = days - (weekdayFromDays(days) + 6) % 7;
+    long long week = (monday - kFirstMondayDays) / 7;  // Exact: monday is a Monday
+
+    CachedWeek& slot = t_week_cache[(static_cast<unsigned long long>(week) * 31 + tz.value)
+                                    % kWeekCacheSlots];
+    if (slot.tz_id == tz.value && slot.generation == ref.generation && slot.week == week) {
+        out = slot.range;
+        return true;
+    }
+
+    // Convert both local midnights; their distance varies across DST changes
+    long long start_local = monday * 86400LL;
+    long long end_local = (monday + 7) * 86400LL;
+    out.start_utc = static_cast<time_t>(start_local - cachedOffsetForLocal(tz, ref, start_local));
+    out.end_utc = static_cast<time_t>(end_local - cachedOffsetForLocal(tz, ref, end_local));
+
+    slot.tz_id = tz.value;
+    slot.generation = ref.generation;
+    slot.week = week;
+    slot.range = out;
+    return true;
+}
+
+bool TimezoneUtils::weekBounds(const std::string& date_str, TzId tz, UtcRange& out) {
+    LocalDate date;
+    if (parseDate(std::string_view(date_str), date) != ParseError::None) {
+        return false;
+    }
+    return weekBounds(date, tz, out);
+}
+
+// "00" "01" ... "99": one lookup writes two digits at a time.
+static const char kDigitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static inline void writeTwoDigits(int value, char* out) {
+    const char* pair = kDigitPairs + value * 2;
+    out[0] = pair[0];
+    out[1] = pair[1];
+}
+
+bool TimezoneUtils::writeLocalTimestamp(long long local_seconds, char* out) {
+    // Split into whole days and seconds within the day. Floor division keeps
+    // the time-of-day non-negative for instants before the epoch.
+    long long days = local_seconds / 86400;
+    long long secs_of_day = local_seconds % 86400;
+    if (secs_of_day < 0) {
+        secs_of_day += 86400;
+        days -= 1;
+    }
+
+    // Pure arithmetic instead of gmtime(), which returns a pointer to a
+    // shared static buffer and is not safe to call from several threads.
+    LocalDate date = civilFromDays(days);
+    int year = date.year;
+    int month = date.month;
+    int day = date.day;
+    if (year < 0 || year > 9999) {
+        return false;
+    }
+    int hour = static_cast<int>(secs_of_day / 3600);
+    int minute = static_cast<int>((secs_of_day % 3600) / 60);
+
+    // Layout: YYYY-MM-DD HH:MM
+    writeTwoDigits(year / 100, out);
+    writeTwoDigits(year % 100, out + 2);
+    out[4] = '-';
+    writeTwoDigits(month, out + 5);
+    out[7] = '-';
+    writeTwoDigits(day, out + 8);
+    out[10] = ' ';
+    writeTwoDigits(hour, out + 11);
+    out[13] = ':';
+    writeTwoDigits(minute, out + 14);
+    return true;
+}
+
+size_t TimezoneUtils::formatLocal(time_t utc_time, const std::string& tz_str, char* out) {
+    return formatLocal(utc_time, resolveTimezone(tz_str), out);
+}
+
+size_t TimezoneUtils::formatLocal(time_t utc_time, TzId tz, char* out) {
+    ZoneRef ref(tz);
+    if (!ref.zone) {
+        return 0;
+    }
+
+    // Convert UTC to local: add the offset in effect at that instant
+    long long local_time = static_cast<long long>(utc_time) + cachedOffsetAtUtc(tz, ref, utc_time);
+    return writeLocalTimestamp(local_time, out) ? kLocalTimestampLength : 0;
+}
+
+size_t TimezoneUtils::formatLocalBatch(const time_t* utc_times, size_t count,
+                                       const std::string& tz_str, char* out) {
+    return formatLocalBatch(utc_times, count, resolveTimezone(tz_str), out);
+}
+
+size_t TimezoneUtils::formatLocalBatch(const time_t* utc_times, size_t count,
+                                       TzId tz, char* out) {
+    // Look the zone up once for the whole batch
+    ZoneRef ref(tz);
+    if (!ref.zone) {
+        return 0;
+    }
+
+    char* p = out;
+    for (size_t i = 0; i < count; i++, p += kLocalTimestampLength) {
+        long long local_time = static_cast<long long>(utc_times[i]) +
+                               cachedOffsetAtUtc(tz, ref, utc_times[i]);
+        if (!writeLocalTimestamp(local_time, p)) {
+            std::memcpy(p, "####-##-## ##:##", kLocalTimestampLength);
+        }
+    }
+    return count * kLocalTimestampLength;
 }
 
 std::string TimezoneUtils::utcToLocal(time_t utc_time, const std::string& tz_str) {
-    if (!isValidTimezone(tz_str)) {
+    return utcToLocal(utc_time, resolveTimezone(tz_str));
+}
+
+std::string TimezoneUtils::utcToLocal(time_t utc_time, TzId tz) {
+    if (!tz.isValid()) {
         return "INVALID_TZ";
     }
-    
-    // Get timezone offset
-    int offset_seconds = getOffsetSeconds(tz_str);
-    
-    // Convert UTC to local: add the offset
-    time_t local_time = utc_time + offset_seconds;
-    
-    // Convert to tm structure
-    struct tm* tm_local = gmtime(&local_time);
-    if (!tm_local) {
+
+    char buf[kLocalTimestampLength];
+    if (formatLocal(utc_time, tz, buf) == 0) {
         return "INVALID_TIME";
     }
-    
-    // Format as "YYYY-MM-DD HH:MM"
-    std::ostringstream oss;
-    oss << std::setfill('0')
-        << std::setw(4) << (tm_local->tm_year + 1900) << "-"
-        << std::setw(2) << (tm_local->tm_mon + 1) << "-"
-        << std::setw(2) << tm_local->tm_mday << " "
-        << std::setw(2) << tm_local->tm_hour << ":"
-        << std::setw(2) << tm_local->tm_min;
-    
-    return oss.str();
+    return std::string(buf, kLocalTimestampLength);
 }
-
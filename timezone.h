@@ -2,32 +2,99 @@
 #define TIMEZONE_H
 
 #include <string>
+#include <string_view>
 #include <ctime>
 #include <mutex>
+#include "tzdb.h"
 
 
+/**
+ * Calendar date in some (unspecified) timezone, as typed by the user.
+ */
+struct LocalDate {
+    int year;
+    int month;  // 1-12
+    int day;    // 1-31
+};
+
+/**
+ * Wall-clock time of day, minute precision.
+ */
+struct LocalTime {
+    int hour;    // 0-23
+    int minute;  // 0-59
+};
+
+/**
+ * Local date and wall-clock time together, e.g. 2025-01-10 14:00 in some zone.
+ */
+struct LocalDateTime {
+    LocalDate date;
+    LocalTime time;
+};
+
+/**
+ * Half-open range of UTC instants [start_utc, end_utc).
+ */
+struct UtcRange {
+    time_t start_utc;
+    time_t end_utc;
+};
+
+/**
+ * Outcome of the fixed-format date/time parsers.
+ * Lets callers report *why* input was rejected without exceptions.
+ */
+enum class ParseError {
+    None,         // Parsed successfully
+    BadLength,    // Input is not exactly "YYYY-MM-DD" / "HH:MM" wide
+    BadSyntax,    // Non-digit in a digit position, or wrong separator
+    OutOfRange,   // Field outside its range (month 13, hour 24, year < 1970)
+    InvalidDate   // Day does not exist in that month (e.g. 2025-02-30)
+};
+
 /**
  * Timezone utilities for converting between local time and UTC.
  * 
- * Limitations:
- * - Uses fixed offsets (does not account for DST)
- * - Only supports UTC, IST, and PST
- * - For production, use a proper timezone library (e.g., ICU, date library)
+ * Timezones:
+ * - "UTC", "IST" and "PST" short names (IST/PST map to Asia/Kolkata and
+ *   America/Los_Angeles, falling back to fixed offsets without zoneinfo)
+ * - Any IANA name installed in the zoneinfo directory ("Europe/London"),
+ *   with full DST history via TzDatabase
+ *
+ * Every function taking a timezone name has an overload taking a TzId.
+ * Resolve the name once with resolveTimezone and use the TzId overloads in
+ * loops: they skip the name lookup and never throw.
  */
 class TimezoneUtils {
 public:
+    /**
+     * Resolve a timezone name to a handle for the TzId overloads.
+     *
+     * @param tz_str Timezone string ("UTC", "IST", "PST" or an IANA name)
+     * @return Handle, or an invalid TzId for an unknown timezone
+     */
+    static TzId resolveTimezone(const std::string& tz_str);
+
     /**
      * Convert a local time string to UTC time_t.
      * 
      * @param date_str Date in format "YYYY-MM-DD"
      * @param time_str Time in format "HH:MM"
-     * @param tz_str Timezone string ("UTC", "IST", or "PST")
+     * @param tz_str Timezone string ("UTC", "IST", "PST" or an IANA name)
      * @return time_t representing UTC time, or -1 on error
      */
     static time_t localToUTC(const std::string& date_str, 
                             const std::string& time_str, 
                             const std::string& tz_str);
 
+    /**
+     * localToUTC for an already resolved timezone.
+     */
+    static time_t localToUTC(const std::string& date_str,
+                            const std::string& time_str,
+                            TzId tz);
+
     /**
      * Convert UTC time_t to local time string.
      * 
@@ -38,13 +105,140 @@ public:
     static std::string utcToLocal(time_t utc_time, const std::string& tz_str);
 
     /**
-     * Get timezone offset in seconds from UTC.
+     * utcToLocal for an already resolved timezone.
+     */
+    static std::string utcToLocal(time_t utc_time, TzId tz);
+
+    /**
+     * Convert a structured local date-time to UTC. No strings involved.
+     *
+     * @param local Wall-clock date and time in tz (must be a valid date)
+     * @param tz Resolved timezone
+     * @return UTC time, or -1 for an invalid timezone
+     */
+    static time_t toUTC(const LocalDateTime& local, TzId tz);
+
+    /**
+     * Convert UTC to the structured local date-time in tz.
+     *
+     * @return false for an invalid timezone
+     */
+    static bool toLocal(time_t utc_time, TzId tz, LocalDateTime& out);
+
+    /**
+     * UTC range of an event given as one local date with start and end times.
+     *
+     * If the end wall-clock time is not after the start (e.g. 23:00-01:00),
+     * the event runs overnight and ends on the following local day. The
+     * day is added with pure date arithmetic; no mktime, no host TZ.
+     *
+     * @param date Local date of the start
+     * @param start Local start time
+     * @param end Local end time (next day if <= start)
+     * @param tz Resolved timezone
+     * @param out Filled on success
+     * @return false for an invalid timezone
+     */
+    static bool eventRange(const LocalDate& date, const LocalTime& start,
+                           const LocalTime& end, TzId tz, UtcRange& out);
+
+    /**
+     * UTC bounds of the local calendar week (Monday 00:00 to the next
+     * Monday 00:00, wall-clock time in tz) containing a local date.
+     *
+     * The weekday comes from the local date itself, not from the UTC
+     * instant of its midnight, and both ends are converted separately, so
+     * a week containing a DST change is 167 or 169 hours long as it should.
+     *
+     * Results are memoized per thread by (zone, week number), so repeated
+     * "list week" calls for the same week skip the date math entirely.
+     *
+     * @param date Any day in the week, in tz
+     * @param tz Resolved timezone
+     * @param out Filled on success
+     * @return false for an invalid timezone
+     */
+    static bool weekBounds(const LocalDate& date, TzId tz, UtcRange& out);
+
+    /**
+     * weekBounds for a "YYYY-MM-DD" string.
+     *
+     * @return false for an invalid date or timezone
+     */
+    static bool weekBounds(const std::string& date_str, TzId tz, UtcRange& out);
+
+    /**
+     * Width of a timestamp written by formatLocal: "YYYY-MM-DD HH:MM".
+     * The output is fixed width and not NUL-terminated.
+     */
+    static const size_t kLocalTimestampLength = 16;
+
+    /**
+     * Write UTC time as local "YYYY-MM-DD HH:MM" into a caller buffer.
+     *
+     * Allocation-free alternative to utcToLocal for rendering loops:
+     * digits come from a two-digit lookup table instead of ostringstream.
+     *
+     * @param utc_time UTC time as time_t
+     * @param tz_str Target timezone string
+     * @param out Buffer with room for kLocalTimestampLength chars
+     * @return kLocalTimestampLength, or 0 for an invalid timezone or a year
+     *         outside 0000-9999 (nothing is written in that case)
+     */
+    static size_t formatLocal(time_t utc_time, const std::string& tz_str, char* out);
+
+    /**
+     * formatLocal for an already resolved timezone.
+     */
+    static size_t formatLocal(time_t utc_time, TzId tz, char* out);
+
+    /**
+     * Format many UTC times for one timezone in a single call.
+     *
+     * The timezone is validated once for the whole batch. Record i is
+     * written at out + i * kLocalTimestampLength; unrepresentable years
+     * are written as "####-##-## ##:##" so the layout stays fixed.
+     *
+     * @param utc_times Array of count UTC times
+     * @param count Number of times to format
+     * @param tz_str Target timezone string
+     * @param out Buffer with room for count * kLocalTimestampLength chars
+     * @return Number of bytes written (0 for an invalid timezone)
+     */
+    static size_t formatLocalBatch(const time_t* utc_times, size_t count,
+                                   const std::string& tz_str, char* out);
+
+    /**
+     * formatLocalBatch for an already resolved timezone.
+     */
+    static size_t formatLocalBatch(const time_t* utc_times, size_t count,
+                                   TzId tz, char* out);
+
+    /**
+     * Get the timezone offset in seconds from UTC currently in effect.
      * 
      * @param tz_str Timezone string
      * @return Offset in seconds (positive for east of UTC, negative for west)
+     * @throws std::invalid_argument for an unknown timezone
      */
     static int getOffsetSeconds(const std::string& tz_str);
 
+    /**
+     * Get the timezone offset in seconds from UTC at a given instant.
+     * 
+     * @param tz_str Timezone string
+     * @param utc_time Instant to evaluate (DST depends on it)
+     * @return Offset in seconds (positive for east of UTC, negative for west)
+     * @throws std::invalid_argument for an unknown timezone
+     */
+    static int getOffsetSeconds(const std::string& tz_str, time_t utc_time);
+
+    /**
+     * Offset at a given instant for an already resolved timezone.
+     * Returns 0 for an invalid handle instead of throwing.
+     */
+    static int getOffsetSeconds(TzId tz, time_t utc_time);
+
     /**
      * Validate timezone string.
      * 
@@ -59,6 +253,138 @@ public:
      */
     static bool parseDate(const std::string& date_str, struct tm& tm_out);
 
+    /**
+     * Parse "YYYY-MM-DD" without allocating.
+     *
+     * Hand-rolled fixed-width parser: checks each character position
+     * directly instead of going through std::istringstream, which dominates
+     * the cost of bulk imports. Rejects dates that do not exist in the
+     * calendar (Feb 30, Feb 29 in non-leap years, Apr 31, ...).
+     *
+     * @param date_str Exactly 10 characters
+     * @param out Filled only on success
+     * @return ParseError::None on success, otherwise the reason for rejection
+     */
+    static ParseError parseDate(std::string_view date_str, LocalDate& out) noexcept;
+
+    /**
+     * Parse "HH:MM" (24-hour clock) without allocating.
+     *
+     * @param time_str Exactly 5 characters
+     * @param out Filled only on success
+     * @return ParseError::None on success, otherwise the reason for rejection
+     */
+    static ParseError parseTime(std::string_view time_str, LocalTime& out) noexcept;
+
+    // ---------------------------------------------------------------------
+    // Civil calendar math. constexpr so that fixed dates and offsets fold at
+    // compile time and the formulas can be checked with static_assert.
+    // ---------------------------------------------------------------------
+
+    /**
+     * Gregorian leap year rule.
+     */
+    static constexpr bool isLeapYear(int year) {
+        return (year % 4 == 0 && year % 100 != 0) || (year % 400 == 0);
+    }
+
+    /**
+     * Number of days in the given month (1-12) of the given year.
+     */
+    static constexpr int daysInMonth(int year, int month) {
+        constexpr int kDaysInMonth[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+        return (month == 2 && isLeapYear(year)) ? 29 : kDaysInMonth[month - 1];
+    }
+
+    /**
+     * Count days from 1970-01-01 to the given civil (proleptic Gregorian) date.
+     * Constant time: uses 400-year era arithmetic instead of looping over years.
+     * Dates before 1970 yield negative values.
+     *
+     * Howard Hinnant's algorithm: the calendar repeats every 400 years
+     * (146097 days), so the date splits into an era and a year-of-era.
+     * Starting the year in March puts the leap day last, which makes the
+     * day-of-year formula independent of leap years.
+     *
+     * @param year Full year (e.g. 2025)
+     * @param month Month 1-12
+     * @param day Day of month 1-31
+     * @return Days since the Unix epoch
+     */
+    static constexpr long long daysFromCivil(int year, int month, int day) {
+        long long y = year - (month <= 2 ? 1 : 0);
+        long long era = (y >= 0 ? y : y - 399) / 400;
+        long long yoe = y - era * 400;                                      // [0, 399]
+        long long doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5
+                        + day - 1;                                          // [0, 365]
+        long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;              // [0, 146096]
+        return era * 146097 + doe - 719468;  // 719468 = days from 0000-03-01 to 1970-01-01
+    }
+
+    /**
+     * Inverse of daysFromCivil: split a day count since 1970-01-01 into
+     * year, month (1-12) and day (1-31). Constant time, no libc calls.
+     */
+    static constexpr LocalDate civilFromDays(long long days) {
+        long long z = days + 719468;
+        long long era = (z >= 0 ? z : z - 146096) / 146097;
+        long long doe = z - era * 146097;                                   // [0, 146096]
+        long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;  // [0, 399]
+        long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);            // [0, 365]
+        long long mp = (5 * doy + 2) / 153;                                 // [0, 11], March = 0
+        int day = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+        int month = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+        int year = static_cast<int>(yoe + era * 400 + (month <= 2 ? 1 : 0));
+        return LocalDate{year, month, day};
+    }
+
+    /**
+     * civilFromDays with out-parameters.
+     */
+    static constexpr void civilFromDays(long long days, int& year, int& month, int& day) {
+        LocalDate date = civilFromDays(days);
+        year = date.year;
+        month = date.month;
+        day = date.day;
+    }
+
+    /**
+     * Date a number of days after (or before, if negative) another date.
+     */
+    static constexpr LocalDate addDays(const LocalDate& date, long long days) {
+        return civilFromDays(daysFromCivil(date.year, date.month, date.day) + days);
+    }
+
+    /**
+     * Day of week for a day count since 1970-01-01 (0 = Sunday ... 6 = Saturday).
+     */
+    static constexpr int weekdayFromDays(long long days) {
+        return static_cast<int>(((days % 7) + 11) % 7);  // 1970-01-01 was a Thursday
+    }
+
+    /**
+     * Local wall-clock time as seconds since 1970-01-01 00:00 (no offset applied).
+     */
+    static constexpr long long toLocalSeconds(const LocalDate& date, const LocalTime& time) {
+        return daysFromCivil(date.year, date.month, date.day) * 86400LL
+               + time.hour * 3600LL + time.minute * 60LL;
+    }
+
+    /**
+     * Can every timezone show this instant as "YYYY-MM-DD HH:MM"? True for
+     * years 0001-9998 UTC: a day of margin on either side of what
+     * writeLocalTimestamp represents covers any UTC offset.
+     */
+    static constexpr bool isRenderableUtc(long long utc_seconds) {
+        return utc_seconds >= daysFromCivil(1, 1, 1) * 86400LL && utc_seconds < daysFromCivil(9999, 1, 1) * 86400LL;
+    }
+
+    /**
+     * Write local seconds since the epoch as "YYYY-MM-DD HH:MM".
+     * Returns false (writing nothing) if the year does not fit 4 digits.
+     */
+    static bool writeLocalTimestamp(long long local_seconds, char* out);
+
 private:
     /**
      * Parse time string "HH:MM" into tm structure.
@@ -66,5 +392,49 @@ private:
     static bool parseTime(const std::string& time_str, struct tm& tm_out);
 };
 
+/**
+ * Converter for a zone whose offset is known at compile time.
+ *
+ * For callers that always work in one fixed-offset zone (embedded
+ * gateways, batch jobs pinned to UTC): no registry lookup, no DST search,
+ * each conversion inlines to a single add or subtract.
+ *
+ * Example: FixedZone<19800>::toUtc(local) is local - 19800.
+ *
+ * @tparam OffsetSeconds Seconds east of UTC
+ */
+template <int OffsetSeconds>
+struct FixedZone {
+    static_assert(OffsetSeconds > -24 * 3600 && OffsetSeconds < 24 * 3600,
+                  "UTC offset must be less than a day");
+
+    static constexpr int kOffsetSeconds = OffsetSeconds;
+
+    static constexpr long long toUtc(long long local_seconds) {
+        return local_seconds - OffsetSeconds;
+    }
+
+    static constexpr long long toLocal(long long utc_seconds) {
+        return utc_seconds + OffsetSeconds;
+    }
+
+    static constexpr time_t localToUTC(const LocalDate& date, const LocalTime& time) {
+        return static_cast<time_t>(toUtc(TimezoneUtils::toLocalSeconds(date, time)));
+    }
+
+    /**
+     * Same output as TimezoneUtils::formatLocal, without the zone lookup.
+     */
+    static size_t formatLocal(time_t utc_time, char* out) {
+        return TimezoneUtils::writeLocalTimestamp(toLocal(utc_time), out)
+                   ? TimezoneUtils::kLocalTimestampLength : 0;
+    }
+};
+
+// Fixed-offset zones matching the CLI's short names (standard time only)
+typedef FixedZone<0> UtcZone;
+typedef FixedZone<19800> IstZone;       // +5:30
+typedef FixedZone<-28800> PstFixedZone;  // -8:00, ignores US daylight saving
+
 #endif // TIMEZONE_H
 
@@ -0,0 +1,733 @@
+#include "tzdb.h"
+#include "timezone.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <utility>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ---------------------------------------------------------------------------
+// ZoneInfo lookups
+// ---------------------------------------------------------------------------
+
+ZoneInfo::ZoneInfo(const std::string& name, int offset_seconds)
+    : name_(name), offsets_(1, offset_seconds) {
+}
+
+size_t ZoneInfo::intervalIndex(long long utc_seconds) const {
+    // First transition strictly after the instant; the interval before it
+    // is the one in effect (transitions take effect at their own instant).
+    return std::upper_bound(transitions_.begin(), transitions_.end(), utc_seconds)
+           - transitions_.begin();
+}
+
+OffsetInterval ZoneInfo::intervalAt(long long utc_seconds) const {
+    size_t i = intervalIndex(utc_seconds);
+    OffsetInterval interval;
+    interval.begin_utc = (i > 0) ? transitions_[i - 1] : std::numeric_limits<long long>::min();
+    interval.end_utc = (i < transitions_.size()) ? transitions_[i]
+                                                  : std::numeric_limits<long long>::max();
+    interval.offset_seconds = offsets_[i];
+    return interval;
+}
+
+int ZoneInfo::offsetAtUtc(long long utc_seconds) const {
+    return offsets_[intervalIndex(utc_seconds)];
+}
+
+int ZoneInfo::offsetForLocal(long long local_seconds) const {
+    // Offsets differ from UTC by less than a day and transitions are far
+    // apart, so the interval holding "local read as UTC" is at most one
+    // interval away from the answer. Each candidate offset is valid if the
+    // UTC instant it produces really lies inside that candidate's interval.
+    size_t k = intervalIndex(local_seconds);
+    size_t first = (k > 0) ? k - 1 : 0;
+    size_t last = std::min(k + 1, offsets_.size() - 1);
+
+    bool found = false;
+    long long best_utc = 0;
+    for (size_t c = first; c <= last; c++) {
+        long long utc = local_seconds - offsets_[c];
+        if (intervalIndex(utc) == c && (!found || utc < best_utc)) {
+            best_utc = utc;  // Earliest instant wins for ambiguous times
+            found = true;
+        }
+    }
+    if (found) {
+        return static_cast<int>(local_seconds - best_utc);
+    }
+
+    // No candidate matched: the wall-clock time was skipped by a forward
+    // change. Use the offset from before that change.
+    for (size_t c = std::max<size_t>(first, 1); c <= last; c++) {
+        long long t = transitions_[c - 1];
+        if (local_seconds >= t + offsets_[c - 1] && local_seconds < t + offsets_[c]) {
+            return offsets_[c - 1];
+        }
+    }
+    return offsets_[k];
+}
+
+void ZoneInfo::addTransition(long long utc_seconds, int offset_seconds) {
+    if (!transitions_.empty() && utc_seconds <= transitions_.back()) {
+        return;  // Keep the table strictly ascending
+    }
+    if (offset_seconds == offsets_.back()) {
+        return;  // Only abbreviation/isdst changed; offset is what matters
+    }
+    transitions_.push_back(utc_seconds);
+    offsets_.push_back(offset_seconds);
+}
+
+// ---------------------------------------------------------------------------
+// POSIX TZ footer rules, e.g. "PST8PDT,M3.2.0,M11.1.0"
+// ---------------------------------------------------------------------------
+
+namespace {
+
+// A rule date: Mm.w.d, Jn (1-365, Feb 29 never counted) or n (0-365)
+struct PosixRuleDate {
+    char kind;          // 'M', 'J' or 'n'
+    int month;          // M: 1-12
+    int week;           // M: 1-5, 5 = last
+    int weekday;        // M: 0 = Sunday
+    int day;            // J / n
+    int time_seconds;   // Local time of the change, default 02:00
+};
+
+class PosixRuleParser {
+public:
+    explicit PosixRuleParser(const std::string& s) : s_(s), pos_(0) {}
+
+    bool atEnd() const { return pos_ >= s_.size(); }
+
+    bool consume(char c) {
+        if (pos_ < s_.size() && s_[pos_] == c) {
+            pos_++;
+            return true;
+        }
+        return false;
+    }
+
+    // Abbreviation: alphabetic ("PST") or quoted ("<+0530>")
+    bool name() {
+        if (consume('<')) {
+            size_t close = s_.find('>', pos_);
+            if (close == std::string::npos) {
+                return false;
+            }
+            pos_ = close + 1;
+            return true;
+        }
+        size_t start = pos_;
+        while (pos_ < s_.size() && std::isalpha(static_cast<unsigned char>(s_[pos_]))) {
+            pos_++;
+        }
+        return pos_ - start >= 3;
+    }
+
+    // [+-]hh[:mm[:ss]] in seconds; hours up to 167 (TZif v3 extension)
+    bool duration(int& seconds) {
+        int sign = 1;
+        if (consume('-')) {
+            sign = -1;
+        } else {
+            consume('+');
+        }
+        int parts[3] = {0, 0, 0};
+        for (int i = 0; i < 3; i++) {
+            if (i > 0 && !consume(':')) {
+                break;
+            }
+            if (!number(parts[i]) || (i == 0 && parts[i] > 167) || (i > 0 && parts[i] > 59)) {
+                return false;
+            }
+        }
+        seconds = sign * (parts[0] * 3600 + parts[1] * 60 + parts[2]);
+        return true;
+    }
+
+    bool ruleDate(PosixRuleDate& out) {
+        out.time_seconds = 2 * 3600;
+        if (consume('M')) {
+            out.kind = 'M';
+            if (!number(out.month) || !consume('.') || !number(out.week) ||
+                !consume('.') || !number(out.weekday)) {
+                return false;
+            }
+            if (out.month < 1 || out.month > 12 || out.week < 1 || out.week > 5 ||
+                out.weekday > 6) {
+                return false;
+            }
+        } else if (consume('J')) {
+            out.kind = 'J';
+            if (!number(out.day) || out.day < 1 || out.day > 365) {
+                return false;
+            }
+        } else {
+            out.kind = 'n';
+            if (!number(out.day) || out.day > 365) {
+                return false;
+            }
+        }
+        if (consume('/')) {
+            return duration(out.time_seconds);
+        }
+        return true;
+    }
+
+private:
+    const std::string& s_;
+    size_t pos_;
+
+    bool number(int& value) {
+        size_t start = pos_;
+        value = 0;
+        while (pos_ < s_.size() && s_[pos_] >= '0' && s_[pos_] <= '9' && pos_ - start < 4) {
+            value = value * 10 + (s_[pos_] - '0');
+            pos_++;
+        }
+        return pos_ > start;
+    }
+};
+
+// Days since epoch of the local date a rule refers to in a given year
+long long ruleDay(const PosixRuleDate& rule, int year) {
+    if (rule.kind == 'J') {
+        // Feb 29 is never counted, so day 60 is always March 1
+        int extra = (TimezoneUtils::isLeapYear(year) && rule.day >= 60) ? 1 : 0;
+        return TimezoneUtils::daysFromCivil(year, 1, 1) + rule.day - 1 + extra;
+    }
+    if (rule.kind == 'n') {
+        return TimezoneUtils::daysFromCivil(year, 1, 1) + rule.day;
+    }
+
+    // Mm.w.d: the w-th weekday d of month m (w = 5 means the last one)
+    long long first = TimezoneUtils::daysFromCivil(year, rule.month, 1);
+    int first_weekday = TimezoneUtils::weekdayFromDays(first);
+    int day = 1 + (rule.weekday - first_weekday + 7) % 7 + (rule.week - 1) * 7;
+    while (day > TimezoneUtils::daysInMonth(year, rule.month)) {
+        day -= 7;
+    }
+    return first + day - 1;
+}
+
+}  // namespace
+
+bool ZoneInfo::extendWithPosixRule(const std::string& rule) {
+    PosixRuleParser parser(rule);
+
+    // POSIX offsets count hours *west* of UTC ("PST8" is UTC-8)
+    int std_west = 0;
+    if (!parser.name() || !parser.duration(std_west)) {
+        return false;
+    }
+    int std_offset = -std_west;
+
+    if (parser.atEnd()) {
+        // No DST: a single offset from the end of the table onwards
+        long long after = transitions_.empty() ? 0 : transitions_.back() + 1;
+        addTransition(after, std_offset);
+        return true;
+    }
+
+    if (!parser.name()) {
+        return false;
+    }
+    int dst_offset = std_offset + 3600;
+    int dst_west = 0;
+    if (!parser.consume(',')) {
+        if (!parser.duration(dst_west)) {
+            return false;
+        }
+        dst_offset = -dst_west;
+        if (!parser.consume(',')) {
+            return false;
+        }
+    }
+
+    PosixRuleDate start, end;
+    if (!parser.ruleDate(start) || !parser.consume(',') || !parser.ruleDate(end) ||
+        !parser.atEnd()) {
+        return false;
+    }
+
+    // Continue from the year of the last explicit transition
+    int first_year = 1970;
+    if (!transitions_.empty()) {
+        first_year = TimezoneUtils::civilFromDays(transitions_.back() / 86400).year;
+    }
+
+    for (int year = first_year; year <= kLastExpandedYear; year++) {
+        // DST starts at a standard-time wall clock and ends at a DST one.
+        // Sorting handles southern-hemisphere rules where end < start.
+        long long dst_begin = ruleDay(start, year) * 86400 + start.time_seconds - std_offset;
+        long long dst_end = ruleDay(end, year) * 86400 + end.time_seconds - dst_offset;
+        if (dst_begin < dst_end) {
+            addTransition(dst_begin, dst_offset);
+            addTransition(dst_end, std_offset);
+        } else {
+            addTransition(dst_end, std_offset);
+            addTransition(dst_begin, dst_offset);
+        }
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// TZif loading
+// ---------------------------------------------------------------------------
+
+namespace {
+
+struct TzifHeader {
+    char version;
+    uint32_t isutcnt, isstdcnt, leapcnt, timecnt, typecnt, charcnt;
+};
+
+const size_t kTzifHeaderSize = 44;
+
+uint32_t readBE32(const unsigned char* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+int64_t readBE64(const unsigned char* p) {
+    return static_cast<int64_t>((uint64_t(readBE32(p)) << 32) | readBE32(p + 4));
+}
+
+bool readHeader(const unsigned char* p, const unsigned char* end, TzifHeader& h) {
+    if (end - p < static_cast<ptrdiff_t>(kTzifHeaderSize) || std::memcmp(p, "TZif", 4) != 0) {
+        return false;
+    }
+    h.version = static_cast<char>(p[4]);
+    h.isutcnt = readBE32(p + 20);
+    h.isstdcnt = readBE32(p + 24);
+    h.leapcnt = readBE32(p + 28);
+    h.timecnt = readBE32(p + 32);
+    h.typecnt = readBE32(p + 36);
+    h.charcnt = readBE32(p + 40);
+    return h.typecnt > 0;
+}
+
+// Size of the data block following a header, for 4- or 8-byte times
+size_t dataBlockSize(const TzifHeader& h, size_t time_size) {
+    return size_t(h.timecnt) * (time_size + 1) + size_t(h.typecnt) * 6 + h.charcnt +
+           size_t(h.leapcnt) * (time_size + 4) + h.isstdcnt + h.isutcnt;
+}
+
+}  // namespace
+
+std::unique_ptr<ZoneInfo> ZoneInfo::loadTZif(const std::string& name, const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return nullptr;
+    }
+
+    const unsigned char* begin = static_cast<const unsigned char*>(map);
+    const unsigned char* end = begin + size;
+    std::unique_ptr<ZoneInfo> zone;
+
+    TzifHeader h;
+    if (readHeader(begin, end, h)) {
+        const unsigned char* data = begin + kTzifHeaderSize;
+        size_t time_size = 4;
+
+        // Version 2+ repeats everything with 64-bit times; prefer that block
+        if (h.version >= '2') {
+            const unsigned char* v2 = data + dataBlockSize(h, 4);
+            if (v2 <= end && readHeader(v2, end, h)) {
+                data = v2 + kTzifHeaderSize;
+                time_size = 8;
+            } else {
+                h.typecnt = 0;  // Truncated file
+            }
+        }
+
+        size_t block = dataBlockSize(h, time_size);
+        if (h.typecnt > 0 && static_cast<size_t>(end - data) >= block) {
+            const unsigned char* times = data;
+            const unsigned char* indices = times + size_t(h.timecnt) * time_size;
+            const unsigned char* types = indices + h.timecnt;
+
+            zone.reset(new ZoneInfo());
+            zone->name_ = name;
+            zone->offsets_.push_back(static_cast<int32_t>(readBE32(types)));
+
+            for (uint32_t i = 0; i < h.timecnt; i++) {
+                unsigned type = indices[i];
+                if (type >= h.typecnt) {
+                    zone.reset();
+                    break;
+                }
+                long long t = (time_size == 8) ? readBE64(times + i * 8)
+                                               : static_cast<int32_t>(readBE32(times + i * 4));
+                zone->addTransition(t, static_cast<int32_t>(readBE32(types + type * 6)));
+            }
+
+            // Footer: "\n<POSIX TZ rule>\n" after the 64-bit block
+            const unsigned char* footer = data + block;
+            if (zone && time_size == 8 && footer < end && *footer == '\n') {
+                const unsigned char* nl = static_cast<const unsigned char*>(
+                    std::memchr(footer + 1, '\n', end - footer - 1));
+                if (nl && nl > footer + 1) {
+                    zone->extendWithPosixRule(std::string(footer + 1, nl));
+                }
+            }
+        }
+    }
+
+    ::munmap(map, size);
+    return zone;
+}
+
+// ---------------------------------------------------------------------------
+// TzDatabase
+// ---------------------------------------------------------------------------
+
+// Reader registry for safe reclamation of replaced snapshots.
+//
+// Each thread that reads a TzDatabase owns one slot. On entering a read
+// section it stores the current global epoch into its slot, then loads the
+// snapshot pointer; on leaving it stores 0. A writer swaps the pointer,
+// bumps the epoch to E, and waits until every slot is 0 or >= E. A reader
+// whose slot is < E may have loaded the old pointer; a reader that
+// published its slot after the writer's scan loads the new one (all
+// operations are sequentially consistent). Readers only write their own
+// cache line, so there is no shared counter to contend on.
+//
+// Slots come in blocks. When every slot is taken, the thread links a new
+// block onto the last one instead of waiting for another thread to exit.
+// A writer that scanned past the end before the link could not see the
+// new slots, but a reader in them loads the pointer after the link, so it
+// gets the new snapshot. Blocks are never freed (their number is bounded
+// by the peak count of live reader threads).
+namespace {
+
+struct alignas(64) ReaderSlot {
+    std::atomic<unsigned long long> epoch{0};
+    std::atomic<bool> in_use{false};
+};
+
+const int kReaderSlotsPerBlock = 1024;
+
+struct ReaderSlotBlock {
+    ReaderSlot slots[kReaderSlotsPerBlock];
+    std::atomic<ReaderSlotBlock*> next{nullptr};
+};
+
+ReaderSlotBlock g_reader_slots;
+std::atomic<unsigned long long> g_reader_epoch{1};
+
+template <typename Visit>
+void forEachReaderSlot(Visit visit) {
+    for (ReaderSlotBlock* block = &g_reader_slots; block; block = block->next.load()) {
+        for (ReaderSlot& slot : block->slots) {
+            visit(slot);
+        }
+    }
+}
+
+// Claims a slot on first use and returns it when the thread exits
+struct ThreadReaderSlot {
+    ReaderSlot* slot = nullptr;
+    int depth = 0;  // Nesting level of ReadGuards on this thread
+
+    ReaderSlot& acquire() {
+        ReaderSlotBlock* block = &g_reader_slots;
+        while (!slot) {
+            for (ReaderSlot& candidate : block->slots) {
+                bool expected = false;
+                if (!candidate.in_use.load(std::memory_order_relaxed) &&
+                    candidate.in_use.compare_exchange_strong(expected, true)) {
+                    slot = &candidate;
+                    break;
+                }
+            }
+            if (slot) {
+                break;
+            }
+            ReaderSlotBlock* next = block->next.load();
+            if (!next) {
+                // More live reader threads than slots: grow. Whoever loses
+                // the race to link a block uses the winner's
+                std::unique_ptr<ReaderSlotBlock> fresh(new ReaderSlotBlock());
+                if (block->next.compare_exchange_strong(next, fresh.get())) {
+                    next = fresh.release();
+                }
+            }
+            block = next;
+        }
+        return *slot;
+    }
+
+    ~ThreadReaderSlot() {
+        if (slot) {
+            slot->epoch.store(0);
+            slot->in_use.store(false);
+        }
+    }
+};
+
+thread_local ThreadReaderSlot t_reader;
+
+// Oldest epoch a reader entered at, or the maximum if no reader is inside
+// a guard. A snapshot swapped out before the epoch was advanced to E can
+// be freed once this is at least E.
+unsigned long long oldestReaderEpoch() {
+    unsigned long long oldest = std::numeric_limits<unsigned long long>::max();
+    forEachReaderSlot([&oldest](const ReaderSlot& slot) {
+        unsigned long long e = slot.epoch.load();
+        if (e != 0 && e < oldest) {
+            oldest = e;
+        }
+    });
+    return oldest;
+}
+
+// Wait until no reader can still hold a pointer loaded before the epoch
+// was advanced to new_epoch.
+void waitForReaders(unsigned long long new_epoch) {
+    forEachReaderSlot([new_epoch](const ReaderSlot& slot) {
+        while (true) {
+            unsigned long long e = slot.epoch.load();
+            if (e == 0 || e >= new_epoch) {
+                break;
+            }
+            std::this_thread::yield();
+        }
+    });
+}
+
+}  // namespace
+
+TzDatabase::ReadGuard::ReadGuard(const TzDatabase& db) {
+    if (t_reader.depth++ == 0) {
+        t_reader.acquire().epoch.store(g_reader_epoch.load());
+    }
+    snapshot_ = db.current_.load();
+}
+
+TzDatabase::ReadGuard::~ReadGuard() {
+    if (--t_reader.depth == 0) {
+        t_reader.slot->epoch.store(0, std::memory_order_release);
+    }
+}
+
+TzId TzDatabase::ReadGuard::find(const std::string& name) const {
+    auto it = snapshot_->ids.find(name);
+    return it == snapshot_->ids.end() ? TzId() : TzId(it->second);
+}
+
+TzDatabase::TzDatabase(const std::string& zoneinfo_dir)
+    : dir_(zoneinfo_dir), current_(new TzSnapshot{{}, {}, 1}) {
+}
+
+TzDatabase::~TzDatabase() {
+    for (const auto& entry : retired_) {
+        delete entry.first;
+    }
+    delete current_.load();
+}
+
+TzDatabase& TzDatabase::instance() {
+    static TzDatabase db([] {
+        const char* env = std::getenv("TZDIR");
+        return std::string(env && *env ? env : "/usr/share/zoneinfo");
+    }());
+    return db;
+}
+
+bool TzDatabase::isSafeZoneName(const std::string& name) {
+    if (name.empty() || name.size() > 64 || name[0] == '/' || name[0] == '.') {
+        return false;
+    }
+    for (char c : name) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '/' && c != '_' &&
+            c != '-' && c != '+') {
+            return false;
+        }
+    }
+    return name.find("/.") == std::string::npos;
+}
+
+unsigned long long TzDatabase::generation() const {
+    ReadGuard guard(*this);
+    return guard.generation();
+}
+
+void TzDatabase::reclaim(const TzSnapshot* old) {
+    waitForReaders(g_reader_epoch.fetch_add(1) + 1);
+    delete old;
+}
+
+void TzDatabase::retireLocked(const TzSnapshot* old) {
+    retired_.emplace_back(old, g_reader_epoch.fetch_add(1) + 1);
+
+    // One pass over the reader slots frees whatever nobody can still see
+    unsigned long long oldest = oldestReaderEpoch();
+    size_t kept = 0;
+    for (const auto& entry : retired_) {
+        if (entry.second <= oldest) {
+            delete entry.first;
+        } else {
+            retired_[kept++] = entry;
+        }
+    }
+    retired_.resize(kept);
+}
+
+TzId TzDatabase::registerZone(const std::string& name, const std::string& file,
+                              std::shared_ptr<const ZoneInfo> zone) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const TzSnapshot* old = current_.load();
+    auto it = old->ids.find(name);
+    if (it != old->ids.end()) {
+        return TzId(it->second);  // Lost a race to register the same name
+    }
+    if (old->zones.size() >= static_cast<size_t>(kMaxZones)) {
+        return TzId();
+    }
+
+    // Copy-on-write: the new snapshot shares every existing zone
+    TzSnapshot* next = new TzSnapshot(*old);
+    next->zones.push_back(std::move(zone));
+    next->generation = old->generation + 1;
+    int id = static_cast<int>(next->zones.size() - 1);
+    next->ids[name] = id;
+    files_.push_back(file);
+    current_.store(next);
+
+    // Never wait here: this runs on request paths, and readers on every
+    // other thread would hold it up
+    retireLocked(old);
+    return TzId(id);
+}
+
+TzId TzDatabase::resolve(const std::string& name) {
+    if (!isSafeZoneName(name)) {
+        return TzId();
+    }
+    {
+        ReadGuard guard(*this);
+        TzId id = guard.find(name);
+        if (id.isValid()) {
+            return id;
+        }
+    }
+
+    // Failed loads are not cached so arbitrary input cannot grow the table
+    std::unique_ptr<ZoneInfo> zone = ZoneInfo::loadTZif(name, dir_ + "/" + name);
+    if (!zone) {
+        return TzId();
+    }
+    return registerZone(name, name, std::move(zone));
+}
+
+TzId TzDatabase::resolveFixed(const std::string& name, int offset_seconds) {
+    {
+        ReadGuard guard(*this);
+        TzId id = guard.find(name);
+        if (id.isValid()) {
+            return id;
+        }
+    }
+    return registerZone(name, "", std::make_shared<const ZoneInfo>(name, offset_seconds));
+}
+
+size_t TzDatabase::reload() {
+    // Ids are never reused, so a copy of the file list stays accurate; zones
+    // registered meanwhile were just loaded and keep their tables
+    std::vector<std::string> files;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        files = files_;
+    }
+
+    // Parse everything without the lock: resolving new names goes on
+    std::vector<std::pair<size_t, std::shared_ptr<const ZoneInfo>>> loaded;
+    for (size_t id = 0; id < files.size(); id++) {
+        if (files[id].empty()) {
+            continue;  // Fixed-offset zone, nothing on disk
+        }
+        std::unique_ptr<ZoneInfo> zone = ZoneInfo::loadTZif(files[id], dir_ + "/" + files[id]);
+        if (zone) {
+            loaded.emplace_back(id, std::move(zone));
+        }
+    }
+
+    const TzSnapshot* old;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        old = current_.load();
+        TzSnapshot* next = new TzSnapshot(*old);
+        next->generation = old->generation + 1;
+        for (auto& entry : loaded) {
+            next->zones[entry.first] = std::move(entry.second);
+        }
+        current_.store(next);
+    }
+    reclaim(old);
+    return loaded.size();
+}
+
+// ---------------------------------------------------------------------------
+// TzReloadThread
+// ---------------------------------------------------------------------------
+
+TzReloadThread::TzReloadThread() : wake_fd_(::eventfd(0, EFD_CLOEXEC)), stopping_(false) {
+    if (wake_fd_ >= 0) {
+        thread_ = std::thread(&TzReloadThread::run, this);
+    }
+}
+
+TzReloadThread::~TzReloadThread() {
+    if (wake_fd_ < 0) {
+        return;
+    }
+    stopping_ = true;
+    request();
+    thread_.join();
+    ::close(wake_fd_);
+}
+
+void TzReloadThread::request() {
+    uint64_t one = 1;
+    ssize_t ignored = ::write(wake_fd_, &one, sizeof(one));
+    (void)ignored;
+}
+
+void TzReloadThread::run() {
+    while (true) {
+        // Reading resets the counter, so any number of requests made
+        // before this point are served by the one reload below
+        uint64_t count;
+        ssize_t n = ::read(wake_fd_, &count, sizeof(count));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 || stopping_) {
+            return;
+        }
+        TzDatabase::instance().reload();
+    }
+}
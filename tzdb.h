@@ -0,0 +1,330 @@
+#ifndef TZDB_H
+#define TZDB_H
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * A span of time [begin_utc, end_utc) during which a zone's offset is constant.
+ */
+struct OffsetInterval {
+    long long begin_utc;
+    long long end_utc;
+    int offset_seconds;
+};
+
+/**
+ * One IANA timezone flattened into a table of UTC offset changes.
+ *
+ * Layout:
+ * - transitions_ holds the UTC instants (seconds since epoch, ascending)
+ *   at which the offset changes.
+ * - offsets_ has one more entry than transitions_: offsets_[0] applies
+ *   before the first transition and offsets_[i + 1] from transitions_[i]
+ *   (inclusive) until the next one.
+ *
+ * So an offset lookup is a single binary search, O(log transitions).
+ * Consecutive entries with the same offset are merged when loading, since
+ * only the offset matters for conversion (not the abbreviation or isdst).
+ */
+class ZoneInfo {
+public:
+    /**
+     * Zone with a single fixed offset and no transitions.
+     */
+    ZoneInfo(const std::string& name, int offset_seconds);
+
+    const std::string& name() const { return name_; }
+
+    /**
+     * Index of the offset interval containing a UTC instant.
+     */
+    size_t intervalIndex(long long utc_seconds) const;
+
+    /**
+     * The constant-offset interval containing a UTC instant, with its bounds,
+     * so callers can reuse it for nearby instants without searching again.
+     */
+    OffsetInterval intervalAt(long long utc_seconds) const;
+
+    /**
+     * UTC offset (seconds east of UTC) in effect at a UTC instant.
+     */
+    int offsetAtUtc(long long utc_seconds) const;
+
+    /**
+     * UTC offset to subtract from a local wall-clock time to get UTC.
+     *
+     * Wall-clock times are not unique around DST changes:
+     * - Ambiguous times (clocks set back) resolve to the earlier instant.
+     * - Skipped times (clocks set forward) use the offset from before the
+     *   change, which moves them forward by the size of the gap, the same
+     *   way most calendar applications do.
+     *
+     * @param local_seconds Local wall-clock time as seconds since 1970-01-01
+     */
+    int offsetForLocal(long long local_seconds) const;
+
+    /**
+     * Load a zone from a TZif file (RFC 8536, versions 1-4).
+     *
+     * The file is mmap'd, parsed once into the transition table, and
+     * unmapped again. The 64-bit data block is used when present. The
+     * POSIX TZ rule in the footer (e.g. "PST8PDT,M3.2.0,M11.1.0") is
+     * expanded into explicit transitions up to kLastExpandedYear, so files
+     * from "slim" tzdata builds work too.
+     *
+     * @param name Zone name, kept for display
+     * @param path File to load
+     * @return Loaded zone, or nullptr if the file is missing or malformed
+     */
+    static std::unique_ptr<ZoneInfo> loadTZif(const std::string& name, const std::string& path);
+
+    // POSIX footer rules are expanded into transitions through this year.
+    static const int kLastExpandedYear = 2100;
+
+private:
+    ZoneInfo() = default;
+
+    std::string name_;
+    std::vector<long long> transitions_;
+    std::vector<int> offsets_;
+
+    /**
+     * Append a transition, skipping it if the offset does not change.
+     */
+    void addTransition(long long utc_seconds, int offset_seconds);
+
+    /**
+     * Expand the TZif footer rule into transitions after the table ends.
+     * Returns false if the rule cannot be parsed (the table is kept as is).
+     */
+    bool extendWithPosixRule(const std::string& rule);
+};
+
+/**
+ * Handle to a zone registered in a TzDatabase.
+ *
+ * Resolve a name once (string compares, possibly a file load), then pass
+ * the handle around: looking a zone up by TzId is a plain table index.
+ * A default-constructed TzId is invalid.
+ */
+struct TzId {
+    int value;
+
+    TzId() : value(-1) {}
+    explicit TzId(int id) : value(id) {}
+
+    bool isValid() const { return value >= 0; }
+    bool operator==(TzId other) const { return value == other.value; }
+    bool operator!=(TzId other) const { return value != other.value; }
+};
+
+/**
+ * Immutable set of zone tables, indexed by TzId.
+ *
+ * TzDatabase never modifies a published snapshot. Registering a zone or
+ * reloading builds a new one (sharing unchanged zones) and swaps it in.
+ */
+struct TzSnapshot {
+    std::vector<std::shared_ptr<const ZoneInfo>> zones;
+
+    // Registered names and the id each one resolved to
+    std::map<std::string, int> ids;
+
+    // Increases with every published snapshot; lets per-thread caches that
+    // remember intervals notice that the tables they came from were replaced.
+    unsigned long long generation;
+};
+
+/**
+ * Registry of IANA timezones loaded from a zoneinfo directory.
+ *
+ * Zones are loaded on first use and kept until the database is destroyed,
+ * so each TZif file is parsed once (until reload). No libc timezone state
+ * (TZ, tzset, localtime) is involved.
+ *
+ * Every zone gets a TzId (its index in the current TzSnapshot). Looking up a
+ * known name or reading zones goes through a ReadGuard and never locks;
+ * only registering a new name takes the writer mutex, and only to copy and
+ * swap the snapshot (zoneinfo files are parsed before it is taken).
+ * Registering never waits for readers: the replaced snapshot is freed by a
+ * later writer once no guard can still see it.
+ *
+ * Hot reload is RCU style: reload() parses the zoneinfo files off to the
+ * side without any lock, publishes the new snapshot with one atomic pointer swap, and frees
+ * the old snapshot only once no reader can still be using it. Readers
+ * never block or retry; in-flight conversions finish on the old tables.
+ */
+class TzDatabase {
+public:
+    /**
+     * @param zoneinfo_dir Directory containing TZif files, e.g. "/usr/share/zoneinfo"
+     */
+    explicit TzDatabase(const std::string& zoneinfo_dir);
+    ~TzDatabase();
+
+    TzDatabase(const TzDatabase&) = delete;
+    TzDatabase& operator=(const TzDatabase&) = delete;
+
+    /**
+     * Process-wide database. Reads $TZDIR if set, else /usr/share/zoneinfo.
+     */
+    static TzDatabase& instance();
+
+    /**
+     * Resolve an IANA name ("Europe/London") to a handle, loading the zone
+     * on first use.
+     *
+     * @param name IANA zone name
+     * @return Handle, or an invalid TzId if the name is unsafe, not
+     *         installed, or the table is full
+     */
+    TzId resolve(const std::string& name);
+
+    /**
+     * Register (or find) a zone with a single fixed offset under a name.
+     * Used for UTC and for fallbacks when zoneinfo is not installed.
+     */
+    TzId resolveFixed(const std::string& name, int offset_seconds);
+
+    /**
+     * Re-read every file-backed zone from the zoneinfo directory and
+     * publish the result atomically. TzIds stay the same. A zone whose
+     * file has become unreadable keeps its previous table.
+     *
+     * Conversions running concurrently are never blocked; the caller waits
+     * (outside any reader path) until the replaced tables can be freed.
+     *
+     * @return Number of zones re-read from disk
+     */
+    size_t reload();
+
+    /**
+     * Generation of the currently published snapshot.
+     */
+    unsigned long long generation() const;
+
+    /**
+     * Read-side critical section. Zone pointers obtained through a guard
+     * stay valid until the guard is destroyed, even if reload() publishes
+     * new tables meanwhile. Cheap (two stores to a per-thread slot), never
+     * blocks, and may be nested.
+     */
+    class ReadGuard {
+    public:
+        explicit ReadGuard(const TzDatabase& db);
+        ~ReadGuard();
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+        /**
+         * Zone for a handle, or nullptr for an invalid handle.
+         */
+        const ZoneInfo* zone(TzId id) const {
+            if (id.value < 0 || static_cast<size_t>(id.value) >= snapshot_->zones.size()) {
+                return nullptr;
+            }
+            return snapshot_->zones[id.value].get();
+        }
+
+        /**
+         * Handle of an already registered name, or an invalid TzId.
+         */
+        TzId find(const std::string& name) const;
+
+        unsigned long long generation() const { return snapshot_->generation; }
+
+    private:
+        const TzSnapshot* snapshot_;
+    };
+
+    // Capacity of the id table (tzdata has about 600 names including links)
+    static const int kMaxZones = 2048;
+
+    const std::string& directory() const { return dir_; }
+
+private:
+    const std::string dir_;
+
+    // Serializes writers (registering a name, reload's swap). Readers and
+    // lookups of known names never take it.
+    std::mutex mutex_;
+
+    // For each id, the name to load on reload; empty for fixed zones
+    std::vector<std::string> files_;
+
+    // Currently published snapshot, owned by the database
+    std::atomic<const TzSnapshot*> current_;
+
+    // Snapshots swapped out by registrations, each with the reader epoch
+    // that must be passed before it can be freed. Guarded by mutex_.
+    std::vector<std::pair<const TzSnapshot*, unsigned long long>> retired_;
+
+    /**
+     * Free a snapshot that has been swapped out, once every reader that
+     * might still use it has left. Called without mutex_, so a slow reader
+     * delays only this writer, not the next one.
+     */
+    static void reclaim(const TzSnapshot* old);
+
+    /**
+     * Queue a swapped-out snapshot for freeing without waiting for its
+     * readers, and free the queued ones no reader can still see. Caller
+     * holds mutex_.
+     */
+    void retireLocked(const TzSnapshot* old);
+
+    /**
+     * Give an already loaded zone the next id, unless another thread
+     * registered the name first (its id is returned then).
+     */
+    TzId registerZone(const std::string& name, const std::string& file,
+                      std::shared_ptr<const ZoneInfo> zone);
+
+    /**
+     * Reject names that could escape the zoneinfo directory.
+     */
+    static bool isSafeZoneName(const std::string& name);
+};
+
+/**
+ * A thread that runs TzDatabase::instance().reload() when asked. reload()
+ * re-parses every loaded zone and then waits for readers of the old
+ * tables, so a server hands it here instead of running it on an event
+ * loop or worker. Requests made while a reload runs are merged into one
+ * more reload.
+ */
+class TzReloadThread {
+public:
+    TzReloadThread();
+
+    /**
+     * Stop the thread, after the reload in progress if any.
+     */
+    ~TzReloadThread();
+
+    TzReloadThread(const TzReloadThread&) = delete;
+    TzReloadThread& operator=(const TzReloadThread&) = delete;
+
+    /**
+     * Ask for a reload and return at once. Async-signal-safe (for SIGHUP).
+     */
+    void request();
+
+private:
+    int wake_fd_;  // Blocking eventfd the thread sleeps on; -1 if it could not be created
+    std::atomic<bool> stopping_;
+    std::thread thread_;
+
+    void run();
+};
+
+#endif // TZDB_H
@@ -0,0 +1,42 @@
+#ifndef VARINT_H
+#define VARINT_H
+
+#include <cstdint>
+#include <string>
+
+/**
+ * LEB128 varints and zigzag encoding, shared by the column files and the
+ * binary wire protocol. Small values take one byte; zigzag maps small
+ * negative deltas to small unsigned values first.
+ */
+
+inline void putVarint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+// Returns false on a truncated or over-long varint
+inline bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t byte = *p++;
+        v |= uint64_t(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline uint64_t zigzag(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+inline int64_t unzigzag(uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+#endif // VARINT_H
@@ -0,0 +1,277 @@
+#include "wal.h"
+#include "crc32c.h"
+#include "file_util.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Record header: payload length + CRC32C of payload
+const size_t kHeaderSize = 8;
+
+// Fixed part of the payload: type, id, start, end, title length
+const size_t kFixedPayloadSize = 1 + 4 + 8 + 8 + 4;
+
+// Upper bound used to reject garbage lengths in a corrupt tail
+const uint32_t kMaxPayloadSize = 1 << 20;
+
+void putU32(std::string& out, uint32_t v) {
+    char b[4] = {char(v), char(v >> 8), char(v >> 16), char(v >> 24)};
+    out.append(b, 4);
+}
+
+void putU64(std::string& out, uint64_t v) {
+    putU32(out, static_cast<uint32_t>(v));
+    putU32(out, static_cast<uint32_t>(v >> 32));
+}
+
+uint32_t getU32(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return uint32_t(u[0]) | uint32_t(u[1]) << 8 | uint32_t(u[2]) << 16 | uint32_t(u[3]) << 24;
+}
+
+uint64_t getU64(const char* p) {
+    return uint64_t(getU32(p)) | uint64_t(getU32(p + 4)) << 32;
+}
+
+void encodeRecord(const WalRecord& record, std::string& out) {
+    uint32_t payload_size = static_cast<uint32_t>(kFixedPayloadSize + record.title.size());
+    size_t header_pos = out.size();
+    putU32(out, payload_size);
+    putU32(out, 0);  // CRC, patched below
+
+    size_t payload_pos = out.size();
+    out.push_back(static_cast<char>(record.type));
+    putU32(out, static_cast<uint32_t>(record.event_id));
+    putU64(out, static_cast<uint64_t>(record.start_utc));
+    putU64(out, static_cast<uint64_t>(record.end_utc));
+    putU32(out, static_cast<uint32_t>(record.title.size()));
+    out.append(record.title);
+
+    uint32_t crc = crc32c(out.data() + payload_pos, payload_size);
+    char b[4] = {char(crc), char(crc >> 8), char(crc >> 16), char(crc >> 24)};
+    out.replace(header_pos + 4, 4, b, 4);
+}
+
+// Decode one record at data[pos]. Returns the record size, or 0 if the
+// bytes there are not an intact record.
+size_t decodeRecord(const std::string& data, size_t pos, WalRecord& out) {
+    if (data.size() - pos < kHeaderSize) {
+        return 0;
+    }
+    uint32_t payload_size = getU32(data.data() + pos);
+    uint32_t crc = getU32(data.data() + pos + 4);
+    if (payload_size < kFixedPayloadSize || payload_size > kMaxPayloadSize ||
+        data.size() - pos - kHeaderSize < payload_size) {
+        return 0;
+    }
+
+    const char* p = data.data() + pos + kHeaderSize;
+    if (crc32c(p, payload_size) != crc) {
+        return 0;
+    }
+
+    uint8_t type = static_cast<uint8_t>(p[0]);
+    uint32_t title_size = getU32(p + 21);
+    if ((type != WalRecord::Create && type != WalRecord::Delete && type != WalRecord::Archive) ||
+        kFixedPayloadSize + title_size != payload_size) {
+        return 0;
+    }
+    out.type = static_cast<WalRecord::Type>(type);
+    out.event_id = static_cast<int>(getU32(p + 1));
+    out.start_utc = static_cast<time_t>(getU64(p + 5));
+    out.end_utc = static_cast<time_t>(getU64(p + 13));
+    out.title.assign(p + kFixedPayloadSize, title_size);
+    return kHeaderSize + payload_size;
+}
+
+}  // namespace
+
+WriteAheadLog::WriteAheadLog()
+    : fd_(-1), appended_lsn_(0), durable_lsn_(0), flushing_(false), failed_(false),
+      stopping_(false) {
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    close();
+}
+
+bool WriteAheadLog::replay(const std::string& path,
+                           const std::function<void(const WalRecord&)>& apply) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == ENOENT;  // No log yet
+    }
+
+    // Read the whole log; records are small and replay is sequential
+    std::string data;
+    char buf[1 << 16];
+    while (true) {
+        ssize_t n = ::read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            ::close(fd);
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        data.append(buf, static_cast<size_t>(n));
+    }
+
+    size_t pos = 0;
+    WalRecord record;
+    while (pos < data.size()) {
+        size_t size = decodeRecord(data, pos, record);
+        if (size == 0) {
+            break;  // Torn or corrupt tail: everything after it is unacknowledged
+        }
+        apply(record);
+        pos += size;
+    }
+
+    bool ok = true;
+    if (pos < data.size()) {
+        ok = ::ftruncate(fd, static_cast<off_t>(pos)) == 0 && ::fdatasync(fd) == 0;
+    }
+    ::close(fd);
+    return ok;
+}
+
+bool WriteAheadLog::open(const std::string& path, const WalOptions& options) {
+    close();
+
+    struct stat st;
+    bool existed = ::stat(path.c_str(), &st) == 0;
+
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        return false;
+    }
+    if (!existed) {
+        FileUtil::syncParentDirectory(path);
+    }
+
+    path_ = path;
+    options_ = options;
+    failed_ = false;
+    stopping_ = false;
+    if (options_.sync_policy == WalSyncPolicy::Interval) {
+        syncer_ = std::thread(&WriteAheadLog::syncerLoop, this);
+    }
+    return true;
+}
+
+void WriteAheadLog::close() {
+    if (syncer_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        stop_cv_.notify_all();
+        syncer_.join();
+    }
+    if (fd_ >= 0) {
+        sync();
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+uint64_t WriteAheadLog::append(const WalRecord& record) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    encodeRecord(record, pending_);
+    uint64_t lsn = ++appended_lsn_;
+
+    // EveryOp: no batching at all. The record is written and synced right
+    // here, so the caller's own lock is held across the fsync.
+    if (options_.sync_policy == WalSyncPolicy::EveryOp) {
+        flushUpTo(lsn, lock);
+    }
+    return lsn;
+}
+
+bool WriteAheadLog::waitDurable(uint64_t lsn) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (options_.sync_policy == WalSyncPolicy::Interval) {
+        return !failed_;  // The syncer makes it durable within interval_ms
+    }
+    return flushUpTo(lsn, lock);
+}
+
+bool WriteAheadLog::sync() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return flushUpTo(appended_lsn_, lock);
+}
+
+bool WriteAheadLog::rotate(const std::string& sealed_path) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // fd_ may only be swapped with nothing pending and no leader writing.
+    // While we wait, a waiter with a later record can become leader, so
+    // repeat until none is.
+    do {
+        if (!flushUpTo(appended_lsn_, lock)) {
+            return false;
+        }
+    } while (flushing_);
+
+    if (std::rename(path_.c_str(), sealed_path.c_str()) != 0) {
+        return false;
+    }
+    int fd = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        // Records appended from now on would have nowhere to go
+        failed_ = true;
+        return false;
+    }
+    ::close(fd_);
+    fd_ = fd;
+    FileUtil::syncParentDirectory(path_);
+    return true;
+}
+
+bool WriteAheadLog::flushUpTo(uint64_t lsn, std::unique_lock<std::mutex>& lock) {
+    while (durable_lsn_ < lsn && !failed_) {
+        if (flushing_) {
+            // Another thread is leading a flush; the next one will include us
+            flushed_cv_.wait(lock);
+            continue;
+        }
+
+        // Become the leader: take everything appended so far as one batch
+        flushing_ = true;
+        std::string batch;
+        batch.swap(pending_);
+        uint64_t batch_lsn = appended_lsn_;
+        lock.unlock();
+
+        bool ok = FileUtil::writeAll(fd_, batch.data(), batch.size()) && ::fdatasync(fd_) == 0;
+
+        lock.lock();
+        flushing_ = false;
+        if (ok) {
+            durable_lsn_ = batch_lsn;
+        } else {
+            failed_ = true;
+        }
+        flushed_cv_.notify_all();
+    }
+    return !failed_;
+}
+
+void WriteAheadLog::syncerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        stop_cv_.wait_for(lock, std::chrono::milliseconds(options_.interval_ms));
+        if (durable_lsn_ < appended_lsn_) {
+            flushUpTo(appended_lsn_, lock);
+        }
+    }
+}
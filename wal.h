@@ -0,0 +1,159 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * When the write-ahead log forces appended records to stable storage.
+ */
+enum class WalSyncPolicy {
+    EveryOp,   // write + fsync each record on its own before acknowledging
+    Batched,   // group commit: concurrent mutations share one write + fsync
+    Interval   // acknowledge immediately; a background thread syncs every interval_ms
+};
+
+struct WalOptions {
+    WalSyncPolicy sync_policy;
+    int interval_ms;  // Only used by WalSyncPolicy::Interval
+
+    WalOptions() : sync_policy(WalSyncPolicy::Batched), interval_ms(100) {}
+};
+
+/**
+ * One logged mutation. Deletes carry the start time too, so replay can
+ * find the event in the sorted set in O(log n) instead of scanning by ID.
+ * Archive records move every event ending at or before start_utc out of
+ * the live set (they were written to an archive segment first).
+ */
+struct WalRecord {
+    enum Type : uint8_t {
+        Create = 1,
+        Delete = 2,
+        Archive = 3
+    };
+
+    Type type;
+    int event_id;
+    time_t start_utc;    // Archive: the cutoff
+    time_t end_utc;      // Create only
+    std::string title;   // Create only
+};
+
+/**
+ * Append-only log of calendar mutations.
+ *
+ * On-disk record: [u32 payload length][u32 CRC32C of payload][payload],
+ * little-endian. Payload: u8 type, i32 id, i64 start, i64 end,
+ * u32 title length, title bytes. A torn or corrupt tail (crash during a
+ * write) fails the length/CRC check; replay stops there and truncates it.
+ *
+ * Appending and waiting are separate steps so that the caller can append
+ * while holding its own lock (fixing the log order to match the order
+ * mutations were applied) and wait for durability after releasing it.
+ * With WalSyncPolicy::Batched, whichever waiter finds no flush in progress
+ * becomes the leader and writes + fsyncs everything appended so far;
+ * waiters that arrive meanwhile are covered by the next flush. Throughput
+ * then scales with concurrency instead of being capped at 1 / fsync latency.
+ */
+class WriteAheadLog {
+public:
+    WriteAheadLog();
+    ~WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    /**
+     * Read every intact record of an existing log, in order.
+     * A missing file is an empty log. A corrupt or torn tail is cut off.
+     *
+     * @param path Log file
+     * @param apply Called once per record
+     * @return false on an I/O error
+     */
+    static bool replay(const std::string& path, const std::function<void(const WalRecord&)>& apply);
+
+    /**
+     * Open (creating if needed) a log for appending.
+     *
+     * @return false on an I/O error
+     */
+    bool open(const std::string& path, const WalOptions& options);
+
+    /**
+     * Flush anything pending, stop the background syncer and close the file.
+     */
+    void close();
+
+    bool isOpen() const { return fd_ >= 0; }
+
+    /**
+     * Queue a record. Cheap: encodes into an in-memory buffer.
+     *
+     * @return Log sequence number to pass to waitDurable
+     */
+    uint64_t append(const WalRecord& record);
+
+    /**
+     * Block until the record with this sequence number is durable
+     * according to the sync policy (returns at once for Interval).
+     *
+     * @return false if the log hit an I/O error; the log stays failed
+     */
+    bool waitDurable(uint64_t lsn);
+
+    /**
+     * Write and fsync everything appended so far, regardless of policy.
+     *
+     * @return false if the log hit an I/O error
+     */
+    bool sync();
+
+    /**
+     * Seal the current log and continue in a fresh one: flush everything
+     * appended so far, rename the file to sealed_path and reopen an empty
+     * log under the original name. Records appended afterwards go to the
+     * new file, so sealed_path holds exactly a prefix of the history.
+     *
+     * Appends wait for the flush and rename, nothing longer.
+     *
+     * @return false if the log hit an I/O error
+     */
+    bool rotate(const std::string& sealed_path);
+
+private:
+    int fd_;
+    std::string path_;
+    WalOptions options_;
+
+    std::mutex mutex_;
+    std::condition_variable flushed_cv_;
+
+    std::string pending_;       // Encoded records not yet written
+    uint64_t appended_lsn_;     // Last sequence number handed out
+    uint64_t durable_lsn_;      // Last sequence number written and synced
+    bool flushing_;             // A leader is writing outside the lock
+    bool failed_;               // Sticky I/O error
+
+    // Interval policy
+    std::thread syncer_;
+    std::condition_variable stop_cv_;
+    bool stopping_;
+
+    /**
+     * Write + fsync pending records until durable_lsn_ >= lsn, acting as
+     * group-commit leader when no other flush is running.
+     * Caller holds lock on mutex_.
+     */
+    bool flushUpTo(uint64_t lsn, std::unique_lock<std::mutex>& lock);
+
+    void syncerLoop();
+};
+
+#endif // WAL_H